@@ -0,0 +1,1051 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+
+#include "bit_matrix.h"
+#include "checkpoint.h"
+#include "compare.h"
+#include "complex_gemm.h"
+#include "conv.h"
+#include "distributed.h"
+#include "eigs.h"
+#include "epilogue.h"
+#include "half.h"
+#include "kron.h"
+#include "linalg.h"
+#include "maintained.h"
+#include "matfun.h"
+#include "matrix.h"
+#include "memo.h"
+#include "modular.h"
+#include "quantize.h"
+#include "semiring.h"
+#include "summa.h"
+#include "tiled.h"
+
+/**
+ * @brief Times a function, returning the best of a few runs in seconds
+ *
+ * @param f The function to time
+ * @param runs The number of times to run it
+ * @return double The fastest run time in seconds
+ */
+static double time_best(const std::function<void()> &f, int runs = 3)
+{
+    double best = 1e300;
+    for (int r = 0; r < runs; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+/**
+ * @brief Fills a matrix with uniformly distributed random values
+ */
+template <class T>
+static codesample::matrix<T> random_matrix(size_t rows, size_t cols, std::mt19937 &rng, double lo = -1, double hi = 1)
+{
+    std::uniform_real_distribution<double> dist(lo, hi);
+    codesample::matrix<T> m(rows, cols);
+    for (size_t i = 0; i < rows; i++)
+    {
+        for (size_t j = 0; j < cols; j++)
+        {
+            m[i][j] = static_cast<T>(dist(rng));
+        }
+    }
+    return m;
+}
+
+/**
+ * @brief Converts a matrix to another element type
+ */
+template <class To, class From>
+static codesample::matrix<To> convert(const codesample::matrix<From> &m)
+{
+    codesample::matrix<To> result(m.rows(), m.cols());
+    for (size_t i = 0; i < m.rows(); i++)
+    {
+        for (size_t j = 0; j < m.cols(); j++)
+        {
+            result[i][j] = static_cast<To>(m[i][j]);
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Largest error of a result relative to a long double reference,
+ * scaled by the magnitude of the reference entry
+ */
+template <class T>
+static double max_relative_error(const codesample::matrix<T> &m, const codesample::matrix<long double> &ref)
+{
+    double worst = 0;
+    for (size_t i = 0; i < m.rows(); i++)
+    {
+        for (size_t j = 0; j < m.cols(); j++)
+        {
+            long double err = std::fabs(static_cast<long double>(m[i][j]) - ref[i][j]);
+            long double scale = std::max(std::fabs(ref[i][j]), 1.0L);
+            worst = std::max(worst, static_cast<double>(err / scale));
+        }
+    }
+    return worst;
+}
+
+/**
+ * @brief Accuracy and throughput of float storage with float, double and
+ * compensated accumulation against the pure double path
+ */
+static void bench_mixed_precision(std::mt19937 &rng)
+{
+    std::printf("mixed precision multiply (m x k * k x n, values in [0, 1))\n");
+    std::printf("%6s %6s %6s  %-16s %12s %10s\n", "m", "k", "n", "variant", "max rel err", "GFLOP/s");
+
+    const size_t shapes[][3] = {{64, 256, 64}, {32, 4096, 32}, {8, 65536, 8}};
+    for (auto &shape : shapes)
+    {
+        size_t m = shape[0], k = shape[1], n = shape[2];
+
+        // positive values so that the sums grow with k and rounding accumulates
+        auto a_f = random_matrix<float>(m, k, rng, 0, 1);
+        auto b_f = random_matrix<float>(k, n, rng, 0, 1);
+        auto a_d = convert<double>(a_f);
+        auto b_d = convert<double>(b_f);
+        auto a_l = convert<long double>(a_f);
+        auto b_l = convert<long double>(b_f);
+        auto ref = codesample::matrix<long double>::multiply(a_l, b_l);
+
+        double flops = 2.0 * m * n * k;
+        codesample::matrix<float> c_f;
+        codesample::matrix<double> c_d;
+
+        double t = time_best([&]() { c_f = codesample::matrix<float>::multiply(a_f, b_f); });
+        std::printf("%6zu %6zu %6zu  %-16s %12.3e %10.3f\n", m, k, n, "float", max_relative_error(c_f, ref), flops / t * 1e-9);
+
+        t = time_best([&]() { c_f = codesample::matrix<float>::multiply_mixed<double>(a_f, b_f); });
+        std::printf("%6zu %6zu %6zu  %-16s %12.3e %10.3f\n", m, k, n, "float/double acc", max_relative_error(c_f, ref), flops / t * 1e-9);
+
+        t = time_best([&]() { c_f = codesample::matrix<float>::multiply_compensated(a_f, b_f); });
+        std::printf("%6zu %6zu %6zu  %-16s %12.3e %10.3f\n", m, k, n, "float/dot2", max_relative_error(c_f, ref), flops / t * 1e-9);
+
+        t = time_best([&]() { c_d = codesample::matrix<double>::multiply(a_d, b_d); });
+        std::printf("%6zu %6zu %6zu  %-16s %12.3e %10.3f\n", m, k, n, "double", max_relative_error(c_d, ref), flops / t * 1e-9);
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Throughput of the widening 16-bit multiplies against float storage
+ */
+static void bench_half(std::mt19937 &rng)
+{
+    std::printf("16-bit multiply (n x n * n x n, float accumulation)\n");
+    std::printf("%6s  %-16s %12s %10s\n", "n", "variant", "max rel err", "GFLOP/s");
+
+    const size_t sizes[] = {64, 256};
+    for (size_t n : sizes)
+    {
+        auto a_f = random_matrix<float>(n, n, rng);
+        auto b_f = random_matrix<float>(n, n, rng);
+        auto a_h = codesample::narrow<codesample::fp16>(a_f);
+        auto b_h = codesample::narrow<codesample::fp16>(b_f);
+        auto a_b = codesample::narrow<codesample::bf16>(a_f);
+        auto b_b = codesample::narrow<codesample::bf16>(b_f);
+        auto a_l = convert<long double>(a_f);
+        auto b_l = convert<long double>(b_f);
+        auto ref = codesample::matrix<long double>::multiply(a_l, b_l);
+
+        double flops = 2.0 * n * n * n;
+        codesample::matrix<float> c;
+
+        double t = time_best([&]() { c = codesample::matrix<float>::multiply(a_f, b_f); });
+        std::printf("%6zu  %-16s %12.3e %10.3f\n", n, "float", max_relative_error(c, ref), flops / t * 1e-9);
+
+        t = time_best([&]() { c = codesample::multiply_widened(a_h, b_h); });
+        std::printf("%6zu  %-16s %12.3e %10.3f\n", n, "fp16", max_relative_error(c, ref), flops / t * 1e-9);
+
+        t = time_best([&]() { c = codesample::multiply_widened(a_b, b_b); });
+        std::printf("%6zu  %-16s %12.3e %10.3f\n", n, "bf16", max_relative_error(c, ref), flops / t * 1e-9);
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Throughput of the int8 multiply (raw and requantized) against the
+ * float paths on the same shapes
+ */
+static void bench_quantized(std::mt19937 &rng)
+{
+    std::printf("int8 multiply (n x n * n x n)\n");
+    std::printf("%6s  %-16s %10s\n", "n", "variant", "GOP/s");
+
+    const size_t sizes[] = {64, 256, 512};
+    for (size_t n : sizes)
+    {
+        auto a_f = random_matrix<float>(n, n, rng);
+        auto b_f = random_matrix<float>(n, n, rng);
+        auto qa = codesample::choose_quant_params(a_f, codesample::quant_axis::row);
+        auto qb = codesample::choose_quant_params(b_f, codesample::quant_axis::column);
+        auto qc = codesample::quant_params(n / 64.0f, 0);
+        auto a_q = codesample::quantize(a_f, qa);
+        auto b_q = codesample::quantize(b_f, qb);
+
+        double ops = 2.0 * n * n * n;
+        codesample::matrix<float> c_f;
+        codesample::matrix<int32_t> c_32;
+        codesample::matrix<int8_t> c_8;
+
+        double t = time_best([&]() { c_f = codesample::matrix<float>::multiply_mixed<float>(a_f, b_f); });
+        std::printf("%6zu  %-16s %10.3f\n", n, "float", ops / t * 1e-9);
+
+        t = time_best([&]() { c_32 = codesample::multiply_s8(a_q, b_q); });
+        std::printf("%6zu  %-16s %10.3f\n", n, "int8 -> int32", ops / t * 1e-9);
+
+        t = time_best([&]() { c_8 = codesample::multiply_quantized(a_q, qa, b_q, qb, qc); });
+        std::printf("%6zu  %-16s %10.3f\n", n, "int8 requantized", ops / t * 1e-9);
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Throughput of the split storage complex multiplies against the
+ * generic interleaved path
+ */
+static void bench_complex(std::mt19937 &rng)
+{
+    typedef std::complex<double> cd;
+    std::printf("complex<double> multiply (n x n * n x n)\n");
+    std::printf("%6s  %-16s %12s %10s\n", "n", "variant", "max abs err", "GFLOP/s");
+
+    const size_t sizes[] = {64, 256};
+    for (size_t n : sizes)
+    {
+        auto a_re = random_matrix<double>(n, n, rng);
+        auto a_im = random_matrix<double>(n, n, rng);
+        auto b_re = random_matrix<double>(n, n, rng);
+        auto b_im = random_matrix<double>(n, n, rng);
+        codesample::matrix<cd> a(n, n), b(n, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                a[i][j] = cd(a_re[i][j], a_im[i][j]);
+                b[i][j] = cd(b_re[i][j], b_im[i][j]);
+            }
+        }
+
+        // 8 real flops per complex multiply-add
+        double flops = 8.0 * n * n * n;
+        codesample::matrix<cd> ref, c;
+
+        double t = time_best([&]() { ref = codesample::matrix<cd>::multiply_mixed<cd>(a, b); });
+        std::printf("%6zu  %-16s %12.3e %10.3f\n", n, "interleaved", 0.0, flops / t * 1e-9);
+
+        const codesample::complex_algorithm algorithms[] = {codesample::complex_algorithm::conventional,
+                                                            codesample::complex_algorithm::three_m};
+        const char *names[] = {"split 4M", "split 3M"};
+        for (int v = 0; v < 2; v++)
+        {
+            t = time_best([&]() { c = codesample::multiply_complex(a, b, algorithms[v]); });
+            double err = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    err = std::max(err, std::abs(c[i][j] - ref[i][j]));
+                }
+            }
+            std::printf("%6zu  %-16s %12.3e %10.3f\n", n, names[v], err, flops / t * 1e-9);
+        }
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Boolean products of random sparse 0/1 matrices: packed bits
+ * against a matrix<int> product
+ */
+static void bench_bit_matrix(std::mt19937 &rng)
+{
+    std::printf("boolean multiply (n x n * n x n, 5%% density)\n");
+    std::printf("%6s  %-16s %10s\n", "n", "variant", "ms");
+
+    const size_t sizes[] = {256, 1024};
+    for (size_t n : sizes)
+    {
+        std::bernoulli_distribution bit(0.05);
+        codesample::matrix<int> a(n, n), b(n, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                a[i][j] = bit(rng);
+                b[i][j] = bit(rng);
+            }
+        }
+        codesample::bit_matrix a_bits(a), b_bits(b);
+        codesample::bit_matrix c_bits;
+        codesample::matrix<int> c;
+        codesample::matrix<uint32_t> counts;
+
+        if (n <= 256)
+        {
+            double t = time_best([&]() { c = codesample::matrix<int>::multiply_mixed<int>(a, b); }, 1);
+            std::printf("%6zu  %-16s %10.3f\n", n, "matrix<int>", t * 1e3);
+        }
+
+        double t = time_best([&]() { c_bits = a_bits * b_bits; });
+        std::printf("%6zu  %-16s %10.3f\n", n, "four russians", t * 1e3);
+
+        t = time_best([&]() { counts = codesample::bit_matrix::multiply_count(a_bits, b_bits); });
+        std::printf("%6zu  %-16s %10.3f\n", n, "popcount", t * 1e3);
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief All pairs shortest paths by (min, +) squaring against a
+ * hand-written Floyd-Warshall loop
+ */
+static void bench_shortest_paths(std::mt19937 &rng)
+{
+    std::printf("all pairs shortest paths (n vertices, 10%% of edges present)\n");
+    std::printf("%6s  %-16s %10s\n", "n", "variant", "ms");
+
+    const size_t sizes[] = {128, 512};
+    for (size_t n : sizes)
+    {
+        std::bernoulli_distribution edge(0.1);
+        std::uniform_int_distribution<int> weight(1, 10);
+        const double inf = codesample::min_plus<double>::zero();
+        codesample::matrix<double> w(n, n, inf);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                if (edge(rng))
+                {
+                    w[i][j] = weight(rng);
+                }
+            }
+        }
+
+        codesample::matrix<double> d1, d2;
+        double t = time_best([&]() {
+            d1 = w;
+            for (size_t i = 0; i < n; i++)
+            {
+                d1[i][i] = 0;
+            }
+            for (size_t p = 0; p < n; p++)
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    for (size_t j = 0; j < n; j++)
+                    {
+                        d1[i][j] = std::min(d1[i][j], d1[i][p] + d1[p][j]);
+                    }
+                }
+            }
+        }, 1);
+        std::printf("%6zu  %-16s %10.3f\n", n, "floyd-warshall", t * 1e3);
+
+        t = time_best([&]() { d2 = codesample::shortest_paths(w); }, 1);
+        std::printf("%6zu  %-16s %10.3f%s\n", n, "min-plus squaring", t * 1e3, d1 == d2 ? "" : "  MISMATCH");
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Modular multiply with each reduction strategy against reducing
+ * every product with a division
+ */
+static void bench_modular(std::mt19937 &rng)
+{
+    std::printf("modular multiply (n x n)\n");
+    std::printf("%6s  %-24s %10s %10s\n", "n", "modulus", "naive ms", "ms");
+
+    const uint64_t moduli[] = {998244353, (1ULL << 61) - 1, 1ULL << 62};
+    const char *names[] = {"998244353 (lazy)", "2^61 - 1 (montgomery)", "2^62 (division)"};
+    const size_t n = 256;
+    std::uniform_int_distribution<uint64_t> value;
+    codesample::matrix<uint64_t> a(n, n), b(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            a[i][j] = value(rng);
+            b[i][j] = value(rng);
+        }
+    }
+
+    for (size_t m = 0; m < 3; m++)
+    {
+        const uint64_t p = moduli[m];
+        codesample::matrix<uint64_t> c1(n, n), c2;
+        double naive = time_best([&]() {
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    uint64_t sum = 0;
+                    for (size_t k = 0; k < n; k++)
+                    {
+                        uint64_t product = codesample::detail::mulmod(a[i][k] % p, b[k][j] % p, p);
+                        sum = codesample::detail::addmod(sum, product, p);
+                    }
+                    c1[i][j] = sum;
+                }
+            }
+        }, 1);
+        double t = time_best([&]() { c2 = codesample::modular_multiply(a, b, p); });
+        std::printf("%6zu  %-24s %10.3f %10.3f%s\n", n, names[m], naive * 1e3, t * 1e3, c1 == c2 ? "" : "  MISMATCH");
+    }
+
+    codesample::matrix<int64_t> x(n, n), y(n, n);
+    std::uniform_int_distribution<int64_t> big(-(1LL << 40), 1LL << 40);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            x[i][j] = big(rng);
+            y[i][j] = big(rng);
+        }
+    }
+    double t = time_best([&]() { codesample::exact_multiply(x, y); });
+    std::printf("%6zu  %-24s %10s %10.3f\n", n, "exact (2 primes)", "", t * 1e3);
+    std::printf("\n");
+}
+
+/**
+ * @brief Kronecker matvec through the operator against forming the
+ * product and multiplying by it
+ */
+static void bench_kron(std::mt19937 &rng)
+{
+    std::printf("Kronecker matvec (two n x n factors)\n");
+    std::printf("%6s  %12s %12s %12s\n", "n", "form ms", "dense ms", "lazy ms");
+
+    const size_t sizes[] = {32, 64, 512};
+    for (size_t n : sizes)
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        codesample::matrix<double> b = random_matrix<double>(n, n, rng);
+        std::vector<double> x(n * n);
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            x[i] = std::uniform_real_distribution<double>(-1, 1)(rng);
+        }
+
+        codesample::kronecker_operator<double> op(a, b);
+        std::vector<double> y_lazy;
+        double lazy = time_best([&]() { y_lazy = op.apply(x); });
+
+        if (n > 64)
+        {
+            // the dense product would need n^4 doubles
+            std::printf("%6zu  %12s %12s %12.3f\n", n, "-", "-", lazy * 1e3);
+            continue;
+        }
+
+        codesample::matrix<double> dense;
+        double form = time_best([&]() { dense = codesample::kron(a, b); }, 1);
+        std::vector<double> y_dense(n * n);
+        double matvec = time_best([&]() {
+            for (size_t i = 0; i < dense.rows(); i++)
+            {
+                y_dense[i] = codesample::dot(dense[i], x);
+            }
+        });
+
+        double err = 0;
+        for (size_t i = 0; i < y_dense.size(); i++)
+        {
+            err = std::max(err, std::fabs(y_dense[i] - y_lazy[i]));
+        }
+        std::printf("%6zu  %12.3f %12.3f %12.3f%s\n", n, form * 1e3, matvec * 1e3, lazy * 1e3,
+                    err < 1e-9 * n * n ? "" : "  MISMATCH");
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief 3x3 convolution: explicit im2col and multiply, implicit GEMM and
+ * Winograd
+ */
+static void bench_conv(std::mt19937 &rng)
+{
+    std::printf("3x3 convolution, padding 1 (channels in = out, size x size)\n");
+    std::printf("%8s %6s  %-14s %10s %10s\n", "channels", "size", "variant", "ms", "max err");
+
+    const size_t shapes[][2] = {{16, 64}, {64, 28}};
+    for (const size_t *shape : shapes)
+    {
+        const size_t channels = shape[0], size = shape[1];
+        std::vector<codesample::matrix<float>> input;
+        for (size_t c = 0; c < channels; c++)
+        {
+            input.push_back(random_matrix<float>(size, size, rng));
+        }
+        codesample::matrix<float> weights = random_matrix<float>(channels, channels * 9, rng);
+        codesample::conv_params params(3, 3, 1, 1);
+
+        codesample::matrix<float> patches(channels * 9, size * size), explicit_out;
+        double t = time_best([&]() {
+            for (size_t c = 0; c < channels; c++)
+            {
+                for (size_t k = 0; k < 9; k++)
+                {
+                    for (size_t y = 0; y < size; y++)
+                    {
+                        for (size_t x = 0; x < size; x++)
+                        {
+                            long iy = static_cast<long>(y + k / 3) - 1, ix = static_cast<long>(x + k % 3) - 1;
+                            bool inside = iy >= 0 && ix >= 0 && iy < static_cast<long>(size) &&
+                                          ix < static_cast<long>(size);
+                            patches[c * 9 + k][y * size + x] = inside ? input[c][iy][ix] : 0.0f;
+                        }
+                    }
+                }
+            }
+            explicit_out = weights * patches;
+        });
+        std::printf("%8zu %6zu  %-14s %10.3f %10s\n", channels, size, "im2col", t * 1e3, "-");
+
+        const codesample::conv_algorithm algorithms[] = {codesample::conv_algorithm::implicit_gemm,
+                                                         codesample::conv_algorithm::winograd};
+        const char *names[] = {"implicit gemm", "winograd"};
+        for (size_t a = 0; a < 2; a++)
+        {
+            std::vector<codesample::matrix<float>> out;
+            t = time_best([&]() { out = codesample::convolve(input, weights, params, algorithms[a]); });
+            double err = 0;
+            for (size_t f = 0; f < channels; f++)
+            {
+                for (size_t p = 0; p < size * size; p++)
+                {
+                    err = std::max(err, static_cast<double>(std::fabs(out[f][p / size][p % size] - explicit_out[f][p])));
+                }
+            }
+            std::printf("%8zu %6zu  %-14s %10.3f %10.2e\n", channels, size, names[a], t * 1e3, err);
+        }
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Bias and GELU after a multiply, as a second pass and fused
+ */
+static void bench_epilogue(std::mt19937 &rng)
+{
+    std::printf("multiply + bias + gelu (n x n float)\n");
+    std::printf("%6s  %12s %12s\n", "n", "2 pass ms", "fused ms");
+
+    const size_t sizes[] = {128, 512};
+    for (size_t n : sizes)
+    {
+        codesample::matrix<float> a = random_matrix<float>(n, n, rng);
+        codesample::matrix<float> b = random_matrix<float>(n, n, rng);
+        std::vector<float> bias(n);
+        for (float &v : bias)
+        {
+            v = std::uniform_real_distribution<float>(-1, 1)(rng);
+        }
+
+        codesample::matrix<float> c1, c2;
+        double separate = time_best([&]() {
+            c1 = a * b;
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    float v = c1[i][j] + bias[j];
+                    c1[i][j] = 0.5f * v * (1.0f + std::erf(v * 0.70710678f));
+                }
+            }
+        });
+        double fused = time_best([&]() {
+            c2 = codesample::matrix<float>::multiply(a, b, codesample::chain(codesample::bias(bias), codesample::gelu()));
+        });
+        std::printf("%6zu  %12.3f %12.3f%s\n", n, separate * 1e3, fused * 1e3,
+                    max_relative_error(c2, convert<long double>(c1)) < 1e-5 ? "" : "  MISMATCH");
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Products of row and column major refs, with no conversion
+ */
+static void bench_layout(std::mt19937 &rng)
+{
+    std::printf("multiply by layout of A and B (n x n double refs, column major output)\n");
+    std::printf("%6s  %-8s %-8s %10s\n", "n", "A", "B", "ms");
+
+    const size_t n = 512;
+    codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+    codesample::matrix<double> b = random_matrix<double>(n, n, rng);
+    std::vector<double> a_rows(n * n), a_cols(n * n), b_rows(n * n), b_cols(n * n), c_cols(n * n);
+    codesample::matrix_ref<double> ar(a_rows.data(), n, n), br(b_rows.data(), n, n);
+    codesample::matrix_ref<double, codesample::column_major> ac(a_cols.data(), n, n), bc(b_cols.data(), n, n);
+    codesample::matrix_ref<double, codesample::column_major> c(c_cols.data(), n, n);
+    ar.assign(a);
+    ac.assign(a);
+    br.assign(b);
+    bc.assign(b);
+
+    double t = time_best([&]() { codesample::multiply_into(ar, br, c); });
+    std::printf("%6zu  %-8s %-8s %10.3f\n", n, "row", "row", t * 1e3);
+    t = time_best([&]() { codesample::multiply_into(ac, br, c); });
+    std::printf("%6zu  %-8s %-8s %10.3f\n", n, "column", "row", t * 1e3);
+    t = time_best([&]() { codesample::multiply_into(ar, bc, c); });
+    std::printf("%6zu  %-8s %-8s %10.3f\n", n, "row", "column", t * 1e3);
+    t = time_best([&]() { codesample::multiply_into(ac, bc, c); });
+    std::printf("%6zu  %-8s %-8s %10.3f\n", n, "column", "column", t * 1e3);
+    std::printf("\n");
+}
+
+/**
+ * @brief Tiled storage: conversion, multiply and transpose against the
+ * row major matrix
+ */
+static void bench_tiled(std::mt19937 &rng)
+{
+    std::printf("tiled storage (n x n double, 64 x 64 tiles)\n");
+    std::printf("%6s  %-12s %12s %12s %12s\n", "n", "layout", "convert ms", "multiply ms", "transpose ms");
+
+    const size_t n = 1024;
+    codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+    codesample::matrix<double> b = random_matrix<double>(n, n, rng);
+    codesample::matrix<double> c;
+    double mul = time_best([&]() { c = a * b; }, 1);
+    double tr = time_best([&]() { codesample::matrix<double>(a).transpose(); }, 1);
+    std::printf("%6zu  %-12s %12s %12.3f %12.3f\n", n, "row major", "-", mul * 1e3, tr * 1e3);
+
+    const codesample::tile_order orders[] = {codesample::tile_order::row_major, codesample::tile_order::morton};
+    const char *names[] = {"tile rows", "morton"};
+    for (size_t o = 0; o < 2; o++)
+    {
+        codesample::tiled_matrix<double> ta, tb, tc;
+        double to_tiles = time_best([&]() {
+            ta = codesample::tiled_matrix<double>(a, orders[o]);
+            tb = codesample::tiled_matrix<double>(b, orders[o]);
+        });
+        mul = time_best([&]() { tc = ta * tb; }, 1);
+        tr = time_best([&]() { ta.transpose(); });
+        std::printf("%6zu  %-12s %12.3f %12.3f %12.3f%s\n", n, names[o], to_tiles * 1e3 / 2, mul * 1e3, tr * 1e3,
+                    max_relative_error(tc.to_matrix(), convert<long double>(c)) < 1e-9 ? "" : "  MISMATCH");
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Small and skinny shapes through the blocked kernel alone and
+ * through the shape dispatch in detail::gemm(), which picks the kernels
+ * for detail::gemm_tiny_size and detail::gemm_skinny_k
+ */
+static void bench_small_shapes(std::mt19937 &rng)
+{
+    std::printf("small and skinny shapes (double, us per product)\n");
+    std::printf("%6s %6s %6s %12s %12s\n", "m", "n", "k", "blocked", "dispatched");
+
+    const size_t shapes[][3] = {{1, 3, 3}, {3, 1, 3}, {3, 3, 3}, {4, 4, 4}, {5, 5, 5}, {8, 8, 8},
+                                {1024, 1, 1024}, {1, 1024, 1024}, {1024, 1024, 1}, {256, 256, 8},
+                                {1024, 1024, 16}, {1024, 1024, 32}};
+    for (const auto &shape : shapes)
+    {
+        const size_t m = shape[0], n = shape[1], k = shape[2];
+        codesample::matrix<double> a = random_matrix<double>(m, k, rng);
+        codesample::matrix<double> b = random_matrix<double>(k, n, rng);
+        codesample::matrix<double> c(m, n);
+        codesample::detail::row_writer<double> out(c);
+        const size_t reps = std::max<size_t>(1, 10000000 / (m * n * k + 1000));
+        double blocked = time_best([&]() {
+            for (size_t r = 0; r < reps; r++)
+            {
+                codesample::detail::gemm_blocked<codesample::plus_times<double>>(a, b, out);
+            }
+        });
+        double dispatched = time_best([&]() {
+            for (size_t r = 0; r < reps; r++)
+            {
+                codesample::detail::gemm<codesample::plus_times<double>>(a, b, out);
+            }
+        });
+        std::printf("%6zu %6zu %6zu %12.3f %12.3f\n", m, n, k, blocked * 1e6 / reps, dispatched * 1e6 / reps);
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Blocked LU against row by row Gaussian elimination, and the cost
+ * of an inverse and of a condition estimate
+ */
+static void bench_linalg(std::mt19937 &rng)
+{
+    std::printf("LU factorization (n x n double)\n");
+    std::printf("%6s %14s %12s %12s %12s %14s\n", "n", "elimination ms", "LU ms", "inverse ms", "cond est ms",
+                "est / exact");
+
+    for (size_t n : {256, 1024})
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+
+        // elimination with partial pivoting on the rows of a matrix<T>
+        double eliminate = time_best([&]() {
+            codesample::matrix<double> m = a;
+            for (size_t c = 0; c < n; c++)
+            {
+                size_t pivot = c;
+                for (size_t r = c + 1; r < n; r++)
+                {
+                    if (std::fabs(m[r][c]) > std::fabs(m[pivot][c]))
+                    {
+                        pivot = r;
+                    }
+                }
+                std::swap(m[c], m[pivot]);
+                for (size_t r = c + 1; r < n; r++)
+                {
+                    const double l = m[r][c] /= m[c][c];
+                    for (size_t j = c + 1; j < n; j++)
+                    {
+                        m[r][j] -= l * m[c][j];
+                    }
+                }
+            }
+        }, 1);
+
+        double factor = time_best([&]() { codesample::lu_decomposition<double> lu(a); }, 1);
+        const codesample::lu_decomposition<double> lu(a);
+        codesample::matrix<double> a_inv;
+        double invert = time_best([&]() { a_inv = lu.inverse(); }, 1);
+        double estimate = 0;
+        double cond = time_best([&]() { estimate = lu.condition_estimate(); });
+
+        double norm = 0, inv_norm = 0;
+        for (size_t j = 0; j < n; j++)
+        {
+            double col = 0, inv_col = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                col += std::fabs(a[i][j]);
+                inv_col += std::fabs(a_inv[i][j]);
+            }
+            norm = std::max(norm, col);
+            inv_norm = std::max(inv_norm, inv_col);
+        }
+        std::printf("%6zu %14.3f %12.3f %12.3f %12.3f %14.3f\n", n, eliminate * 1e3, factor * 1e3, invert * 1e3,
+                    cond * 1e3, estimate / (norm * inv_norm));
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief Matrix functions: expm of a Markov generator, a large power by
+ * repeated squaring against repeated multiplication, and an SPD square root
+ */
+static void bench_matfun(std::mt19937 &rng)
+{
+    std::printf("matrix functions (n x n double)\n");
+    std::printf("%6s %10s %16s %14s %12s\n", "n", "expm ms", "pow 64 naive ms", "pow 64 ms", "sqrtm ms");
+
+    for (size_t n : {128, 256})
+    {
+        codesample::matrix<double> q = random_matrix<double>(n, n, rng, 0, 1);
+        for (size_t i = 0; i < n; i++)
+        {
+            double total = 0;
+            for (size_t j = 0; j < n; j++)
+            {
+                total += i == j ? 0 : q[i][j];
+            }
+            q[i][i] = -total;
+        }
+        double expm = time_best([&]() { codesample::expm(q); }, 1);
+
+        codesample::matrix<double> p = codesample::expm(q);
+        double naive = time_best([&]() {
+            codesample::matrix<double> r = p;
+            for (int k = 1; k < 64; k++)
+            {
+                r = r * p;
+            }
+        }, 1);
+        double squared = time_best([&]() { codesample::pow(p, 64); }, 1);
+
+        codesample::matrix<double> b = random_matrix<double>(n, n, rng);
+        codesample::matrix<double> spd = b * codesample::matrix<double>(b).transpose();
+        for (size_t i = 0; i < n; i++)
+        {
+            spd[i][i] += static_cast<double>(n);
+            for (size_t j = 0; j < i; j++)
+            {
+                spd[i][j] = spd[j][i];
+            }
+        }
+        double root = time_best([&]() { codesample::sqrtm(spd); }, 1);
+        std::printf("%6zu %10.3f %16.3f %14.3f %12.3f\n", n, expm * 1e3, naive * 1e3, squared * 1e3, root * 1e3);
+    }
+    std::printf("\n");
+}
+
+static void bench_eigs(std::mt19937 &rng)
+{
+    std::printf("6 dominant eigenpairs (n x n symmetric double)\n");
+    std::printf("%6s %12s %12s %12s %10s\n", "n", "dense ms", "lanczos ms", "arnoldi ms", "matvecs");
+
+    for (size_t n : {256, 512})
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                a[i][j] = a[j][i];
+            }
+        }
+        double dense = time_best([&]() { codesample::symmetric_eigen<double> eigen(a); }, 1);
+        size_t matvecs = 0;
+        double lanczos = time_best([&]() { matvecs = codesample::lanczos(a, 6).matvecs; }, 1);
+        double arnoldi = time_best([&]() { codesample::arnoldi(a, 6); }, 1);
+        std::printf("%6zu %12.3f %12.3f %12.3f %10zu\n", n, dense * 1e3, lanczos * 1e3, arnoldi * 1e3, matvecs);
+    }
+
+    // PageRank by power iteration on a sparse lazy random walk
+    const size_t nodes = 1 << 20;
+    std::uniform_int_distribution<size_t> pick(0, nodes - 1);
+    std::vector<size_t> from, to;
+    std::vector<double> weight;
+    for (size_t i = 0; i < nodes; i++)
+    {
+        for (size_t t = 0; t < 8; t++)
+        {
+            from.push_back(t == 0 ? i : pick(rng));
+            to.push_back(i);
+            weight.push_back(0.125);
+        }
+    }
+    codesample::csr_matrix<double> walk(nodes, nodes, from, to, weight);
+    size_t iterations = 0;
+    double rank = time_best([&]() { iterations = codesample::power_iteration<double>(walk, 1e-8).matvecs; }, 1);
+    std::printf("pagerank, %zu nodes: %zu iterations in %.3f ms\n\n", nodes, iterations, rank * 1e3);
+}
+
+static void bench_compare(std::mt19937 &rng)
+{
+    std::printf("comparing equal n x n double matrices\n");
+    std::printf("%6s %16s %10s %14s %18s\n", "n", "checked loop ms", "== ms", "allclose ms", "compare_ulps ms");
+
+    for (size_t n : {512, 2048})
+    {
+        const codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        const codesample::matrix<double> b = a;
+        bool differ = false;
+        // the element loop operator!= used to run, through the checked const operator[]
+        double checked = time_best([&]() {
+            differ = false;
+            for (size_t i = 0; i < n && !differ; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    if (a[i].at(j) != b[i].at(j))
+                    {
+                        differ = true;
+                        break;
+                    }
+                }
+            }
+        });
+        double equal = time_best([&]() { differ = a != b; });
+        double close = time_best([&]() { differ = !codesample::allclose(a, b); });
+        double ulps = time_best([&]() { differ = !codesample::compare_ulps(a, b, 4).ok(); });
+        std::printf("%6zu %16.3f %10.3f %14.3f %18.3f\n", n, checked * 1e3, equal * 1e3, close * 1e3, ulps * 1e3);
+    }
+    std::printf("\n");
+}
+
+static void bench_summa(std::mt19937 &rng)
+{
+    std::printf("SUMMA across processes (n x n double)\n");
+    std::printf("%6s %10s %12s %12s %12s\n", "n", "in-process", "1 process", "4 processes", "9 processes");
+
+    for (size_t n : {512, 1024})
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        codesample::matrix<double> b = random_matrix<double>(n, n, rng);
+        double local = time_best([&]() { a * b; }, 1);
+        double one = time_best([&]() { codesample::summa_multiply(a, b, 1); }, 1);
+        double four = time_best([&]() { codesample::summa_multiply(a, b, 4); }, 1);
+        double nine = time_best([&]() { codesample::summa_multiply(a, b, 9); }, 1);
+        std::printf("%6zu %10.3f %12.3f %12.3f %12.3f\n", n, local * 1e3, one * 1e3, four * 1e3, nine * 1e3);
+    }
+    std::printf("\n");
+}
+
+static void bench_distributed(std::mt19937 &rng)
+{
+    std::printf("Distributed LU (n x n double, block 64; factorization only, then with scatter and gather)\n");
+    std::printf("%6s %10s %12s %12s %12s\n", "n", "serial", "4 processes", "9 processes", "4 + scatter");
+
+    for (size_t n : {512, 1024})
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        double serial = time_best([&]() { codesample::lu_decomposition<double> lu(a); }, 1);
+        double factor[2] = {0, 0}, whole = 0;
+        for (size_t p = 0; p < 2; p++)
+        {
+            const size_t processes = p == 0 ? 4 : 9;
+            const auto start = std::chrono::steady_clock::now();
+            codesample::run_local_processes(processes, [&](codesample::transport &t) {
+                const codesample::process_grid grid(t.size());
+                auto d = codesample::distributed_matrix<double>::scatter(t, grid, a);
+                t.barrier();
+                const auto factor_start = std::chrono::steady_clock::now();
+                codesample::lu_factor(d);
+                t.barrier();
+                factor[p] = std::chrono::duration<double>(std::chrono::steady_clock::now() - factor_start).count();
+                d.gather();
+            });
+            if (p == 0)
+            {
+                whole = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+        std::printf("%6zu %10.3f %12.3f %12.3f %12.3f\n", n, serial * 1e3, factor[0] * 1e3, factor[1] * 1e3,
+                    whole * 1e3);
+    }
+    std::printf("\n");
+}
+
+static void bench_checkpoint(std::mt19937 &rng)
+{
+    // a tenth of the plain run between saves, so that each run saves
+    // several times; overhead is against the plain run
+    std::printf("Checkpointing overhead (n x n double, state in /tmp, saving every tenth of the plain time)\n");
+    std::printf("%6s %-9s %10s %12s %8s %12s %8s %10s %9s\n", "n", "job", "plain", "every step", "saves",
+                "every 1/10", "saves", "per save", "overhead");
+
+    for (size_t n : {512, 1024, 2048})
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        for (int job = 0; job < 2; job++)
+        {
+            const double plain = job == 0 ? time_best([&]() { codesample::lu_decomposition<double> lu(a); })
+                                          : time_best([&]() { a * a; });
+            double times[2];
+            size_t saves[2];
+            for (int c = 0; c < 2; c++)
+            {
+                times[c] = time_best([&]() {
+                    codesample::checkpoint cp("/tmp/matrix_bench.ckpt", c == 0 ? 0.0 : plain / 10);
+                    if (job == 0)
+                    {
+                        codesample::checkpointed_lu(a, cp);
+                    }
+                    else
+                    {
+                        codesample::checkpointed_multiply(a, a, cp);
+                    }
+                    saves[c] = cp.saves();
+                });
+            }
+            std::printf("%6zu %-9s %10.3f %12.3f %8zu %12.3f %8zu %10.3f %8.1f%%\n", n, job == 0 ? "lu" : "multiply",
+                        plain * 1e3, times[0] * 1e3, saves[0], times[1] * 1e3, saves[1],
+                        (times[1] - plain) / std::max<size_t>(saves[1], 1) * 1e3, (times[1] / plain - 1) * 100);
+        }
+    }
+    std::printf("\n");
+}
+
+static void bench_memo(std::mt19937 &rng)
+{
+    std::printf("Product cache (n x n double; hash is both operands, hit includes hashing)\n");
+    std::printf("%6s %10s %10s %10s %10s\n", "n", "multiply", "hash", "GB/s", "hit");
+
+    codesample::product_cache &cache = codesample::product_cache::instance();
+    cache.enable(size_t(1) << 30);
+    for (size_t n : {128, 512, 1024, 2048})
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        codesample::matrix<double> b = random_matrix<double>(n, n, rng);
+        double multiply = time_best([&]() { a * b; }, 1);
+        double hash = time_best([&]() {
+            codesample::detail::content_hash(a);
+            codesample::detail::content_hash(b);
+        });
+        codesample::memo_multiply(a, b);
+        double hit = time_best([&]() { codesample::memo_multiply(a, b); });
+        std::printf("%6zu %10.3f %10.3f %10.2f %10.3f\n", n, multiply * 1e3, hash * 1e3,
+                    2.0 * n * n * sizeof(double) / hash / 1e9, hit * 1e3);
+    }
+    cache.disable();
+    std::printf("\n");
+}
+
+static void bench_maintained(std::mt19937 &rng)
+{
+    std::printf("Maintained product after changing k rows of A and k columns of B (n x n double)\n");
+    std::printf("%6s %10s %10s %10s %10s\n", "n", "multiply", "k = 1", "k = 8", "k = 32");
+
+    for (size_t n : {512, 1024})
+    {
+        codesample::matrix<double> a = random_matrix<double>(n, n, rng);
+        codesample::matrix<double> b = random_matrix<double>(n, n, rng);
+        double multiply = time_best([&]() { a * b; }, 1);
+        codesample::maintained_product<double> c(a, b);
+        double times[3];
+        const size_t ks[3] = {1, 8, 32};
+        for (size_t t = 0; t < 3; t++)
+        {
+            times[t] = time_best([&]() {
+                for (size_t i = 0; i < ks[t]; i++)
+                {
+                    a(i * 7 % n, i) += 1.0;
+                    b(i, i * 13 % n) -= 1.0;
+                }
+                c.update();
+            });
+        }
+        std::printf("%6zu %10.3f %10.3f %10.3f %10.3f\n", n, multiply * 1e3, times[0] * 1e3, times[1] * 1e3,
+                    times[2] * 1e3);
+    }
+    std::printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    std::mt19937 rng(argc > 1 ? std::stoul(argv[1]) : 42);
+
+    bench_mixed_precision(rng);
+    bench_half(rng);
+    bench_quantized(rng);
+    bench_complex(rng);
+    bench_bit_matrix(rng);
+    bench_shortest_paths(rng);
+    bench_modular(rng);
+    bench_kron(rng);
+    bench_conv(rng);
+    bench_epilogue(rng);
+    bench_layout(rng);
+    bench_tiled(rng);
+    bench_small_shapes(rng);
+    bench_linalg(rng);
+    bench_matfun(rng);
+    bench_eigs(rng);
+    bench_compare(rng);
+    bench_summa(rng);
+    bench_distributed(rng);
+    bench_checkpoint(rng);
+    bench_memo(rng);
+    bench_maintained(rng);
+
+    return 0;
+}
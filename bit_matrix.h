@@ -0,0 +1,503 @@
+/**
+ * @file bit_matrix.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief A boolean matrix packed 64 entries per word
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Each row is stored as a run of 64-bit words with column j in bit j % 64
+ * of word j / 64. Bits past the last column are always zero, so whole-word
+ * operations (OR, AND, popcount, comparison) never need masking.
+ */
+
+#ifndef _BIT_MATRIX_H_
+#define _BIT_MATRIX_H_
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    namespace detail
+    {
+        inline unsigned popcount64(uint64_t x)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+            return static_cast<unsigned>(std::bitset<64>(x).count());
+#endif
+        }
+
+        /**
+         * @brief Transposes a 64x64 bit block in place, where bit c of
+         * word r is entry (r, c), by swapping progressively smaller
+         * off-diagonal sub-blocks
+         */
+        inline void transpose64(uint64_t a[64])
+        {
+            uint64_t mask = 0x00000000ffffffffULL;
+            for (unsigned j = 32; j != 0; j >>= 1, mask ^= mask << j)
+            {
+                for (unsigned k = 0; k < 64; k = ((k | j) + 1) & ~j)
+                {
+                    uint64_t t = ((a[k] >> j) ^ a[k | j]) & mask;
+                    a[k] ^= t << j;
+                    a[k | j] ^= t;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief A matrix of booleans packed one bit per entry, with boolean
+     * (OR of ANDs) and counting products
+     *
+     */
+    class bit_matrix
+    {
+      private:
+        size_t _rows;
+        size_t _cols;
+        size_t _words;
+        std::vector<uint64_t> _bits;
+
+      public:
+        /**
+         * @brief Construct a new empty bit matrix
+         *
+         */
+        bit_matrix()
+        : _rows(0), _cols(0), _words(0)
+        {
+        }
+
+        /**
+         * @brief Construct a new mxn bit matrix
+         *
+         * @param rows The number of rows
+         * @param cols The number of columns
+         * @param value The value to populate the matrix with
+         */
+        bit_matrix(size_t rows, size_t cols, bool value = false)
+        : _rows(rows), _cols(cols), _words((cols + 63) / 64), _bits(rows * _words, 0)
+        {
+            if (value)
+            {
+                for (size_t i = 0; i < rows; i++)
+                {
+                    for (size_t w = 0; w < _words; w++)
+                    {
+                        row(i)[w] = ~0ULL;
+                    }
+                    clear_padding(i);
+                }
+            }
+        }
+
+        /**
+         * @brief Construct a bit matrix from a matrix, with nonzero entries
+         * becoming true
+         *
+         * @tparam T The type of data in the matrix. Must be comparable to T()
+         * @param m The matrix to convert
+         */
+        template <class T>
+        explicit bit_matrix(const matrix<T> &m)
+        : bit_matrix(m.rows(), m.cols())
+        {
+            for (size_t i = 0; i < _rows; i++)
+            {
+                for (size_t j = 0; j < _cols; j++)
+                {
+                    if (m[i][j] != T())
+                    {
+                        set(i, j);
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Construct an identity bit matrix
+         *
+         * @param n The number of rows and columns
+         * @return bit_matrix The nxn identity
+         */
+        static bit_matrix identity(size_t n)
+        {
+            bit_matrix result(n, n);
+            for (size_t i = 0; i < n; i++)
+            {
+                result.set(i, i);
+            }
+            return result;
+        }
+
+        /**
+         * @brief Gets the number of rows in this matrix
+         *
+         * @return size_t The number of rows in this matrix
+         */
+        size_t rows() const
+        {
+            return _rows;
+        }
+
+        /**
+         * @brief Gets the number of columns in this matrix
+         *
+         * @return size_t The number of columns in this matrix
+         */
+        size_t cols() const
+        {
+            return _cols;
+        }
+
+        /**
+         * @brief Gets the number of 64-bit words in each row
+         *
+         * @return size_t The number of words per row
+         */
+        size_t words() const
+        {
+            return _words;
+        }
+
+        /**
+         * @brief Gets the packed words of a row
+         *
+         * @param i The index of the row
+         * @return const uint64_t* The words of the row
+         */
+        const uint64_t *row(size_t i) const
+        {
+            return _bits.data() + i * _words;
+        }
+
+        /**
+         * @brief Gets the packed words of a row for modification. Bits past
+         * the last column must be left zero.
+         *
+         * @param i The index of the row
+         * @return uint64_t* The words of the row
+         */
+        uint64_t *row(size_t i)
+        {
+            return _bits.data() + i * _words;
+        }
+
+        /**
+         * @brief Gets an entry of this matrix
+         *
+         * @param i The row of the entry
+         * @param j The column of the entry
+         * @return bool The value of the entry
+         */
+        bool get(size_t i, size_t j) const
+        {
+            check(i, j);
+            return (row(i)[j / 64] >> (j % 64)) & 1;
+        }
+
+        /**
+         * @brief Sets an entry of this matrix
+         *
+         * @param i The row of the entry
+         * @param j The column of the entry
+         * @param value The new value of the entry
+         */
+        void set(size_t i, size_t j, bool value = true)
+        {
+            check(i, j);
+            uint64_t bit = 1ULL << (j % 64);
+            if (value)
+            {
+                row(i)[j / 64] |= bit;
+            }
+            else
+            {
+                row(i)[j / 64] &= ~bit;
+            }
+        }
+
+        /**
+         * @brief Counts the true entries in this matrix
+         *
+         * @return size_t The number of true entries
+         */
+        size_t count() const
+        {
+            size_t total = 0;
+            for (uint64_t w : _bits)
+            {
+                total += detail::popcount64(w);
+            }
+            return total;
+        }
+
+        /**
+         * @brief Computes the transpose of this matrix, 64x64 blocks at a time
+         *
+         * @return bit_matrix The transpose of this matrix
+         */
+        bit_matrix transpose() const
+        {
+            bit_matrix result(_cols, _rows);
+            uint64_t block[64];
+            for (size_t i0 = 0; i0 < _rows; i0 += 64)
+            {
+                const size_t nr = std::min<size_t>(64, _rows - i0);
+                for (size_t w = 0; w < _words; w++)
+                {
+                    for (size_t r = 0; r < 64; r++)
+                    {
+                        block[r] = r < nr ? row(i0 + r)[w] : 0;
+                    }
+                    detail::transpose64(block);
+
+                    const size_t nc = std::min<size_t>(64, _cols - w * 64);
+                    for (size_t c = 0; c < nc; c++)
+                    {
+                        result.row(w * 64 + c)[i0 / 64] = block[c];
+                    }
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Computes the boolean product of two bit matrices:
+         * entry (i, j) is true if a(i, k) and b(k, j) for some k.
+         * Uses the Four Russians method: rows of b are taken 8 at a time and
+         * all 256 of their ORs tabulated, so each row of the result needs one
+         * table lookup per 8 columns of a instead of one OR per set bit.
+         *
+         * @param a The first matrix
+         * @param b The second matrix
+         * @return bit_matrix The boolean product
+         */
+        static bit_matrix multiply(const bit_matrix &a, const bit_matrix &b)
+        {
+            check_multiply(a, b);
+
+            // rows of b are combined 8 at a time, using a table of all 256
+            // possible ORs of those rows
+            const size_t russian_bits = 8;
+            const size_t words = b._words;
+            bit_matrix result(a._rows, b._cols);
+            std::vector<uint64_t> table((1u << russian_bits) * words);
+
+            for (size_t k0 = 0; k0 < a._cols; k0 += russian_bits)
+            {
+                const size_t nk = std::min(russian_bits, a._cols - k0);
+
+                // table[mask] = OR of the rows k0 + t of b for each bit t in mask,
+                // built from the entry with the lowest bit of mask cleared
+                std::fill(table.begin(), table.begin() + words, 0);
+                for (size_t mask = 1; mask < (1u << nk); mask++)
+                {
+                    size_t low = 0;
+                    while (!((mask >> low) & 1))
+                    {
+                        low++;
+                    }
+                    const uint64_t *prev = &table[(mask & (mask - 1)) * words];
+                    const uint64_t *b_row = b.row(k0 + low);
+                    uint64_t *entry = &table[mask * words];
+                    for (size_t w = 0; w < words; w++)
+                    {
+                        entry[w] = prev[w] | b_row[w];
+                    }
+                }
+
+                // k0 is a multiple of 8, so the chunk never straddles a word
+                const size_t word = k0 / 64;
+                const size_t shift = k0 % 64;
+                for (size_t i = 0; i < a._rows; i++)
+                {
+                    size_t mask = (a.row(i)[word] >> shift) & ((1u << nk) - 1);
+                    if (mask != 0)
+                    {
+                        const uint64_t *entry = &table[mask * words];
+                        uint64_t *out = result.row(i);
+                        for (size_t w = 0; w < words; w++)
+                        {
+                            out[w] |= entry[w];
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Computes the product of two 0/1 matrices over the integers:
+         * entry (i, j) counts the k with a(i, k) and b(k, j), i.e. the size
+         * of the intersection of row i of a and column j of b, using popcount
+         *
+         * @param a The first matrix
+         * @param b The second matrix
+         * @return matrix<uint32_t> The counts
+         */
+        static matrix<uint32_t> multiply_count(const bit_matrix &a, const bit_matrix &b)
+        {
+            check_multiply(a, b);
+
+            const bit_matrix b_T = b.transpose();
+            matrix<uint32_t> result(a._rows, b._cols);
+            for (size_t i = 0; i < a._rows; i++)
+            {
+                const uint64_t *a_row = a.row(i);
+                std::vector<uint32_t> &out = result[i];
+                for (size_t j = 0; j < b._cols; j++)
+                {
+                    const uint64_t *b_col = b_T.row(j);
+                    uint32_t total = 0;
+                    for (size_t w = 0; w < a._words; w++)
+                    {
+                        total += detail::popcount64(a_row[w] & b_col[w]);
+                    }
+                    out[j] = total;
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Computes the reflexive transitive closure of a square
+         * matrix viewed as a graph's adjacency: entry (i, j) is true if j is
+         * reachable from i. Squares (A | I) until it stops changing, which
+         * takes at most log2(n) products.
+         *
+         * @return bit_matrix The reachability matrix
+         */
+        bit_matrix transitive_closure() const
+        {
+            if (_rows != _cols)
+            {
+                throw invalid_dimension(_rows, _cols);
+            }
+
+            bit_matrix reach = *this;
+            for (size_t i = 0; i < _rows; i++)
+            {
+                reach.set(i, i);
+            }
+
+            for (size_t span = 1; span < _rows; span *= 2)
+            {
+                bit_matrix next = multiply(reach, reach);
+                if (next == reach)
+                {
+                    break;
+                }
+                reach = next;
+            }
+            return reach;
+        }
+
+        /**
+         * @brief Converts this matrix to a matrix of another type
+         *
+         * @tparam T The type of data in the result. Must be constructible from bool
+         * @return matrix<T> The matrix with true as T(1) and false as T(0)
+         */
+        template <class T>
+        matrix<T> to_matrix() const
+        {
+            matrix<T> result(_rows, _cols);
+            for (size_t i = 0; i < _rows; i++)
+            {
+                for (size_t j = 0; j < _cols; j++)
+                {
+                    result[i][j] = T(get(i, j));
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Compute the boolean product of this matrix with another
+         *
+         * @param other The other matrix to multiply against
+         * @return bit_matrix The boolean product
+         */
+        bit_matrix operator*(const bit_matrix &other) const
+        {
+            return multiply(*this, other);
+        }
+
+        bool operator==(const bit_matrix &rhs) const
+        {
+            return _rows == rhs._rows && _cols == rhs._cols && _bits == rhs._bits;
+        }
+
+        bool operator!=(const bit_matrix &rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+        /**
+         * @brief Print the contents of this matrix as 0s and 1s
+         *
+         * @param out the ostream to print this matrix to
+         */
+        void print(std::ostream &out = std::cout) const
+        {
+            for (size_t i = 0; i < _rows; i++)
+            {
+                for (size_t j = 0; j < _cols; j++)
+                {
+                    out << get(i, j) << " ";
+                }
+                out << std::endl;
+            }
+        }
+
+      private:
+        void check(size_t i, size_t j) const
+        {
+            if (i >= _rows || j >= _cols)
+            {
+                throw std::out_of_range("bit_matrix index out of range");
+            }
+        }
+
+        void clear_padding(size_t i)
+        {
+            if (_cols % 64 != 0)
+            {
+                row(i)[_words - 1] &= (1ULL << (_cols % 64)) - 1;
+            }
+        }
+
+        static void check_multiply(const bit_matrix &a, const bit_matrix &b)
+        {
+            if (a._rows == 0 || b._rows == 0)
+            {
+                throw std::out_of_range("Can't multiply matrix of size 0!");
+            }
+            if (a._cols != b._rows)
+            {
+                throw invalid_dimension(a._cols, b._rows);
+            }
+        }
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, const bit_matrix &m)
+    {
+        m.print(os);
+        return os;
+    }
+}
+
+#endif
@@ -0,0 +1,808 @@
+/**
+ * @file checkpoint.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Checkpoint and restart for long factorizations and products
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * A checkpoint is one binary file holding the state of one job: which
+ * step it reached, the finished part of the result and whatever else the
+ * algorithm needs to carry on. The state is copied out between steps and
+ * written by another thread, to a temporary file that is synced and then
+ * renamed over the old one, so the file on disk is always a complete
+ * step, whenever the process dies. A header carries a checksum of the
+ * state and a fingerprint of the inputs; a file that fails either is
+ * ignored and the job starts over.
+ *
+ * A job whose saved state only grows, like the finished rows of a
+ * product, can append() to the file instead: the new bytes are written
+ * past the old state and synced before the header is rewritten in place.
+ *
+ * Saves are paced by time, and skipped while the last one is still being
+ * written, so the job never waits on the disk. Copying, hashing and
+ * writing a whole state takes about 1 ms per megabyte, so the default
+ * interval keeps the cost well under one percent; an interval near that
+ * cost makes saving dominate.
+ *
+ *     checkpoint cp("/var/tmp/factor.ckpt");
+ *     lu_decomposition<double> lu = checkpointed_lu(a, cp);  // rerun to resume
+ */
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "linalg.h"
+#include "matrix.h"
+
+namespace codesample
+{
+    namespace detail
+    {
+        const uint64_t checkpoint_magic = 0x31544e504b434d43; // "CMCKPNT1"
+
+        /**
+         * @brief What a checkpoint file holds, so one job never resumes
+         * from another's file
+         */
+        const uint64_t checkpoint_lu = 1;
+        const uint64_t checkpoint_multiply = 2;
+
+        /**
+         * @brief A 64 bit FNV-1a style hash over whole words, continuing
+         * from hash
+         */
+        inline uint64_t hash_bytes(const void *data, size_t bytes, uint64_t hash = 0xcbf29ce484222325)
+        {
+            const unsigned char *p = static_cast<const unsigned char *>(data);
+            size_t i = 0;
+            for (; i + 8 <= bytes; i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, p + i, 8);
+                hash = (hash ^ word) * 0x100000001b3;
+            }
+            for (; i < bytes; i++)
+            {
+                hash = (hash ^ p[i]) * 0x100000001b3;
+            }
+            return hash;
+        }
+
+        /**
+         * @brief A fingerprint of a matrix's shape, element size and contents
+         */
+        template <class T>
+        uint64_t fingerprint(const matrix<T> &m, uint64_t hash = 0xcbf29ce484222325)
+        {
+            const uint64_t shape[3] = {m.rows(), m.cols(), sizeof(T)};
+            hash = hash_bytes(shape, sizeof(shape), hash);
+            for (size_t i = 0; i < m.rows(); i++)
+            {
+                hash = hash_bytes(m[i].data(), m.cols() * sizeof(T), hash);
+            }
+            return hash;
+        }
+
+        /**
+         * @brief hash_bytes() over bytes that arrive in pieces: the hash of
+         * the whole words so far, and the bytes after them
+         */
+        class stream_hash
+        {
+          private:
+            uint64_t _words;
+            unsigned char _tail[8];
+            size_t _tail_bytes;
+
+          public:
+            stream_hash()
+            : _words(0xcbf29ce484222325), _tail_bytes(0)
+            {
+            }
+
+            void add(const void *data, size_t bytes)
+            {
+                const unsigned char *p = static_cast<const unsigned char *>(data);
+                if (_tail_bytes > 0)
+                {
+                    // finish the word the last piece started
+                    const size_t fill = std::min(bytes, 8 - _tail_bytes);
+                    std::memcpy(_tail + _tail_bytes, p, fill);
+                    _tail_bytes += fill;
+                    p += fill;
+                    bytes -= fill;
+                    if (_tail_bytes < 8)
+                    {
+                        return;
+                    }
+                    _words = hash_bytes(_tail, 8, _words);
+                    _tail_bytes = 0;
+                }
+                const size_t whole = bytes / 8 * 8;
+                _words = hash_bytes(p, whole, _words);
+                _tail_bytes = bytes - whole;
+                std::memcpy(_tail, p + whole, _tail_bytes);
+            }
+
+            /**
+             * @brief The same as hash_bytes() over everything added
+             */
+            uint64_t value() const
+            {
+                return hash_bytes(_tail, _tail_bytes, _words);
+            }
+        };
+
+        /**
+         * @brief Appends raw values to a state buffer
+         */
+        class state_writer
+        {
+          private:
+            std::vector<char> _bytes;
+
+          public:
+            state_writer()
+            {
+            }
+
+            /**
+             * @brief Writes into a buffer, such as checkpoint::buffer(),
+             * keeping its memory but not its contents
+             */
+            explicit state_writer(std::vector<char> &&buffer)
+            : _bytes(std::move(buffer))
+            {
+                _bytes.clear();
+            }
+
+            /**
+             * @brief Makes room for at least this many bytes in all, so
+             * that large states are not copied as the buffer grows
+             */
+            void reserve(size_t bytes)
+            {
+                _bytes.reserve(bytes);
+            }
+
+            void put(const void *data, size_t bytes)
+            {
+                const char *p = static_cast<const char *>(data);
+                _bytes.insert(_bytes.end(), p, p + bytes);
+            }
+
+            template <class V>
+            void put(const V &value)
+            {
+                static_assert(std::is_trivially_copyable<V>::value, "State is saved as bytes");
+                put(&value, sizeof(V));
+            }
+
+            std::vector<char> &bytes()
+            {
+                return _bytes;
+            }
+        };
+
+        /**
+         * @brief Reads values back from a state buffer, in the order they
+         * were put
+         */
+        class state_reader
+        {
+          private:
+            const std::vector<char> &_bytes;
+            size_t _at;
+
+          public:
+            explicit state_reader(const std::vector<char> &bytes)
+            : _bytes(bytes), _at(0)
+            {
+            }
+
+            void get(void *data, size_t bytes)
+            {
+                if (bytes > _bytes.size() - _at)
+                {
+                    throw std::runtime_error("Checkpoint state is truncated");
+                }
+                std::memcpy(data, _bytes.data() + _at, bytes);
+                _at += bytes;
+            }
+
+            template <class V>
+            V get()
+            {
+                V value;
+                get(&value, sizeof(V));
+                return value;
+            }
+        };
+
+        inline void write_file(int fd, const char *data, size_t bytes)
+        {
+            while (bytes > 0)
+            {
+                const ssize_t written = ::write(fd, data, bytes);
+                if (written < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (written <= 0)
+                {
+                    throw std::runtime_error(std::string("Can't write checkpoint: ") + std::strerror(errno));
+                }
+                data += written;
+                bytes -= static_cast<size_t>(written);
+            }
+        }
+    }
+
+    /**
+     * @brief One checkpoint file, written in the background
+     *
+     */
+    class checkpoint
+    {
+      private:
+        /**
+         * @brief The file header: the state follows it
+         */
+        struct header
+        {
+            uint64_t magic;
+            uint64_t kind;
+            uint64_t fingerprint;
+            uint64_t step;
+            uint64_t bytes;
+            uint64_t checksum;
+        };
+
+        std::string _path;
+        double _interval;
+        std::chrono::steady_clock::time_point _last;
+        std::thread _writer;
+        std::atomic<bool> _writing;
+        std::exception_ptr _error;
+        std::atomic<size_t> _saves;
+        uint64_t _restored;
+
+        // The state in the file as last saved or loaded, for append(): set
+        // by the writer, and read only after flush()
+        bool _stored;
+        uint64_t _stored_kind;
+        uint64_t _stored_fingerprint;
+        uint64_t _stored_bytes;
+        detail::stream_hash _stored_hash;
+
+        // the memory of the last state written, for buffer()
+        std::vector<char> _spare;
+
+        /**
+         * @brief Checks the header fields and a hash of the state, so that
+         * an appended state can be checked without reading it again
+         */
+        static uint64_t checksum(const header &h, const detail::stream_hash &state)
+        {
+            const uint64_t fields[5] = {h.magic, h.kind, h.fingerprint, h.step, h.bytes};
+            return detail::hash_bytes(fields, sizeof(fields), state.value());
+        }
+
+        void stored(const header &h, const detail::stream_hash &state)
+        {
+            _stored = true;
+            _stored_kind = h.kind;
+            _stored_fingerprint = h.fingerprint;
+            _stored_bytes = h.bytes;
+            _stored_hash = state;
+        }
+
+        /**
+         * @brief Writes the file next to the old one, then renames it over
+         */
+        void write(const header &h, const std::vector<char> &state)
+        {
+            const std::string temporary = _path + ".tmp";
+            const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Can't create " + temporary + ": " + std::strerror(errno));
+            }
+            try
+            {
+                detail::write_file(fd, reinterpret_cast<const char *>(&h), sizeof(h));
+                detail::write_file(fd, state.data(), state.size());
+                if (::fsync(fd) != 0)
+                {
+                    throw std::runtime_error(std::string("Can't sync checkpoint: ") + std::strerror(errno));
+                }
+            }
+            catch (...)
+            {
+                ::close(fd);
+                ::unlink(temporary.c_str());
+                throw;
+            }
+            ::close(fd);
+            if (::rename(temporary.c_str(), _path.c_str()) != 0)
+            {
+                throw std::runtime_error("Can't replace " + _path + ": " + std::strerror(errno));
+            }
+
+            // sync the directory too, so that the rename itself survives a crash
+            const size_t slash = _path.rfind('/');
+            const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : _path.substr(0, slash);
+            const int dir = ::open(directory.c_str(), O_RDONLY);
+            if (dir >= 0)
+            {
+                ::fsync(dir);
+                ::close(dir);
+            }
+        }
+
+        /**
+         * @brief Writes more state past the end of the file's, then the
+         * header in place. Until the header is written the old one stands,
+         * and still describes a complete state.
+         */
+        void write_more(const header &h, uint64_t offset, const std::vector<char> &more)
+        {
+            const int fd = ::open(_path.c_str(), O_WRONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Can't open " + _path + ": " + std::strerror(errno));
+            }
+            try
+            {
+                const off_t end = static_cast<off_t>(sizeof(h) + offset);
+                if (::lseek(fd, end, SEEK_SET) != end)
+                {
+                    throw std::runtime_error(std::string("Can't seek in checkpoint: ") + std::strerror(errno));
+                }
+                detail::write_file(fd, more.data(), more.size());
+                if (::fsync(fd) != 0 || ::lseek(fd, 0, SEEK_SET) != 0)
+                {
+                    throw std::runtime_error(std::string("Can't sync checkpoint: ") + std::strerror(errno));
+                }
+                detail::write_file(fd, reinterpret_cast<const char *>(&h), sizeof(h));
+                if (::fsync(fd) != 0)
+                {
+                    throw std::runtime_error(std::string("Can't sync checkpoint: ") + std::strerror(errno));
+                }
+            }
+            catch (...)
+            {
+                ::close(fd);
+                throw;
+            }
+            ::close(fd);
+        }
+
+        void join()
+        {
+            if (_writer.joinable())
+            {
+                _writer.join();
+            }
+        }
+
+      public:
+        /**
+         * @brief Construct a new checkpoint
+         *
+         * @param path The file to keep the state in
+         * @param interval The least number of seconds between saves
+         */
+        explicit checkpoint(const std::string &path, double interval = 30.0)
+        : _path(path), _interval(interval), _last(std::chrono::steady_clock::now()), _writing(false), _saves(0),
+          _restored(0), _stored(false), _stored_kind(0), _stored_fingerprint(0), _stored_bytes(0)
+        {
+        }
+
+        checkpoint(const checkpoint &) = delete;
+        checkpoint &operator=(const checkpoint &) = delete;
+
+        /**
+         * @brief Waits for the write in flight; a failure in it is lost
+         */
+        ~checkpoint()
+        {
+            join();
+        }
+
+        const std::string &path() const
+        {
+            return _path;
+        }
+
+        /**
+         * @brief Whether it is time to save: the interval has passed since
+         * the last save and that save is on disk
+         */
+        bool due() const
+        {
+            return !_writing.load() &&
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - _last).count() >= _interval;
+        }
+
+        /**
+         * @brief Starts writing a step's state in the background
+         *
+         * @param kind What the state is, checked again by load()
+         * @param fingerprint A fingerprint of the inputs, checked again by load()
+         * @param step How far the job got
+         * @param state The state, taken over by the writer
+         * @throws std::runtime_error if the previous write failed
+         */
+        void save(uint64_t kind, uint64_t fingerprint, uint64_t step, std::vector<char> &&state)
+        {
+            flush();
+            _stored = false;
+            _last = std::chrono::steady_clock::now();
+            _writing = true;
+            const std::shared_ptr<std::vector<char>> moved = std::make_shared<std::vector<char>>(std::move(state));
+            _writer = std::thread([this, kind, fingerprint, step, moved]() {
+                try
+                {
+                    header h = {detail::checkpoint_magic, kind, fingerprint, step, moved->size(), 0};
+                    detail::stream_hash hash;
+                    hash.add(moved->data(), moved->size());
+                    h.checksum = checksum(h, hash);
+                    write(h, *moved);
+                    stored(h, hash);
+                    _saves++;
+                }
+                catch (...)
+                {
+                    _error = std::current_exception();
+                }
+                _spare = std::move(*moved);
+                _writing = false;
+            });
+        }
+
+        /**
+         * @brief Starts writing a step's state in the background, as the
+         * state last saved or loaded followed by more bytes. Only the new
+         * bytes are written, so a job whose finished part only grows can
+         * save it at the cost of what it added.
+         *
+         * @param kind What the state is: the same as the state it extends
+         * @param fingerprint A fingerprint of the inputs: the same as the state it extends
+         * @param step How far the job got
+         * @param more The bytes to add to the state, taken over by the writer
+         * @throws std::logic_error if there is no such state to extend
+         * @throws std::runtime_error if the previous write failed
+         */
+        void append(uint64_t kind, uint64_t fingerprint, uint64_t step, std::vector<char> &&more)
+        {
+            flush();
+            if (!_stored || _stored_kind != kind || _stored_fingerprint != fingerprint)
+            {
+                throw std::logic_error("No checkpoint state of this kind to append to");
+            }
+            _stored = false;
+            _last = std::chrono::steady_clock::now();
+            _writing = true;
+            const std::shared_ptr<std::vector<char>> moved = std::make_shared<std::vector<char>>(std::move(more));
+            _writer = std::thread([this, step, moved]() {
+                try
+                {
+                    header h = {detail::checkpoint_magic, _stored_kind, _stored_fingerprint, step,
+                                _stored_bytes + moved->size(), 0};
+                    detail::stream_hash hash = _stored_hash;
+                    hash.add(moved->data(), moved->size());
+                    h.checksum = checksum(h, hash);
+                    write_more(h, _stored_bytes, *moved);
+                    stored(h, hash);
+                    _saves++;
+                }
+                catch (...)
+                {
+                    _error = std::current_exception();
+                }
+                _spare = std::move(*moved);
+                _writing = false;
+            });
+        }
+
+        /**
+         * @brief Gets an empty buffer to build the next state in, holding
+         * the memory of the last one written so that a large state is not
+         * paid for in fresh pages each save. Waits for the write in flight.
+         *
+         * @throws std::runtime_error if it failed
+         */
+        std::vector<char> buffer()
+        {
+            flush();
+            std::vector<char> spare = std::move(_spare);
+            spare.clear();
+            return spare;
+        }
+
+        /**
+         * @brief Reads the state back, if the file holds a complete state
+         * of this kind for these inputs
+         *
+         * @param kind What the state should be
+         * @param fingerprint The fingerprint of the inputs
+         * @param step Set to the step the state is from
+         * @param state Set to the state
+         * @return true If a state was read; false for no file or a bad one
+         */
+        bool load(uint64_t kind, uint64_t fingerprint, uint64_t &step, std::vector<char> &state)
+        {
+            flush();
+            _stored = false;
+            const int fd = ::open(_path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            }
+            header h;
+            bool ok = ::read(fd, &h, sizeof(h)) == static_cast<ssize_t>(sizeof(h)) &&
+                      h.magic == detail::checkpoint_magic && h.kind == kind && h.fingerprint == fingerprint;
+            struct stat info;
+            // an append cut short leaves bytes past the state
+            ok = ok && ::fstat(fd, &info) == 0 && static_cast<uint64_t>(info.st_size) >= sizeof(h) + h.bytes;
+            if (ok)
+            {
+                state.resize(h.bytes);
+                size_t done = 0;
+                while (done < state.size())
+                {
+                    const ssize_t got = ::read(fd, state.data() + done, state.size() - done);
+                    if (got <= 0)
+                    {
+                        break;
+                    }
+                    done += static_cast<size_t>(got);
+                }
+                detail::stream_hash hash;
+                hash.add(state.data(), state.size());
+                ok = done == state.size() && checksum(h, hash) == h.checksum;
+                if (ok)
+                {
+                    stored(h, hash);
+                }
+            }
+            ::close(fd);
+            if (!ok)
+            {
+                return false;
+            }
+            step = h.step;
+            _restored = h.step;
+            return true;
+        }
+
+        /**
+         * @brief Waits for the write in flight
+         *
+         * @throws std::runtime_error if it failed
+         */
+        void flush()
+        {
+            join();
+            if (_error)
+            {
+                std::exception_ptr error = _error;
+                _error = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+
+        /**
+         * @brief Deletes the file, and any write a crash cut short, once
+         * the job is done with it
+         */
+        void remove()
+        {
+            flush();
+            _stored = false;
+            ::unlink(_path.c_str());
+            ::unlink((_path + ".tmp").c_str());
+        }
+
+        /**
+         * @brief The number of states written
+         */
+        size_t saves() const
+        {
+            return _saves.load();
+        }
+
+        /**
+         * @brief The step the last successful load() resumed from, 0 if none
+         */
+        uint64_t restored_step() const
+        {
+            return _restored;
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Saves and restores the state of an lu_decomposition
+         * between block columns
+         */
+        template <class T>
+        struct lu_access
+        {
+            static std::vector<char> state(const lu_decomposition<T> &lu, std::vector<char> &&buffer)
+            {
+                state_writer out(std::move(buffer));
+                out.reserve((3 + lu._perm.size()) * sizeof(uint64_t) + (1 + lu._lu.size()) * sizeof(T));
+                out.put(static_cast<uint64_t>(lu._n));
+                out.put(static_cast<int64_t>(lu._sign));
+                out.put(static_cast<uint64_t>(lu._singular));
+                out.put(lu._norm1);
+                for (size_t p : lu._perm)
+                {
+                    out.put(static_cast<uint64_t>(p));
+                }
+                out.put(lu._lu.data(), lu._lu.size() * sizeof(T));
+                return std::move(out.bytes());
+            }
+
+            static void restore(lu_decomposition<T> &lu, const std::vector<char> &state)
+            {
+                state_reader in(state);
+                lu._n = in.get<uint64_t>();
+                lu._sign = static_cast<int>(in.get<int64_t>());
+                lu._singular = in.get<uint64_t>() != 0;
+                lu._norm1 = in.get<T>();
+                lu._perm.resize(lu._n);
+                for (size_t &p : lu._perm)
+                {
+                    p = in.get<uint64_t>();
+                }
+                lu._lu.resize(lu._n * lu._n);
+                in.get(lu._lu.data(), lu._lu.size() * sizeof(T));
+            }
+
+            static lu_decomposition<T> factor(const matrix<T> &a, checkpoint &cp)
+            {
+                const uint64_t inputs = fingerprint(a);
+                uint64_t step = 0;
+                std::vector<char> saved;
+                lu_decomposition<T> lu;
+                if (cp.load(checkpoint_lu, inputs, step, saved))
+                {
+                    restore(lu, saved);
+                }
+                else
+                {
+                    lu.start(a);
+                    step = 0;
+                }
+
+                size_t j0 = step;
+                while (j0 < lu._n)
+                {
+                    j0 = lu.factor_step(j0);
+                    if (j0 < lu._n && cp.due())
+                    {
+                        cp.save(checkpoint_lu, inputs, j0, state(lu, cp.buffer()));
+                    }
+                }
+                cp.remove();
+                return lu;
+            }
+        };
+    }
+
+    /**
+     * @brief Factors a square matrix like lu_decomposition, saving the
+     * state after block columns as the checkpoint's interval allows. If
+     * the checkpoint holds a state for the same matrix, carries on from
+     * it. The file is deleted once the factorization is done.
+     *
+     * @param a The matrix to factor
+     * @param cp The checkpoint
+     * @return lu_decomposition<T> The factorization
+     */
+    template <class T>
+    lu_decomposition<T> checkpointed_lu(const matrix<T> &a, checkpoint &cp)
+    {
+        return detail::lu_access<T>::factor(a, cp);
+    }
+
+    /**
+     * @brief Multiplies two matrices a panel of rows at a time, saving the
+     * finished rows as the checkpoint's interval allows; each save after
+     * the first appends only the rows finished since. If the checkpoint
+     * holds rows of the same product, carries on after them. The file is
+     * deleted once the product is done.
+     *
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @param cp The checkpoint
+     * @param panel The number of rows per step
+     * @return matrix<T> The product
+     */
+    template <class T>
+    matrix<T> checkpointed_multiply(const matrix<T> &m1, const matrix<T> &m2, checkpoint &cp, size_t panel = 256)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+
+        const size_t rows = m1.rows(), cols = m2.cols();
+        const uint64_t inputs = detail::fingerprint(m2, detail::fingerprint(m1));
+        matrix<T> result(rows, cols);
+        uint64_t done = 0;
+        std::vector<char> saved;
+        if (cp.load(detail::checkpoint_multiply, inputs, done, saved) && done <= rows &&
+            saved.size() == done * cols * sizeof(T))
+        {
+            detail::state_reader in(saved);
+            for (size_t i = 0; i < done; i++)
+            {
+                in.get(result[i].data(), cols * sizeof(T));
+            }
+        }
+        else
+        {
+            done = 0;
+        }
+
+        // finished rows never change, so each save adds the rows finished
+        // since the one before to the file
+        size_t saved_rows = done;
+        for (size_t r0 = done; r0 < rows; r0 += std::max<size_t>(panel, 1))
+        {
+            const size_t r1 = std::min(rows, r0 + std::max<size_t>(panel, 1));
+            multiply_into(m1.view(r0, 0, r1 - r0, m1.cols()), m2, result.view(r0, 0, r1 - r0, cols));
+            if (r1 < rows && cp.due())
+            {
+                detail::state_writer out(cp.buffer());
+                out.reserve((r1 - saved_rows) * cols * sizeof(T));
+                for (size_t i = saved_rows; i < r1; i++)
+                {
+                    out.put(result[i].data(), cols * sizeof(T));
+                }
+                if (saved_rows == 0)
+                {
+                    cp.save(detail::checkpoint_multiply, inputs, r1, std::move(out.bytes()));
+                }
+                else
+                {
+                    cp.append(detail::checkpoint_multiply, inputs, r1, std::move(out.bytes()));
+                }
+                saved_rows = r1;
+            }
+        }
+        cp.remove();
+        return result;
+    }
+}
+
+#endif
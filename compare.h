@@ -0,0 +1,334 @@
+/**
+ * @file compare.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Approximate comparison of floating point matrices
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Products computed by different kernels round differently, so floating
+ * point results are compared within a tolerance rather than with ==.
+ * allclose() and allclose_ulps() answer yes or no and stop at the first
+ * element out of tolerance; compare_close() and compare_ulps() scan
+ * everything and report where the first and the worst mismatches are.
+ * All of them test elements in branch-free chunks and split large
+ * matrices across threads, like operator==.
+ */
+
+#ifndef _COMPARE_H_
+#define _COMPARE_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief Where two matrices differ
+     *
+     */
+    struct mismatch_report
+    {
+        /**
+         * The number of elements out of tolerance
+         */
+        size_t mismatches;
+
+        /**
+         * The first element out of tolerance, in row major order
+         */
+        size_t first_row;
+        size_t first_col;
+
+        /**
+         * The element furthest out of tolerance, the first if several tie
+         */
+        size_t worst_row;
+        size_t worst_col;
+
+        /**
+         * How far out the worst element is: its error over the tolerance
+         * for compare_close(), its distance in ulps for compare_ulps().
+         * Infinite for a NaN.
+         */
+        double worst;
+
+        /**
+         * @brief Whether every element is within tolerance
+         */
+        bool ok() const
+        {
+            return mismatches == 0;
+        }
+    };
+
+    /**
+     * @brief Prints a one line summary of a comparison
+     */
+    inline std::ostream &operator<<(std::ostream &os, const mismatch_report &report)
+    {
+        if (report.ok())
+        {
+            return os << "no mismatches";
+        }
+        return os << report.mismatches << " mismatches, first at (" << report.first_row << ", " << report.first_col
+                  << "), worst at (" << report.worst_row << ", " << report.worst_col << "): " << report.worst;
+    }
+
+    namespace detail
+    {
+        /**
+         * @brief Maps the sign-magnitude bits of x to an integer with the
+         * same order as the float values, 0 and -0 both to 0. Branch free,
+         * so comparison loops over it vectorize.
+         */
+        template <class T>
+        int64_t ordered_bits(T x)
+        {
+            typedef typename std::conditional<sizeof(T) == 4, int32_t, int64_t>::type I;
+            I bits;
+            std::memcpy(&bits, &x, sizeof(T));
+            const I negative = bits >> (8 * sizeof(T) - 1);
+            return static_cast<int64_t>((bits ^ (negative & std::numeric_limits<I>::max())) - negative);
+        }
+    }
+
+    /**
+     * @brief The number of representable values from a to b: 0 if equal
+     * (including 0 and -0), 1 for neighbours. The maximum for a NaN.
+     */
+    template <class T>
+    uint64_t ulp_distance(T a, T b)
+    {
+        static_assert(std::is_floating_point<T>::value && (sizeof(T) == 4 || sizeof(T) == 8),
+                      "ulp_distance needs float or double");
+        const int64_t oa = detail::ordered_bits(a), ob = detail::ordered_bits(b);
+        const uint64_t distance = oa > ob ? static_cast<uint64_t>(oa) - static_cast<uint64_t>(ob)
+                                          : static_cast<uint64_t>(ob) - static_cast<uint64_t>(oa);
+        return (a != a) | (b != b) ? std::numeric_limits<uint64_t>::max() : distance;
+    }
+
+    namespace detail
+    {
+        /**
+         * @brief numpy's isclose(): |a - b| <= atol + rtol |b| for finite
+         * values, and an infinity is close only to itself
+         */
+        template <class T>
+        struct close_test
+        {
+            T rtol;
+            T atol;
+
+            bool operator()(const T &a, const T &b) const
+            {
+                return (a == b) |
+                       (std::isfinite(a) & std::isfinite(b) & (std::abs(a - b) <= atol + rtol * std::abs(b)));
+            }
+
+            double excess(const T &a, const T &b) const
+            {
+                if (!std::isfinite(a) || !std::isfinite(b))
+                {
+                    return std::numeric_limits<double>::infinity();
+                }
+                const double error = std::abs(static_cast<double>(a) - static_cast<double>(b));
+                const double tolerance = static_cast<double>(atol + rtol * std::abs(b));
+                return error != error ? std::numeric_limits<double>::infinity() : error / tolerance;
+            }
+        };
+
+        template <class T>
+        struct ulp_test
+        {
+            uint64_t max_ulps;
+
+            bool operator()(const T &a, const T &b) const
+            {
+                return ulp_distance(a, b) <= max_ulps;
+            }
+
+            double excess(const T &a, const T &b) const
+            {
+                const uint64_t distance = ulp_distance(a, b);
+                return distance == std::numeric_limits<uint64_t>::max() ? std::numeric_limits<double>::infinity()
+                                                                        : static_cast<double>(distance);
+            }
+        };
+
+        template <class T>
+        void check_same_shape(const matrix<T> &a, const matrix<T> &b)
+        {
+            if (a.rows() != b.rows())
+            {
+                throw invalid_dimension(a.rows(), b.rows());
+            }
+            if (a.cols() != b.cols())
+            {
+                throw invalid_dimension(a.cols(), b.cols());
+            }
+        }
+
+        /**
+         * @brief Whether test passes on every pair of elements, stopping
+         * at the first failure
+         */
+        template <class T, class Test>
+        bool all_pass(const matrix<T> &a, const matrix<T> &b, const Test &test)
+        {
+            check_same_shape(a, b);
+            return !any_row(a.rows(), a.cols(), [&](size_t i) { return row_fails(a[i], b[i], test); });
+        }
+
+        /**
+         * @brief Scans every pair of elements, in ranges of rows across
+         * threads, and merges the ranges' reports
+         */
+        template <class T, class Test>
+        mismatch_report report_failures(const matrix<T> &a, const matrix<T> &b, const Test &test)
+        {
+            check_same_shape(a, b);
+            mismatch_report total = {0, 0, 0, 0, 0, 0.0};
+            std::mutex merge;
+            const size_t threads = a.rows() * a.cols() < compare_parallel_threshold ? 1 : num_threads();
+            parallel_for(a.rows(), 1, threads, [&](size_t r0, size_t r1) {
+                mismatch_report part = {0, 0, 0, 0, 0, 0.0};
+                for (size_t i = r0; i < r1; i++)
+                {
+                    const std::vector<T> &row_a = a[i], &row_b = b[i];
+                    // skip passing chunks without leaving the vector loop
+                    for (size_t j0 = 0; j0 < row_a.size(); j0 += compare_chunk)
+                    {
+                        const size_t j1 = std::min(row_a.size(), j0 + compare_chunk);
+                        bool failed = false;
+                        for (size_t j = j0; j < j1; j++)
+                        {
+                            failed |= !test(row_a[j], row_b[j]);
+                        }
+                        if (!failed)
+                        {
+                            continue;
+                        }
+                        for (size_t j = j0; j < j1; j++)
+                        {
+                            if (test(row_a[j], row_b[j]))
+                            {
+                                continue;
+                            }
+                            const double excess = test.excess(row_a[j], row_b[j]);
+                            if (part.mismatches++ == 0)
+                            {
+                                part.first_row = part.worst_row = i;
+                                part.first_col = part.worst_col = j;
+                                part.worst = excess;
+                            }
+                            else if (excess > part.worst)
+                            {
+                                part.worst_row = i;
+                                part.worst_col = j;
+                                part.worst = excess;
+                            }
+                        }
+                    }
+                }
+
+                if (part.mismatches == 0)
+                {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(merge);
+                if (total.mismatches == 0)
+                {
+                    total = part;
+                    return;
+                }
+                total.mismatches += part.mismatches;
+                // ranges merge in any order, so break ties by position
+                if (part.first_row < total.first_row)
+                {
+                    total.first_row = part.first_row;
+                    total.first_col = part.first_col;
+                }
+                if (part.worst > total.worst || (part.worst == total.worst && part.worst_row < total.worst_row))
+                {
+                    total.worst_row = part.worst_row;
+                    total.worst_col = part.worst_col;
+                    total.worst = part.worst;
+                }
+            });
+            return total;
+        }
+    }
+
+    /**
+     * @brief Whether every element of a is within atol + rtol |b| of the
+     * element of b, as numpy's allclose(). NaNs are never close.
+     *
+     * @param a The first matrix
+     * @param b The second matrix, the reference the relative tolerance scales with
+     * @param rtol The relative tolerance
+     * @param atol The absolute tolerance
+     * @return true If every element is close
+     * @throws invalid_dimension if the shapes differ
+     */
+    template <class T>
+    bool allclose(const matrix<T> &a, const matrix<T> &b, T rtol = static_cast<T>(1e-5),
+                  T atol = static_cast<T>(1e-8))
+    {
+        return detail::all_pass(a, b, detail::close_test<T>{rtol, atol});
+    }
+
+    /**
+     * @brief Whether every element of a is within max_ulps representable
+     * values of the element of b
+     *
+     * @param a The first matrix
+     * @param b The second matrix
+     * @param max_ulps The largest distance allowed, see ulp_distance()
+     * @return true If every element is close
+     * @throws invalid_dimension if the shapes differ
+     */
+    template <class T>
+    bool allclose_ulps(const matrix<T> &a, const matrix<T> &b, uint64_t max_ulps)
+    {
+        return detail::all_pass(a, b, detail::ulp_test<T>{max_ulps});
+    }
+
+    /**
+     * @brief Finds every element of a not within atol + rtol |b| of the
+     * element of b
+     *
+     * @return mismatch_report The count, and the first and worst mismatch
+     * @throws invalid_dimension if the shapes differ
+     */
+    template <class T>
+    mismatch_report compare_close(const matrix<T> &a, const matrix<T> &b, T rtol = static_cast<T>(1e-5),
+                                  T atol = static_cast<T>(1e-8))
+    {
+        return detail::report_failures(a, b, detail::close_test<T>{rtol, atol});
+    }
+
+    /**
+     * @brief Finds every element of a more than max_ulps representable
+     * values from the element of b
+     *
+     * @return mismatch_report The count, and the first and worst mismatch
+     * @throws invalid_dimension if the shapes differ
+     */
+    template <class T>
+    mismatch_report compare_ulps(const matrix<T> &a, const matrix<T> &b, uint64_t max_ulps)
+    {
+        return detail::report_failures(a, b, detail::ulp_test<T>{max_ulps});
+    }
+}
+
+#endif
@@ -0,0 +1,240 @@
+/**
+ * @file complex_gemm.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Complex matrix multiply on split real and imaginary storage
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * std::complex<T> stores real and imaginary parts interleaved, which
+ * forces shuffles into every SIMD multiply. These kernels first split each
+ * operand into separate real and imaginary planes (with the right hand
+ * operand transposed so its columns are contiguous), after which every
+ * product is a handful of real dot products that vectorize like any other
+ * real loop.
+ */
+
+#ifndef _COMPLEX_GEMM_H_
+#define _COMPLEX_GEMM_H_
+
+#include <complex>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief How to form complex products from real ones
+     *
+     */
+    enum class complex_algorithm
+    {
+        /**
+         * Four real products per complex product:
+         * re = ar*br - ai*bi, im = ar*bi + ai*br
+         */
+        conventional,
+
+        /**
+         * Three real products per complex product (the 3M method):
+         * t1 = ar*br, t2 = ai*bi, t3 = (ar+ai)*(br+bi),
+         * re = t1 - t2, im = t3 - t1 - t2.
+         * Does 25% fewer multiplies, but the imaginary part is computed by
+         * cancellation so its error is relative to |a||b| rather than to
+         * the imaginary part itself.
+         */
+        three_m
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Real and imaginary planes of a complex matrix, stored row
+         * major and contiguous. For the 3M method the sum of the two planes
+         * is stored as well.
+         */
+        template <class T>
+        struct split_complex
+        {
+            size_t rows;
+            size_t cols;
+            std::vector<T> re;
+            std::vector<T> im;
+            std::vector<T> sum;
+
+            split_complex(size_t r, size_t c, bool with_sum)
+            : rows(r), cols(c), re(r * c), im(r * c), sum(with_sum ? r * c : 0)
+            {
+            }
+
+            void set(size_t i, size_t j, const std::complex<T> &v)
+            {
+                re[i * cols + j] = v.real();
+                im[i * cols + j] = v.imag();
+                if (!sum.empty())
+                {
+                    sum[i * cols + j] = v.real() + v.imag();
+                }
+            }
+        };
+
+        /**
+         * @brief Splits a complex matrix, optionally transposing it
+         */
+        template <class T>
+        split_complex<T> split(const matrix<std::complex<T>> &m, bool transpose, bool with_sum)
+        {
+            split_complex<T> result(transpose ? m.cols() : m.rows(), transpose ? m.rows() : m.cols(), with_sum);
+            for (size_t i = 0; i < m.rows(); i++)
+            {
+                const std::complex<T> *row = m[i].data();
+                for (size_t j = 0; j < m.cols(); j++)
+                {
+                    if (transpose)
+                    {
+                        result.set(j, i, row[j]);
+                    }
+                    else
+                    {
+                        result.set(i, j, row[j]);
+                    }
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Number of independent partial sums per dot product, so
+         * that the reductions vectorize without reassociation flags
+         */
+        const size_t complex_lanes = 8;
+
+        /**
+         * @brief Fused conventional kernel: the four real dot products of one
+         * complex product in a single pass over k
+         */
+        template <class T>
+        std::complex<T> dot_conventional(const T *ar, const T *ai, const T *br, const T *bi, size_t k)
+        {
+            T rr[complex_lanes] = {}, ii[complex_lanes] = {}, ri[complex_lanes] = {}, ir[complex_lanes] = {};
+            size_t p = 0;
+            for (; p + complex_lanes <= k; p += complex_lanes)
+            {
+                for (size_t l = 0; l < complex_lanes; l++)
+                {
+                    rr[l] += ar[p + l] * br[p + l];
+                    ii[l] += ai[p + l] * bi[p + l];
+                    ri[l] += ar[p + l] * bi[p + l];
+                    ir[l] += ai[p + l] * br[p + l];
+                }
+            }
+            for (; p < k; p++)
+            {
+                rr[0] += ar[p] * br[p];
+                ii[0] += ai[p] * bi[p];
+                ri[0] += ar[p] * bi[p];
+                ir[0] += ai[p] * br[p];
+            }
+
+            T re = T(), im = T();
+            for (size_t l = 0; l < complex_lanes; l++)
+            {
+                re += rr[l] - ii[l];
+                im += ri[l] + ir[l];
+            }
+            return std::complex<T>(re, im);
+        }
+
+        /**
+         * @brief Fused 3M kernel: three real dot products per complex product
+         */
+        template <class T>
+        std::complex<T> dot_three_m(const T *ar, const T *ai, const T *as,
+                                    const T *br, const T *bi, const T *bs, size_t k)
+        {
+            T t1[complex_lanes] = {}, t2[complex_lanes] = {}, t3[complex_lanes] = {};
+            size_t p = 0;
+            for (; p + complex_lanes <= k; p += complex_lanes)
+            {
+                for (size_t l = 0; l < complex_lanes; l++)
+                {
+                    t1[l] += ar[p + l] * br[p + l];
+                    t2[l] += ai[p + l] * bi[p + l];
+                    t3[l] += as[p + l] * bs[p + l];
+                }
+            }
+            for (; p < k; p++)
+            {
+                t1[0] += ar[p] * br[p];
+                t2[0] += ai[p] * bi[p];
+                t3[0] += as[p] * bs[p];
+            }
+
+            T s1 = T(), s2 = T(), s3 = T();
+            for (size_t l = 0; l < complex_lanes; l++)
+            {
+                s1 += t1[l];
+                s2 += t2[l];
+                s3 += t3[l];
+            }
+            return std::complex<T>(s1 - s2, s3 - s1 - s2);
+        }
+    }
+
+    /**
+     * @brief Computes the product of two complex matrices using split real
+     * and imaginary storage
+     *
+     * @tparam T The real type (float, double or long double)
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @param algorithm Whether to use four or three real products per complex product
+     * @return matrix<std::complex<T>> The computed matrix product
+     */
+    template <class T>
+    matrix<std::complex<T>> multiply_complex(const matrix<std::complex<T>> &m1,
+                                             const matrix<std::complex<T>> &m2,
+                                             complex_algorithm algorithm = complex_algorithm::conventional)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+
+        const bool three_m = algorithm == complex_algorithm::three_m;
+        const size_t k = m1.cols();
+        detail::split_complex<T> a = detail::split(m1, false, three_m);
+        detail::split_complex<T> b_T = detail::split(m2, true, three_m);
+
+        matrix<std::complex<T>> result(m1.rows(), m2.cols());
+        for (size_t i = 0; i < m1.rows(); i++)
+        {
+            const T *ar = &a.re[i * k];
+            const T *ai = &a.im[i * k];
+            std::vector<std::complex<T>> &out = result[i];
+            for (size_t j = 0; j < m2.cols(); j++)
+            {
+                const T *br = &b_T.re[j * k];
+                const T *bi = &b_T.im[j * k];
+                if (three_m)
+                {
+                    out[j] = detail::dot_three_m(ar, ai, &a.sum[i * k], br, bi, &b_T.sum[j * k], k);
+                }
+                else
+                {
+                    out[j] = detail::dot_conventional(ar, ai, br, bi, k);
+                }
+            }
+        }
+        return result;
+    }
+}
+
+#endif
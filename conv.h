@@ -0,0 +1,403 @@
+/**
+ * @file conv.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief 2D convolution without an im2col buffer
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * A multi-channel image is a std::vector of equally sized matrices, one
+ * per channel. Weights are one row per output channel, laid out like an
+ * im2col row: input channel, then kernel row, then kernel column.
+ *
+ * Convolution is the product of the weights with the matrix of input
+ * patches. Rather than expanding that matrix in memory (kernel area times
+ * the size of the input), the implicit GEMM path hands the multiply kernel
+ * a source that computes patch elements as they are packed. 3x3 kernels
+ * with stride 1 can instead use Winograd's F(2x2, 3x3), which produces
+ * each 2x2 output tile with 16 multiplies instead of 36.
+ */
+
+#ifndef _CONV_H_
+#define _CONV_H_
+
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief The shape of a convolution
+     *
+     */
+    struct conv_params
+    {
+        size_t kernel_rows;
+        size_t kernel_cols;
+        size_t stride;
+        size_t padding;
+
+        /**
+         * @brief Construct new convolution parameters
+         *
+         * @param kernel_rows Height of the kernel
+         * @param kernel_cols Width of the kernel
+         * @param stride Step between output positions, in both directions
+         * @param padding Zeros added on every side of the input
+         */
+        conv_params(size_t kernel_rows, size_t kernel_cols, size_t stride = 1, size_t padding = 0)
+        : kernel_rows(kernel_rows), kernel_cols(kernel_cols), stride(stride), padding(padding)
+        {
+        }
+    };
+
+    /**
+     * @brief How to compute a convolution
+     *
+     */
+    enum class conv_algorithm
+    {
+        /**
+         * Winograd where it applies, implicit GEMM otherwise
+         */
+        automatic,
+
+        /**
+         * The weights times input patches, formed while packing
+         */
+        implicit_gemm,
+
+        /**
+         * F(2x2, 3x3). Only for floating point 3x3 kernels with stride 1.
+         * Rounding differs slightly from the direct sum.
+         */
+        winograd
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief The patch matrix of an image, seen by the multiply kernel
+         * as a (channels * kernel area) x (output positions) matrix without
+         * being formed. Index arithmetic is tabulated up front so packing
+         * does no division.
+         */
+        template <class T>
+        class patch_source
+        {
+          private:
+            const std::vector<matrix<T>> &_input;
+            std::vector<size_t> _channel;
+            std::vector<long> _row_offset;
+            std::vector<long> _col_offset;
+            std::vector<long> _out_row;
+            std::vector<long> _out_col;
+
+          public:
+            patch_source(const std::vector<matrix<T>> &input, const conv_params &params, size_t out_rows,
+                         size_t out_cols)
+            : _input(input)
+            {
+                for (size_t c = 0; c < input.size(); c++)
+                {
+                    for (size_t ky = 0; ky < params.kernel_rows; ky++)
+                    {
+                        for (size_t kx = 0; kx < params.kernel_cols; kx++)
+                        {
+                            _channel.push_back(c);
+                            _row_offset.push_back(static_cast<long>(ky) - static_cast<long>(params.padding));
+                            _col_offset.push_back(static_cast<long>(kx) - static_cast<long>(params.padding));
+                        }
+                    }
+                }
+                for (size_t oy = 0; oy < out_rows; oy++)
+                {
+                    for (size_t ox = 0; ox < out_cols; ox++)
+                    {
+                        _out_row.push_back(static_cast<long>(oy * params.stride));
+                        _out_col.push_back(static_cast<long>(ox * params.stride));
+                    }
+                }
+            }
+
+            size_t rows() const
+            {
+                return _channel.size();
+            }
+
+            size_t cols() const
+            {
+                return _out_row.size();
+            }
+
+            T operator()(size_t k, size_t p) const
+            {
+                const matrix<T> &image = _input[_channel[k]];
+                const long y = _out_row[p] + _row_offset[k];
+                const long x = _out_col[p] + _col_offset[k];
+                if (y < 0 || x < 0 || y >= static_cast<long>(image.rows()) || x >= static_cast<long>(image.cols()))
+                {
+                    return T();
+                }
+                return image(static_cast<size_t>(y), static_cast<size_t>(x));
+            }
+        };
+
+        /**
+         * @brief Stores output positions into per channel output matrices
+         */
+        template <class T>
+        class channel_writer
+        {
+          private:
+            std::vector<std::vector<T> *> _rows;
+            size_t _out_rows;
+            size_t _out_cols;
+
+          public:
+            channel_writer(std::vector<matrix<T>> &output)
+            : _out_rows(output[0].rows()), _out_cols(output[0].cols())
+            {
+                for (matrix<T> &channel : output)
+                {
+                    for (size_t i = 0; i < channel.rows(); i++)
+                    {
+                        _rows.push_back(&channel[i]);
+                    }
+                }
+            }
+
+            template <class V>
+            void operator()(size_t channel, size_t position, const V &value)
+            {
+                (*_rows[channel * _out_rows + position / _out_cols])[position % _out_cols] = static_cast<T>(value);
+            }
+        };
+
+        /**
+         * @brief d -> B^T d, along one line of 4 with the given stride
+         */
+        template <class T>
+        void winograd_input(const T *d, size_t s, T *out, size_t os)
+        {
+            out[0] = d[0] - d[2 * s];
+            out[os] = d[s] + d[2 * s];
+            out[2 * os] = d[2 * s] - d[s];
+            out[3 * os] = d[s] - d[3 * s];
+        }
+
+        /**
+         * @brief g -> G g, from a line of 3 to a line of 4
+         */
+        template <class T>
+        void winograd_kernel(const T *g, size_t s, T *out, size_t os)
+        {
+            out[0] = g[0];
+            out[os] = (g[0] + g[s] + g[2 * s]) / 2;
+            out[2 * os] = (g[0] - g[s] + g[2 * s]) / 2;
+            out[3 * os] = g[2 * s];
+        }
+
+        /**
+         * @brief m -> A^T m, from a line of 4 to a line of 2
+         */
+        template <class T>
+        void winograd_output(const T *m, size_t s, T *out, size_t os)
+        {
+            out[0] = m[0] + m[s] + m[2 * s];
+            out[os] = m[s] - m[2 * s] - m[3 * s];
+        }
+
+        /**
+         * @brief F(2x2, 3x3): transform the kernels and the 4x4 input
+         * tiles, then for each of the 16 transformed positions multiply
+         * (output channels x input channels) by (input channels x tiles)
+         * with the blocked kernel, then transform back
+         */
+        template <class T>
+        void winograd_convolve(const std::vector<matrix<T>> &input, const matrix<T> &weights, size_t padding,
+                               std::vector<matrix<T>> &output)
+        {
+            const size_t channels = input.size(), filters = weights.rows();
+            const size_t out_rows = output[0].rows(), out_cols = output[0].cols();
+            const size_t tile_rows = (out_rows + 1) / 2, tile_cols = (out_cols + 1) / 2;
+            const size_t tiles = tile_rows * tile_cols;
+            const long height = static_cast<long>(input[0].rows()), width = static_cast<long>(input[0].cols());
+
+            // u[e] is filters x channels, v[e] is channels x tiles
+            std::vector<T> u(16 * filters * channels), v(16 * channels * tiles), m(16 * filters * tiles);
+            for (size_t f = 0; f < filters; f++)
+            {
+                for (size_t c = 0; c < channels; c++)
+                {
+                    T g[9], gg[12], transformed[16];
+                    for (size_t i = 0; i < 9; i++)
+                    {
+                        g[i] = weights(f, c * 9 + i);
+                    }
+                    for (size_t col = 0; col < 3; col++)
+                    {
+                        winograd_kernel(g + col, 3, gg + col, 3);
+                    }
+                    for (size_t row = 0; row < 4; row++)
+                    {
+                        winograd_kernel(gg + row * 3, 1, transformed + row * 4, 1);
+                    }
+                    for (size_t e = 0; e < 16; e++)
+                    {
+                        u[(e * filters + f) * channels + c] = transformed[e];
+                    }
+                }
+            }
+
+            for (size_t c = 0; c < channels; c++)
+            {
+                for (size_t ty = 0; ty < tile_rows; ty++)
+                {
+                    for (size_t tx = 0; tx < tile_cols; tx++)
+                    {
+                        T d[16], bd[16], transformed[16];
+                        for (long y = 0; y < 4; y++)
+                        {
+                            for (long x = 0; x < 4; x++)
+                            {
+                                const long iy = static_cast<long>(2 * ty) + y - static_cast<long>(padding);
+                                const long ix = static_cast<long>(2 * tx) + x - static_cast<long>(padding);
+                                d[y * 4 + x] = (iy < 0 || ix < 0 || iy >= height || ix >= width)
+                                                   ? T()
+                                                   : input[c](static_cast<size_t>(iy), static_cast<size_t>(ix));
+                            }
+                        }
+                        for (size_t col = 0; col < 4; col++)
+                        {
+                            winograd_input(d + col, 4, bd + col, 4);
+                        }
+                        for (size_t row = 0; row < 4; row++)
+                        {
+                            winograd_input(bd + row * 4, 1, transformed + row * 4, 1);
+                        }
+                        const size_t t = ty * tile_cols + tx;
+                        for (size_t e = 0; e < 16; e++)
+                        {
+                            v[(e * channels + c) * tiles + t] = transformed[e];
+                        }
+                    }
+                }
+            }
+
+            for (size_t e = 0; e < 16; e++)
+            {
+                const array_source<T> ue = {&u[e * filters * channels], filters, channels};
+                const array_source<T> ve = {&v[e * channels * tiles], channels, tiles};
+                array_writer<T> me = {&m[e * filters * tiles], tiles};
+                gemm<plus_times<T>>(ue, ve, me);
+            }
+
+            for (size_t f = 0; f < filters; f++)
+            {
+                matrix<T> &out = output[f];
+                for (size_t ty = 0; ty < tile_rows; ty++)
+                {
+                    for (size_t tx = 0; tx < tile_cols; tx++)
+                    {
+                        const size_t t = ty * tile_cols + tx;
+                        T mt[16], am[8], y[4];
+                        for (size_t e = 0; e < 16; e++)
+                        {
+                            mt[e] = m[(e * filters + f) * tiles + t];
+                        }
+                        for (size_t col = 0; col < 4; col++)
+                        {
+                            winograd_output(mt + col, 4, am + col, 4);
+                        }
+                        for (size_t row = 0; row < 2; row++)
+                        {
+                            winograd_output(am + row * 4, 1, y + row * 2, 1);
+                        }
+                        for (size_t dy = 0; dy < 2 && 2 * ty + dy < out_rows; dy++)
+                        {
+                            for (size_t dx = 0; dx < 2 && 2 * tx + dx < out_cols; dx++)
+                            {
+                                out[2 * ty + dy][2 * tx + dx] = y[dy * 2 + dx];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Convolves a multi-channel image with a bank of filters
+     * (cross-correlation, as in CNNs: the kernel is not flipped)
+     *
+     * @tparam T The type of data in the matrices
+     * @param input One matrix per input channel, all the same size
+     * @param weights One row per output channel, of input channels *
+     * kernel_rows * kernel_cols weights ordered channel, row, column
+     * @param params The kernel size, stride and padding
+     * @param algorithm Which method to use
+     * @return std::vector<matrix<T>> One matrix per output channel
+     */
+    template <class T>
+    std::vector<matrix<T>> convolve(const std::vector<matrix<T>> &input, const matrix<T> &weights,
+                                    const conv_params &params,
+                                    conv_algorithm algorithm = conv_algorithm::automatic)
+    {
+        if (input.empty() || input[0].rows() == 0 || weights.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        for (const matrix<T> &channel : input)
+        {
+            if (channel.rows() != input[0].rows() || channel.cols() != input[0].cols())
+            {
+                throw invalid_dimension("Input channels differ in size");
+            }
+        }
+        const size_t patch = input.size() * params.kernel_rows * params.kernel_cols;
+        if (weights.cols() != patch)
+        {
+            throw invalid_dimension(weights.cols(), patch);
+        }
+        if (params.stride == 0 || params.kernel_rows == 0 || params.kernel_cols == 0)
+        {
+            throw std::invalid_argument("Kernel size and stride must be nonzero");
+        }
+        const size_t padded_rows = input[0].rows() + 2 * params.padding;
+        const size_t padded_cols = input[0].cols() + 2 * params.padding;
+        if (padded_rows < params.kernel_rows || padded_cols < params.kernel_cols)
+        {
+            throw invalid_dimension("Kernel is larger than the padded input");
+        }
+
+        const size_t out_rows = (padded_rows - params.kernel_rows) / params.stride + 1;
+        const size_t out_cols = (padded_cols - params.kernel_cols) / params.stride + 1;
+        std::vector<matrix<T>> output(weights.rows(), matrix<T>(out_rows, out_cols));
+
+        const bool winograd_applies = std::is_floating_point<T>::value && params.kernel_rows == 3 &&
+                                      params.kernel_cols == 3 && params.stride == 1;
+        if (algorithm == conv_algorithm::winograd && !winograd_applies)
+        {
+            throw std::invalid_argument("Winograd needs a floating point 3x3 kernel with stride 1");
+        }
+
+        if (algorithm != conv_algorithm::implicit_gemm && winograd_applies)
+        {
+            detail::winograd_convolve(input, weights, params.padding, output);
+        }
+        else
+        {
+            detail::patch_source<T> patches(input, params, out_rows, out_cols);
+            detail::channel_writer<T> out(output);
+            detail::gemm<plus_times<T>>(weights, patches, out);
+        }
+        return output;
+    }
+}
+
+#endif
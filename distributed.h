@@ -0,0 +1,821 @@
+/**
+ * @file distributed.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Matrices distributed block-cyclically over ranks, and LU
+ * factorization of them
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * A distributed_matrix is split into block x block blocks dealt out over a
+ * process_grid (see summa.h) like cards: block (I, J) lives on grid
+ * position (I mod grid rows, J mod grid cols). Each rank stores its blocks
+ * as one row major local matrix. The cyclic deal keeps every rank busy as
+ * a factorization works its way down the diagonal, which a plain block
+ * split would not.
+ *
+ * Everything here runs on every rank at once, SPMD style, inside
+ * run_local_processes() or anything else that provides a transport:
+ *
+ *     run_local_processes(4, [&](transport &t) {
+ *         process_grid grid(t.size());
+ *         auto d = distributed_matrix<double>::scatter(t, grid, a, 64);
+ *         distributed_lu_result lu = lu_factor(d);
+ *         matrix<double> factors = d.gather();    // on rank 0
+ *     });
+ */
+
+#ifndef _DISTRIBUTED_H_
+#define _DISTRIBUTED_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "linalg.h"
+#include "matrix.h"
+#include "summa.h"
+
+namespace codesample
+{
+    namespace detail
+    {
+        /**
+         * @brief One dimension of a block-cyclic distribution: n indices in
+         * blocks of block, dealt over procs ranks
+         */
+        struct block_cyclic
+        {
+            size_t n;
+            size_t block;
+            size_t procs;
+
+            size_t owner(size_t i) const
+            {
+                return (i / block) % procs;
+            }
+
+            /**
+             * @brief The index of global index i on its owner
+             */
+            size_t local(size_t i) const
+            {
+                return i / (block * procs) * block + i % block;
+            }
+
+            /**
+             * @brief The global index of local index li on rank p
+             */
+            size_t global(size_t li, size_t p) const
+            {
+                return (li / block * procs + p) * block + li % block;
+            }
+
+            /**
+             * @brief How many of rank p's indices are below i, which is
+             * also the local index of the first one at or after i
+             */
+            size_t local_before(size_t i, size_t p) const
+            {
+                const size_t cycle = block * procs;
+                const size_t start = p * block, rest = i % cycle;
+                return i / cycle * block + (rest > start ? std::min(block, rest - start) : 0);
+            }
+
+            size_t count(size_t p) const
+            {
+                return local_before(n, p);
+            }
+        };
+
+        /**
+         * @brief Runs a function on another thread and waits for it,
+         * passing on what it throws
+         */
+        class background_task
+        {
+          private:
+            std::thread _thread;
+            std::exception_ptr _error;
+
+          public:
+            template <class F>
+            void start(const F &f)
+            {
+                wait();
+                _thread = std::thread([this, f]() {
+                    try
+                    {
+                        f();
+                    }
+                    catch (...)
+                    {
+                        _error = std::current_exception();
+                    }
+                });
+            }
+
+            void wait()
+            {
+                if (_thread.joinable())
+                {
+                    _thread.join();
+                }
+                if (_error)
+                {
+                    std::exception_ptr error = _error;
+                    _error = nullptr;
+                    std::rethrow_exception(error);
+                }
+            }
+
+            ~background_task()
+            {
+                if (_thread.joinable())
+                {
+                    _thread.join();
+                }
+            }
+        };
+
+        /**
+         * @brief Swaps count elements with the same buffer on rank other
+         * through t; the lower rank sends first
+         */
+        template <class T>
+        void exchange(transport &t, size_t other, T *data, size_t count)
+        {
+            std::vector<T> theirs(count);
+            if (t.rank() < other)
+            {
+                t.send(other, data, count * sizeof(T));
+                t.receive(other, theirs.data(), count * sizeof(T));
+            }
+            else
+            {
+                t.receive(other, theirs.data(), count * sizeof(T));
+                t.send(other, data, count * sizeof(T));
+            }
+            std::copy(theirs.begin(), theirs.end(), data);
+        }
+    }
+
+    /**
+     * @brief A matrix dealt block-cyclically over the ranks of a transport.
+     * Each rank holds only its own blocks; every method is collective, so
+     * all ranks call it together, except the local accessors.
+     *
+     * @tparam T The type of data in the matrix
+     */
+    template <class T>
+    class distributed_matrix
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Distributed elements are sent as bytes");
+
+      private:
+        transport *_t;
+        process_grid _grid;
+        detail::block_cyclic _row_layout;
+        detail::block_cyclic _col_layout;
+        size_t _row;
+        size_t _col;
+        std::vector<T> _local;
+
+        /**
+         * @brief Calls f(li, lj, di, dj) for each element of sender's
+         * local matrix that target's local matrix in dst holds, in the
+         * sender's row major order: li, lj index the sender's storage and
+         * di, dj the target's. transposed maps (i, j) to (j, i).
+         */
+        template <class F>
+        void for_each_sent(size_t sender, size_t target, const distributed_matrix &dst, bool transposed,
+                           const F &f) const
+        {
+            const size_t sr = sender / _grid.cols, sc = sender % _grid.cols;
+            const size_t tr = target / dst._grid.cols, tc = target % dst._grid.cols;
+            // the target dimension each source dimension lands in
+            const detail::block_cyclic &by_row = transposed ? dst._col_layout : dst._row_layout;
+            const detail::block_cyclic &by_col = transposed ? dst._row_layout : dst._col_layout;
+            const size_t want_row = transposed ? tc : tr, want_col = transposed ? tr : tc;
+            const size_t rows = _row_layout.count(sr), cols = _col_layout.count(sc);
+            for (size_t li = 0; li < rows; li++)
+            {
+                const size_t gi = _row_layout.global(li, sr);
+                if (by_row.owner(gi) != want_row)
+                {
+                    continue;
+                }
+                for (size_t lj = 0; lj < cols; lj++)
+                {
+                    const size_t gj = _col_layout.global(lj, sc);
+                    if (by_col.owner(gj) != want_col)
+                    {
+                        continue;
+                    }
+                    const size_t di = by_row.local(gi), dj = by_col.local(gj);
+                    f(li, lj, transposed ? dj : di, transposed ? di : dj);
+                }
+            }
+        }
+
+        /**
+         * @brief Builds a copy in another layout, every pair of ranks
+         * exchanging what the other needs. Pairs go in one fixed order on
+         * every rank, which keeps the synchronous sends from deadlocking.
+         */
+        distributed_matrix remap(const process_grid &grid, size_t block, bool transposed) const
+        {
+            distributed_matrix result(*_t, grid, transposed ? cols() : rows(), transposed ? rows() : cols(), block);
+            const size_t me = _t->rank(), ranks = _t->size();
+            const auto send_to = [&](size_t q) {
+                std::vector<T> buffer;
+                for_each_sent(me, q, result, transposed,
+                              [&](size_t li, size_t lj, size_t, size_t) { buffer.push_back(local(li, lj)); });
+                if (!buffer.empty())
+                {
+                    _t->send(q, buffer.data(), buffer.size() * sizeof(T));
+                }
+            };
+            const auto receive_from = [&](size_t s) {
+                std::vector<size_t> positions;
+                for_each_sent(s, me, result, transposed, [&](size_t, size_t, size_t di, size_t dj) {
+                    positions.push_back(di * result.local_cols() + dj);
+                });
+                std::vector<T> buffer(positions.size());
+                if (!buffer.empty())
+                {
+                    _t->receive(s, buffer.data(), buffer.size() * sizeof(T));
+                }
+                for (size_t p = 0; p < positions.size(); p++)
+                {
+                    result._local[positions[p]] = buffer[p];
+                }
+            };
+
+            for_each_sent(me, me, result, transposed, [&](size_t li, size_t lj, size_t di, size_t dj) {
+                result.local(di, dj) = local(li, lj);
+            });
+            for (size_t a = 0; a < ranks; a++)
+            {
+                for (size_t b = a + 1; b < ranks; b++)
+                {
+                    if (me == a)
+                    {
+                        send_to(b);
+                        receive_from(b);
+                    }
+                    else if (me == b)
+                    {
+                        receive_from(a);
+                        send_to(a);
+                    }
+                }
+            }
+            return result;
+        }
+
+      public:
+        /**
+         * @brief Construct a new distributed matrix of zeros
+         *
+         * @param t The transport, which must outlive the matrix
+         * @param grid The grid of ranks, with as many positions as t has ranks
+         * @param rows The number of rows
+         * @param cols The number of columns
+         * @param block The side of each block
+         */
+        distributed_matrix(transport &t, const process_grid &grid, size_t rows, size_t cols, size_t block = 64)
+        : _t(&t), _grid(grid), _row_layout{rows, block, grid.rows}, _col_layout{cols, block, grid.cols},
+          _row(t.rank() / grid.cols), _col(t.rank() % grid.cols)
+        {
+            if (grid.rows * grid.cols != t.size())
+            {
+                throw invalid_dimension(grid.rows * grid.cols, t.size());
+            }
+            if (block == 0)
+            {
+                throw std::invalid_argument("Block size must be nonzero");
+            }
+            _local.resize(local_rows() * local_cols());
+        }
+
+        /**
+         * @brief Deals out a matrix held by rank 0
+         *
+         * @param t The transport
+         * @param grid The grid of ranks
+         * @param m The matrix on rank 0; ignored on the other ranks
+         * @param block The side of each block
+         * @return distributed_matrix The distributed copy, on every rank
+         */
+        static distributed_matrix scatter(transport &t, const process_grid &grid, const matrix<T> &m,
+                                          size_t block = 64)
+        {
+            std::vector<size_t> everyone(t.size());
+            for (size_t r = 0; r < everyone.size(); r++)
+            {
+                everyone[r] = r;
+            }
+            uint64_t shape[2] = {m.rows(), m.cols()};
+            t.broadcast(everyone, 0, shape, sizeof(shape));
+            distributed_matrix result(t, grid, shape[0], shape[1], block);
+            if (t.rank() != 0)
+            {
+                if (!result._local.empty())
+                {
+                    t.receive(0, result._local.data(), result._local.size() * sizeof(T));
+                }
+                return result;
+            }
+
+            for (size_t q = t.size(); q-- > 0;)
+            {
+                const size_t qr = q / grid.cols, qc = q % grid.cols;
+                const size_t rows = result._row_layout.count(qr), cols = result._col_layout.count(qc);
+                std::vector<T> piece(rows * cols);
+                for (size_t li = 0; li < rows; li++)
+                {
+                    const std::vector<T> &row = m[result._row_layout.global(li, qr)];
+                    for (size_t lj = 0; lj < cols; lj++)
+                    {
+                        piece[li * cols + lj] = row[result._col_layout.global(lj, qc)];
+                    }
+                }
+                if (q == 0)
+                {
+                    result._local.swap(piece);
+                }
+                else if (!piece.empty())
+                {
+                    t.send(q, piece.data(), piece.size() * sizeof(T));
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Collects the whole matrix on rank 0
+         *
+         * @return matrix<T> The matrix on rank 0, an empty one elsewhere
+         */
+        matrix<T> gather() const
+        {
+            if (_t->rank() != 0)
+            {
+                if (!_local.empty())
+                {
+                    _t->send(0, _local.data(), _local.size() * sizeof(T));
+                }
+                return matrix<T>();
+            }
+
+            matrix<T> result(rows(), cols());
+            for (size_t q = 0; q < _t->size(); q++)
+            {
+                const size_t qr = q / _grid.cols, qc = q % _grid.cols;
+                const size_t rows = _row_layout.count(qr), cols = _col_layout.count(qc);
+                std::vector<T> piece(rows * cols);
+                if (q == 0)
+                {
+                    piece = _local;
+                }
+                else if (!piece.empty())
+                {
+                    _t->receive(q, piece.data(), piece.size() * sizeof(T));
+                }
+                for (size_t li = 0; li < rows; li++)
+                {
+                    std::vector<T> &row = result[_row_layout.global(li, qr)];
+                    for (size_t lj = 0; lj < cols; lj++)
+                    {
+                        row[_col_layout.global(lj, qc)] = piece[li * cols + lj];
+                    }
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Copies this matrix into another grid or block size
+         *
+         * @param grid The new grid, over the same ranks
+         * @param block The new block size
+         * @return distributed_matrix The copy
+         */
+        distributed_matrix redistribute(const process_grid &grid, size_t block) const
+        {
+            return remap(grid, block, false);
+        }
+
+        /**
+         * @brief Computes the transpose, on the same grid and block size
+         *
+         * @return distributed_matrix The transpose
+         */
+        distributed_matrix transpose() const
+        {
+            return remap(_grid, block_size(), true);
+        }
+
+        size_t rows() const
+        {
+            return _row_layout.n;
+        }
+
+        size_t cols() const
+        {
+            return _col_layout.n;
+        }
+
+        size_t block_size() const
+        {
+            return _row_layout.block;
+        }
+
+        const process_grid &grid() const
+        {
+            return _grid;
+        }
+
+        transport &get_transport() const
+        {
+            return *_t;
+        }
+
+        /**
+         * @brief This rank's position in the grid
+         */
+        size_t grid_row() const
+        {
+            return _row;
+        }
+
+        size_t grid_col() const
+        {
+            return _col;
+        }
+
+        const detail::block_cyclic &row_layout() const
+        {
+            return _row_layout;
+        }
+
+        const detail::block_cyclic &col_layout() const
+        {
+            return _col_layout;
+        }
+
+        /**
+         * @brief The shape of this rank's local matrix
+         */
+        size_t local_rows() const
+        {
+            return _row_layout.count(_row);
+        }
+
+        size_t local_cols() const
+        {
+            return _col_layout.count(_col);
+        }
+
+        /**
+         * @brief This rank's local matrix, local_rows() x local_cols() row
+         * major. Local row li is global row row_layout().global(li, grid_row()).
+         */
+        T *local_data()
+        {
+            return _local.data();
+        }
+
+        const T *local_data() const
+        {
+            return _local.data();
+        }
+
+        T &local(size_t li, size_t lj)
+        {
+            return _local[li * local_cols() + lj];
+        }
+
+        const T &local(size_t li, size_t lj) const
+        {
+            return _local[li * local_cols() + lj];
+        }
+    };
+
+    /**
+     * @brief The row interchanges of a distributed LU factorization
+     *
+     */
+    struct distributed_lu_result
+    {
+        /**
+         * Row i of PA is row permutation[i] of A
+         */
+        std::vector<size_t> permutation;
+
+        /**
+         * Whether a pivot was exactly zero
+         */
+        bool singular;
+    };
+
+    namespace detail
+    {
+        template <class T>
+        struct pivot_candidate
+        {
+            T magnitude;
+            uint64_t row;
+
+            bool better_than(const pivot_candidate &other) const
+            {
+                return magnitude > other.magnitude || (magnitude == other.magnitude && row < other.row);
+            }
+        };
+
+        /**
+         * @brief Swaps global rows r1 and r2 in the given local columns on
+         * every rank of this grid column
+         */
+        template <class T>
+        void swap_rows(distributed_matrix<T> &a, size_t r1, size_t r2, const std::vector<size_t> &columns)
+        {
+            const detail::block_cyclic &rows = a.row_layout();
+            const size_t o1 = rows.owner(r1), o2 = rows.owner(r2), me = a.grid_row();
+            if (columns.empty() || (me != o1 && me != o2))
+            {
+                return;
+            }
+            if (o1 == o2)
+            {
+                for (size_t lj : columns)
+                {
+                    std::swap(a.local(rows.local(r1), lj), a.local(rows.local(r2), lj));
+                }
+                return;
+            }
+            const size_t mine = me == o1 ? r1 : r2, other = me == o1 ? o2 : o1;
+            std::vector<T> values(columns.size());
+            for (size_t c = 0; c < columns.size(); c++)
+            {
+                values[c] = a.local(rows.local(mine), columns[c]);
+            }
+            detail::exchange(a.get_transport(), a.grid().rank(other, a.grid_col()), values.data(), values.size());
+            for (size_t c = 0; c < columns.size(); c++)
+            {
+                a.local(rows.local(mine), columns[c]) = values[c];
+            }
+        }
+
+        /**
+         * @brief Factors global columns [k0, k1) from row k0 down, on the
+         * grid column that owns them. Swaps rows within the panel only, and
+         * returns the pivot rows and whether one was zero.
+         */
+        template <class T>
+        std::vector<uint64_t> factor_panel(distributed_matrix<T> &a, size_t k0, size_t k1)
+        {
+            transport &t = a.get_transport();
+            const detail::block_cyclic &rows = a.row_layout(), &cols = a.col_layout();
+            const size_t me = a.grid_row(), local_rows = a.local_rows(), w = k1 - k0;
+            const size_t lc0 = cols.local(k0);
+            const std::vector<size_t> group = a.grid().col_group(a.grid_col());
+            std::vector<size_t> panel_columns(w);
+            for (size_t c = 0; c < w; c++)
+            {
+                panel_columns[c] = lc0 + c;
+            }
+
+            std::vector<uint64_t> pivots(w + 1);
+            std::vector<T> pivot_row(w);
+            for (size_t c = k0; c < k1; c++)
+            {
+                const size_t lc = cols.local(c);
+                pivot_candidate<T> best = {T(), std::numeric_limits<uint64_t>::max()};
+                for (size_t li = rows.local_before(c, me); li < local_rows; li++)
+                {
+                    const pivot_candidate<T> here = {std::abs(a.local(li, lc)), rows.global(li, me)};
+                    if (here.better_than(best))
+                    {
+                        best = here;
+                    }
+                }
+                // the best over the grid column, gathered on its first rank
+                if (t.rank() == group[0])
+                {
+                    for (size_t g = 1; g < group.size(); g++)
+                    {
+                        pivot_candidate<T> theirs;
+                        t.receive(group[g], &theirs, sizeof(theirs));
+                        if (theirs.better_than(best))
+                        {
+                            best = theirs;
+                        }
+                    }
+                }
+                else
+                {
+                    t.send(group[0], &best, sizeof(best));
+                }
+                t.broadcast(group, group[0], &best, sizeof(best));
+
+                pivots[c - k0] = c;
+                if (best.magnitude == T())
+                {
+                    // nothing to eliminate with; carry on as lu_decomposition does
+                    pivots[w] = 1;
+                    continue;
+                }
+                pivots[c - k0] = best.row;
+                if (best.row != c)
+                {
+                    swap_rows(a, c, best.row, panel_columns);
+                }
+
+                const size_t owner = rows.owner(c);
+                if (me == owner)
+                {
+                    for (size_t cc = c; cc < k1; cc++)
+                    {
+                        pivot_row[cc - k0] = a.local(rows.local(c), lc0 + (cc - k0));
+                    }
+                }
+                t.broadcast(group, a.grid().rank(owner, a.grid_col()), &pivot_row[c - k0], (k1 - c) * sizeof(T));
+
+                const T diag = pivot_row[c - k0];
+                for (size_t li = rows.local_before(c + 1, me); li < local_rows; li++)
+                {
+                    T *row = &a.local(li, lc0);
+                    const T l = row[c - k0] /= diag;
+                    for (size_t cc = c + 1; cc < k1; cc++)
+                    {
+                        row[cc - k0] -= l * pivot_row[cc - k0];
+                    }
+                }
+            }
+            return pivots;
+        }
+    }
+
+    /**
+     * @brief Factors a square distributed matrix in place as PA = LU with
+     * partial pivoting, right-looking and blocked by the matrix's block
+     * size: L below the diagonal (unit diagonal implied) and U on and above
+     * it, the same factors as lu_decomposition. Collective.
+     *
+     * Each step factors a panel on its grid column, broadcasts the pivots
+     * and L along grid rows and U along grid columns, and updates the
+     * trailing matrix with the multiply kernel. The block column of the
+     * next panel is updated first and the rest on another thread, so the
+     * next panel's factorization and broadcasts overlap the bulk of the
+     * trailing update (one step of lookahead).
+     *
+     * @param a The matrix, overwritten by its factors
+     * @return distributed_lu_result The row permutation, on every rank
+     */
+    template <class T>
+    distributed_lu_result lu_factor(distributed_matrix<T> &a)
+    {
+        if (a.rows() == 0)
+        {
+            throw std::out_of_range("Can't factor matrix of size 0!");
+        }
+        if (a.rows() != a.cols())
+        {
+            throw invalid_dimension(a.rows(), a.cols());
+        }
+
+        transport &t = a.get_transport();
+        const process_grid &grid = a.grid();
+        const detail::block_cyclic &rows = a.row_layout(), &cols = a.col_layout();
+        const size_t n = a.rows(), nb = a.block_size(), me_row = a.grid_row(), me_col = a.grid_col();
+        const size_t local_rows = a.local_rows(), local_cols = a.local_cols();
+        T *data = a.local_data();
+
+        distributed_lu_result result;
+        result.singular = false;
+        result.permutation.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            result.permutation[i] = i;
+        }
+
+        detail::background_task trailing;
+        for (size_t k0 = 0; k0 < n; k0 += nb)
+        {
+            const size_t k1 = std::min(n, k0 + nb), w = k1 - k0;
+            const size_t panel_col = cols.owner(k0), panel_row = rows.owner(k0);
+
+            // the panel's block column was brought up to date first, so
+            // this overlaps the rest of the previous trailing update
+            std::vector<uint64_t> pivots(w + 1);
+            if (me_col == panel_col)
+            {
+                pivots = detail::factor_panel(a, k0, k1);
+            }
+            t.broadcast(grid.row_group(me_row), grid.rank(me_row, panel_col), pivots.data(),
+                        pivots.size() * sizeof(uint64_t));
+            result.singular = result.singular || pivots[w] != 0;
+            trailing.wait();
+
+            // apply the interchanges to the columns outside the panel
+            std::vector<size_t> other_columns;
+            const size_t lp0 = me_col == panel_col ? cols.local(k0) : local_cols;
+            for (size_t lj = 0; lj < local_cols; lj++)
+            {
+                if (lj < lp0 || lj >= lp0 + w)
+                {
+                    other_columns.push_back(lj);
+                }
+            }
+            for (size_t c = k0; c < k1; c++)
+            {
+                if (pivots[c - k0] != c)
+                {
+                    detail::swap_rows(a, c, pivots[c - k0], other_columns);
+                    std::swap(result.permutation[c], result.permutation[pivots[c - k0]]);
+                }
+            }
+            if (k1 == n)
+            {
+                break;
+            }
+
+            // L, from row k0 down, along grid rows
+            const size_t lr0 = rows.local_before(k0, me_row), lr1 = rows.local_before(k1, me_row);
+            std::vector<T> l_panel((local_rows - lr0) * w);
+            if (me_col == panel_col)
+            {
+                const size_t lc0 = cols.local(k0);
+                for (size_t li = lr0; li < local_rows; li++)
+                {
+                    std::copy(data + li * local_cols + lc0, data + li * local_cols + lc0 + w,
+                              &l_panel[(li - lr0) * w]);
+                }
+            }
+            if (!l_panel.empty())
+            {
+                t.broadcast(grid.row_group(me_row), grid.rank(me_row, panel_col), l_panel.data(),
+                            l_panel.size() * sizeof(T));
+            }
+
+            // U12 = L11^-1 A12 on the diagonal grid row, then along grid columns
+            const size_t lc1 = cols.local_before(k1, me_col), trailing_cols = local_cols - lc1;
+            std::vector<T> u_panel(w * trailing_cols);
+            if (me_row == panel_row && trailing_cols > 0)
+            {
+                T *a12 = data + lr0 * local_cols + lc1;
+                detail::solve_unit_lower(l_panel.data(), w, w, a12, local_cols, trailing_cols);
+                for (size_t i = 0; i < w; i++)
+                {
+                    std::copy(a12 + i * local_cols, a12 + i * local_cols + trailing_cols, &u_panel[i * trailing_cols]);
+                }
+            }
+            if (!u_panel.empty())
+            {
+                t.broadcast(grid.col_group(me_col), grid.rank(panel_row, me_col), u_panel.data(),
+                            u_panel.size() * sizeof(T));
+            }
+
+            // A22 -= L21 U12: the next panel's columns now, the rest behind
+            const size_t update_rows = local_rows - lr1;
+            if (update_rows == 0 || trailing_cols == 0)
+            {
+                continue;
+            }
+            // shared, so the panels live as long as the task using them
+            const std::shared_ptr<std::vector<T>> l_keep = std::make_shared<std::vector<T>>();
+            const std::shared_ptr<std::vector<T>> u_keep = std::make_shared<std::vector<T>>();
+            l_keep->swap(l_panel);
+            u_keep->swap(u_panel);
+            const auto update = [=](size_t j0, size_t j1) {
+                const matrix_ref<const T> l(l_keep->data() + (lr1 - lr0) * w, update_rows, w, w);
+                const matrix_ref<const T> u(u_keep->data() + j0, w, j1 - j0, trailing_cols);
+                detail::subtract_writer<T> out = {data + lr1 * local_cols + lc1 + j0, local_cols};
+                detail::gemm<plus_times<T>>(l, u, out);
+            };
+            const size_t next_cols = cols.owner(k1) == me_col ? std::min(nb, n - k1) : 0;
+            if (next_cols > 0)
+            {
+                update(0, next_cols);
+            }
+            if (next_cols < trailing_cols)
+            {
+                trailing.start([=]() { update(next_cols, trailing_cols); });
+            }
+        }
+        trailing.wait();
+        return result;
+    }
+}
+
+#endif
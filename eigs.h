@@ -0,0 +1,1136 @@
+/**
+ * @file eigs.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief A few dominant eigenpairs of large matrices: power iteration,
+ * Lanczos and implicitly restarted Arnoldi
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * The solvers only ever apply the matrix to vectors, so they take any
+ * linear operator: a type with rows() and apply(const T *x, T *y)
+ * computing y = A x. dense_operator wraps a matrix<T>, csr_matrix is a
+ * sparse one, and kronecker_operator (kron.h) works too. Overloads taking
+ * a matrix<T> wrap it for you.
+ *
+ * Apart from the operator, the work is on vectors as long as the matrix,
+ * and on the Krylov basis: the vector loops are fused so that each pass
+ * over memory does as much as it can, and split across threads once the
+ * vectors are long enough to pay for it. Projections onto the basis go
+ * through the multiply kernel.
+ */
+
+#ifndef _EIGS_H_
+#define _EIGS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "linalg.h"
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief Eigenvalues and unit eigenvectors from one of the iterative
+     * solvers, largest magnitude first
+     *
+     * @tparam V The type of the values: T, or std::complex<T> from arnoldi()
+     */
+    template <class V>
+    struct eigenpairs
+    {
+        std::vector<V> values;
+        std::vector<std::vector<V>> vectors;
+
+        /**
+         * The number of times the operator was applied
+         */
+        size_t matvecs;
+
+        /**
+         * Whether every pair met the tolerance
+         */
+        bool converged;
+    };
+
+    /**
+     * @brief A dense matrix as a linear operator. Holds a reference, so
+     * the matrix must outlive it.
+     *
+     * @tparam T The type of data in the matrix
+     */
+    template <class T>
+    class dense_operator
+    {
+      private:
+        const matrix<T> &_m;
+
+      public:
+        explicit dense_operator(const matrix<T> &m)
+        : _m(m)
+        {
+        }
+
+        size_t rows() const
+        {
+            return _m.rows();
+        }
+
+        size_t cols() const
+        {
+            return _m.cols();
+        }
+
+        /**
+         * @brief Computes y = A x through the multiply kernel's
+         * matrix-vector path
+         */
+        void apply(const T *x, T *y) const
+        {
+            const detail::array_source<T> x_source = {x, _m.cols(), 1};
+            detail::array_writer<T> out = {y, 1};
+            detail::gemm<plus_times<T>>(_m, x_source, out);
+        }
+    };
+
+    /**
+     * @brief A sparse matrix in compressed sparse row form
+     *
+     * @tparam T The type of data in the matrix
+     */
+    template <class T>
+    class csr_matrix
+    {
+      private:
+        size_t _rows;
+        size_t _cols;
+        std::vector<size_t> _row_start;
+        std::vector<size_t> _col_index;
+        std::vector<T> _values;
+
+      public:
+        /**
+         * @brief Construct a new sparse matrix from (row, column, value)
+         * triplets in any order. Values at the same position are summed.
+         *
+         * @param rows The number of rows
+         * @param cols The number of columns
+         * @param row_index The row of each value
+         * @param col_index The column of each value
+         * @param values The values
+         */
+        csr_matrix(size_t rows, size_t cols, const std::vector<size_t> &row_index,
+                   const std::vector<size_t> &col_index, const std::vector<T> &values)
+        : _rows(rows), _cols(cols), _row_start(rows + 1)
+        {
+            if (row_index.size() != values.size() || col_index.size() != values.size())
+            {
+                throw invalid_dimension(row_index.size() != values.size() ? row_index.size() : col_index.size(),
+                                        values.size());
+            }
+            for (size_t t = 0; t < values.size(); t++)
+            {
+                if (row_index[t] >= rows || col_index[t] >= cols)
+                {
+                    throw std::out_of_range("Sparse entry outside the matrix");
+                }
+            }
+
+            std::vector<size_t> order(values.size());
+            for (size_t t = 0; t < order.size(); t++)
+            {
+                order[t] = t;
+            }
+            std::sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+                return row_index[x] != row_index[y] ? row_index[x] < row_index[y] : col_index[x] < col_index[y];
+            });
+            for (size_t t : order)
+            {
+                const size_t r = row_index[t];
+                // _row_start[r + 1] counts the entries of row r so far
+                if (_row_start[r + 1] > 0 && _col_index.back() == col_index[t])
+                {
+                    _values.back() += values[t];
+                    continue;
+                }
+                _col_index.push_back(col_index[t]);
+                _values.push_back(values[t]);
+                _row_start[r + 1]++;
+            }
+            for (size_t r = 0; r < rows; r++)
+            {
+                _row_start[r + 1] += _row_start[r];
+            }
+        }
+
+        size_t rows() const
+        {
+            return _rows;
+        }
+
+        size_t cols() const
+        {
+            return _cols;
+        }
+
+        /**
+         * @brief The number of stored values
+         */
+        size_t nonzeros() const
+        {
+            return _values.size();
+        }
+
+        /**
+         * @brief Computes y = A x, rows split across threads
+         */
+        void apply(const T *x, T *y) const
+        {
+            const size_t threads = _values.size() < detail::gemm_parallel_threshold ? 1 : num_threads();
+            detail::parallel_for(_rows, 64, threads, [&](size_t r0, size_t r1) {
+                for (size_t r = r0; r < r1; r++)
+                {
+                    T sum = T();
+                    for (size_t t = _row_start[r]; t < _row_start[r + 1]; t++)
+                    {
+                        sum += _values[t] * x[_col_index[t]];
+                    }
+                    y[r] = sum;
+                }
+            });
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Vectors shorter than this are processed on one thread
+         */
+        const size_t vector_parallel_threshold = 1 << 17;
+
+        inline size_t vector_threads(size_t n)
+        {
+            return n < vector_parallel_threshold ? 1 : num_threads();
+        }
+
+        /**
+         * @brief Sums f(begin, end) over one range of [0, n) per thread.
+         * The split depends only on the thread count, so results repeat.
+         */
+        template <class R, class F>
+        R parallel_sum(size_t n, const F &f)
+        {
+            const size_t threads = vector_threads(n);
+            std::vector<R> partial(threads);
+            parallel_for(threads, 1, threads, [&](size_t t0, size_t t1) {
+                for (size_t t = t0; t < t1; t++)
+                {
+                    partial[t] = f(t * n / threads, (t + 1) * n / threads);
+                }
+            });
+            R total = R();
+            for (const R &p : partial)
+            {
+                total += p;
+            }
+            return total;
+        }
+
+        template <class T>
+        T dot(const T *x, const T *y, size_t n)
+        {
+            return parallel_sum<T>(n, [&](size_t i0, size_t i1) {
+                T sum = T();
+                for (size_t i = i0; i < i1; i++)
+                {
+                    sum += x[i] * y[i];
+                }
+                return sum;
+            });
+        }
+
+        /**
+         * @brief x *= alpha
+         */
+        template <class T>
+        void scale(T *x, size_t n, T alpha)
+        {
+            parallel_for(n, 1024, vector_threads(n), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i++)
+                {
+                    x[i] *= alpha;
+                }
+            });
+        }
+
+        /**
+         * @brief A pair of sums from one pass
+         */
+        template <class T>
+        struct sum_pair
+        {
+            T first;
+            T second;
+
+            sum_pair &operator+=(const sum_pair &other)
+            {
+                first += other.first;
+                second += other.second;
+                return *this;
+            }
+        };
+
+        /**
+         * @brief Computes x.y and y.y in one pass
+         */
+        template <class T>
+        sum_pair<T> dot_and_norm(const T *x, const T *y, size_t n)
+        {
+            return parallel_sum<sum_pair<T>>(n, [&](size_t i0, size_t i1) {
+                sum_pair<T> sums = {T(), T()};
+                for (size_t i = i0; i < i1; i++)
+                {
+                    sums.first += x[i] * y[i];
+                    sums.second += y[i] * y[i];
+                }
+                return sums;
+            });
+        }
+
+        /**
+         * @brief For power iteration: sets x = y / ||y|| and returns
+         * ||y - lambda x||^2 for the old x, in one pass
+         */
+        template <class T>
+        T normalize_with_residual(T *x, const T *y, size_t n, T lambda, T inv_norm)
+        {
+            return parallel_sum<T>(n, [&](size_t i0, size_t i1) {
+                T sum = T();
+                for (size_t i = i0; i < i1; i++)
+                {
+                    const T r = y[i] - lambda * x[i];
+                    sum += r * r;
+                    x[i] = y[i] * inv_norm;
+                }
+                return sum;
+            });
+        }
+
+        /**
+         * @brief For Lanczos: w -= alpha v + beta v_prev, returning w.w
+         * after the update, in one pass
+         */
+        template <class T>
+        T three_term_update(T *w, const T *v, const T *v_prev, size_t n, T alpha, T beta)
+        {
+            return parallel_sum<T>(n, [&](size_t i0, size_t i1) {
+                T sum = T();
+                for (size_t i = i0; i < i1; i++)
+                {
+                    w[i] -= alpha * v[i] + beta * v_prev[i];
+                    sum += w[i] * w[i];
+                }
+                return sum;
+            });
+        }
+
+        /**
+         * @brief Makes w orthogonal to the rows of the count x n basis,
+         * Gram-Schmidt applied twice ("twice is enough"), returning the
+         * coefficients of the first pass plus the second
+         */
+        template <class T>
+        std::vector<T> orthogonalize(const T *basis, size_t count, size_t n, T *w)
+        {
+            std::vector<T> total(count), h(count);
+            if (count == 0)
+            {
+                return total;
+            }
+            const array_source<T> basis_source = {basis, count, n};
+            for (int pass = 0; pass < 2; pass++)
+            {
+                const array_source<T> w_source = {w, n, 1};
+                array_writer<T> to_h = {h.data(), 1};
+                gemm<plus_times<T>>(basis_source, w_source, to_h);
+                const array_source<T> h_source = {h.data(), 1, count};
+                subtract_writer<T> from_w = {w, n};
+                gemm<plus_times<T>>(h_source, basis_source, from_w);
+                for (size_t i = 0; i < count; i++)
+                {
+                    total[i] += h[i];
+                }
+            }
+            return total;
+        }
+
+        /**
+         * @brief Computes x = sum_j coefficients[j] * basis row j
+         */
+        template <class T>
+        void combine_rows(const T *basis, size_t count, size_t n, const T *coefficients, T *x)
+        {
+            const array_source<T> c_source = {coefficients, 1, count};
+            const array_source<T> basis_source = {basis, count, n};
+            array_writer<T> out = {x, n};
+            gemm<plus_times<T>>(c_source, basis_source, out);
+        }
+
+        /**
+         * @brief A fixed, well spread starting vector, so that results repeat
+         */
+        template <class T>
+        void start_vector(T *x, size_t n, unsigned seed)
+        {
+            uint32_t state = 2463534242u + seed;
+            for (size_t i = 0; i < n; i++)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                x[i] = static_cast<T>(1) + static_cast<T>(state % 1000) / static_cast<T>(2000);
+            }
+        }
+
+        /**
+         * @brief The eigenvalues of a small m x m upper Hessenberg matrix,
+         * by the shifted QR algorithm in complex arithmetic with Wilkinson
+         * shifts and deflation. Conjugate pairs come out exactly conjugate.
+         */
+        template <class T>
+        std::vector<std::complex<T>> hessenberg_eigenvalues(const std::vector<T> &h, size_t m)
+        {
+            typedef std::complex<T> C;
+            std::vector<C> a(h.begin(), h.begin() + m * m);
+            std::vector<C> values;
+            const T eps = std::numeric_limits<T>::epsilon();
+            size_t hi = m;
+            int iteration = 0;
+            while (hi > 0)
+            {
+                size_t lo = hi - 1;
+                while (lo > 0 &&
+                       std::abs(a[lo * m + lo - 1]) > eps * (std::abs(a[lo * m + lo]) + std::abs(a[(lo - 1) * m + lo - 1])))
+                {
+                    lo--;
+                }
+                if (lo == hi - 1 || iteration > 100)
+                {
+                    values.push_back(a[(hi - 1) * m + hi - 1]);
+                    hi--;
+                    iteration = 0;
+                    continue;
+                }
+
+                // the eigenvalue of the trailing 2 x 2 nearer its last diagonal element
+                const C a11 = a[(hi - 2) * m + hi - 2], a12 = a[(hi - 2) * m + hi - 1];
+                const C a21 = a[(hi - 1) * m + hi - 2], a22 = a[(hi - 1) * m + hi - 1];
+                const C half_trace = (a11 + a22) / static_cast<T>(2);
+                const C root = std::sqrt(half_trace * half_trace - (a11 * a22 - a12 * a21));
+                C shift = std::abs(half_trace + root - a22) < std::abs(half_trace - root - a22) ? half_trace + root
+                                                                                              : half_trace - root;
+                if (++iteration % 10 == 0)
+                {
+                    // an exceptional shift to break cycles
+                    shift = a22 + std::abs(a21);
+                }
+
+                for (size_t i = lo; i < hi; i++)
+                {
+                    a[i * m + i] -= shift;
+                }
+                std::vector<C> cs(hi), ss(hi);
+                for (size_t k = lo; k + 1 < hi; k++)
+                {
+                    const C x = a[k * m + k], y = a[(k + 1) * m + k];
+                    const T r = std::sqrt(std::norm(x) + std::norm(y));
+                    const C c = r == T() ? C(1) : x / r, s = r == T() ? C(0) : y / r;
+                    cs[k] = c;
+                    ss[k] = s;
+                    for (size_t j = k; j < hi; j++)
+                    {
+                        const C top = a[k * m + j], bottom = a[(k + 1) * m + j];
+                        a[k * m + j] = std::conj(c) * top + std::conj(s) * bottom;
+                        a[(k + 1) * m + j] = -s * top + c * bottom;
+                    }
+                }
+                for (size_t k = lo; k + 1 < hi; k++)
+                {
+                    const C c = cs[k], s = ss[k];
+                    for (size_t i = lo; i <= std::min(k + 1, hi - 1); i++)
+                    {
+                        const C left = a[i * m + k], right = a[i * m + k + 1];
+                        a[i * m + k] = left * c + right * s;
+                        a[i * m + k + 1] = -left * std::conj(s) + right * std::conj(c);
+                    }
+                }
+                for (size_t i = lo; i < hi; i++)
+                {
+                    a[i * m + i] += shift;
+                }
+            }
+
+            // h is real, so its eigenvalues are real or come in conjugate
+            // pairs; complex arithmetic only gets them nearly so
+            T norm = T();
+            for (size_t i = 0; i < m * m; i++)
+            {
+                norm = std::max(norm, std::abs(h[i]));
+            }
+            std::vector<C> cleaned;
+            for (const C &value : values)
+            {
+                if (std::abs(value.imag()) <= 1000 * eps * norm)
+                {
+                    cleaned.push_back(C(value.real()));
+                }
+                else if (value.imag() > T())
+                {
+                    cleaned.push_back(value);
+                    cleaned.push_back(std::conj(value));
+                }
+            }
+            return cleaned;
+        }
+
+        /**
+         * @brief A unit null vector of the small m x m matrix h - theta I,
+         * by two steps of inverse iteration
+         */
+        template <class T>
+        std::vector<std::complex<T>> null_vector(const std::vector<T> &h, size_t m, std::complex<T> theta)
+        {
+            typedef std::complex<T> C;
+            T norm = T();
+            for (size_t i = 0; i < m * m; i++)
+            {
+                norm = std::max(norm, std::abs(h[i]));
+            }
+            const T tiny = std::numeric_limits<T>::epsilon() * std::max(norm, static_cast<T>(1));
+
+            std::vector<C> y(m, C(1));
+            for (int step = 0; step < 2; step++)
+            {
+                std::vector<C> a(m * m);
+                for (size_t i = 0; i < m * m; i++)
+                {
+                    a[i] = h[i];
+                }
+                for (size_t i = 0; i < m; i++)
+                {
+                    a[i * m + i] -= theta;
+                }
+                // Gaussian elimination with partial pivoting; a zero pivot
+                // is what we expect, and is nudged rather than reported
+                for (size_t c = 0; c < m; c++)
+                {
+                    size_t pivot = c;
+                    for (size_t r = c + 1; r < m; r++)
+                    {
+                        if (std::abs(a[r * m + c]) > std::abs(a[pivot * m + c]))
+                        {
+                            pivot = r;
+                        }
+                    }
+                    if (pivot != c)
+                    {
+                        std::swap_ranges(&a[c * m], &a[c * m] + m, &a[pivot * m]);
+                        std::swap(y[c], y[pivot]);
+                    }
+                    if (std::abs(a[c * m + c]) < tiny)
+                    {
+                        a[c * m + c] = tiny;
+                    }
+                    for (size_t r = c + 1; r < m; r++)
+                    {
+                        const C l = a[r * m + c] / a[c * m + c];
+                        for (size_t j = c; j < m; j++)
+                        {
+                            a[r * m + j] -= l * a[c * m + j];
+                        }
+                        y[r] -= l * y[c];
+                    }
+                }
+                for (size_t i = m; i-- > 0;)
+                {
+                    for (size_t j = i + 1; j < m; j++)
+                    {
+                        y[i] -= a[i * m + j] * y[j];
+                    }
+                    y[i] /= a[i * m + i];
+                }
+                T length = T();
+                for (size_t i = 0; i < m; i++)
+                {
+                    length += std::norm(y[i]);
+                }
+                length = std::sqrt(length);
+                for (size_t i = 0; i < m; i++)
+                {
+                    y[i] /= length;
+                }
+            }
+            return y;
+        }
+
+        /**
+         * @brief The orthogonal factor of the QR factorization of the small
+         * m x m matrix a, by Householder reflections
+         */
+        template <class T>
+        std::vector<T> orthogonal_factor(std::vector<T> a, size_t m)
+        {
+            std::vector<T> q(m * m);
+            for (size_t i = 0; i < m; i++)
+            {
+                q[i * m + i] = static_cast<T>(1);
+            }
+            std::vector<T> v(m);
+            for (size_t c = 0; c + 1 < m; c++)
+            {
+                T norm = T();
+                for (size_t r = c; r < m; r++)
+                {
+                    norm += a[r * m + c] * a[r * m + c];
+                }
+                norm = std::sqrt(norm);
+                if (norm == T())
+                {
+                    continue;
+                }
+                const T alpha = a[c * m + c] > T() ? -norm : norm;
+                T v_norm = T();
+                for (size_t r = c; r < m; r++)
+                {
+                    v[r] = a[r * m + c] - (r == c ? alpha : T());
+                    v_norm += v[r] * v[r];
+                }
+                if (v_norm == T())
+                {
+                    continue;
+                }
+                // a = (I - 2 v v^T / v.v) a, q = q (I - 2 v v^T / v.v)
+                for (size_t j = 0; j < m; j++)
+                {
+                    T s = T();
+                    for (size_t r = c; r < m; r++)
+                    {
+                        s += v[r] * a[r * m + j];
+                    }
+                    s *= 2 / v_norm;
+                    for (size_t r = c; r < m; r++)
+                    {
+                        a[r * m + j] -= s * v[r];
+                    }
+                }
+                for (size_t i = 0; i < m; i++)
+                {
+                    T s = T();
+                    for (size_t r = c; r < m; r++)
+                    {
+                        s += q[i * m + r] * v[r];
+                    }
+                    s *= 2 / v_norm;
+                    for (size_t r = c; r < m; r++)
+                    {
+                        q[i * m + r] -= s * v[r];
+                    }
+                }
+            }
+            return q;
+        }
+
+        /**
+         * @brief Orders eigenvalues by decreasing magnitude, a conjugate
+         * pair together with the positive imaginary part first
+         */
+        template <class C>
+        bool larger_magnitude(const C &x, const C &y)
+        {
+            const auto ax = std::abs(x), ay = std::abs(y);
+            if (ax != ay)
+            {
+                return ax > ay;
+            }
+            return std::imag(x) > std::imag(y);
+        }
+    }
+
+    /**
+     * @brief Finds the eigenvalue of largest magnitude and its eigenvector
+     * by power iteration. Converges at the rate |lambda_2 / lambda_1|, so
+     * suits matrices with a clear gap, like PageRank's.
+     *
+     * @tparam Op A linear operator: rows() and apply(const T *x, T *y)
+     * @param op The operator
+     * @param tolerance Stop once ||A x - lambda x|| <= tolerance * |lambda|
+     * @param max_iterations The most times to apply the operator
+     * @return eigenpairs<T> One pair
+     */
+    template <class T, class Op>
+    eigenpairs<T> power_iteration(const Op &op, T tolerance = static_cast<T>(1e-10), size_t max_iterations = 1000)
+    {
+        const size_t n = op.rows();
+        if (n == 0)
+        {
+            throw std::out_of_range("Can't find eigenvalues of matrix of size 0!");
+        }
+
+        std::vector<T> x(n), y(n);
+        detail::start_vector(x.data(), n, 0);
+        detail::scale(x.data(), n, static_cast<T>(1) / std::sqrt(detail::dot(x.data(), x.data(), n)));
+
+        eigenpairs<T> result;
+        result.converged = false;
+        result.matvecs = 0;
+        T lambda = T();
+        while (result.matvecs < max_iterations)
+        {
+            op.apply(x.data(), y.data());
+            result.matvecs++;
+            // x has unit length, so x.y is the Rayleigh quotient
+            const detail::sum_pair<T> sums = detail::dot_and_norm(x.data(), y.data(), n);
+            lambda = sums.first;
+            if (sums.second == T())
+            {
+                break;
+            }
+            const T residual = std::sqrt(detail::normalize_with_residual(x.data(), y.data(), n, lambda,
+                                                                         static_cast<T>(1) / std::sqrt(sums.second)));
+            if (residual <= tolerance * std::abs(lambda))
+            {
+                result.converged = true;
+                break;
+            }
+        }
+
+        result.values.push_back(lambda);
+        result.vectors.push_back(x);
+        return result;
+    }
+
+    template <class T>
+    eigenpairs<T> power_iteration(const matrix<T> &a, T tolerance = static_cast<T>(1e-10),
+                                  size_t max_iterations = 1000)
+    {
+        return power_iteration(dense_operator<T>(a), tolerance, max_iterations);
+    }
+
+    /**
+     * @brief Finds the k eigenvalues of largest magnitude of a symmetric
+     * operator and their eigenvectors by the Lanczos method with full
+     * reorthogonalization. The basis grows until all k Ritz pairs meet
+     * the tolerance, so memory is O(basis size * n).
+     *
+     * @tparam Op A symmetric linear operator: rows() and apply(const T *x, T *y)
+     * @param op The operator
+     * @param k The number of eigenpairs
+     * @param tolerance Stop once each ||A x - lambda x|| <= tolerance * |lambda|
+     * @param max_basis The largest Krylov basis to build
+     * @return eigenpairs<T> k pairs, largest magnitude first
+     */
+    template <class T, class Op>
+    eigenpairs<T> lanczos(const Op &op, size_t k, T tolerance = static_cast<T>(1e-10), size_t max_basis = 300)
+    {
+        const size_t n = op.rows();
+        if (n == 0)
+        {
+            throw std::out_of_range("Can't find eigenvalues of matrix of size 0!");
+        }
+        if (k == 0 || k > n)
+        {
+            throw invalid_dimension(k, n);
+        }
+        max_basis = std::min(n, std::max(max_basis, k));
+
+        std::vector<T> basis(max_basis * n), alpha, beta;
+        std::vector<T> w(n);
+        T *v = basis.data();
+        detail::start_vector(v, n, 0);
+        detail::scale(v, n, static_cast<T>(1) / std::sqrt(detail::dot(v, v, n)));
+
+        eigenpairs<T> result;
+        result.matvecs = 0;
+        result.converged = false;
+        std::vector<size_t> wanted;
+        matrix<T> ritz_vectors;
+        std::vector<T> ritz_values;
+        size_t size = 0;
+        unsigned seed = 1;
+        T scale = T();
+
+        // Ritz pairs from the tridiagonal projection, the k largest wanted
+        const auto ritz_pairs = [&](size_t count) {
+            matrix<T> tridiagonal(count, count);
+            for (size_t i = 0; i < count; i++)
+            {
+                tridiagonal[i][i] = alpha[i];
+                if (i + 1 < count)
+                {
+                    tridiagonal[i][i + 1] = tridiagonal[i + 1][i] = beta[i];
+                }
+            }
+            const symmetric_eigen<T> projected(tridiagonal);
+            ritz_values = projected.values();
+            ritz_vectors = projected.vectors();
+            wanted.resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                wanted[i] = i;
+            }
+            std::sort(wanted.begin(), wanted.end(),
+                      [&](size_t x, size_t y) { return std::abs(ritz_values[x]) > std::abs(ritz_values[y]); });
+            wanted.resize(k);
+        };
+
+        while (true)
+        {
+            // extend the basis by one vector
+            const size_t j = size;
+            const T *vj = &basis[j * n];
+            op.apply(vj, w.data());
+            result.matvecs++;
+            const T a = detail::dot(vj, w.data(), n);
+            const T b = j > 0 ? beta[j - 1] : T();
+            detail::three_term_update(w.data(), vj, j > 0 ? &basis[(j - 1) * n] : vj, n, a, b);
+            const std::vector<T> correction = detail::orthogonalize(basis.data(), j + 1, n, w.data());
+            alpha.push_back(a + correction[j]);
+            beta.push_back(std::sqrt(detail::dot(w.data(), w.data(), n)));
+            scale = std::max(scale, std::abs(alpha.back()) + beta.back() + b);
+            size = j + 1;
+
+            const bool full = size == max_basis;
+            if (beta.back() <= std::numeric_limits<T>::epsilon() * scale)
+            {
+                // the basis spans an invariant subspace: carry on from a
+                // fresh direction, leaving the projection block diagonal
+                beta.back() = T();
+                if (full)
+                {
+                    result.converged = true;
+                    break;
+                }
+                detail::start_vector(w.data(), n, seed++);
+                detail::orthogonalize(basis.data(), size, n, w.data());
+                const T w_norm = std::sqrt(detail::dot(w.data(), w.data(), n));
+                detail::scale(w.data(), n, static_cast<T>(1) / w_norm);
+                std::copy(w.begin(), w.end(), basis.begin() + size * n);
+                continue;
+            }
+            if (size >= k && (size % 5 == 0 || full))
+            {
+                ritz_pairs(size);
+
+                // ||A x - theta x|| = beta_m |last element of the Ritz vector|
+                bool done = true;
+                for (size_t i : wanted)
+                {
+                    const T residual = beta.back() * std::abs(ritz_vectors[size - 1][i]);
+                    done = done && residual <= tolerance * std::abs(ritz_values[i]);
+                }
+                if (done)
+                {
+                    result.converged = true;
+                    break;
+                }
+                if (full)
+                {
+                    break;
+                }
+            }
+            detail::scale(w.data(), n, static_cast<T>(1) / beta.back());
+            std::copy(w.begin(), w.end(), basis.begin() + size * n);
+        }
+
+        if (wanted.size() != k || ritz_values.size() != size)
+        {
+            ritz_pairs(size);
+        }
+        std::vector<T> coefficients(size);
+        for (size_t i : wanted)
+        {
+            for (size_t r = 0; r < size; r++)
+            {
+                coefficients[r] = ritz_vectors[r][i];
+            }
+            std::vector<T> x(n);
+            detail::combine_rows(basis.data(), size, n, coefficients.data(), x.data());
+            result.values.push_back(ritz_values[i]);
+            result.vectors.push_back(x);
+        }
+        return result;
+    }
+
+    template <class T>
+    eigenpairs<T> lanczos(const matrix<T> &a, size_t k, T tolerance = static_cast<T>(1e-10), size_t max_basis = 300)
+    {
+        return lanczos(dense_operator<T>(a), k, tolerance, max_basis);
+    }
+
+    /**
+     * @brief Finds the k eigenvalues of largest magnitude of a general
+     * operator and their eigenvectors by implicitly restarted Arnoldi
+     * (Sorensen's method, as in ARPACK). The basis holds basis_size
+     * vectors; each restart filters the unwanted Ritz values out with
+     * them as shifts, keeping memory fixed.
+     *
+     * @tparam Op A linear operator: rows() and apply(const T *x, T *y)
+     * @param op The operator
+     * @param k The number of eigenpairs
+     * @param tolerance Stop once each ||A x - lambda x|| <= tolerance * |lambda|
+     * @param basis_size The size of the Krylov basis, 0 for max(2k + 1, 20)
+     * @param max_restarts The most restarts
+     * @return eigenpairs<std::complex<T>> k pairs, largest magnitude first
+     */
+    template <class T, class Op>
+    eigenpairs<std::complex<T>> arnoldi(const Op &op, size_t k, T tolerance = static_cast<T>(1e-10),
+                                        size_t basis_size = 0, size_t max_restarts = 300)
+    {
+        typedef std::complex<T> C;
+        const size_t n = op.rows();
+        if (n == 0)
+        {
+            throw std::out_of_range("Can't find eigenvalues of matrix of size 0!");
+        }
+        if (k == 0 || k > n)
+        {
+            throw invalid_dimension(k, n);
+        }
+        const size_t m = std::min(n, basis_size ? std::max(basis_size, k + 2) : std::max<size_t>(2 * k + 1, 20));
+        const T eps = std::numeric_limits<T>::epsilon();
+
+        // A V = V H + f e_m^T, the basis vectors as rows of v
+        std::vector<T> v(m * n), h(m * m), f(n);
+        detail::start_vector(f.data(), n, 0);
+        T f_norm = std::sqrt(detail::dot(f.data(), f.data(), n));
+
+        eigenpairs<C> result;
+        result.matvecs = 0;
+        result.converged = false;
+        std::vector<C> ritz;
+        size_t start = 0;
+        unsigned seed = 1;
+        T scale = T();
+        for (size_t restart = 0;; restart++)
+        {
+            // extend the factorization from start to m vectors
+            for (size_t j = start; j < m; j++)
+            {
+                T *vj = &v[j * n];
+                if (j > 0 && f_norm <= eps * scale)
+                {
+                    // an invariant subspace: carry on from a fresh direction
+                    detail::start_vector(f.data(), n, seed++);
+                    detail::orthogonalize(v.data(), j, n, f.data());
+                    f_norm = std::sqrt(detail::dot(f.data(), f.data(), n));
+                    if (j > 0)
+                    {
+                        h[j * m + j - 1] = T();
+                    }
+                }
+                else if (j > 0)
+                {
+                    h[j * m + j - 1] = f_norm;
+                }
+                std::copy(f.begin(), f.end(), vj);
+                detail::scale(vj, n, static_cast<T>(1) / f_norm);
+
+                op.apply(vj, f.data());
+                result.matvecs++;
+                const std::vector<T> coefficients = detail::orthogonalize(v.data(), j + 1, n, f.data());
+                for (size_t i = 0; i <= j; i++)
+                {
+                    h[i * m + j] = coefficients[i];
+                }
+                f_norm = std::sqrt(detail::dot(f.data(), f.data(), n));
+                T column = f_norm * f_norm;
+                for (size_t i = 0; i <= j; i++)
+                {
+                    column += coefficients[i] * coefficients[i];
+                }
+                scale = std::max(scale, std::sqrt(column));
+            }
+
+            ritz = detail::hessenberg_eigenvalues(h, m);
+            std::sort(ritz.begin(), ritz.end(), detail::larger_magnitude<C>);
+
+            // ||A x - theta x|| = ||f|| |last element of the Ritz vector|
+            bool done = true;
+            for (size_t i = 0; i < k && done; i++)
+            {
+                const std::vector<C> y = detail::null_vector(h, m, ritz[i]);
+                done = f_norm * std::abs(y[m - 1]) <= tolerance * std::max(std::abs(ritz[i]), eps);
+            }
+            if (done || m == n || restart == max_restarts)
+            {
+                result.converged = done || m == n;
+                break;
+            }
+
+            // keep a conjugate pair together
+            size_t keep = k;
+            if (keep < m - 1 && ritz[keep - 1].imag() > T() && ritz[keep] == std::conj(ritz[keep - 1]))
+            {
+                keep++;
+            }
+
+            // apply the unwanted Ritz values as shifts: H = Q^T H Q
+            std::vector<T> q(m * m);
+            for (size_t i = 0; i < m; i++)
+            {
+                q[i * m + i] = static_cast<T>(1);
+            }
+            for (size_t s = keep; s < m; s++)
+            {
+                const C mu = ritz[s];
+                if (mu.imag() < T())
+                {
+                    continue;
+                }
+                // H - mu I for a real shift, (H - mu I)(H - conj(mu) I) for a complex one
+                std::vector<T> shifted(m * m);
+                if (mu.imag() == T())
+                {
+                    shifted = h;
+                    for (size_t i = 0; i < m; i++)
+                    {
+                        shifted[i * m + i] -= mu.real();
+                    }
+                }
+                else
+                {
+                    const T twice_real = 2 * mu.real(), magnitude = std::norm(mu);
+                    for (size_t i = 0; i < m; i++)
+                    {
+                        for (size_t j = 0; j < m; j++)
+                        {
+                            T sum = T();
+                            for (size_t p = 0; p < m; p++)
+                            {
+                                sum += h[i * m + p] * h[p * m + j];
+                            }
+                            shifted[i * m + j] = sum - twice_real * h[i * m + j] + (i == j ? magnitude : T());
+                        }
+                    }
+                }
+                const std::vector<T> step = detail::orthogonal_factor(shifted, m);
+
+                std::vector<T> hq(m * m), next(m * m);
+                for (size_t i = 0; i < m; i++)
+                {
+                    for (size_t j = 0; j < m; j++)
+                    {
+                        T sum = T();
+                        for (size_t p = 0; p < m; p++)
+                        {
+                            sum += h[i * m + p] * step[p * m + j];
+                        }
+                        hq[i * m + j] = sum;
+                    }
+                }
+                for (size_t i = 0; i < m; i++)
+                {
+                    for (size_t j = 0; j < m; j++)
+                    {
+                        T sum = T();
+                        for (size_t p = 0; p < m; p++)
+                        {
+                            sum += step[p * m + i] * hq[p * m + j];
+                        }
+                        // H stays upper Hessenberg up to rounding
+                        h[i * m + j] = i > j + 1 ? T() : sum;
+                    }
+                }
+                for (size_t i = 0; i < m; i++)
+                {
+                    for (size_t j = 0; j < m; j++)
+                    {
+                        T sum = T();
+                        for (size_t p = 0; p < m; p++)
+                        {
+                            sum += q[i * m + p] * step[p * m + j];
+                        }
+                        next[i * m + j] = sum;
+                    }
+                }
+                q.swap(next);
+            }
+
+            // f = v_keep h(keep, keep - 1) + f q(m - 1, keep - 1), V = V Q(:, 0:keep)
+            std::vector<T> q_T(keep * m);
+            for (size_t i = 0; i < keep; i++)
+            {
+                for (size_t j = 0; j < m; j++)
+                {
+                    q_T[i * m + j] = q[j * m + i];
+                }
+            }
+            std::vector<T> kept(keep * n), next_vector(n);
+            const detail::array_source<T> q_source = {q_T.data(), keep, m};
+            const detail::array_source<T> v_source = {v.data(), m, n};
+            detail::array_writer<T> to_kept = {kept.data(), n};
+            detail::gemm<plus_times<T>>(q_source, v_source, to_kept);
+            std::vector<T> last_column(m);
+            for (size_t j = 0; j < m; j++)
+            {
+                last_column[j] = q[j * m + keep];
+            }
+            detail::combine_rows(v.data(), m, n, last_column.data(), next_vector.data());
+            const T beta = h[keep * m + keep - 1], sigma = q[(m - 1) * m + keep - 1];
+            for (size_t i = 0; i < n; i++)
+            {
+                f[i] = next_vector[i] * beta + f[i] * sigma;
+            }
+            f_norm = std::sqrt(detail::dot(f.data(), f.data(), n));
+            std::copy(kept.begin(), kept.end(), v.begin());
+            for (size_t i = 0; i < m; i++)
+            {
+                for (size_t j = 0; j < m; j++)
+                {
+                    if (i >= keep || j >= keep)
+                    {
+                        h[i * m + j] = T();
+                    }
+                }
+            }
+            start = keep;
+        }
+
+        // Ritz vectors x = V y
+        std::vector<T> real_part(m), imag_part(m), x_real(n), x_imag(n);
+        for (size_t i = 0; i < k; i++)
+        {
+            const std::vector<C> y = detail::null_vector(h, m, ritz[i]);
+            for (size_t j = 0; j < m; j++)
+            {
+                real_part[j] = y[j].real();
+                imag_part[j] = y[j].imag();
+            }
+            detail::combine_rows(v.data(), m, n, real_part.data(), x_real.data());
+            detail::combine_rows(v.data(), m, n, imag_part.data(), x_imag.data());
+            std::vector<C> x(n);
+            for (size_t j = 0; j < n; j++)
+            {
+                x[j] = C(x_real[j], x_imag[j]);
+            }
+            result.values.push_back(ritz[i]);
+            result.vectors.push_back(x);
+        }
+        return result;
+    }
+
+    template <class T>
+    eigenpairs<std::complex<T>> arnoldi(const matrix<T> &a, size_t k, T tolerance = static_cast<T>(1e-10),
+                                        size_t basis_size = 0, size_t max_restarts = 300)
+    {
+        return arnoldi(dense_operator<T>(a), k, tolerance, basis_size, max_restarts);
+    }
+}
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * @file epilogue.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Elementwise operations fused into the end of a matrix multiply
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * An epilogue is called as epilogue(i, j, value) on each element of a
+ * product as the multiply kernel produces it, and returns the value to
+ * store. Pass one to matrix<T>::multiply(m1, m2, epilogue), or to
+ * multiply_to<Out>() to store into a different element type. Combine them
+ * with chain(). Epilogues holding a value per row or column check their
+ * sizes against the product's before the multiply starts, throwing
+ * invalid_dimension:
+ *
+ *     matrix<float>::multiply(x, w, chain(bias(b), relu()))
+ */
+
+#ifndef _EPILOGUE_H_
+#define _EPILOGUE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "matrix.h"
+#include "quantize.h"
+
+namespace codesample
+{
+    /**
+     * @brief Adds a bias row: bias[j] to every element of column j
+     *
+     * @tparam T The type of the bias
+     */
+    template <class T>
+    struct bias_epilogue
+    {
+        std::vector<T> values;
+
+        /**
+         * @brief Checks that there is one value per column of the product
+         */
+        void check(size_t, size_t cols) const
+        {
+            if (values.size() != cols)
+            {
+                throw invalid_dimension(values.size(), cols);
+            }
+        }
+
+        template <class V>
+        V operator()(size_t, size_t j, const V &v) const
+        {
+            return v + static_cast<V>(values[j]);
+        }
+    };
+
+    /**
+     * @brief Multiplies by a constant
+     *
+     * @tparam T The type of the constant
+     */
+    template <class T>
+    struct scale_epilogue
+    {
+        T alpha;
+
+        template <class V>
+        V operator()(size_t, size_t, const V &v) const
+        {
+            return v * static_cast<V>(alpha);
+        }
+    };
+
+    /**
+     * @brief max(v, 0)
+     *
+     */
+    struct relu_epilogue
+    {
+        template <class V>
+        V operator()(size_t, size_t, const V &v) const
+        {
+            return std::max(v, V());
+        }
+    };
+
+    /**
+     * @brief The exact (erf based) GELU, v * Phi(v)
+     *
+     */
+    struct gelu_epilogue
+    {
+        template <class V>
+        V operator()(size_t, size_t, const V &v) const
+        {
+            return static_cast<V>(0.5) * v * (static_cast<V>(1) + std::erf(v * static_cast<V>(0.70710678118654752440)));
+        }
+    };
+
+    /**
+     * @brief Clamps to [lo, hi]
+     *
+     * @tparam T The type of the bounds
+     */
+    template <class T>
+    struct clamp_epilogue
+    {
+        T lo;
+        T hi;
+
+        template <class V>
+        V operator()(size_t, size_t, const V &v) const
+        {
+            return std::min(static_cast<V>(hi), std::max(static_cast<V>(lo), v));
+        }
+    };
+
+    /**
+     * @brief Quantizes to int8 with the given parameters (see quantize.h),
+     * rounding to nearest and saturating. The result is still in the
+     * accumulation type; use multiply_to<int8_t>() to store it as int8.
+     *
+     */
+    struct quantize_epilogue
+    {
+        quant_params params;
+
+        void check(size_t rows, size_t cols) const
+        {
+            params.check(rows, cols);
+        }
+
+        template <class V>
+        V operator()(size_t i, size_t j, const V &v) const
+        {
+            const size_t idx = params.index(i, j);
+            const double q = std::nearbyint(static_cast<double>(v) / params.scale[idx]) + params.zero_point[idx];
+            return static_cast<V>(std::min(127.0, std::max(-128.0, q)));
+        }
+    };
+
+    /**
+     * @brief Two epilogues applied one after the other
+     *
+     */
+    template <class First, class Second>
+    struct epilogue_chain
+    {
+        First first;
+        Second second;
+
+        void check(size_t rows, size_t cols) const
+        {
+            detail::check_epilogue(first, rows, cols, 0);
+            detail::check_epilogue(second, rows, cols, 0);
+        }
+
+        template <class V>
+        V operator()(size_t i, size_t j, const V &v) const
+        {
+            return second(i, j, first(i, j, v));
+        }
+    };
+
+    template <class T>
+    bias_epilogue<T> bias(const std::vector<T> &values)
+    {
+        return bias_epilogue<T>{values};
+    }
+
+    template <class T>
+    scale_epilogue<T> scale(const T &alpha)
+    {
+        return scale_epilogue<T>{alpha};
+    }
+
+    inline relu_epilogue relu()
+    {
+        return relu_epilogue();
+    }
+
+    inline gelu_epilogue gelu()
+    {
+        return gelu_epilogue();
+    }
+
+    template <class T>
+    clamp_epilogue<T> clamp(const T &lo, const T &hi)
+    {
+        return clamp_epilogue<T>{lo, hi};
+    }
+
+    inline quantize_epilogue quantize_output(const quant_params &params)
+    {
+        return quantize_epilogue{params};
+    }
+
+    /**
+     * @brief Applies first, then second
+     */
+    template <class First, class Second>
+    epilogue_chain<First, Second> chain(const First &first, const Second &second)
+    {
+        return epilogue_chain<First, Second>{first, second};
+    }
+
+    /**
+     * @brief Applies first, then second, then third
+     */
+    template <class First, class Second, class Third>
+    epilogue_chain<epilogue_chain<First, Second>, Third> chain(const First &first, const Second &second,
+                                                               const Third &third)
+    {
+        return chain(chain(first, second), third);
+    }
+
+    /**
+     * @brief Computes the product of two matrices through an epilogue,
+     * storing into a matrix of a different element type, e.g. float
+     * products quantized straight into int8
+     *
+     * @tparam Out The element type of the result
+     * @tparam T The element type of the operands, which products accumulate in
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @param epilogue Applied to element (i, j) of the product
+     * @return matrix<Out> The transformed product
+     */
+    template <class Out, class T, class Epilogue>
+    matrix<Out> multiply_to(const matrix<T> &m1, const matrix<T> &m2, const Epilogue &epilogue)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+
+        matrix<Out> result(m1.rows(), m2.cols());
+        detail::epilogue_writer<Out, Epilogue> out(result, epilogue);
+        detail::gemm<plus_times<T>>(m1, m2, out);
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,501 @@
+/**
+ * @file half.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief 16-bit floating point element types (bfloat16 and IEEE half)
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Both types are storage formats: arithmetic is done in float, and
+ * conversions round to nearest even. When compiled with F16C (e.g.
+ * -mf16c or -march=native on x86) the fp16 conversions use the hardware
+ * instructions, and with AVX2 bulk bf16 widening is vectorized. Otherwise
+ * portable bit manipulation is used and gives identical results.
+ */
+
+#ifndef _HALF_H_
+#define _HALF_H_
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief Bit level conversions between float and the 16-bit formats
+     *
+     */
+    namespace detail
+    {
+        inline uint32_t float_bits(float f)
+        {
+            uint32_t x;
+            std::memcpy(&x, &f, sizeof(x));
+            return x;
+        }
+
+        inline float bits_float(uint32_t x)
+        {
+            float f;
+            std::memcpy(&f, &x, sizeof(f));
+            return f;
+        }
+
+        /**
+         * @brief Rounds a float to the nearest bfloat16, ties to even.
+         * NaNs stay NaNs (quietened) rather than rounding to infinity.
+         */
+        inline uint16_t float_to_bf16(float f)
+        {
+            uint32_t x = float_bits(f);
+            if ((x & 0x7fffffff) > 0x7f800000)
+            {
+                return static_cast<uint16_t>((x >> 16) | 0x0040);
+            }
+            x += 0x7fff + ((x >> 16) & 1);
+            return static_cast<uint16_t>(x >> 16);
+        }
+
+        inline float bf16_to_float(uint16_t h)
+        {
+            return bits_float(static_cast<uint32_t>(h) << 16);
+        }
+
+        /**
+         * @brief Rounds a float to the nearest IEEE binary16, ties to even,
+         * including subnormal results and overflow to infinity
+         */
+        inline uint16_t float_to_fp16(float f)
+        {
+#if defined(__F16C__)
+            return static_cast<uint16_t>(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+            uint32_t x = float_bits(f);
+            uint32_t sign = (x >> 16) & 0x8000;
+            uint32_t abs_x = x & 0x7fffffff;
+
+            if (abs_x >= 0x7f800000)
+            {
+                // infinity stays infinity, NaN keeps its top payload bits and is quietened
+                return static_cast<uint16_t>(sign | 0x7c00 | (abs_x > 0x7f800000 ? 0x0200 | ((abs_x >> 13) & 0x3ff) : 0));
+            }
+            if (abs_x >= 0x477ff000)
+            {
+                // at or above 65520, which rounds past the largest half (65504)
+                return static_cast<uint16_t>(sign | 0x7c00);
+            }
+            if (abs_x < 0x38800000)
+            {
+                // below the smallest normal half: let the float adder do the
+                // rounding by aligning the value against 0.5
+                const uint32_t magic = 126u << 23;
+                uint32_t rounded = float_bits(bits_float(abs_x) + bits_float(magic));
+                return static_cast<uint16_t>(sign | (rounded - magic));
+            }
+
+            // rebias the exponent and round the mantissa to 10 bits
+            uint32_t odd = (abs_x >> 13) & 1;
+            abs_x += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + odd;
+            return static_cast<uint16_t>(sign | (abs_x >> 13));
+#endif
+        }
+
+        inline float fp16_to_float(uint16_t h)
+        {
+#if defined(__F16C__)
+            return _cvtsh_ss(h);
+#else
+            uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+            uint32_t exponent = (h >> 10) & 0x1f;
+            uint32_t mantissa = h & 0x3ff;
+
+            if (exponent == 0)
+            {
+                // zero or subnormal: mantissa * 2^-24 is exact in float
+                float value = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+                return bits_float(float_bits(value) | sign);
+            }
+            if (exponent == 31)
+            {
+                return bits_float(sign | 0x7f800000 | (mantissa << 13));
+            }
+            return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+#endif
+        }
+    }
+
+    /**
+     * @brief A bfloat16 value: the top 16 bits of an IEEE float.
+     * Same range as float with 8 bits of precision.
+     *
+     */
+    class bf16
+    {
+      private:
+        uint16_t _bits;
+
+      public:
+        /**
+         * @brief Construct a new bf16 equal to zero
+         *
+         */
+        bf16()
+        : _bits(0)
+        {
+        }
+
+        /**
+         * @brief Construct a new bf16 by rounding a float
+         *
+         * @param value The value to round
+         */
+        bf16(float value)
+        : _bits(detail::float_to_bf16(value))
+        {
+        }
+
+        /**
+         * @brief Construct a bf16 from its raw bit pattern
+         *
+         * @param bits The bit pattern
+         * @return bf16 The value with that bit pattern
+         */
+        static bf16 from_bits(uint16_t bits)
+        {
+            bf16 result;
+            result._bits = bits;
+            return result;
+        }
+
+        /**
+         * @brief Gets the raw bit pattern of this value
+         *
+         * @return uint16_t The bit pattern
+         */
+        uint16_t bits() const
+        {
+            return _bits;
+        }
+
+        /**
+         * @brief Widens this value to float, which is exact
+         *
+         * @return float The value as a float
+         */
+        operator float() const
+        {
+            return detail::bf16_to_float(_bits);
+        }
+
+        bf16 &operator+=(float rhs)
+        {
+            return *this = bf16(static_cast<float>(*this) + rhs);
+        }
+
+        bf16 &operator-=(float rhs)
+        {
+            return *this = bf16(static_cast<float>(*this) - rhs);
+        }
+
+        bf16 &operator*=(float rhs)
+        {
+            return *this = bf16(static_cast<float>(*this) * rhs);
+        }
+
+        bf16 &operator/=(float rhs)
+        {
+            return *this = bf16(static_cast<float>(*this) / rhs);
+        }
+    };
+
+    /**
+     * @brief An IEEE 754 binary16 value.
+     * 5 exponent bits (max 65504) and 11 bits of precision.
+     *
+     */
+    class fp16
+    {
+      private:
+        uint16_t _bits;
+
+      public:
+        /**
+         * @brief Construct a new fp16 equal to zero
+         *
+         */
+        fp16()
+        : _bits(0)
+        {
+        }
+
+        /**
+         * @brief Construct a new fp16 by rounding a float
+         *
+         * @param value The value to round
+         */
+        fp16(float value)
+        : _bits(detail::float_to_fp16(value))
+        {
+        }
+
+        /**
+         * @brief Construct a fp16 from its raw bit pattern
+         *
+         * @param bits The bit pattern
+         * @return fp16 The value with that bit pattern
+         */
+        static fp16 from_bits(uint16_t bits)
+        {
+            fp16 result;
+            result._bits = bits;
+            return result;
+        }
+
+        /**
+         * @brief Gets the raw bit pattern of this value
+         *
+         * @return uint16_t The bit pattern
+         */
+        uint16_t bits() const
+        {
+            return _bits;
+        }
+
+        /**
+         * @brief Widens this value to float, which is exact
+         *
+         * @return float The value as a float
+         */
+        operator float() const
+        {
+            return detail::fp16_to_float(_bits);
+        }
+
+        fp16 &operator+=(float rhs)
+        {
+            return *this = fp16(static_cast<float>(*this) + rhs);
+        }
+
+        fp16 &operator-=(float rhs)
+        {
+            return *this = fp16(static_cast<float>(*this) - rhs);
+        }
+
+        fp16 &operator*=(float rhs)
+        {
+            return *this = fp16(static_cast<float>(*this) * rhs);
+        }
+
+        fp16 &operator/=(float rhs)
+        {
+            return *this = fp16(static_cast<float>(*this) / rhs);
+        }
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, bf16 value)
+    {
+        return os << static_cast<float>(value);
+    }
+
+    inline std::ostream &operator<<(std::ostream &os, fp16 value)
+    {
+        return os << static_cast<float>(value);
+    }
+
+    /**
+     * @brief Widens an array of bf16 values to float
+     *
+     * @param in The values to widen
+     * @param out Where to store the widened values
+     * @param n The number of values
+     */
+    inline void widen(const bf16 *in, float *out, size_t n)
+    {
+        static_assert(sizeof(bf16) == sizeof(uint16_t), "bf16 must be 16 bits");
+        const uint16_t *bits = reinterpret_cast<const uint16_t *>(in);
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bits + i));
+            __m256i w = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+            _mm256_storeu_ps(out + i, _mm256_castsi256_ps(w));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out[i] = detail::bf16_to_float(bits[i]);
+        }
+    }
+
+    /**
+     * @brief Widens an array of fp16 values to float
+     *
+     * @param in The values to widen
+     * @param out Where to store the widened values
+     * @param n The number of values
+     */
+    inline void widen(const fp16 *in, float *out, size_t n)
+    {
+        static_assert(sizeof(fp16) == sizeof(uint16_t), "fp16 must be 16 bits");
+        const uint16_t *bits = reinterpret_cast<const uint16_t *>(in);
+        size_t i = 0;
+#if defined(__F16C__)
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bits + i));
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out[i] = detail::fp16_to_float(bits[i]);
+        }
+    }
+
+    /**
+     * @brief Rounds an array of floats to bf16
+     *
+     * @param in The values to round
+     * @param out Where to store the rounded values
+     * @param n The number of values
+     */
+    inline void narrow(const float *in, bf16 *out, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            out[i] = bf16(in[i]);
+        }
+    }
+
+    /**
+     * @brief Rounds an array of floats to fp16
+     *
+     * @param in The values to round
+     * @param out Where to store the rounded values
+     * @param n The number of values
+     */
+    inline void narrow(const float *in, fp16 *out, size_t n)
+    {
+        size_t i = 0;
+#if defined(__F16C__)
+        uint16_t *bits = reinterpret_cast<uint16_t *>(out);
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bits + i), h);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out[i] = fp16(in[i]);
+        }
+    }
+
+    /**
+     * @brief Widens a matrix of 16-bit floats to a float matrix
+     *
+     * @tparam H bf16 or fp16
+     * @param m The matrix to widen
+     * @return matrix<float> The widened matrix
+     */
+    template <class H>
+    matrix<float> widen(const matrix<H> &m)
+    {
+        matrix<float> result(m.rows(), m.cols());
+        for (size_t i = 0; i < m.rows(); i++)
+        {
+            widen(m[i].data(), result[i].data(), m.cols());
+        }
+        return result;
+    }
+
+    /**
+     * @brief Rounds a float matrix to 16-bit floats
+     *
+     * @tparam H bf16 or fp16
+     * @param m The matrix to round
+     * @return matrix<H> The rounded matrix
+     */
+    template <class H>
+    matrix<H> narrow(const matrix<float> &m)
+    {
+        matrix<H> result(m.rows(), m.cols());
+        for (size_t i = 0; i < m.rows(); i++)
+        {
+            narrow(m[i].data(), result[i].data(), m.cols());
+        }
+        return result;
+    }
+
+    namespace detail
+    {
+        /**
+         * @brief Widens runs of a 16-bit float matrix with widen() as the
+         * multiply kernel packs them, eight at a time where F16C or AVX2
+         * is available
+         */
+        template <class H>
+        struct widen_packed
+        {
+            static const bool fast = true;
+
+            static void row(const matrix<H> &m, size_t i, size_t j, size_t n, float *out)
+            {
+                widen(m[i].data() + j, out, n);
+            }
+        };
+
+        template <class H>
+        const bool widen_packed<H>::fast;
+
+        template <>
+        struct pack_convert<matrix<bf16>, float> : widen_packed<bf16>
+        {
+        };
+
+        template <>
+        struct pack_convert<matrix<fp16>, float> : widen_packed<fp16>
+        {
+        };
+    }
+
+    /**
+     * @brief Computes the product of two 16-bit float matrices, widening
+     * to float and accumulating in float. Values are widened with widen()
+     * as the blocked multiply kernel packs its panels, so no float copy of
+     * either operand is made.
+     *
+     * @tparam H bf16 or fp16
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @return matrix<float> The computed matrix product
+     */
+    template <class H>
+    matrix<float> multiply_widened(const matrix<H> &m1, const matrix<H> &m2)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+
+        matrix<float> result(m1.rows(), m2.cols());
+        detail::row_writer<float> out(result);
+        detail::gemm<plus_times<float>>(m1, m2, out);
+        return result;
+    }
+}
+
+#endif
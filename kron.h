@@ -0,0 +1,168 @@
+/**
+ * @file kron.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Kronecker products, materialized or applied lazily
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * The Kronecker product of an m x n and a p x q matrix is mp x nq, so
+ * forming it for two n x n factors costs O(n^4) memory. Applying it to a
+ * vector does not need it formed: with vec() stacking the columns of a
+ * matrix,
+ *
+ *     (A kron B) vec(X) = vec(B X A^T)
+ *
+ * which is two ordinary products and O(n^2) memory.
+ */
+
+#ifndef _KRON_H_
+#define _KRON_H_
+
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief Computes the Kronecker product of two matrices: the block
+     * matrix whose (i, j) block is a(i, j) * b
+     *
+     * @tparam T The type of data in the matrices
+     * @param a The first matrix
+     * @param b The second matrix
+     * @return matrix<T> The (a.rows() * b.rows()) x (a.cols() * b.cols()) product
+     */
+    template <class T>
+    matrix<T> kron(const matrix<T> &a, const matrix<T> &b)
+    {
+        matrix<T> result(a.rows() * b.rows(), a.cols() * b.cols());
+        if (result.rows() == 0 || result.cols() == 0)
+        {
+            return result;
+        }
+
+        detail::row_writer<T> out(result);
+        const size_t work = result.rows() * result.cols();
+        detail::parallel_for(result.rows(), 1, work < detail::gemm_parallel_threshold ? 1 : num_threads(),
+                             [&](size_t r0, size_t r1) {
+            for (size_t r = r0; r < r1; r++)
+            {
+                const size_t ia = r / b.rows(), ib = r % b.rows();
+                for (size_t ja = 0; ja < a.cols(); ja++)
+                {
+                    const T &scale = a(ia, ja);
+                    for (size_t jb = 0; jb < b.cols(); jb++)
+                    {
+                        out(r, ja * b.cols() + jb, scale * b(ib, jb));
+                    }
+                }
+            }
+        });
+        return result;
+    }
+
+    /**
+     * @brief The Kronecker product of two matrices as a linear operator,
+     * applied without forming it. Vectors are indexed the same way as the
+     * rows and columns of kron(a, b).
+     *
+     * @tparam T The type of data in the matrices
+     */
+    template <class T>
+    class kronecker_operator
+    {
+      private:
+        matrix<T> _a;
+        matrix<T> _b_T;
+
+      public:
+        /**
+         * @brief Construct a new kronecker operator
+         *
+         * @param a The first factor
+         * @param b The second factor
+         */
+        kronecker_operator(const matrix<T> &a, const matrix<T> &b)
+        : _a(a), _b_T(matrix<T>(b).transpose())
+        {
+            if (a.rows() == 0 || b.rows() == 0)
+            {
+                throw std::out_of_range("Can't multiply matrix of size 0!");
+            }
+        }
+
+        size_t rows() const
+        {
+            return _a.rows() * _b_T.cols();
+        }
+
+        size_t cols() const
+        {
+            return _a.cols() * _b_T.rows();
+        }
+
+        /**
+         * @brief Computes y = (a kron b) x
+         *
+         * @param x The cols() long input
+         * @param y The rows() long output, which must not overlap x
+         */
+        void apply(const T *x, T *y) const
+        {
+            // With row major storage, x read as an a.cols() x b.cols() matrix
+            // is X^T, and y = A X^T B^T read the same way. Pick the cheaper
+            // bracketing.
+            const size_t m = _a.rows(), n = _a.cols(), p = _b_T.cols(), q = _b_T.rows();
+            const detail::array_source<T> x_T = {x, n, q};
+            detail::array_writer<T> out = {y, p};
+            if (m * q * (n + p) <= n * p * (q + m))
+            {
+                std::vector<T> ax(m * q);
+                detail::array_writer<T> to_ax = {ax.data(), q};
+                detail::gemm<plus_times<T>>(_a, x_T, to_ax);
+                const detail::array_source<T> ax_source = {ax.data(), m, q};
+                detail::gemm<plus_times<T>>(ax_source, _b_T, out);
+            }
+            else
+            {
+                std::vector<T> xb(n * p);
+                detail::array_writer<T> to_xb = {xb.data(), p};
+                detail::gemm<plus_times<T>>(x_T, _b_T, to_xb);
+                const detail::array_source<T> xb_source = {xb.data(), n, p};
+                detail::gemm<plus_times<T>>(_a, xb_source, out);
+            }
+        }
+
+        /**
+         * @brief Computes (a kron b) x
+         *
+         * @param x The input vector
+         * @return std::vector<T> The product
+         */
+        std::vector<T> apply(const std::vector<T> &x) const
+        {
+            if (x.size() != cols())
+            {
+                throw invalid_dimension(cols(), x.size());
+            }
+            std::vector<T> y(rows());
+            apply(x.data(), y.data());
+            return y;
+        }
+
+        /**
+         * @brief Forms the operator as a dense matrix
+         *
+         * @return matrix<T> kron(a, b)
+         */
+        matrix<T> to_matrix() const
+        {
+            return kron(_a, matrix<T>(_b_T).transpose());
+        }
+    };
+}
+
+#endif
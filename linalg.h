@@ -0,0 +1,917 @@
+/**
+ * @file linalg.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief LU factorization, solves, inverse, determinant, condition
+ * estimates and symmetric eigendecomposition
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * lu_decomposition factors a square matrix once, as PA = LU with partial
+ * pivoting, and then solves, inverts or estimates the condition number
+ * from the factors. Solving is both cheaper and more accurate than
+ * multiplying by the inverse, so prefer
+ *
+ *     lu_decomposition<double> lu(a);
+ *     matrix<double> x = lu.solve(b);
+ *
+ * to inverse(a) * b, and check lu.condition_estimate() rather than
+ * forming the inverse to see whether a system is well conditioned.
+ *
+ * The factorization is blocked: each panel of columns is factored on its
+ * own and the rest of the matrix is updated with one product through the
+ * multithreaded multiply kernel, where nearly all the work happens.
+ */
+
+#ifndef _LINALG_H_
+#define _LINALG_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief Exception thrown when solving with, or inverting, a matrix
+     * that has no inverse
+     *
+     */
+    class singular_matrix : public std::exception
+    {
+      private:
+        std::string message;
+
+      public:
+        /**
+         * @brief Construct a new singular matrix exception
+         *
+         * @param msg The message
+         */
+        singular_matrix(const char *msg)
+        : message(msg)
+        {
+        }
+
+        const char *what() const throw()
+        {
+            return message.c_str();
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief The number of columns factored per panel, and the block
+         * size of the triangular solves
+         */
+        const size_t lu_block = 64;
+
+        /**
+         * @brief Subtracts kernel output from a row major array
+         */
+        template <class T>
+        struct subtract_writer
+        {
+            T *data;
+            size_t ld;
+
+            template <class V>
+            void operator()(size_t i, size_t j, const V &value)
+            {
+                data[i * ld + j] -= static_cast<T>(value);
+            }
+        };
+
+        /**
+         * @brief Overwrites the n x cols row major array b with L^-1 b, for
+         * L the unit lower triangle of the n x n array l
+         */
+        template <class T>
+        void solve_unit_lower(const T *l, size_t ldl, size_t n, T *b, size_t ldb, size_t cols)
+        {
+            for (size_t i0 = 0; i0 < n; i0 += lu_block)
+            {
+                const size_t i1 = std::min(n, i0 + lu_block);
+                const size_t work = (i1 - i0) * (i1 - i0) * cols;
+                parallel_for(cols, 64, work < gemm_parallel_threshold ? 1 : num_threads(), [&](size_t c0, size_t c1) {
+                    for (size_t i = i0; i < i1; i++)
+                    {
+                        for (size_t p = i0; p < i; p++)
+                        {
+                            const T lip = l[i * ldl + p];
+                            for (size_t c = c0; c < c1; c++)
+                            {
+                                b[i * ldb + c] -= lip * b[p * ldb + c];
+                            }
+                        }
+                    }
+                });
+
+                if (i1 < n)
+                {
+                    const matrix_ref<const T> l_below(l + i1 * ldl + i0, n - i1, i1 - i0, ldl);
+                    const matrix_ref<const T> solved(b + i0 * ldb, i1 - i0, cols, ldb);
+                    subtract_writer<T> out = {b + i1 * ldb, ldb};
+                    gemm<plus_times<T>>(l_below, solved, out);
+                }
+            }
+        }
+
+        /**
+         * @brief Overwrites the n x cols row major array b with U^-1 b, for
+         * U the upper triangle of the n x n array u
+         */
+        template <class T>
+        void solve_upper(const T *u, size_t ldu, size_t n, T *b, size_t ldb, size_t cols)
+        {
+            for (size_t i1 = n; i1 > 0; i1 -= std::min(i1, lu_block))
+            {
+                const size_t i0 = i1 - std::min(i1, lu_block);
+                const size_t work = (i1 - i0) * (i1 - i0) * cols;
+                parallel_for(cols, 64, work < gemm_parallel_threshold ? 1 : num_threads(), [&](size_t c0, size_t c1) {
+                    for (size_t i = i1; i-- > i0;)
+                    {
+                        for (size_t p = i + 1; p < i1; p++)
+                        {
+                            const T uip = u[i * ldu + p];
+                            for (size_t c = c0; c < c1; c++)
+                            {
+                                b[i * ldb + c] -= uip * b[p * ldb + c];
+                            }
+                        }
+                        const T diag = u[i * ldu + i];
+                        for (size_t c = c0; c < c1; c++)
+                        {
+                            b[i * ldb + c] /= diag;
+                        }
+                    }
+                });
+
+                if (i0 > 0)
+                {
+                    const matrix_ref<const T> u_above(u + i0, i0, i1 - i0, ldu);
+                    const matrix_ref<const T> solved(b + i0 * ldb, i1 - i0, cols, ldb);
+                    subtract_writer<T> out = {b, ldb};
+                    gemm<plus_times<T>>(u_above, solved, out);
+                }
+            }
+        }
+    }
+
+    namespace detail
+    {
+        template <class T>
+        struct lu_access;
+    }
+
+    /**
+     * @brief The LU factorization with partial pivoting of a square
+     * matrix, PA = LU, with L unit lower triangular and U upper triangular
+     *
+     * @tparam T A floating point type
+     */
+    template <class T>
+    class lu_decomposition
+    {
+        // restores and steps a factorization, for checkpoint.h
+        friend struct detail::lu_access<T>;
+
+      private:
+        size_t _n;
+        std::vector<T> _lu;
+        std::vector<size_t> _perm;
+        int _sign;
+        bool _singular;
+        T _norm1;
+
+        /**
+         * @brief Factors columns [j0, j1) of the rows from j0 down,
+         * swapping whole rows as it pivots
+         */
+        void factor_panel(size_t j0, size_t j1)
+        {
+            T *a = _lu.data();
+            const size_t n = _n;
+            for (size_t c = j0; c < j1; c++)
+            {
+                size_t pivot = c;
+                for (size_t r = c + 1; r < n; r++)
+                {
+                    if (std::abs(a[r * n + c]) > std::abs(a[pivot * n + c]))
+                    {
+                        pivot = r;
+                    }
+                }
+                if (a[pivot * n + c] == T())
+                {
+                    // nothing to eliminate with; carry on so that det() is 0
+                    _singular = true;
+                    continue;
+                }
+                if (pivot != c)
+                {
+                    std::swap_ranges(a + c * n, a + (c + 1) * n, a + pivot * n);
+                    std::swap(_perm[c], _perm[pivot]);
+                    _sign = -_sign;
+                }
+
+                const T diag = a[c * n + c];
+                for (size_t r = c + 1; r < n; r++)
+                {
+                    T *row = a + r * n;
+                    const T l = row[c] /= diag;
+                    for (size_t cc = c + 1; cc < j1; cc++)
+                    {
+                        row[cc] -= l * a[c * n + cc];
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Solves A^T x = b in place: U^T L^T P x = b
+         */
+        void solve_transposed(std::vector<T> &x) const
+        {
+            const T *a = _lu.data();
+            const size_t n = _n;
+            for (size_t i = 0; i < n; i++)
+            {
+                x[i] /= a[i * n + i];
+                for (size_t q = i + 1; q < n; q++)
+                {
+                    x[q] -= a[i * n + q] * x[i];
+                }
+            }
+            for (size_t i = n; i-- > 0;)
+            {
+                for (size_t q = 0; q < i; q++)
+                {
+                    x[q] -= a[i * n + q] * x[i];
+                }
+            }
+            std::vector<T> y(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                y[_perm[i]] = x[i];
+            }
+            x.swap(y);
+        }
+
+        void check_invertible() const
+        {
+            if (_singular)
+            {
+                throw singular_matrix("Matrix is singular");
+            }
+        }
+
+        lu_decomposition()
+        : _n(0), _sign(1), _singular(false), _norm1()
+        {
+        }
+
+        /**
+         * @brief Factors block column [j0, j0 + lu_block) and updates the
+         * trailing matrix with it
+         *
+         * @return size_t The first column of the next block
+         */
+        size_t factor_step(size_t j0)
+        {
+            const size_t n = _n;
+            const size_t j1 = std::min(n, j0 + detail::lu_block);
+            T *lu = _lu.data();
+            factor_panel(j0, j1);
+            if (j1 < n)
+            {
+                // U12 = L11^-1 A12, then A22 -= L21 U12
+                detail::solve_unit_lower(lu + j0 * n + j0, n, j1 - j0, lu + j0 * n + j1, n, n - j1);
+                const matrix_ref<const T> l21(lu + j1 * n + j0, n - j1, j1 - j0, n);
+                const matrix_ref<const T> u12(lu + j0 * n + j1, j1 - j0, n - j1, n);
+                detail::subtract_writer<T> out = {lu + j1 * n + j1, n};
+                detail::gemm<plus_times<T>>(l21, u12, out);
+            }
+            return j1;
+        }
+
+        /**
+         * @brief Checks and copies in the matrix to factor
+         */
+        void start(const matrix<T> &a)
+        {
+            if (a.rows() == 0)
+            {
+                throw std::out_of_range("Can't factor matrix of size 0!");
+            }
+            if (a.rows() != a.cols())
+            {
+                throw invalid_dimension(a.rows(), a.cols());
+            }
+
+            const size_t n = _n = a.rows();
+            _lu.resize(n * n);
+            _perm.resize(n);
+            matrix_ref<T>(_lu.data(), n, n).assign(a);
+            for (size_t j = 0; j < n; j++)
+            {
+                T sum = T();
+                for (size_t i = 0; i < n; i++)
+                {
+                    sum += std::abs(_lu[i * n + j]);
+                }
+                _norm1 = std::max(_norm1, sum);
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                _perm[i] = i;
+            }
+        }
+
+      public:
+        /**
+         * @brief Factors a square matrix
+         *
+         * @param a The matrix to factor
+         */
+        explicit lu_decomposition(const matrix<T> &a)
+        : lu_decomposition()
+        {
+            start(a);
+            size_t j0 = 0;
+            while (j0 < _n)
+            {
+                j0 = factor_step(j0);
+            }
+        }
+
+        size_t size() const
+        {
+            return _n;
+        }
+
+        /**
+         * @brief Whether a pivot was exactly zero. A matrix that is nearly
+         * singular is not reported here; see condition_estimate().
+         */
+        bool singular() const
+        {
+            return _singular;
+        }
+
+        /**
+         * @brief Gets the permutation: row i of PA is row permutation()[i] of A
+         */
+        const std::vector<size_t> &permutation() const
+        {
+            return _perm;
+        }
+
+        /**
+         * @brief Gets L, with the unit diagonal filled in
+         */
+        matrix<T> lower() const
+        {
+            matrix<T> l(_n, _n);
+            for (size_t i = 0; i < _n; i++)
+            {
+                std::copy(&_lu[i * _n], &_lu[i * _n + i], &l[i][0]);
+                l[i][i] = static_cast<T>(1);
+            }
+            return l;
+        }
+
+        /**
+         * @brief Gets U
+         */
+        matrix<T> upper() const
+        {
+            matrix<T> u(_n, _n);
+            for (size_t i = 0; i < _n; i++)
+            {
+                std::copy(&_lu[i * _n + i], &_lu[(i + 1) * _n], &u[i][i]);
+            }
+            return u;
+        }
+
+        /**
+         * @brief Computes the determinant from the diagonal of U
+         *
+         * @return T The determinant, 0 if the matrix is singular
+         */
+        T det() const
+        {
+            T result = static_cast<T>(_sign);
+            for (size_t i = 0; i < _n; i++)
+            {
+                result *= _lu[i * _n + i];
+            }
+            return result;
+        }
+
+        /**
+         * @brief Solves A X = B
+         *
+         * @param b The right hand sides, one per column
+         * @return matrix<T> X
+         * @throws singular_matrix if A is singular
+         */
+        matrix<T> solve(const matrix<T> &b) const
+        {
+            if (b.rows() != _n)
+            {
+                throw invalid_dimension(_n, b.rows());
+            }
+            check_invertible();
+
+            const size_t cols = b.cols();
+            std::vector<T> x(_n * cols);
+            for (size_t i = 0; i < _n; i++)
+            {
+                for (size_t j = 0; j < cols; j++)
+                {
+                    x[i * cols + j] = b(_perm[i], j);
+                }
+            }
+            detail::solve_unit_lower(_lu.data(), _n, _n, x.data(), cols, cols);
+            detail::solve_upper(_lu.data(), _n, _n, x.data(), cols, cols);
+            return matrix<T>(matrix_ref<const T>(x.data(), _n, cols));
+        }
+
+        /**
+         * @brief Solves A x = b
+         *
+         * @param b The right hand side
+         * @return std::vector<T> x
+         * @throws singular_matrix if A is singular
+         */
+        std::vector<T> solve(const std::vector<T> &b) const
+        {
+            if (b.size() != _n)
+            {
+                throw invalid_dimension(_n, b.size());
+            }
+            check_invertible();
+
+            std::vector<T> x(_n);
+            for (size_t i = 0; i < _n; i++)
+            {
+                x[i] = b[_perm[i]];
+            }
+            detail::solve_unit_lower(_lu.data(), _n, _n, x.data(), 1, 1);
+            detail::solve_upper(_lu.data(), _n, _n, x.data(), 1, 1);
+            return x;
+        }
+
+        /**
+         * @brief Computes A^-1 by solving A X = I
+         *
+         * @return matrix<T> The inverse
+         * @throws singular_matrix if A is singular
+         */
+        matrix<T> inverse() const
+        {
+            matrix<T> identity(_n, _n);
+            for (size_t i = 0; i < _n; i++)
+            {
+                identity[i][i] = static_cast<T>(1);
+            }
+            return solve(identity);
+        }
+
+        /**
+         * @brief Estimates the 1-norm condition number ||A||_1 ||A^-1||_1
+         * without forming A^-1, by Hager's method with Higham's
+         * refinements (as in LAPACK's xLACN2): a few solves with A and A^T,
+         * O(n^2) each. The estimate is a lower bound that is almost always
+         * within a factor of 3 of the true value.
+         *
+         * @return T The estimate, infinity if A is singular
+         */
+        T condition_estimate() const
+        {
+            if (_singular)
+            {
+                return std::numeric_limits<T>::infinity();
+            }
+
+            const size_t n = _n;
+            std::vector<T> x(n, static_cast<T>(1) / static_cast<T>(n));
+            T estimate = T();
+            size_t last = n;
+            for (int iteration = 0; iteration < 5; iteration++)
+            {
+                const std::vector<T> y = solve(x);
+                T norm = T();
+                for (size_t i = 0; i < n; i++)
+                {
+                    norm += std::abs(y[i]);
+                }
+                if (iteration > 0 && norm <= estimate)
+                {
+                    break;
+                }
+                estimate = norm;
+
+                std::vector<T> z(n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    z[i] = y[i] < T() ? static_cast<T>(-1) : static_cast<T>(1);
+                }
+                solve_transposed(z);
+                size_t j = 0;
+                for (size_t i = 1; i < n; i++)
+                {
+                    if (std::abs(z[i]) > std::abs(z[j]))
+                    {
+                        j = i;
+                    }
+                }
+                if (j == last)
+                {
+                    break;
+                }
+                last = j;
+                std::fill(x.begin(), x.end(), T());
+                x[j] = static_cast<T>(1);
+            }
+
+            // Higham's extra vector catches matrices that fool the iteration
+            std::vector<T> b(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                const T magnitude = n > 1 ? static_cast<T>(1) + static_cast<T>(i) / static_cast<T>(n - 1)
+                                          : static_cast<T>(1);
+                b[i] = i % 2 ? -magnitude : magnitude;
+            }
+            const std::vector<T> y = solve(b);
+            T norm = T();
+            for (size_t i = 0; i < n; i++)
+            {
+                norm += std::abs(y[i]);
+            }
+            estimate = std::max(estimate, 2 * norm / static_cast<T>(3 * n));
+            return _norm1 * estimate;
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Reduces the symmetric n x n row major array v to
+         * tridiagonal form by Householder reflections, leaving the
+         * diagonal in d, the subdiagonal in e[1..n) and the accumulated
+         * reflections in v (EISPACK's tred2, as in JAMA)
+         */
+        template <class T>
+        void tridiagonalize(std::vector<T> &v, size_t n, std::vector<T> &d, std::vector<T> &e)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                d[j] = v[(n - 1) * n + j];
+            }
+
+            for (size_t i = n - 1; i > 0; i--)
+            {
+                T scale = T(), h = T();
+                for (size_t k = 0; k < i; k++)
+                {
+                    scale += std::abs(d[k]);
+                }
+                if (scale == T())
+                {
+                    e[i] = d[i - 1];
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        d[j] = v[(i - 1) * n + j];
+                        v[i * n + j] = T();
+                        v[j * n + i] = T();
+                    }
+                }
+                else
+                {
+                    for (size_t k = 0; k < i; k++)
+                    {
+                        d[k] /= scale;
+                        h += d[k] * d[k];
+                    }
+                    T f = d[i - 1];
+                    T g = std::sqrt(h);
+                    if (f > T())
+                    {
+                        g = -g;
+                    }
+                    e[i] = scale * g;
+                    h -= f * g;
+                    d[i - 1] = f - g;
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        e[j] = T();
+                    }
+
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        f = d[j];
+                        v[j * n + i] = f;
+                        g = e[j] + v[j * n + j] * f;
+                        for (size_t k = j + 1; k < i; k++)
+                        {
+                            g += v[k * n + j] * d[k];
+                            e[k] += v[k * n + j] * f;
+                        }
+                        e[j] = g;
+                    }
+                    f = T();
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        e[j] /= h;
+                        f += e[j] * d[j];
+                    }
+                    const T hh = f / (h + h);
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        e[j] -= hh * d[j];
+                    }
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        f = d[j];
+                        g = e[j];
+                        for (size_t k = j; k < i; k++)
+                        {
+                            v[k * n + j] -= f * e[k] + g * d[k];
+                        }
+                        d[j] = v[(i - 1) * n + j];
+                        v[i * n + j] = T();
+                    }
+                }
+                d[i] = h;
+            }
+
+            for (size_t i = 0; i + 1 < n; i++)
+            {
+                v[(n - 1) * n + i] = v[i * n + i];
+                v[i * n + i] = static_cast<T>(1);
+                const T h = d[i + 1];
+                if (h != T())
+                {
+                    for (size_t k = 0; k <= i; k++)
+                    {
+                        d[k] = v[k * n + i + 1] / h;
+                    }
+                    for (size_t j = 0; j <= i; j++)
+                    {
+                        T g = T();
+                        for (size_t k = 0; k <= i; k++)
+                        {
+                            g += v[k * n + i + 1] * v[k * n + j];
+                        }
+                        for (size_t k = 0; k <= i; k++)
+                        {
+                            v[k * n + j] -= g * d[k];
+                        }
+                    }
+                }
+                for (size_t k = 0; k <= i; k++)
+                {
+                    v[k * n + i + 1] = T();
+                }
+            }
+            for (size_t j = 0; j < n; j++)
+            {
+                d[j] = v[(n - 1) * n + j];
+                v[(n - 1) * n + j] = T();
+            }
+            v[(n - 1) * n + n - 1] = static_cast<T>(1);
+            e[0] = T();
+        }
+
+        /**
+         * @brief Diagonalizes the tridiagonal matrix from tridiagonalize()
+         * by the implicit QL method, leaving the eigenvalues in d and
+         * applying the rotations to the rows of q_T, the transpose of the
+         * reflections (EISPACK's tql2, as in JAMA)
+         */
+        template <class T>
+        void tridiagonal_ql(std::vector<T> &q_T, size_t n, std::vector<T> &d, std::vector<T> &e)
+        {
+            for (size_t i = 1; i < n; i++)
+            {
+                e[i - 1] = e[i];
+            }
+            e[n - 1] = T();
+
+            T f = T(), tst1 = T();
+            const T eps = std::numeric_limits<T>::epsilon();
+            for (size_t l = 0; l < n; l++)
+            {
+                // find a negligible subdiagonal element
+                tst1 = std::max(tst1, std::abs(d[l]) + std::abs(e[l]));
+                size_t m = l;
+                while (m < n - 1 && std::abs(e[m]) > eps * tst1)
+                {
+                    m++;
+                }
+
+                if (m > l)
+                {
+                    do
+                    {
+                        T g = d[l];
+                        T p = (d[l + 1] - g) / (2 * e[l]);
+                        T r = std::hypot(p, static_cast<T>(1));
+                        if (p < T())
+                        {
+                            r = -r;
+                        }
+                        d[l] = e[l] / (p + r);
+                        d[l + 1] = e[l] * (p + r);
+                        const T dl1 = d[l + 1];
+                        T h = g - d[l];
+                        for (size_t i = l + 2; i < n; i++)
+                        {
+                            d[i] -= h;
+                        }
+                        f += h;
+
+                        p = d[m];
+                        T c = 1, c2 = c, c3 = c;
+                        const T el1 = e[l + 1];
+                        T s = T(), s2 = T();
+                        for (size_t i = m; i-- > l;)
+                        {
+                            c3 = c2;
+                            c2 = c;
+                            s2 = s;
+                            g = c * e[i];
+                            h = c * p;
+                            r = std::hypot(p, e[i]);
+                            e[i + 1] = s * r;
+                            s = e[i] / r;
+                            c = p / r;
+                            p = c * d[i] - s * g;
+                            d[i + 1] = h + s * (c * g + s * d[i]);
+
+                            T *row_i = &q_T[i * n], *row_next = &q_T[(i + 1) * n];
+                            for (size_t k = 0; k < n; k++)
+                            {
+                                const T next = row_next[k];
+                                row_next[k] = s * row_i[k] + c * next;
+                                row_i[k] = c * row_i[k] - s * next;
+                            }
+                        }
+                        p = -s * s2 * c3 * el1 * e[l] / dl1;
+                        e[l] = s * p;
+                        d[l] = c * p;
+                    } while (std::abs(e[l]) > eps * tst1);
+                }
+                d[l] += f;
+                e[l] = T();
+            }
+        }
+    }
+
+    /**
+     * @brief The eigendecomposition A = Q diag(values) Q^T of a symmetric
+     * matrix: Householder reduction to tridiagonal form, then the implicit
+     * QL method, O(n^3) with a small constant
+     *
+     * @tparam T A floating point type
+     */
+    template <class T>
+    class symmetric_eigen
+    {
+      private:
+        std::vector<T> _values;
+        matrix<T> _vectors;
+
+      public:
+        /**
+         * @brief Decomposes a symmetric matrix. Only the lower triangle is
+         * read.
+         *
+         * @param a The matrix
+         */
+        explicit symmetric_eigen(const matrix<T> &a)
+        {
+            if (a.rows() == 0)
+            {
+                throw std::out_of_range("Can't factor matrix of size 0!");
+            }
+            if (a.rows() != a.cols())
+            {
+                throw invalid_dimension(a.rows(), a.cols());
+            }
+
+            const size_t n = a.rows();
+            std::vector<T> v(n * n), d(n), e(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    v[i * n + j] = i >= j ? a(i, j) : a(j, i);
+                }
+            }
+            detail::tridiagonalize(v, n, d, e);
+            std::vector<T> q_T(n * n);
+            transpose_into(matrix_ref<const T>(v.data(), n, n), matrix_ref<T>(q_T.data(), n, n));
+            detail::tridiagonal_ql(q_T, n, d, e);
+
+            // ascending order
+            std::vector<size_t> order(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&](size_t x, size_t y) { return d[x] < d[y]; });
+            _values.resize(n);
+            _vectors = matrix<T>(n, n);
+            for (size_t j = 0; j < n; j++)
+            {
+                _values[j] = d[order[j]];
+                for (size_t i = 0; i < n; i++)
+                {
+                    _vectors[i][j] = q_T[order[j] * n + i];
+                }
+            }
+        }
+
+        /**
+         * @brief Gets the eigenvalues, in ascending order
+         */
+        const std::vector<T> &values() const
+        {
+            return _values;
+        }
+
+        /**
+         * @brief Gets the eigenvectors, column j for values()[j]
+         */
+        const matrix<T> &vectors() const
+        {
+            return _vectors;
+        }
+    };
+
+    /**
+     * @brief Computes the inverse of a square matrix through its LU
+     * factorization. To solve a system, lu_decomposition<T>::solve() is
+     * cheaper and more accurate.
+     *
+     * @param a The matrix to invert
+     * @return matrix<T> The inverse
+     * @throws singular_matrix if a is singular
+     */
+    template <class T>
+    matrix<T> inverse(const matrix<T> &a)
+    {
+        return lu_decomposition<T>(a).inverse();
+    }
+
+    /**
+     * @brief Computes the determinant of a square matrix from its LU
+     * factorization
+     *
+     * @param a The matrix
+     * @return T The determinant
+     */
+    template <class T>
+    T det(const matrix<T> &a)
+    {
+        return lu_decomposition<T>(a).det();
+    }
+
+    /**
+     * @brief Solves a X = b
+     *
+     * @param a A square matrix
+     * @param b The right hand sides, one per column
+     * @return matrix<T> X
+     * @throws singular_matrix if a is singular
+     */
+    template <class T>
+    matrix<T> solve(const matrix<T> &a, const matrix<T> &b)
+    {
+        return lu_decomposition<T>(a).solve(b);
+    }
+
+    /**
+     * @brief Estimates the 1-norm condition number of a square matrix
+     * (see lu_decomposition<T>::condition_estimate())
+     *
+     * @param a The matrix
+     * @return T The estimate, infinity if a is singular
+     */
+    template <class T>
+    T condition_estimate(const matrix<T> &a)
+    {
+        return lu_decomposition<T>(a).condition_estimate();
+    }
+}
+
+#endif
@@ -1,4 +1,30 @@
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "bit_matrix.h"
+#include "checkpoint.h"
+#include "compare.h"
+#include "complex_gemm.h"
+#include "conv.h"
+#include "distributed.h"
+#include "eigs.h"
+#include "epilogue.h"
+#include "half.h"
+#include "kron.h"
+#include "linalg.h"
+#include "maintained.h"
+#include "matfun.h"
 #include "matrix.h"
+#include "memo.h"
+#include "modular.h"
+#include "quantize.h"
+#include "semiring.h"
+#include "summa.h"
+#include "tiled.h"
 
 void test_transpose()
 {
@@ -99,23 +125,3431 @@ void test_multiply()
     }
 }
 
-int main(int argc, char *argv[])
+void test_mixed_precision()
 {
-    std::cout << "Testing transpose... ";
+    // a long inner dimension of values that are not exactly representable
+    // makes float accumulation drift away from the true product
+    const size_t n = 100000;
+    codesample::matrix<float> m1(1, n, 0.1f);
+    codesample::matrix<float> m2(n, 1, 1.0f);
+    const double expected = n * static_cast<double>(0.1f);
+
+    double plain_error = std::fabs(codesample::matrix<float>::multiply(m1, m2)[0][0] - expected);
+    double mixed_error = std::fabs(codesample::matrix<float>::multiply_mixed<double>(m1, m2)[0][0] - expected);
+    double compensated_error = std::fabs(codesample::matrix<float>::multiply_compensated(m1, m2)[0][0] - expected);
+
+    // rounding the exact result to float is the best either can do
+    double ulp = expected * std::numeric_limits<float>::epsilon();
+    if (mixed_error > ulp)
+    {
+        throw std::runtime_error("mixed precision multiply 1");
+    }
+    if (compensated_error > ulp)
+    {
+        throw std::runtime_error("compensated multiply 1");
+    }
+    if (plain_error <= mixed_error)
+    {
+        throw std::runtime_error("mixed precision multiply not more accurate");
+    }
+
+    // exact products must match the plain multiply
+    codesample::matrix<float> m3{{1,2,3}, {4,5,6}};
+    codesample::matrix<float> m4{{1,2}, {3,4}, {5,6}};
+    codesample::matrix<float> result1{{22,28}, {49,64}};
+    if (codesample::matrix<float>::multiply_mixed<double>(m3, m4) != result1)
+    {
+        throw std::runtime_error("mixed precision multiply 2");
+    }
+    if (codesample::matrix<float>::multiply_compensated(m3, m4) != result1)
+    {
+        throw std::runtime_error("compensated multiply 2");
+    }
+
+    // the kernel's compensated semiring gives exactly the compensated dot
+    // products, across panels of k and on the skinny and vector paths
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    const size_t shapes[][3] = {{70, 600, 50}, {1, 300, 40}, {9, 12, 33}, {40, 500, 1}};
+    for (auto &shape : shapes)
+    {
+        codesample::matrix<float> a(shape[0], shape[1]), b(shape[1], shape[2]);
+        for (size_t i = 0; i < a.rows(); i++)
+        {
+            for (size_t j = 0; j < a.cols(); j++)
+            {
+                a[i][j] = dist(gen);
+            }
+        }
+        for (size_t i = 0; i < b.rows(); i++)
+        {
+            for (size_t j = 0; j < b.cols(); j++)
+            {
+                b[i][j] = dist(gen);
+            }
+        }
+        const codesample::matrix<float> product = codesample::matrix<float>::multiply_compensated(a, b);
+        const codesample::matrix<float> b_T = b.transpose();
+        for (size_t i = 0; i < a.rows(); i++)
+        {
+            for (size_t j = 0; j < b.cols(); j++)
+            {
+                if (product[i][j] != codesample::dot_compensated(a[i], b_T[j]))
+                {
+                    throw std::runtime_error("compensated multiply 3");
+                }
+            }
+        }
+    }
+
+    // mismatched inner dimensions
     try
     {
-        test_transpose();
-        std::cout << "passed" << std::endl;
+        codesample::matrix<float>::multiply_mixed<double>(m3, m3);
+        throw std::runtime_error("mixed precision multiply dimensions");
     }
-    catch (std::exception &e)
+    catch (codesample::invalid_dimension &e)
+    {
+    }
+    try
+    {
+        codesample::matrix<float>::multiply_compensated(m3, m3);
+        throw std::runtime_error("compensated multiply dimensions");
+    }
+    catch (codesample::invalid_dimension &e)
     {
-        std::cout << "failed: " << e.what() << std::endl;
     }
+}
 
-    std::cout << "Testing multiply... ";
+void test_half()
+{
+    using codesample::bf16;
+    using codesample::fp16;
+
+    // exactly representable values round trip
+    const float exact[] = {0.0f, 1.0f, -2.5f, 0.375f, 65280.0f, -65280.0f};
+    for (float f : exact)
+    {
+        if (static_cast<float>(fp16(f)) != f || static_cast<float>(bf16(f)) != f)
+        {
+            throw std::runtime_error("16-bit round trip of " + std::to_string(f));
+        }
+    }
+    if (static_cast<float>(fp16(65504.0f)) != 65504.0f
+        || std::fabs(static_cast<float>(bf16(1e30f)) - 1e30f) > 1e30f / 256)
+    {
+        throw std::runtime_error("16-bit range");
+    }
+
+    // bit patterns of known values
+    if (fp16(1.0f).bits() != 0x3c00 || bf16(1.0f).bits() != 0x3f80)
+    {
+        throw std::runtime_error("16-bit encoding of 1");
+    }
+    if (fp16(5.9604644775390625e-8f).bits() != 0x0001)
+    {
+        throw std::runtime_error("fp16 smallest subnormal");
+    }
+    if (fp16(65536.0f).bits() != 0x7c00 || fp16(-1e10f).bits() != 0xfc00)
+    {
+        throw std::runtime_error("fp16 overflow to infinity");
+    }
+    if (!std::isnan(static_cast<float>(fp16(std::numeric_limits<float>::quiet_NaN())))
+        || !std::isnan(static_cast<float>(bf16(std::numeric_limits<float>::quiet_NaN()))))
+    {
+        throw std::runtime_error("16-bit NaN");
+    }
+
+    // ties round to even: 1 + 2^-11 is halfway between 1 and the next fp16
+    if (fp16(1.0f + std::ldexp(1.0f, -11)).bits() != 0x3c00
+        || fp16(1.0f + 3 * std::ldexp(1.0f, -11)).bits() != 0x3c02)
+    {
+        throw std::runtime_error("fp16 round to nearest even");
+    }
+    if (bf16(1.0f + std::ldexp(1.0f, -8)).bits() != 0x3f80
+        || bf16(1.0f + 3 * std::ldexp(1.0f, -8)).bits() != 0x3f82)
+    {
+        throw std::runtime_error("bf16 round to nearest even");
+    }
+
+    // bulk conversion agrees with the scalar conversion, including the
+    // remainder past the last full SIMD block
+    std::vector<float> values;
+    for (int i = 0; i < 37; i++)
+    {
+        values.push_back((i - 18) * 0.3f);
+    }
+    std::vector<fp16> halves(values.size());
+    std::vector<float> widened(values.size());
+    codesample::narrow(values.data(), halves.data(), values.size());
+    codesample::widen(halves.data(), widened.data(), values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (widened[i] != static_cast<float>(fp16(values[i])))
+        {
+            throw std::runtime_error("fp16 bulk conversion");
+        }
+    }
+
+    // 16-bit matrices work with the generic matrix operations
+    codesample::matrix<bf16> m1{{1,2,3}, {4,5,6}};
+    codesample::matrix<bf16> m2{{1,2}, {3,4}, {5,6}};
+    codesample::matrix<bf16> result1{{22,28}, {49,64}};
+    if (m1 * m2 != result1)
+    {
+        throw std::runtime_error("bf16 multiply");
+    }
+
+    // widening multiply accumulates in float
+    codesample::matrix<fp16> m3(1, 4096, fp16(1.0f));
+    codesample::matrix<fp16> m4(4096, 3, fp16(0.5f));
+    codesample::matrix<float> result2(1, 3, 2048.0f);
+    if (codesample::multiply_widened(m3, m4) != result2)
+    {
+        throw std::runtime_error("fp16 widening multiply");
+    }
+    if (codesample::multiply_widened(m1, m2) != codesample::matrix<float>{{22,28}, {49,64}})
+    {
+        throw std::runtime_error("bf16 widening multiply");
+    }
+
+    // panels widened as they are packed give exactly the float product of
+    // the widened matrices, on the blocked and skinny paths
+    const size_t shapes[][3] = {{70, 300, 45}, {33, 9, 41}};
+    for (auto &shape : shapes)
+    {
+        codesample::matrix<float> a(shape[0], shape[1]), b(shape[1], shape[2]);
+        for (size_t i = 0; i < a.rows(); i++)
+        {
+            for (size_t j = 0; j < a.cols(); j++)
+            {
+                a[i][j] = static_cast<float>((i * 7 + j * 3) % 19) / 4 - 2;
+            }
+        }
+        for (size_t i = 0; i < b.rows(); i++)
+        {
+            for (size_t j = 0; j < b.cols(); j++)
+            {
+                b[i][j] = static_cast<float>((i * 5 + j * 11) % 23) / 8 - 1.3f;
+            }
+        }
+        const codesample::matrix<fp16> a_h = codesample::narrow<fp16>(a), b_h = codesample::narrow<fp16>(b);
+        const codesample::matrix<bf16> a_b = codesample::narrow<bf16>(a), b_b = codesample::narrow<bf16>(b);
+        if (codesample::multiply_widened(a_h, b_h) != codesample::widen(a_h) * codesample::widen(b_h) ||
+            codesample::multiply_widened(a_b, b_b) != codesample::widen(a_b) * codesample::widen(b_b))
+        {
+            throw std::runtime_error("widening multiply of packed panels");
+        }
+    }
+}
+
+void test_quantized()
+{
+    // full range values, odd shapes and an inner dimension that is not a
+    // multiple of the SIMD width
+    const size_t m = 5, k = 131, n = 7;
+    codesample::matrix<int8_t> a(m, k);
+    codesample::matrix<int8_t> b(k, n);
+    codesample::matrix<int32_t> a_wide(m, k);
+    codesample::matrix<int32_t> b_wide(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a[i][p] = static_cast<int8_t>(i == 0 ? -128 : (i * 37 + p * 11) % 256 - 128);
+            a_wide[i][p] = a[i][p];
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b[p][j] = static_cast<int8_t>(j == 0 ? -128 : (p * 53 + j * 29) % 256 - 128);
+            b_wide[p][j] = b[p][j];
+        }
+    }
+
+    // int8 products accumulate exactly in int32
+    auto expected = a_wide * b_wide;
+    if (codesample::multiply_s8(a, b) != expected)
+    {
+        throw std::runtime_error("int8 multiply");
+    }
+    if (expected[0][0] != 128 * 128 * static_cast<int32_t>(k))
+    {
+        throw std::runtime_error("int8 multiply extremes");
+    }
+
+    // quantized product with per-row and per-column parameters, compared to
+    // the float product to within the rounding of the output
+    codesample::matrix<float> x(m, k);
+    codesample::matrix<float> y(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            x[i][p] = std::sin(0.1f * (i * k + p)) * (i + 1);
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            y[p][j] = std::cos(0.07f * (p * n + j)) + 0.25f * j;
+        }
+    }
+    auto qx = codesample::choose_quant_params(x, codesample::quant_axis::row);
+    auto qy = codesample::choose_quant_params(y, codesample::quant_axis::column);
+    auto x_q = codesample::quantize(x, qx);
+    auto y_q = codesample::quantize(y, qy);
+    auto x_r = codesample::dequantize(x_q, qx);
+    auto y_r = codesample::dequantize(y_q, qy);
+    auto exact = codesample::matrix<float>::multiply_mixed<double>(x_r, y_r);
+    auto qz = codesample::choose_quant_params(exact);
+
+    auto z = codesample::dequantize(codesample::multiply_quantized(x_q, qx, y_q, qy, qz), qz);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            if (std::fabs(z[i][j] - exact[i][j]) > 0.5f * qz.scale[0] * 1.001f)
+            {
+                throw std::runtime_error("quantized multiply");
+            }
+        }
+    }
+
+    // the zero point correction can't be factored out of per-column m1 scales
     try
     {
-        test_multiply();
+        codesample::multiply_quantized(x_q, qy, y_q, qy, qz);
+        throw std::runtime_error("quantized multiply axis");
+    }
+    catch (std::invalid_argument &e)
+    {
+    }
+
+    // rows split across an odd number of threads give the same products
+    codesample::matrix<int8_t> big_a(97, 300), big_b(300, 85);
+    for (size_t i = 0; i < big_a.rows(); i++)
+    {
+        for (size_t p = 0; p < big_a.cols(); p++)
+        {
+            big_a[i][p] = static_cast<int8_t>((i * 41 + p * 7) % 256 - 128);
+        }
+    }
+    for (size_t p = 0; p < big_b.rows(); p++)
+    {
+        for (size_t j = 0; j < big_b.cols(); j++)
+        {
+            big_b[p][j] = static_cast<int8_t>((p * 13 + j * 29) % 256 - 128);
+        }
+    }
+    codesample::set_num_threads(1);
+    const codesample::matrix<int32_t> one_thread = codesample::multiply_s8(big_a, big_b);
+    codesample::set_num_threads(3);
+    const codesample::matrix<int32_t> three_threads = codesample::multiply_s8(big_a, big_b);
+    codesample::set_num_threads(0);
+    int32_t expected_57 = 0;
+    for (size_t p = 0; p < big_a.cols(); p++)
+    {
+        expected_57 += big_a[5][p] * big_b[p][7];
+    }
+    if (three_threads != one_thread || one_thread[5][7] != expected_57)
+    {
+        throw std::runtime_error("threaded int8 multiply");
+    }
+
+    // the longest inner dimension still holds -128 * -128 summed in full,
+    // and one more is refused
+    const size_t deepest = codesample::s8_max_depth;
+    const codesample::matrix<int8_t> row(1, deepest, -128), col(deepest, 1, -128);
+    if (codesample::multiply_s8(row, col)[0][0] != static_cast<int32_t>(deepest * 128 * 128))
+    {
+        throw std::runtime_error("int8 multiply at the depth limit");
+    }
+    try
+    {
+        codesample::multiply_s8(codesample::matrix<int8_t>(1, deepest + 1), codesample::matrix<int8_t>(deepest + 1, 1));
+        throw std::runtime_error("int8 multiply past the depth limit");
+    }
+    catch (std::invalid_argument &e)
+    {
+    }
+}
+
+void test_complex()
+{
+    typedef std::complex<double> cd;
+
+    // small integer parts are exact in both algorithms
+    codesample::matrix<cd> m1{{cd(1,2), cd(3,-1)}, {cd(0,1), cd(2,2)}, {cd(-1,0), cd(4,3)}};
+    codesample::matrix<cd> m2{{cd(2,0), cd(1,1), cd(0,-2)}, {cd(1,-1), cd(3,0), cd(-2,1)}};
+    auto expected = m1 * m2;
+    if (codesample::multiply_complex(m1, m2) != expected)
+    {
+        throw std::runtime_error("complex multiply conventional");
+    }
+    if (codesample::multiply_complex(m1, m2, codesample::complex_algorithm::three_m) != expected)
+    {
+        throw std::runtime_error("complex multiply 3m");
+    }
+
+    // longer inner dimension with a remainder past the unrolled lanes
+    const size_t m = 4, k = 29, n = 3;
+    codesample::matrix<cd> m3(m, k);
+    codesample::matrix<cd> m4(k, n);
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t i = 0; i < m; i++)
+        {
+            m3[i][p] = cd(std::sin(i + 0.3 * p), std::cos(2.0 * i - p));
+        }
+        for (size_t j = 0; j < n; j++)
+        {
+            m4[p][j] = cd(std::cos(0.5 * p * j), std::sin(p + 1.0 * j));
+        }
+    }
+    expected = m3 * m4;
+    auto conventional = codesample::multiply_complex(m3, m4);
+    auto three_m = codesample::multiply_complex(m3, m4, codesample::complex_algorithm::three_m);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            if (std::abs(conventional[i][j] - expected[i][j]) > 1e-12
+                || std::abs(three_m[i][j] - expected[i][j]) > 1e-12)
+            {
+                throw std::runtime_error("complex multiply accuracy");
+            }
+        }
+    }
+
+    try
+    {
+        codesample::multiply_complex(m3, m3);
+        throw std::runtime_error("complex multiply dimensions");
+    }
+    catch (codesample::invalid_dimension &e)
+    {
+    }
+}
+
+void test_bit_matrix()
+{
+    // sizes that straddle word and Four Russians chunk boundaries
+    const size_t m = 70, k = 131, n = 67;
+    codesample::matrix<int> a(m, k);
+    codesample::matrix<int> b(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a[i][p] = (i * 7 + p * 13) % 11 == 0;
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b[p][j] = (p * 5 + j * 3) % 17 == 0;
+        }
+    }
+    codesample::bit_matrix a_bits(a);
+    codesample::bit_matrix b_bits(b);
+    auto counts = a * b;
+
+    // counting product agrees with the integer product, boolean product
+    // with its nonzero pattern
+    auto bit_counts = codesample::bit_matrix::multiply_count(a_bits, b_bits);
+    auto product = a_bits * b_bits;
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            if (bit_counts[i][j] != static_cast<uint32_t>(counts[i][j]))
+            {
+                throw std::runtime_error("bit matrix count multiply");
+            }
+            if (product.get(i, j) != (counts[i][j] != 0))
+            {
+                throw std::runtime_error("bit matrix boolean multiply");
+            }
+        }
+    }
+
+    // transpose round trip and agreement with the generic transpose
+    if (a_bits.transpose() != codesample::bit_matrix(a.transpose()) || a_bits.transpose().transpose() != a_bits)
+    {
+        throw std::runtime_error("bit matrix transpose");
+    }
+    if (a_bits.to_matrix<int>() != a)
+    {
+        throw std::runtime_error("bit matrix conversion");
+    }
+
+    // reachability along a chain 0 -> 1 -> ... -> 99 plus a cycle 100 <-> 101
+    codesample::bit_matrix graph(102, 102);
+    for (size_t i = 0; i + 1 < 100; i++)
+    {
+        graph.set(i, i + 1);
+    }
+    graph.set(100, 101);
+    graph.set(101, 100);
+    auto reach = graph.transitive_closure();
+    if (!reach.get(0, 99) || !reach.get(42, 42) || reach.get(99, 0) || reach.get(0, 100) || !reach.get(101, 100))
+    {
+        throw std::runtime_error("bit matrix closure");
+    }
+    if (reach.count() != 100 * 101 / 2 + 4)
+    {
+        throw std::runtime_error("bit matrix closure count");
+    }
+
+    try
+    {
+        a_bits * a_bits;
+        throw std::runtime_error("bit matrix multiply dimensions");
+    }
+    catch (codesample::invalid_dimension &e)
+    {
+    }
+}
+
+void test_semiring()
+{
+    // blocked kernel against a plain triple loop, on a shape that leaves
+    // partial register tiles and spans several panels of k, run with one
+    // and with several threads
+    const size_t m = 67, k = 300, n = 131;
+    codesample::matrix<long long> a(m, k);
+    codesample::matrix<long long> b(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a[i][p] = static_cast<long long>((i * 31 + p * 17) % 23) - 11;
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b[p][j] = static_cast<long long>((p * 13 + j * 7) % 19) - 9;
+        }
+    }
+    codesample::matrix<long long> expected(m, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t p = 0; p < k; p++)
+            {
+                expected[i][j] += a[i][p] * b[p][j];
+            }
+        }
+    }
+    const size_t thread_counts[] = {1, 3};
+    for (size_t threads : thread_counts)
+    {
+        codesample::set_num_threads(threads);
+        if (a * b != expected)
+        {
+            throw std::runtime_error("blocked multiply with " + std::to_string(threads) + " threads");
+        }
+    }
+    codesample::set_num_threads(0);
+
+    // shortest paths on a small graph: 0 -> 1 -> 2 -> 3 is shorter than 0 -> 3,
+    // and 4 is unreachable
+    const double inf = codesample::min_plus<double>::zero();
+    codesample::matrix<double> weights{{0, 1, inf, 10, inf},
+                                       {inf, 0, 2, inf, inf},
+                                       {inf, inf, 0, 3, inf},
+                                       {inf, inf, inf, 0, inf},
+                                       {inf, inf, inf, 1, 0}};
+    codesample::matrix<double> distances{{0, 1, 3, 6, inf},
+                                         {inf, 0, 2, 5, inf},
+                                         {inf, inf, 0, 3, inf},
+                                         {inf, inf, inf, 0, inf},
+                                         {inf, inf, inf, 1, 0}};
+    if (codesample::shortest_paths(weights) != distances)
+    {
+        throw std::runtime_error("shortest paths");
+    }
+
+    // integer weights use the largest value for no edge, without overflowing
+    const int none = codesample::min_plus<int>::zero();
+    codesample::matrix<int> int_weights{{0, 4, none}, {none, 0, 5}, {1, none, 0}};
+    codesample::matrix<int> int_distances{{0, 4, 9}, {6, 0, 5}, {1, 5, 0}};
+    if (codesample::shortest_paths(int_weights) != int_distances)
+    {
+        throw std::runtime_error("integer shortest paths");
+    }
+
+    // best two step scores
+    codesample::matrix<int> scores1{{1, 5}, {2, 0}};
+    codesample::matrix<int> scores2{{3, 1}, {0, 4}};
+    codesample::matrix<int> best{{5, 9}, {5, 4}};
+    if (codesample::matrix<int>::multiply<codesample::max_plus<int>>(scores1, scores2) != best)
+    {
+        throw std::runtime_error("max plus multiply");
+    }
+
+    // two step reachability
+    codesample::matrix<bool> edges{{false, true, false}, {false, false, true}, {false, false, false}};
+    codesample::matrix<bool> two_steps{{false, false, true}, {false, false, false}, {false, false, false}};
+    if (codesample::matrix<bool>::multiply<codesample::or_and>(edges, edges) != two_steps)
+    {
+        throw std::runtime_error("or and multiply");
+    }
+
+    // a single row is split by columns across threads; the ranges must not
+    // share a word of the packed bool rows
+    codesample::matrix<bool> frontier(1, 2048), graph(2048, 2048);
+    for (size_t j = 0; j < 2048; j += 3)
+    {
+        frontier(0, j) = true;
+    }
+    for (size_t i = 0; i < 2048; i++)
+    {
+        graph(i, (i * 7 + 1) % 2048) = true;
+    }
+    codesample::matrix<bool> reached(1, 2048);
+    for (size_t j = 0; j < 2048; j += 3)
+    {
+        reached(0, (j * 7 + 1) % 2048) = true;
+    }
+    for (size_t threads : {3, 5, 7})
+    {
+        codesample::set_num_threads(threads);
+        const codesample::matrix<bool> next = codesample::matrix<bool>::multiply<codesample::or_and>(frontier, graph);
+        codesample::set_num_threads(0);
+        if (next != reached)
+        {
+            throw std::runtime_error("or and row vector across threads");
+        }
+    }
+}
+
+void test_modular()
+{
+    // each reduction strategy against a per element reference, with inputs
+    // that are not reduced and a shape that spans several panels of k
+    const size_t m = 9, k = 300, n = 13;
+    codesample::matrix<uint64_t> a(m, k);
+    codesample::matrix<uint64_t> b(k, n);
+    uint64_t state = 12345;
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            a[i][p] = state;
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            b[p][j] = state;
+        }
+    }
+    const uint64_t moduli[] = {1, 7, 998244353, 2147483647, 1ULL << 32, (1ULL << 61) - 1, 1ULL << 62,
+                               18446744073709551557ULL};
+    for (uint64_t mod : moduli)
+    {
+        codesample::matrix<uint64_t> c = codesample::modular_multiply(a, b, mod);
+        for (size_t i = 0; i < m; i++)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                uint64_t expected = 0;
+                for (size_t p = 0; p < k; p++)
+                {
+                    uint64_t product = codesample::detail::mulmod(a[i][p] % mod, b[p][j] % mod, mod);
+                    expected = codesample::detail::addmod(expected, product, mod);
+                }
+                if (c[i][j] != expected)
+                {
+                    throw std::runtime_error("modular multiply modulo " + std::to_string(mod));
+                }
+            }
+        }
+    }
+
+    if (!codesample::is_prime(2) || !codesample::is_prime(998244353) || !codesample::is_prime((1ULL << 61) - 1) ||
+        !codesample::is_prime(18446744073709551557ULL))
+    {
+        throw std::runtime_error("prime reported composite");
+    }
+    if (codesample::is_prime(1) || codesample::is_prime(561) || codesample::is_prime(3215031751ULL) ||
+        codesample::is_prime(18446744073709551615ULL))
+    {
+        throw std::runtime_error("composite reported prime");
+    }
+
+    // exact products whose sums overflow 64 bits, against int128 arithmetic
+    const int64_t big = std::numeric_limits<int64_t>::max();
+    codesample::matrix<int64_t> x{{big / 2, -(big / 2), 3}, {-5, big / 3, -(big / 7)}};
+    codesample::matrix<int64_t> y{{big / 5, 2}, {big / 11, -big}, {-7, big / 13}};
+    codesample::matrix<codesample::int128> exact = codesample::exact_multiply(x, y);
+    for (size_t i = 0; i < x.rows(); i++)
+    {
+        for (size_t j = 0; j < y.cols(); j++)
+        {
+            codesample::int128 expected;
+            for (size_t p = 0; p < x.cols(); p++)
+            {
+                expected += codesample::int128(x[i][p]) * codesample::int128(y[p][j]);
+            }
+            if (exact[i][j] != expected)
+            {
+                throw std::runtime_error("exact multiply");
+            }
+        }
+    }
+    if (codesample::exact_multiply(codesample::matrix<int64_t>{{-3, 4}}, codesample::matrix<int64_t>{{5}, {2}}) !=
+        codesample::matrix<codesample::int128>{{codesample::int128(-7)}})
+    {
+        throw std::runtime_error("small exact multiply");
+    }
+    if ((codesample::int128(big) * codesample::int128(-big)).str() != "-85070591730234615847396907784232501249")
+    {
+        throw std::runtime_error("int128 formatting");
+    }
+
+    bool thrown = false;
+    try
+    {
+        codesample::matrix<int64_t> huge{{std::numeric_limits<int64_t>::min(), 1}};
+        codesample::exact_multiply(huge, huge.transpose());
+    }
+    catch (std::overflow_error &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("exact multiply accepted a product that may not fit");
+    }
+}
+
+void test_kron()
+{
+    codesample::matrix<int> a{{1, 2}, {3, 4}};
+    codesample::matrix<int> b{{0, 5}, {6, 7}};
+    codesample::matrix<int> ab{{0, 5, 0, 10}, {6, 7, 12, 14}, {0, 15, 0, 20}, {18, 21, 24, 28}};
+    if (codesample::kron(a, b) != ab)
+    {
+        throw std::runtime_error("kron");
+    }
+
+    // the lazy operator against the dense product, with rectangular
+    // factors so that both bracketings get used
+    const size_t shapes[][4] = {{3, 5, 4, 2}, {2, 6, 5, 3}, {5, 2, 3, 7}};
+    for (const size_t *shape : shapes)
+    {
+        codesample::matrix<long long> f(shape[0], shape[1]);
+        codesample::matrix<long long> g(shape[2], shape[3]);
+        for (size_t i = 0; i < f.rows(); i++)
+        {
+            for (size_t j = 0; j < f.cols(); j++)
+            {
+                f[i][j] = static_cast<long long>(i * 7 + j * 3) % 5 - 2;
+            }
+        }
+        for (size_t i = 0; i < g.rows(); i++)
+        {
+            for (size_t j = 0; j < g.cols(); j++)
+            {
+                g[i][j] = static_cast<long long>(i * 5 + j * 11) % 7 - 3;
+            }
+        }
+        codesample::kronecker_operator<long long> op(f, g);
+        codesample::matrix<long long> dense = codesample::kron(f, g);
+        if (op.to_matrix() != dense || op.rows() != dense.rows() || op.cols() != dense.cols())
+        {
+            throw std::runtime_error("kronecker operator shape");
+        }
+
+        std::vector<long long> x(op.cols());
+        for (size_t j = 0; j < x.size(); j++)
+        {
+            x[j] = static_cast<long long>(j % 9) - 4;
+        }
+        std::vector<long long> y = op.apply(x);
+        for (size_t i = 0; i < dense.rows(); i++)
+        {
+            long long expected = 0;
+            for (size_t j = 0; j < dense.cols(); j++)
+            {
+                expected += dense[i][j] * x[j];
+            }
+            if (y[i] != expected)
+            {
+                throw std::runtime_error("kronecker operator apply");
+            }
+        }
+    }
+
+    bool thrown = false;
+    try
+    {
+        codesample::kronecker_operator<int>(a, b).apply(std::vector<int>(3));
+    }
+    catch (codesample::invalid_dimension &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("kronecker operator accepted a vector of the wrong size");
+    }
+}
+
+/**
+ * @brief Direct convolution, for reference
+ */
+template <class T>
+std::vector<codesample::matrix<T>> direct_convolve(const std::vector<codesample::matrix<T>> &input,
+                                                   const codesample::matrix<T> &weights,
+                                                   const codesample::conv_params &params)
+{
+    const long height = input[0].rows(), width = input[0].cols();
+    const long pad = params.padding, kh = params.kernel_rows, kw = params.kernel_cols, s = params.stride;
+    const size_t out_rows = (height + 2 * pad - kh) / s + 1, out_cols = (width + 2 * pad - kw) / s + 1;
+    std::vector<codesample::matrix<T>> output(weights.rows(), codesample::matrix<T>(out_rows, out_cols));
+    for (size_t f = 0; f < weights.rows(); f++)
+    {
+        for (size_t oy = 0; oy < out_rows; oy++)
+        {
+            for (size_t ox = 0; ox < out_cols; ox++)
+            {
+                T sum = T();
+                for (size_t c = 0; c < input.size(); c++)
+                {
+                    for (long ky = 0; ky < kh; ky++)
+                    {
+                        for (long kx = 0; kx < kw; kx++)
+                        {
+                            long y = oy * s + ky - pad, x = ox * s + kx - pad;
+                            if (y >= 0 && x >= 0 && y < height && x < width)
+                            {
+                                sum += weights[f][(c * kh + ky) * kw + kx] * input[c][y][x];
+                            }
+                        }
+                    }
+                }
+                output[f][oy][ox] = sum;
+            }
+        }
+    }
+    return output;
+}
+
+void test_conv()
+{
+    // implicit GEMM is exact on integers, for a few shapes and strides
+    const size_t shapes[][6] = {
+        // channels, filters, kernel rows, kernel cols, stride, padding
+        {1, 1, 3, 3, 1, 0}, {3, 4, 3, 3, 1, 1}, {2, 5, 5, 3, 2, 2}, {4, 3, 1, 1, 1, 0}, {3, 2, 4, 4, 3, 1}};
+    for (const size_t *shape : shapes)
+    {
+        codesample::conv_params params(shape[2], shape[3], shape[4], shape[5]);
+        std::vector<codesample::matrix<long long>> input(shape[0], codesample::matrix<long long>(11, 9));
+        for (size_t c = 0; c < shape[0]; c++)
+        {
+            for (size_t i = 0; i < 11; i++)
+            {
+                for (size_t j = 0; j < 9; j++)
+                {
+                    input[c][i][j] = static_cast<long long>((c * 7 + i * 5 + j * 3) % 11) - 5;
+                }
+            }
+        }
+        codesample::matrix<long long> weights(shape[1], shape[0] * shape[2] * shape[3]);
+        for (size_t f = 0; f < weights.rows(); f++)
+        {
+            for (size_t k = 0; k < weights.cols(); k++)
+            {
+                weights[f][k] = static_cast<long long>((f * 3 + k * 7) % 5) - 2;
+            }
+        }
+        std::vector<codesample::matrix<long long>> output = codesample::convolve(input, weights, params);
+        std::vector<codesample::matrix<long long>> expected = direct_convolve(input, weights, params);
+        for (size_t f = 0; f < expected.size(); f++)
+        {
+            if (output[f] != expected[f])
+            {
+                throw std::runtime_error("implicit GEMM convolution");
+            }
+        }
+    }
+
+    // Winograd agrees with the direct sum up to rounding, including
+    // output sizes that leave partial 2x2 tiles
+    const size_t sizes[][2] = {{8, 8}, {7, 10}, {3, 3}};
+    for (const size_t *size : sizes)
+    {
+        for (size_t padding = 0; padding < 2; padding++)
+        {
+            codesample::conv_params params(3, 3, 1, padding);
+            std::vector<codesample::matrix<double>> input(3, codesample::matrix<double>(size[0], size[1]));
+            for (size_t c = 0; c < input.size(); c++)
+            {
+                for (size_t i = 0; i < size[0]; i++)
+                {
+                    for (size_t j = 0; j < size[1]; j++)
+                    {
+                        input[c][i][j] = std::sin(static_cast<double>(c * 100 + i * 10 + j));
+                    }
+                }
+            }
+            codesample::matrix<double> weights(4, 27);
+            for (size_t f = 0; f < 4; f++)
+            {
+                for (size_t k = 0; k < 27; k++)
+                {
+                    weights[f][k] = std::cos(static_cast<double>(f * 27 + k));
+                }
+            }
+            std::vector<codesample::matrix<double>> fast =
+                codesample::convolve(input, weights, params, codesample::conv_algorithm::winograd);
+            std::vector<codesample::matrix<double>> expected = direct_convolve(input, weights, params);
+            for (size_t f = 0; f < 4; f++)
+            {
+                if (fast[f].rows() != expected[f].rows() || fast[f].cols() != expected[f].cols())
+                {
+                    throw std::runtime_error("Winograd output size");
+                }
+                for (size_t i = 0; i < fast[f].rows(); i++)
+                {
+                    for (size_t j = 0; j < fast[f].cols(); j++)
+                    {
+                        if (std::fabs(fast[f][i][j] - expected[f][i][j]) > 1e-12)
+                        {
+                            throw std::runtime_error("Winograd convolution");
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    bool thrown = false;
+    try
+    {
+        std::vector<codesample::matrix<int>> image(1, codesample::matrix<int>(4, 4));
+        codesample::convolve(image, codesample::matrix<int>(1, 9), codesample::conv_params(3, 3),
+                             codesample::conv_algorithm::winograd);
+    }
+    catch (std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("Winograd accepted integer data");
+    }
+
+    thrown = false;
+    try
+    {
+        std::vector<codesample::matrix<int>> image(2, codesample::matrix<int>(4, 4));
+        codesample::convolve(image, codesample::matrix<int>(1, 9), codesample::conv_params(3, 3));
+    }
+    catch (codesample::invalid_dimension &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("convolution accepted weights of the wrong size");
+    }
+}
+
+void test_epilogue()
+{
+    codesample::matrix<double> x{{1, -2, 3}, {-4, 5, -6}};
+    codesample::matrix<double> w{{0.5, -1}, {2, 0.25}, {-1.5, 1}};
+    codesample::matrix<double> product = x * w;
+    std::vector<double> b{0.25, -10};
+
+    codesample::matrix<double> fused =
+        codesample::matrix<double>::multiply(x, w, codesample::chain(codesample::bias(b), codesample::relu()));
+    for (size_t i = 0; i < product.rows(); i++)
+    {
+        for (size_t j = 0; j < product.cols(); j++)
+        {
+            if (fused[i][j] != std::max(0.0, product[i][j] + b[j]))
+            {
+                throw std::runtime_error("bias and relu");
+            }
+        }
+    }
+
+    fused = codesample::matrix<double>::multiply(
+        x, w, codesample::chain(codesample::scale(2.0), codesample::gelu(), codesample::clamp(-0.1, 5.0)));
+    for (size_t i = 0; i < product.rows(); i++)
+    {
+        for (size_t j = 0; j < product.cols(); j++)
+        {
+            double v = 2 * product[i][j];
+            double expected = std::min(5.0, std::max(-0.1, 0.5 * v * (1 + std::erf(v / std::sqrt(2.0)))));
+            if (std::fabs(fused[i][j] - expected) > 1e-15)
+            {
+                throw std::runtime_error("scale, gelu and clamp");
+            }
+        }
+    }
+
+    // quantizing in the epilogue matches quantizing the float product,
+    // on a product big enough to span several register tiles
+    codesample::matrix<float> a(37, 50);
+    codesample::matrix<float> c(50, 29);
+    for (size_t i = 0; i < a.rows(); i++)
+    {
+        for (size_t j = 0; j < a.cols(); j++)
+        {
+            a[i][j] = static_cast<float>((i * 13 + j * 7) % 17) / 8 - 1;
+        }
+    }
+    for (size_t i = 0; i < c.rows(); i++)
+    {
+        for (size_t j = 0; j < c.cols(); j++)
+        {
+            c[i][j] = static_cast<float>((i * 5 + j * 11) % 13) / 6 - 1;
+        }
+    }
+    codesample::matrix<float> ac = a * c;
+    codesample::quant_params q = codesample::choose_quant_params(ac, codesample::quant_axis::column);
+    codesample::matrix<int8_t> quantized = codesample::multiply_to<int8_t>(a, c, codesample::quantize_output(q));
+    if (quantized != codesample::quantize(ac, q))
+    {
+        throw std::runtime_error("quantize epilogue");
+    }
+
+    // a bias that doesn't match the product's columns is refused, also
+    // inside a chain and when storing into another type
+    const std::vector<std::vector<double>> wrong_biases = {{1.0}, {1.0, 2.0, 3.0}};
+    for (const std::vector<double> &wrong : wrong_biases)
+    {
+        bool thrown = false;
+        try
+        {
+            codesample::matrix<double>::multiply(x, w, codesample::chain(codesample::relu(), codesample::bias(wrong)));
+        }
+        catch (codesample::invalid_dimension &)
+        {
+            thrown = true;
+        }
+        if (!thrown)
+        {
+            throw std::runtime_error("bias of the wrong size");
+        }
+    }
+    bool thrown = false;
+    try
+    {
+        codesample::multiply_to<float>(x, w, codesample::bias(std::vector<double>(5)));
+    }
+    catch (codesample::invalid_dimension &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("bias of the wrong size into another type");
+    }
+}
+
+void test_view()
+{
+    codesample::matrix<int> m{{1, 2, 3, 4}, {5, 6, 7, 8}, {9, 10, 11, 12}};
+    codesample::matrix_view<int> block = m.view(1, 1, 2, 3);
+    if (block.rows() != 2 || block.cols() != 3 || block(0, 0) != 6 || block(1, 2) != 12)
+    {
+        throw std::runtime_error("view elements");
+    }
+    if (codesample::matrix<int>(block.view(1, 0, 1, 2)) != codesample::matrix<int>{{10, 11}})
+    {
+        throw std::runtime_error("view of a view");
+    }
+
+    // writes go through to the matrix, and a cached transpose follows them
+    codesample::matrix<int> m_T = m.transpose();
+    block = m.view(1, 1, 2, 3);
+    block(0, 1) = -7;
+    block.view(1, 0, 1, 1).assign(codesample::matrix<int>{{-10}});
+    if (m != codesample::matrix<int>{{1, 2, 3, 4}, {5, 6, -7, 8}, {9, -10, 11, 12}} || m.transpose() == m_T)
+    {
+        throw std::runtime_error("write through view");
+    }
+
+    const codesample::matrix<int> &const_m = m;
+    codesample::matrix_view<const int> read_only = const_m.view(0, 2, 3, 2);
+    if (codesample::matrix<int>(read_only) != codesample::matrix<int>{{3, 4}, {-7, 8}, {11, 12}})
+    {
+        throw std::runtime_error("read only view");
+    }
+
+    const size_t past_end[][4] = {{2, 0, 2, 1}, {0, 3, 1, 2}};
+    for (const size_t *block_shape : past_end)
+    {
+        bool thrown = false;
+        try
+        {
+            m.view(block_shape[0], block_shape[1], block_shape[2], block_shape[3]);
+        }
+        catch (std::out_of_range &)
+        {
+            thrown = true;
+        }
+        if (!thrown)
+        {
+            throw std::runtime_error("view past the end");
+        }
+    }
+
+    // a block product assembled from views of the operands, accumulated
+    // into views of the output, matches the plain product
+    const size_t n = 70, half = 33;
+    codesample::matrix<double> a(n, n);
+    codesample::matrix<double> b(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            a[i][j] = static_cast<double>((i * 7 + j * 3) % 10) - 5;
+            b[i][j] = static_cast<double>((i * 2 + j * 9) % 8) - 4;
+        }
+    }
+    const codesample::matrix<double> &ca = a, &cb = b;
+    codesample::matrix<double> c(n, n, 99);
+    const size_t starts[] = {0, half}, sizes[] = {half, n - half};
+    for (size_t bi = 0; bi < 2; bi++)
+    {
+        for (size_t bj = 0; bj < 2; bj++)
+        {
+            codesample::matrix_view<double> out = c.view(starts[bi], starts[bj], sizes[bi], sizes[bj]);
+            for (size_t bk = 0; bk < 2; bk++)
+            {
+                codesample::multiply_into(ca.view(starts[bi], starts[bk], sizes[bi], sizes[bk]),
+                                          cb.view(starts[bk], starts[bj], sizes[bk], sizes[bj]), out, bk > 0);
+            }
+        }
+    }
+    if (c != a * b)
+    {
+        throw std::runtime_error("block multiply into views");
+    }
+}
+
+void test_matrix_ref()
+{
+    // buffers with padding at the end of each row, as a caller might hand over
+    const size_t m = 19, k = 45, n = 23, lda = 48, ldb = 24, ldc = 30;
+    std::vector<double> a_buffer(m * lda, -1), b_buffer(k * ldb, -1), c_buffer(m * ldc, -1);
+    codesample::matrix_ref<double> a(a_buffer.data(), m, k, lda);
+    codesample::matrix_ref<double> b(b_buffer.data(), k, n, ldb);
+    codesample::matrix_ref<double> c(c_buffer.data(), m, n, ldc);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a(i, p) = static_cast<double>((i * 3 + p * 5) % 7) - 3;
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b(p, j) = static_cast<double>((p * 11 + j * 2) % 9) - 4;
+        }
+    }
+
+    codesample::matrix_ref<const double> a_const = a;
+    codesample::multiply_into(a_const, b, c);
+    codesample::matrix<double> expected = codesample::matrix<double>(a) * codesample::matrix<double>(b);
+    if (codesample::matrix<double>(c) != expected)
+    {
+        throw std::runtime_error("multiply into matrix ref");
+    }
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = n; j < ldc; j++)
+        {
+            if (c_buffer[i * ldc + j] != -1)
+            {
+                throw std::runtime_error("multiply wrote into row padding");
+            }
+        }
+    }
+
+    // transposing a block of one buffer into another
+    std::vector<double> t_buffer(40 * 40);
+    codesample::matrix_ref<double> t(t_buffer.data(), 40, 40);
+    codesample::transpose_into(a.view(2, 3, 15, 37), t.view(1, 0, 37, 15));
+    for (size_t i = 0; i < 37; i++)
+    {
+        for (size_t j = 0; j < 15; j++)
+        {
+            if (t(i + 1, j) != a(j + 2, i + 3))
+            {
+                throw std::runtime_error("transpose into matrix ref");
+            }
+        }
+    }
+
+    // a matrix can be transposed straight into a ref, and a view into a matrix
+    codesample::matrix<int> small{{1, 2, 3}, {4, 5, 6}};
+    int small_T[6];
+    codesample::transpose_into(small, codesample::matrix_ref<int>(small_T, 3, 2));
+    codesample::matrix<int> back(2, 3);
+    codesample::transpose_into(codesample::matrix_ref<const int>(small_T, 3, 2), back.view(0, 0, 2, 3));
+    if (back != small || small_T[1] != 4)
+    {
+        throw std::runtime_error("transpose between matrix and ref");
+    }
+
+    bool thrown = false;
+    try
+    {
+        codesample::matrix_ref<int>(small_T, 2, 3, 2);
+    }
+    catch (std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("leading dimension shorter than a row");
+    }
+}
+
+void test_layout()
+{
+    // every combination of operand layouts, into a column major output,
+    // against the plain product
+    const size_t m = 21, k = 300, n = 17;
+    codesample::matrix<long long> a(m, k);
+    codesample::matrix<long long> b(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a[i][p] = static_cast<long long>((i * 3 + p * 7) % 11) - 5;
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b[p][j] = static_cast<long long>((p * 5 + j * 2) % 13) - 6;
+        }
+    }
+    codesample::matrix<long long> expected = a * b;
+
+    std::vector<long long> a_rows(m * k), a_cols(m * k), b_rows(k * n), b_cols(k * n), c_cols(m * n);
+    codesample::matrix_ref<long long> ar(a_rows.data(), m, k);
+    codesample::matrix_ref<long long, codesample::column_major> ac(a_cols.data(), m, k);
+    codesample::matrix_ref<long long> br(b_rows.data(), k, n);
+    codesample::matrix_ref<long long, codesample::column_major> bc(b_cols.data(), k, n);
+    ar.assign(a);
+    ac.assign(a);
+    br.assign(b);
+    bc.assign(b);
+    if (a_cols[1] != a[1][0] || b_cols[k] != b[0][1])
+    {
+        throw std::runtime_error("column major storage order");
+    }
+
+    codesample::matrix_ref<long long, codesample::column_major> c(c_cols.data(), m, n);
+    codesample::multiply_into(ar, br, c);
+    bool ok = codesample::matrix<long long>(c) == expected;
+    codesample::multiply_into(ac, br, c);
+    ok = ok && codesample::matrix<long long>(c) == expected;
+    codesample::multiply_into(ar, bc, c);
+    ok = ok && codesample::matrix<long long>(c) == expected;
+    codesample::multiply_into(ac, bc, c);
+    ok = ok && codesample::matrix<long long>(c) == expected;
+    if (!ok)
+    {
+        throw std::runtime_error("mixed layout multiply");
+    }
+
+    // transposing a ref just switches layout, and blocks keep the
+    // leading dimension
+    codesample::matrix_ref<long long> a_T = ac.transposed();
+    if (a_T.rows() != k || a_T.cols() != m || a_T(7, 3) != a[3][7] || a_T.data() != ac.data())
+    {
+        throw std::runtime_error("transposed ref");
+    }
+    codesample::matrix_ref<const long long, codesample::column_major> block = ac.view(2, 5, 3, 4);
+    if (block.ld() != m || block(2, 3) != a[4][8])
+    {
+        throw std::runtime_error("column major block");
+    }
+
+    std::vector<long long> t_cols(m * k);
+    codesample::transpose_into(ac, codesample::matrix_ref<long long, codesample::column_major>(t_cols.data(), k, m));
+    if (codesample::matrix<long long>(codesample::matrix_ref<long long>(t_cols.data(), m, k)) != a)
+    {
+        throw std::runtime_error("transpose into column major");
+    }
+}
+
+void test_tiled()
+{
+    // shapes that leave partial tiles and tile grids that are not a
+    // power-of-two square, with small tiles so that there are many
+    const size_t m = 37, k = 50, n = 29, tile = 8;
+    codesample::matrix<long long> a(m, k);
+    codesample::matrix<long long> b(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a[i][p] = static_cast<long long>((i * 5 + p * 3) % 9) - 4;
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b[p][j] = static_cast<long long>((p * 7 + j * 11) % 13) - 6;
+        }
+    }
+    codesample::matrix<long long> expected = a * b;
+    codesample::matrix<long long> a_T = a.transpose();
+
+    const codesample::tile_order orders[] = {codesample::tile_order::row_major, codesample::tile_order::morton};
+    for (codesample::tile_order order : orders)
+    {
+        codesample::tiled_matrix<long long> ta(a, order, tile);
+        codesample::tiled_matrix<long long> tb(b, order, tile);
+        if (ta.to_matrix() != a || ta(17, 43) != a[17][43])
+        {
+            throw std::runtime_error("tiled round trip");
+        }
+        if ((ta * tb).to_matrix() != expected)
+        {
+            throw std::runtime_error("tiled multiply");
+        }
+        if (ta.transpose().to_matrix() != a_T)
+        {
+            throw std::runtime_error("tiled transpose");
+        }
+    }
+
+    // Morton order puts each aligned 2x2 block of tiles together
+    codesample::tiled_matrix<int> z(4 * tile, 4 * tile, codesample::tile_order::morton, tile);
+    const size_t area = tile * tile;
+    if (z.tile(0, 1) - z.tile(0, 0) != static_cast<long>(area) ||
+        z.tile(1, 0) - z.tile(0, 0) != static_cast<long>(2 * area) ||
+        z.tile(0, 2) - z.tile(0, 0) != static_cast<long>(4 * area))
+    {
+        throw std::runtime_error("Morton tile order");
+    }
+
+    codesample::tiled_matrix<long long> row_tiles(a, codesample::tile_order::row_major, tile);
+    codesample::tiled_matrix<long long> morton_tiles(a, codesample::tile_order::morton, tile);
+    if (row_tiles != morton_tiles)
+    {
+        throw std::runtime_error("comparison across tile orders");
+    }
+
+    bool thrown = false;
+    try
+    {
+        codesample::tiled_matrix<long long>(a, codesample::tile_order::morton, 8) *
+            codesample::tiled_matrix<long long>(b, codesample::tile_order::morton, 16);
+    }
+    catch (codesample::invalid_dimension &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("multiply accepted different tile sizes");
+    }
+}
+
+void test_small_shapes()
+{
+    // shapes on both sides of each cutoff in the shape dispatch, checked
+    // against the blocked kernel with exact integer arithmetic
+    const size_t tiny = codesample::detail::gemm_tiny_size;
+    const size_t skinny = codesample::detail::gemm_skinny_k;
+    const size_t shapes[][3] = {{1, 1, 1}, {1, 3, 3}, {3, 1, 3}, {3, 3, 1}, {2, 4, 3}, {tiny, tiny, tiny},
+                                {tiny + 1, tiny, tiny}, {tiny, tiny, tiny + 1}, {37, 1, 50}, {1, 29, 50},
+                                {1, 1, 50}, {37, 29, skinny}, {37, 29, skinny + 1}, {1, 300, 700}};
+    for (const auto &shape : shapes)
+    {
+        const size_t m = shape[0], n = shape[1], k = shape[2];
+        codesample::matrix<long long> a(m, k);
+        codesample::matrix<long long> b(k, n);
+        for (size_t i = 0; i < m; i++)
+        {
+            for (size_t p = 0; p < k; p++)
+            {
+                a[i][p] = static_cast<long long>((i * 5 + p * 3) % 9) - 4;
+            }
+        }
+        for (size_t p = 0; p < k; p++)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                b[p][j] = static_cast<long long>((p * 7 + j * 11) % 13) - 6;
+            }
+        }
+
+        codesample::matrix<long long> expected(m, n);
+        codesample::detail::row_writer<long long> out(expected);
+        codesample::detail::gemm_blocked<codesample::plus_times<long long>>(a, b, out);
+        if (a * b != expected)
+        {
+            throw std::runtime_error("small shape " + std::to_string(m) + "x" + std::to_string(n) + "x" +
+                                     std::to_string(k));
+        }
+    }
+
+    // the small kernels keep the semiring's zero and order of operations
+    codesample::matrix<int> d({{0, 4, codesample::min_plus<int>::zero()}});
+    codesample::matrix<int> e({{0, 1, 9}, {2, 0, 3}, {5, 1, 0}});
+    codesample::matrix<int> paths = codesample::matrix<int>::multiply<codesample::min_plus<int>>(d, e);
+    if (paths != codesample::matrix<int>({{0, 1, 7}}))
+    {
+        throw std::runtime_error("small min-plus product");
+    }
+}
+
+void test_linalg()
+{
+    // det of a matrix that needs pivoting: the first pivot is 0
+    codesample::matrix<double> a({{0, 2, 1}, {1, 1, 0}, {2, 0, 3}});
+    codesample::lu_decomposition<double> lu(a);
+    if (std::fabs(lu.det() - (-8.0)) > 1e-12 || std::fabs(codesample::det(a) - (-8.0)) > 1e-12)
+    {
+        throw std::runtime_error("determinant");
+    }
+
+    // P A = L U
+    codesample::matrix<double> pa(3, 3);
+    for (size_t i = 0; i < 3; i++)
+    {
+        pa[i] = a[lu.permutation()[i]];
+    }
+    codesample::matrix<double> lu_product = lu.lower() * lu.upper();
+    for (size_t i = 0; i < 3; i++)
+    {
+        for (size_t j = 0; j < 3; j++)
+        {
+            if (std::fabs(lu_product[i][j] - pa[i][j]) > 1e-12)
+            {
+                throw std::runtime_error("LU factors");
+            }
+        }
+    }
+
+    // big enough for several panels and a partial last one
+    const size_t n = 150;
+    codesample::matrix<double> m(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            m[i][j] = std::sin(static_cast<double>(i * i * n + j * j + i * j + 1));
+        }
+    }
+    codesample::matrix<double> m_inv = codesample::inverse(m);
+    codesample::matrix<double> product = m * m_inv;
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            if (std::fabs(product[i][j] - (i == j ? 1.0 : 0.0)) > 1e-8)
+            {
+                throw std::runtime_error("inverse");
+            }
+        }
+    }
+
+    codesample::matrix<double> b(n, 2);
+    for (size_t i = 0; i < n; i++)
+    {
+        b[i][0] = 1;
+        b[i][1] = static_cast<double>(i);
+    }
+    codesample::matrix<double> residual = m * codesample::solve(m, b);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (std::fabs(residual[i][0] - b[i][0]) > 1e-8 || std::fabs(residual[i][1] - b[i][1]) > 1e-6)
+        {
+            throw std::runtime_error("solve");
+        }
+    }
+
+    // the estimate is a lower bound, and close
+    double norm = 0, inv_norm = 0;
+    for (size_t j = 0; j < n; j++)
+    {
+        double col = 0, inv_col = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            col += std::fabs(m[i][j]);
+            inv_col += std::fabs(m_inv[i][j]);
+        }
+        norm = std::max(norm, col);
+        inv_norm = std::max(inv_norm, inv_col);
+    }
+    const double exact = norm * inv_norm;
+    const double estimate = codesample::condition_estimate(m);
+    if (estimate > exact * (1 + 1e-8) || estimate < exact / 3)
+    {
+        throw std::runtime_error("condition estimate");
+    }
+
+    codesample::matrix<double> singular({{1, 2}, {2, 4}});
+    if (codesample::det(singular) != 0 || !std::isinf(codesample::condition_estimate(singular)))
+    {
+        throw std::runtime_error("singular determinant");
+    }
+    bool thrown = false;
+    try
+    {
+        codesample::inverse(singular);
+    }
+    catch (codesample::singular_matrix &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("inverted a singular matrix");
+    }
+}
+
+/**
+ * @brief The largest absolute difference between two matrices of the same size
+ */
+double max_difference(const codesample::matrix<double> &a, const codesample::matrix<double> &b)
+{
+    double worst = 0;
+    for (size_t i = 0; i < a.rows(); i++)
+    {
+        for (size_t j = 0; j < a.cols(); j++)
+        {
+            worst = std::max(worst, std::fabs(a(i, j) - b(i, j)));
+        }
+    }
+    return worst;
+}
+
+void test_matfun()
+{
+    // exp of a rotation generator is a rotation; t = 10 needs scaling
+    const double t = 10;
+    codesample::matrix<double> generator({{0, -t}, {t, 0}});
+    codesample::matrix<double> rotation({{std::cos(t), -std::sin(t)}, {std::sin(t), std::cos(t)}});
+    if (max_difference(codesample::expm(generator), rotation) > 1e-12)
+    {
+        throw std::runtime_error("expm rotation");
+    }
+
+    // nilpotent, and small enough for the lowest degree
+    codesample::matrix<double> nilpotent({{0, 1e-3}, {0, 0}});
+    if (max_difference(codesample::expm(nilpotent), codesample::matrix<double>({{1, 1e-3}, {0, 1}})) > 1e-15)
+    {
+        throw std::runtime_error("expm nilpotent");
+    }
+
+    // a Markov generator: rows sum to 0, so the rows of its exponential sum to 1
+    const size_t n = 20;
+    codesample::matrix<double> q(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        double total = 0;
+        for (size_t j = 0; j < n; j++)
+        {
+            if (i != j)
+            {
+                q[i][j] = static_cast<double>((i * 7 + j * 3) % 5) * 0.3;
+                total += q[i][j];
+            }
+        }
+        q[i][i] = -total;
+    }
+    codesample::matrix<double> transition = codesample::expm(q);
+    for (size_t i = 0; i < n; i++)
+    {
+        double total = 0;
+        for (size_t j = 0; j < n; j++)
+        {
+            total += transition[i][j];
+        }
+        if (std::fabs(total - 1) > 1e-12)
+        {
+            throw std::runtime_error("expm Markov generator");
+        }
+    }
+
+    codesample::matrix<long long> fib({{1, 1}, {1, 0}});
+    if (codesample::pow(fib, 50)[0][1] != 12586269025LL ||
+        codesample::pow(fib, 0) != codesample::matrix<long long>({{1, 0}, {0, 1}}))
+    {
+        throw std::runtime_error("pow");
+    }
+    codesample::matrix<double> a({{2, 1}, {1, 3}});
+    codesample::matrix<double> identity({{1, 0}, {0, 1}});
+    if (max_difference(codesample::pow(a, -3) * codesample::pow(a, 3), identity) > 1e-12)
+    {
+        throw std::runtime_error("negative pow");
+    }
+
+    // symmetric positive definite: b b^T + n I
+    codesample::matrix<double> b(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b[i][j] = std::sin(static_cast<double>(i * i * n + j * j + i * j + 1));
+        }
+    }
+    codesample::matrix<double> spd = b * codesample::matrix<double>(b).transpose();
+    for (size_t i = 0; i < n; i++)
+    {
+        spd[i][i] += static_cast<double>(n);
+    }
+
+    codesample::symmetric_eigen<double> eigen(spd);
+    codesample::matrix<double> av = spd * eigen.vectors();
+    for (size_t j = 0; j < n; j++)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (std::fabs(av[i][j] - eigen.values()[j] * eigen.vectors()[i][j]) > 1e-10)
+            {
+                throw std::runtime_error("symmetric eigenpairs");
+            }
+        }
+    }
+
+    codesample::matrix<double> root = codesample::sqrtm(spd);
+    if (max_difference(root * root, spd) > 1e-10)
+    {
+        throw std::runtime_error("sqrtm");
+    }
+    if (max_difference(codesample::expm(codesample::logm(spd)), spd) > 1e-9)
+    {
+        throw std::runtime_error("logm");
+    }
+
+    // results feed back in, though they are symmetric only up to rounding
+    codesample::matrix<double> fourth_root = codesample::sqrtm(root);
+    if (fourth_root != codesample::matrix<double>(fourth_root).transpose() ||
+        max_difference(fourth_root * fourth_root * fourth_root * fourth_root, spd) > 1e-10)
+    {
+        throw std::runtime_error("sqrtm of sqrtm");
+    }
+    codesample::matrix<double> small = spd;
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            small[i][j] /= 4 * static_cast<double>(n);
+        }
+    }
+    if (max_difference(codesample::logm(codesample::expm(small)), small) > 1e-12)
+    {
+        throw std::runtime_error("logm of expm");
+    }
+
+    bool asymmetric = false;
+    try
+    {
+        codesample::sqrtm(codesample::matrix<double>({{2, 1}, {1.001, 2}}));
+    }
+    catch (std::domain_error &)
+    {
+        asymmetric = true;
+    }
+    if (!asymmetric)
+    {
+        throw std::runtime_error("sqrtm of an asymmetric matrix");
+    }
+
+    bool thrown = false;
+    try
+    {
+        codesample::sqrtm(codesample::matrix<double>({{1, 2}, {2, 1}}));
+    }
+    catch (std::domain_error &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("sqrtm of an indefinite matrix");
+    }
+}
+
+void test_eigs()
+{
+    // symmetric: the largest magnitude eigenvalues, against the dense solver
+    const size_t n = 120;
+    codesample::matrix<double> a(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j <= i; j++)
+        {
+            a[i][j] = a[j][i] = std::sin(static_cast<double>(i * i * n + j * j + i * j + 1));
+        }
+    }
+    std::vector<double> expected = codesample::symmetric_eigen<double>(a).values();
+    std::sort(expected.begin(), expected.end(), [](double x, double y) { return std::fabs(x) > std::fabs(y); });
+    codesample::eigenpairs<double> top = codesample::lanczos(a, 4);
+    if (!top.converged || top.values.size() != 4)
+    {
+        throw std::runtime_error("lanczos convergence");
+    }
+    for (size_t t = 0; t < 4; t++)
+    {
+        if (std::fabs(top.values[t] - expected[t]) > 1e-9 * std::fabs(expected[0]))
+        {
+            throw std::runtime_error("lanczos values");
+        }
+        std::vector<double> ax(n);
+        codesample::dense_operator<double>(a).apply(top.vectors[t].data(), ax.data());
+        for (size_t i = 0; i < n; i++)
+        {
+            if (std::fabs(ax[i] - top.values[t] * top.vectors[t][i]) > 1e-8)
+            {
+                throw std::runtime_error("lanczos vectors");
+            }
+        }
+    }
+
+    // shifted so that the largest eigenvalue dominates
+    codesample::matrix<double> shifted = a;
+    const double largest = codesample::symmetric_eigen<double>(a).values().back();
+    for (size_t i = 0; i < n; i++)
+    {
+        shifted[i][i] += std::fabs(expected[0]);
+    }
+    codesample::eigenpairs<double> dominant = codesample::power_iteration(shifted, 1e-10, 20000);
+    if (!dominant.converged || std::fabs(dominant.values[0] - std::fabs(expected[0]) - largest) > 1e-8)
+    {
+        throw std::runtime_error("power iteration");
+    }
+
+    // PageRank on a sparse graph: a lazy random walk has eigenvalue 1 and
+    // its eigenvector is the stationary distribution
+    const size_t nodes = 2000;
+    std::vector<size_t> from, to;
+    std::vector<double> weight;
+    for (size_t i = 0; i < nodes; i++)
+    {
+        const size_t targets[] = {i, (i + 1) % nodes, (i * 7 + 3) % nodes, (i * 13 + 5) % nodes};
+        for (size_t target : targets)
+        {
+            // column stochastic, and a repeated link adds up
+            from.push_back(target);
+            to.push_back(i);
+            weight.push_back(0.25);
+        }
+    }
+    codesample::csr_matrix<double> walk(nodes, nodes, from, to, weight);
+    codesample::eigenpairs<double> rank = codesample::power_iteration<double>(walk, 1e-12, 5000);
+    if (!rank.converged || std::fabs(rank.values[0] - 1) > 1e-10)
+    {
+        throw std::runtime_error("pagerank");
+    }
+    for (size_t i = 0; i < nodes; i++)
+    {
+        if (rank.vectors[0][i] * rank.vectors[0][0] <= 0)
+        {
+            throw std::runtime_error("pagerank vector sign");
+        }
+    }
+
+    // nonsymmetric, upper triangular apart from a rotation block, so the
+    // eigenvalues are known: 5 +- 3i, then -4.5, then the rest below 3
+    const size_t m = 200;
+    codesample::matrix<double> u(m, m);
+    for (size_t i = 0; i < m; i++)
+    {
+        u[i][i] = 1 + 0.01 * static_cast<double>(i);
+        for (size_t j = i + 1; j < m; j++)
+        {
+            u[i][j] = 0.1 * std::sin(static_cast<double>(i * m + j));
+        }
+    }
+    u[0][0] = u[1][1] = 5;
+    u[0][1] = 3;
+    u[1][0] = -3;
+    u[m / 2][m / 2] = -4.5;
+    codesample::eigenpairs<std::complex<double>> outer = codesample::arnoldi(u, 3);
+    const std::complex<double> known[] = {{5, 3}, {5, -3}, {-4.5, 0}};
+    if (!outer.converged || outer.values.size() != 3)
+    {
+        throw std::runtime_error("arnoldi convergence");
+    }
+    for (size_t t = 0; t < 3; t++)
+    {
+        if (std::abs(outer.values[t] - known[t]) > 1e-9)
+        {
+            throw std::runtime_error("arnoldi values");
+        }
+        for (size_t i = 0; i < m; i++)
+        {
+            std::complex<double> ux = 0;
+            for (size_t j = 0; j < m; j++)
+            {
+                ux += u[i][j] * outer.vectors[t][j];
+            }
+            if (std::abs(ux - outer.values[t] * outer.vectors[t][i]) > 1e-8)
+            {
+                throw std::runtime_error("arnoldi vectors");
+            }
+        }
+    }
+
+    // any operator: the eigenvalues of a kron b are products of theirs
+    codesample::kronecker_operator<double> product(codesample::matrix<double>({{2, 1}, {1, 2}}),
+                                                   codesample::matrix<double>({{4, 1}, {1, 4}}));
+    codesample::eigenpairs<double> products = codesample::lanczos<double>(product, 2);
+    if (std::fabs(products.values[0] - 15) > 1e-12 || std::fabs(products.values[1] - 9) > 1e-12)
+    {
+        throw std::runtime_error("lanczos on a kronecker operator");
+    }
+
+    bool thrown = false;
+    try
+    {
+        codesample::lanczos(a, 0);
+    }
+    catch (codesample::invalid_dimension &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("no eigenpairs requested");
+    }
+}
+
+void test_compare()
+{
+    // == and != work on const matrices
+    const codesample::matrix<double> a({{1, 2, 3}, {4, 5, 6}});
+    const codesample::matrix<double> b({{1, 2, 3}, {4, 5, 6.000001}});
+    if (!(a == a) || a != a || a == b || !(a != b) || a == codesample::matrix<double>({{1, 2, 3}}))
+    {
+        throw std::runtime_error("exact comparison");
+    }
+
+    if (!codesample::allclose(a, b) || codesample::allclose(a, b, 1e-9, 0.0))
+    {
+        throw std::runtime_error("allclose");
+    }
+    const double nan = std::numeric_limits<double>::quiet_NaN(), inf = std::numeric_limits<double>::infinity();
+    codesample::matrix<double> special({{inf, -inf, nan}});
+    if (!codesample::allclose(codesample::matrix<double>({{inf, -inf, 0}}), codesample::matrix<double>({{inf, -inf, 0}})) ||
+        codesample::allclose(special, special) ||
+        codesample::allclose(codesample::matrix<double>({{1}}), codesample::matrix<double>({{inf}})) ||
+        codesample::allclose(codesample::matrix<double>({{inf}}), codesample::matrix<double>({{-inf}})))
+    {
+        throw std::runtime_error("allclose infinities and NaN");
+    }
+    const codesample::mismatch_report infinite =
+        codesample::compare_close(codesample::matrix<double>({{1, inf}}), codesample::matrix<double>({{inf, -inf}}));
+    if (infinite.mismatches != 2 || infinite.worst != inf)
+    {
+        throw std::runtime_error("close report on infinities");
+    }
+
+    if (codesample::ulp_distance(1.0, std::nextafter(1.0, 2.0)) != 1 || codesample::ulp_distance(0.0, -0.0) != 0 ||
+        codesample::ulp_distance(std::numeric_limits<float>::denorm_min(), -std::numeric_limits<float>::denorm_min()) != 2 ||
+        codesample::ulp_distance(1.0f, 2.0f) != (1u << 23))
+    {
+        throw std::runtime_error("ulp distance");
+    }
+
+    // large enough to split across threads, with mismatches placed by hand
+    const size_t n = 1000;
+    codesample::matrix<float> x(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            x[i][j] = static_cast<float>(i) + static_cast<float>(j) / 1024;
+        }
+    }
+    codesample::matrix<float> y = x;
+    if (!codesample::allclose_ulps(x, y, 0) || x != y)
+    {
+        throw std::runtime_error("large equal matrices");
+    }
+    y[900][17] = std::nextafter(y[900][17], 1e9f);
+    y[901][3] = std::nextafter(std::nextafter(y[901][3], 0.0f), 0.0f);
+    y[999][999] = std::nextafter(y[999][999], 0.0f);
+    codesample::mismatch_report report = codesample::compare_ulps(x, y, 0);
+    if (report.mismatches != 3 || report.first_row != 900 || report.first_col != 17 || report.worst_row != 901 ||
+        report.worst_col != 3 || report.worst != 2)
+    {
+        throw std::runtime_error("ulp report");
+    }
+    if (!codesample::allclose_ulps(x, y, 2) || codesample::allclose_ulps(x, y, 1) || x == y)
+    {
+        throw std::runtime_error("allclose_ulps");
+    }
+
+    // a product computed two ways agrees to rounding, not exactly
+    codesample::matrix<double> p(70, 90), q(90, 50);
+    for (size_t i = 0; i < 70; i++)
+    {
+        for (size_t j = 0; j < 90; j++)
+        {
+            p[i][j] = std::sin(static_cast<double>(i * 90 + j));
+        }
+    }
+    for (size_t i = 0; i < 90; i++)
+    {
+        for (size_t j = 0; j < 50; j++)
+        {
+            q[i][j] = std::cos(static_cast<double>(i * 50 + j));
+        }
+    }
+    codesample::matrix<double> reference(70, 50);
+    for (size_t i = 0; i < 70; i++)
+    {
+        for (size_t j = 0; j < 50; j++)
+        {
+            for (size_t k = 90; k-- > 0;)
+            {
+                reference[i][j] += p[i][k] * q[k][j];
+            }
+        }
+    }
+    codesample::mismatch_report close = codesample::compare_close(p * q, reference, 1e-12, 1e-12);
+    if (!close.ok() || !codesample::allclose(p * q, reference, 1e-12, 1e-12))
+    {
+        throw std::runtime_error("product within rounding");
+    }
+    reference[5][7] += 1e-6;
+    reference[60][2] = nan;
+    close = codesample::compare_close(p * q, reference, 1e-12, 1e-12);
+    if (close.mismatches != 2 || close.first_row != 5 || close.first_col != 7 || close.worst_row != 60 ||
+        close.worst != inf)
+    {
+        throw std::runtime_error("close report");
+    }
+
+    bool thrown = false;
+    try
+    {
+        codesample::allclose(a, codesample::matrix<double>(2, 4));
+    }
+    catch (codesample::invalid_dimension &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("allclose of different shapes");
+    }
+}
+
+void test_summa()
+{
+    // products on grids of 1 x 1, 2 x 2, 2 x 3 and 1 x 5, with shapes that
+    // leave some blocks short or empty
+    const size_t shapes[][3] = {{70, 90, 110}, {3, 200, 7}, {257, 1, 129}, {1, 1, 1}};
+    for (const auto &shape : shapes)
+    {
+        codesample::matrix<long long> a(shape[0], shape[2]), b(shape[2], shape[1]);
+        for (size_t i = 0; i < a.rows(); i++)
+        {
+            for (size_t j = 0; j < a.cols(); j++)
+            {
+                a[i][j] = static_cast<long long>((i * 7 + j * 3) % 19) - 9;
+            }
+        }
+        for (size_t i = 0; i < b.rows(); i++)
+        {
+            for (size_t j = 0; j < b.cols(); j++)
+            {
+                b[i][j] = static_cast<long long>((i * 5 + j * 11) % 23) - 11;
+            }
+        }
+        const codesample::matrix<long long> expected = a * b;
+        for (size_t processes : {1, 4, 6, 5})
+        {
+            if (codesample::summa_multiply(a, b, processes, 32) != expected)
+            {
+                throw std::runtime_error("summa multiply");
+            }
+        }
+    }
+
+    codesample::matrix<double> x(64, 80), y(80, 48);
+    for (size_t i = 0; i < 64; i++)
+    {
+        for (size_t j = 0; j < 80; j++)
+        {
+            x[i][j] = std::sin(static_cast<double>(i * 80 + j));
+        }
+    }
+    for (size_t i = 0; i < 80; i++)
+    {
+        for (size_t j = 0; j < 48; j++)
+        {
+            y[i][j] = std::cos(static_cast<double>(i * 48 + j));
+        }
+    }
+    if (!codesample::allclose(codesample::summa_multiply(x, y, 4), x * y, 1e-12, 1e-12))
+    {
+        throw std::runtime_error("summa multiply of doubles");
+    }
+
+    // messages longer than the shared memory slot go through in pieces
+    codesample::run_local_processes(3, [](codesample::transport &t) {
+        std::vector<int> data(1000);
+        if (t.rank() == 1)
+        {
+            for (size_t i = 0; i < data.size(); i++)
+            {
+                data[i] = static_cast<int>(i * i);
+            }
+        }
+        t.broadcast({0, 1, 2}, 1, data.data(), data.size() * sizeof(int));
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            if (data[i] != static_cast<int>(i * i))
+            {
+                throw std::runtime_error("broadcast");
+            }
+        }
+        t.barrier();
+    }, 64);
+
+    // a worker that dies is reported rather than waited on forever
+    bool thrown = false;
+    try
+    {
+        codesample::run_local_processes(3, [](codesample::transport &t) {
+            int value = 0;
+            if (t.rank() == 2)
+            {
+                _exit(3);
+            }
+            if (t.rank() == 0)
+            {
+                t.receive(2, &value, sizeof(value));
+            }
+        });
+    }
+    catch (std::runtime_error &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("dead worker");
+    }
+    thrown = false;
+    try
+    {
+        codesample::run_local_processes(2, [](codesample::transport &t) {
+            if (t.rank() == 1)
+            {
+                throw std::runtime_error("worker error");
+            }
+        });
+    }
+    catch (std::runtime_error &e)
+    {
+        thrown = std::string(e.what()) == "Worker process 1 failed";
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("failed worker");
+    }
+}
+
+/**
+ * @brief Random entries: small integers, so integer products are exact, or
+ * uniform in [-1, 1)
+ */
+template <class T>
+codesample::matrix<T> differential_operand(size_t rows, size_t cols, std::mt19937 &rng)
+{
+    codesample::matrix<T> m(rows, cols);
+    for (size_t i = 0; i < rows; i++)
+    {
+        for (size_t j = 0; j < cols; j++)
+        {
+            m[i][j] = std::numeric_limits<T>::is_integer
+                          ? static_cast<T>(static_cast<int>(rng() % 101) - 50)
+                          : static_cast<T>(std::uniform_real_distribution<double>(-1, 1)(rng));
+        }
+    }
+    return m;
+}
+
+/**
+ * @brief Checks a product element by element against a reference: each
+ * element may be off by of_magnitude * magnitude(i, j) + of_value *
+ * |reference(i, j)|, so zero for both demands an exact match
+ */
+template <class M>
+void check_within(const M &result, const codesample::matrix<long double> &reference,
+                  const codesample::matrix<long double> &magnitude, long double of_magnitude, long double of_value,
+                  const std::string &kernel)
+{
+    for (size_t i = 0; i < reference.rows(); i++)
+    {
+        for (size_t j = 0; j < reference.cols(); j++)
+        {
+            const long double error = std::fabs(static_cast<long double>(result(i, j)) - reference(i, j));
+            if (!(error <= of_magnitude * magnitude(i, j) + of_value * std::fabs(reference(i, j))))
+            {
+                std::ostringstream message;
+                message << kernel << ": element (" << i << ", " << j << ") is off by " << static_cast<double>(error);
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
+}
+
+/**
+ * @brief Checks a kernel's product against the naive reference. Integer
+ * products must match exactly; floating point ones to within the forward
+ * error bound of any summation order, k eps sum_p |a(i, p) b(p, j)|.
+ */
+template <class T, class M>
+void check_against_reference(const M &result, const codesample::matrix<long double> &reference,
+                             const codesample::matrix<long double> &magnitude, size_t k, const std::string &kernel)
+{
+    const long double eps = std::numeric_limits<T>::is_integer ? 0 : std::numeric_limits<T>::epsilon();
+    check_within(result, reference, magnitude, static_cast<long double>(k) * eps, 0, kernel);
+}
+
+/**
+ * @brief The naive product of two matrices in long double, and beside each
+ * element the sum of the magnitudes of the products that formed it
+ */
+template <class A, class B>
+void differential_reference(const codesample::matrix<A> &a, const codesample::matrix<B> &b,
+                            codesample::matrix<long double> &reference, codesample::matrix<long double> &magnitude)
+{
+    reference = codesample::matrix<long double>(a.rows(), b.cols());
+    magnitude = codesample::matrix<long double>(a.rows(), b.cols());
+    for (size_t i = 0; i < a.rows(); i++)
+    {
+        for (size_t j = 0; j < b.cols(); j++)
+        {
+            long double sum = 0, size = 0;
+            for (size_t p = 0; p < a.cols(); p++)
+            {
+                const long double product = static_cast<long double>(a(i, p)) * static_cast<long double>(b(p, j));
+                sum += product;
+                size += std::fabs(product);
+            }
+            reference[i][j] = sum;
+            magnitude[i][j] = size;
+        }
+    }
+}
+
+/**
+ * @brief What Winograd's F(2x2, 3x3) sums to form each output of one
+ * filter: its transforms applied to the magnitudes of the weights and the
+ * input with every sign made positive. Its rounding errors are relative to
+ * these sums, not to the direct sum's terms.
+ */
+template <class T>
+codesample::matrix<long double> winograd_magnitude(const std::vector<codesample::matrix<T>> &input,
+                                                   const codesample::matrix<T> &weights, size_t f, size_t padding,
+                                                   size_t out_rows, size_t out_cols)
+{
+    const long double g_abs[4][3] = {{1, 0, 0}, {0.5, 0.5, 0.5}, {0.5, 0.5, 0.5}, {0, 0, 1}};
+    const long double b_abs[4][4] = {{1, 0, 1, 0}, {0, 1, 1, 0}, {0, 1, 1, 0}, {0, 1, 0, 1}};
+    const long double a_abs[2][4] = {{1, 1, 1, 0}, {0, 1, 1, 1}};
+    const long height = static_cast<long>(input[0].rows()), width = static_cast<long>(input[0].cols());
+    codesample::matrix<long double> magnitude(out_rows, out_cols);
+    for (size_t ty = 0; 2 * ty < out_rows; ty++)
+    {
+        for (size_t tx = 0; 2 * tx < out_cols; tx++)
+        {
+            long double y[2][2] = {{0, 0}, {0, 0}};
+            for (size_t c = 0; c < input.size(); c++)
+            {
+                long double d[4][4];
+                for (long r = 0; r < 4; r++)
+                {
+                    for (long s = 0; s < 4; s++)
+                    {
+                        const long iy = static_cast<long>(2 * ty) + r - static_cast<long>(padding);
+                        const long ix = static_cast<long>(2 * tx) + s - static_cast<long>(padding);
+                        d[r][s] = iy < 0 || ix < 0 || iy >= height || ix >= width
+                                      ? 0
+                                      : std::fabs(static_cast<long double>(
+                                            input[c](static_cast<size_t>(iy), static_cast<size_t>(ix))));
+                    }
+                }
+                for (size_t r = 0; r < 4; r++)
+                {
+                    for (size_t s = 0; s < 4; s++)
+                    {
+                        long double u = 0, v = 0;
+                        for (size_t i = 0; i < 4; i++)
+                        {
+                            for (size_t j = 0; j < 4; j++)
+                            {
+                                v += b_abs[r][i] * d[i][j] * b_abs[s][j];
+                                if (i < 3 && j < 3)
+                                {
+                                    u += g_abs[r][i] * std::fabs(static_cast<long double>(weights(f, c * 9 + i * 3 + j))) *
+                                         g_abs[s][j];
+                                }
+                            }
+                        }
+                        for (size_t p = 0; p < 2; p++)
+                        {
+                            for (size_t q = 0; q < 2; q++)
+                            {
+                                y[p][q] += a_abs[p][r] * u * v * a_abs[q][s];
+                            }
+                        }
+                    }
+                }
+            }
+            for (size_t p = 0; p < 2 && 2 * ty + p < out_rows; p++)
+            {
+                for (size_t q = 0; q < 2 && 2 * tx + q < out_cols; q++)
+                {
+                    magnitude[2 * ty + p][2 * tx + q] = y[p][q];
+                }
+            }
+        }
+    }
+    return magnitude;
+}
+
+/**
+ * @brief Convolves a random image of a few channels, of up to m x n
+ * pixels, with random filters of a random shape. Implicit GEMM is held to
+ * the usual bound over its channels x kernel area terms; Winograd, for 3x3
+ * floating point kernels with stride 1, to its transforms' few roundings
+ * plus the sum over channels, relative to winograd_magnitude().
+ */
+template <class T>
+void differential_convolve(std::mt19937 &rng, size_t m, size_t n)
+{
+    const size_t channels = 1 + rng() % 4, filters = 1 + rng() % 5;
+    const bool three = rng() % 2 != 0;
+    const size_t kernel_rows = three ? 3 : 1 + rng() % 5;
+    const size_t kernel_cols = three ? 3 : 1 + rng() % 5;
+    const size_t stride = three ? 1 : 1 + rng() % 3;
+    const size_t padding = rng() % 3;
+    const codesample::conv_params params(kernel_rows, kernel_cols, stride, padding);
+    const size_t height = std::max(1 + (m - 1) % 40, kernel_rows), width = std::max(1 + (n - 1) % 40, kernel_cols);
+    const size_t out_rows = (height + 2 * padding - kernel_rows) / stride + 1;
+    const size_t out_cols = (width + 2 * padding - kernel_cols) / stride + 1;
+    const size_t patch = channels * kernel_rows * kernel_cols;
+
+    std::vector<codesample::matrix<T>> input;
+    for (size_t c = 0; c < channels; c++)
+    {
+        input.push_back(differential_operand<T>(height, width, rng));
+    }
+    const codesample::matrix<T> weights = differential_operand<T>(filters, patch, rng);
+    const codesample::conv_algorithm algorithm =
+        rng() % 2 ? codesample::conv_algorithm::automatic : codesample::conv_algorithm::implicit_gemm;
+    const bool winograd = std::is_floating_point<T>::value && three && algorithm == codesample::conv_algorithm::automatic;
+    const std::vector<codesample::matrix<T>> output = codesample::convolve(input, weights, params, algorithm);
+
+    for (size_t f = 0; f < filters; f++)
+    {
+        codesample::matrix<long double> reference(out_rows, out_cols), magnitude(out_rows, out_cols);
+        for (size_t oy = 0; oy < out_rows; oy++)
+        {
+            for (size_t ox = 0; ox < out_cols; ox++)
+            {
+                long double sum = 0, size = 0;
+                for (size_t c = 0; c < channels; c++)
+                {
+                    for (size_t ky = 0; ky < kernel_rows; ky++)
+                    {
+                        for (size_t kx = 0; kx < kernel_cols; kx++)
+                        {
+                            const long y = static_cast<long>(oy * stride + ky) - static_cast<long>(padding);
+                            const long x = static_cast<long>(ox * stride + kx) - static_cast<long>(padding);
+                            if (y >= 0 && x >= 0 && y < static_cast<long>(height) && x < static_cast<long>(width))
+                            {
+                                const long double product =
+                                    static_cast<long double>(weights(f, (c * kernel_rows + ky) * kernel_cols + kx)) *
+                                    static_cast<long double>(input[c](static_cast<size_t>(y), static_cast<size_t>(x)));
+                                sum += product;
+                                size += std::fabs(product);
+                            }
+                        }
+                    }
+                }
+                reference[oy][ox] = sum;
+                magnitude[oy][ox] = size;
+            }
+        }
+        if (output[f].rows() != out_rows || output[f].cols() != out_cols)
+        {
+            throw std::runtime_error("convolve: output size");
+        }
+        if (winograd)
+        {
+            check_within(output[f], reference, winograd_magnitude(input, weights, f, padding, out_rows, out_cols),
+                         (channels + 16) * std::numeric_limits<T>::epsilon(), 0, "Winograd convolve");
+        }
+        else
+        {
+            check_against_reference<T>(output[f], reference, magnitude, patch, "implicit GEMM convolve");
+        }
+    }
+}
+
+/**
+ * @brief Multiplies floating point operands with wider and with
+ * compensated accumulation. Either way the result is rounded once to T
+ * when stored; what comes before that is held to k eps of the wider type,
+ * or for the compensated sums to 2 (k eps)^2, relative to the products'
+ * magnitudes. Both also allow for the long double reference's own error.
+ */
+template <class T>
+void differential_floating(const codesample::matrix<T> &a, const codesample::matrix<T> &b,
+                           const codesample::matrix<long double> &reference,
+                           const codesample::matrix<long double> &magnitude, size_t k, std::true_type)
+{
+    typedef typename std::conditional<std::is_same<T, float>::value, double, long double>::type wide;
+    const long double eps = std::numeric_limits<T>::epsilon();
+    const long double reference_error = k * std::numeric_limits<long double>::epsilon();
+    check_within(codesample::matrix<T>::template multiply_mixed<wide>(a, b), reference, magnitude,
+                 k * std::numeric_limits<wide>::epsilon() + reference_error, eps, "multiply_mixed");
+    check_within(codesample::matrix<T>::multiply_compensated(a, b), reference, magnitude,
+                 2 * (k * eps) * (k * eps) + reference_error, eps, "multiply_compensated");
+}
+
+template <class T>
+void differential_floating(const codesample::matrix<T> &, const codesample::matrix<T> &,
+                           const codesample::matrix<long double> &, const codesample::matrix<long double> &, size_t,
+                           std::false_type)
+{
+}
+
+/**
+ * @brief Runs every multiply, transpose and convolution path for element
+ * type T on one random m x k by k x n problem and compares each with a
+ * naive reference
+ */
+template <class T>
+void differential_case(std::mt19937 &rng, size_t m, size_t n, size_t k)
+{
+    const codesample::matrix<T> a = differential_operand<T>(m, k, rng);
+    const codesample::matrix<T> b = differential_operand<T>(k, n, rng);
+    codesample::matrix<long double> reference(m, n), magnitude(m, n);
+    codesample::matrix<T> min_plus_reference(m, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            long double sum = 0, size = 0;
+            T shortest = a(i, 0) + b(0, j);
+            for (size_t p = 0; p < k; p++)
+            {
+                const long double product = static_cast<long double>(a(i, p)) * static_cast<long double>(b(p, j));
+                sum += product;
+                size += std::fabs(product);
+                shortest = std::min<T>(shortest, a(i, p) + b(p, j));
+            }
+            reference[i][j] = sum;
+            magnitude[i][j] = size;
+            min_plus_reference[i][j] = shortest;
+        }
+    }
+
+    check_against_reference<T>(a * b, reference, magnitude, k, "multiply");
+
+    // b column major with padding, the product written into the middle
+    // of a larger matrix that must otherwise stay untouched
+    const size_t ld = k + rng() % 5;
+    std::vector<T> b_buffer(ld * n);
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b_buffer[p + j * ld] = b(p, j);
+        }
+    }
+    const codesample::matrix_ref<const T, codesample::column_major> b_ref(b_buffer.data(), k, n, ld);
+    codesample::matrix<T> outer(m + 3, n + 2);
+    codesample::multiply_into(a, b_ref, outer.view(1, 2, m, n));
+    check_against_reference<T>(outer.view(1, 2, m, n), reference, magnitude, k, "multiply_into a column major ref");
+    for (size_t i = 0; i < m + 3; i++)
+    {
+        for (size_t j = 0; j < n + 2; j++)
+        {
+            if ((i < 1 || i > m || j < 2) && outer(i, j) != T())
+            {
+                throw std::runtime_error("multiply_into wrote outside its view");
+            }
+        }
+    }
+
+    // accumulating into an output that already holds values adds them to
+    // the reference, and one more term to the sum
+    codesample::matrix<T> accumulated(m, n);
+    codesample::matrix<long double> shifted = reference, shifted_magnitude = magnitude;
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            accumulated[i][j] = static_cast<T>(static_cast<int>(i + j) % 7);
+            shifted[i][j] += accumulated(i, j);
+            shifted_magnitude[i][j] += accumulated(i, j);
+        }
+    }
+    codesample::multiply_into(a.view(0, 0, m, k), b, accumulated.view(0, 0, m, n), true);
+    check_against_reference<T>(accumulated, shifted, shifted_magnitude, k + 1, "multiply_into accumulating");
+
+    const size_t tiles[] = {3, 8, 17, 64};
+    const codesample::tile_order order = rng() % 2 ? codesample::tile_order::morton : codesample::tile_order::row_major;
+    const size_t tile = tiles[rng() % 4];
+    check_against_reference<T>(codesample::tiled_matrix<T>(a, order, tile) * codesample::tiled_matrix<T>(b, order, tile),
+                               reference, magnitude, k, "tiled multiply");
+
+    // a bias, a scale by -2 and a relu fused into the store; the scale is
+    // exact, so the bias's addition is the only rounding the epilogue adds
+    std::vector<T> bias(n);
+    for (T &value : bias)
+    {
+        value = static_cast<T>(static_cast<int>(rng() % 21) - 10);
+    }
+    codesample::matrix<long double> fused(m, n), fused_magnitude(m, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            fused[i][j] = std::max(-2 * (reference(i, j) + bias[j]), 0.0L);
+            fused_magnitude[i][j] = 2 * (magnitude(i, j) + std::fabs(static_cast<long double>(bias[j])));
+        }
+    }
+    check_against_reference<T>(
+        codesample::multiply_to<T>(a, b, codesample::chain(codesample::bias(bias), codesample::scale(static_cast<T>(-2)),
+                                                           codesample::relu())),
+        fused, fused_magnitude, k + 1, "multiply_to with epilogues");
+
+    differential_floating(a, b, reference, magnitude, k, std::is_floating_point<T>());
+
+    if (codesample::matrix<T>::template multiply<codesample::min_plus<T>>(a, b) != min_plus_reference)
+    {
+        throw std::runtime_error("min-plus multiply");
+    }
+
+    codesample::matrix<T> a_T = codesample::matrix<T>(a).transpose();
+    std::vector<T> a_T_buffer(k * m);
+    codesample::transpose_into(a, codesample::matrix_ref<T, codesample::column_major>(a_T_buffer.data(), k, m));
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < k; j++)
+        {
+            if (a_T(j, i) != a(i, j) || a_T_buffer[j + i * k] != a(i, j))
+            {
+                throw std::runtime_error("transpose");
+            }
+        }
+    }
+
+    differential_convolve<T>(rng, m, n);
+}
+
+/**
+ * @brief Multiplies float operands stored as fp16 or bf16. Their values
+ * widen exactly, so the product is held to float's bound on the widened
+ * values.
+ */
+template <class H>
+void differential_half(const codesample::matrix<float> &a_float, const codesample::matrix<float> &b_float,
+                       const std::string &kernel)
+{
+    const codesample::matrix<H> a = codesample::narrow<H>(a_float), b = codesample::narrow<H>(b_float);
+    codesample::matrix<long double> reference, magnitude;
+    differential_reference(codesample::widen(a), codesample::widen(b), reference, magnitude);
+    check_against_reference<float>(codesample::multiply_widened(a, b), reference, magnitude, a.cols(), kernel);
+}
+
+/**
+ * @brief Multiplies complex operands both ways. The conventional products
+ * sum 2k real terms, each part of one a(i, p) b(p, j); 3M sums k + 2 terms
+ * of up to twice that size for the imaginary part and takes two others
+ * from it, which four times k + 3 covers.
+ */
+template <class T>
+void differential_complex(std::mt19937 &rng, size_t m, size_t n, size_t k)
+{
+    const codesample::matrix<T> a_re = differential_operand<T>(m, k, rng), a_im = differential_operand<T>(m, k, rng);
+    const codesample::matrix<T> b_re = differential_operand<T>(k, n, rng), b_im = differential_operand<T>(k, n, rng);
+    codesample::matrix<std::complex<T>> a(m, k), b(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a[i][p] = std::complex<T>(a_re(i, p), a_im(i, p));
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b[p][j] = std::complex<T>(b_re(p, j), b_im(p, j));
+        }
+    }
+    codesample::matrix<long double> re(m, n), im(m, n), magnitude(m, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t p = 0; p < k; p++)
+            {
+                const std::complex<long double> x(a_re(i, p), a_im(i, p)), y(b_re(p, j), b_im(p, j));
+                re[i][j] += x.real() * y.real() - x.imag() * y.imag();
+                im[i][j] += x.real() * y.imag() + x.imag() * y.real();
+                magnitude[i][j] += std::sqrt(std::norm(x) * std::norm(y));
+            }
+        }
+    }
+
+    const long double eps = std::numeric_limits<T>::epsilon();
+    const codesample::complex_algorithm algorithms[] = {codesample::complex_algorithm::conventional,
+                                                        codesample::complex_algorithm::three_m};
+    for (codesample::complex_algorithm algorithm : algorithms)
+    {
+        const bool three_m = algorithm == codesample::complex_algorithm::three_m;
+        const codesample::matrix<std::complex<T>> product = codesample::multiply_complex(a, b, algorithm);
+        codesample::matrix<T> product_re(m, n), product_im(m, n);
+        for (size_t i = 0; i < m; i++)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                product_re[i][j] = product(i, j).real();
+                product_im[i][j] = product(i, j).imag();
+            }
+        }
+        const long double bound = (three_m ? 4 * (k + 3) : 2 * k) * eps;
+        const std::string kernel = three_m ? "multiply_complex (3M)" : "multiply_complex";
+        check_within(product_re, re, magnitude, bound, 0, kernel + ", real part");
+        check_within(product_im, im, magnitude, bound, 0, kernel + ", imaginary part");
+    }
+}
+
+/**
+ * @brief Runs the kernels with element types of their own on one random
+ * m x k by k x n problem: 16 bit floats, int8, complex, bits, booleans
+ * and residues. All but the 16 bit and complex ones must be exact.
+ */
+void differential_kernels(std::mt19937 &rng, size_t m, size_t n, size_t k)
+{
+    const codesample::matrix<float> a_float = differential_operand<float>(m, k, rng);
+    const codesample::matrix<float> b_float = differential_operand<float>(k, n, rng);
+    differential_half<codesample::fp16>(a_float, b_float, "multiply_widened (fp16)");
+    differential_half<codesample::bf16>(a_float, b_float, "multiply_widened (bf16)");
+
+    // int8 over its whole range
+    codesample::matrix<int8_t> a_s8(m, k), b_s8(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a_s8[i][p] = static_cast<int8_t>(static_cast<int>(rng() % 256) - 128);
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b_s8[p][j] = static_cast<int8_t>(static_cast<int>(rng() % 256) - 128);
+        }
+    }
+    codesample::matrix<long double> reference, magnitude;
+    differential_reference(a_s8, b_s8, reference, magnitude);
+    check_within(codesample::multiply_s8(a_s8, b_s8), reference, magnitude, 0, 0, "multiply_s8");
+
+    // the requantized product is the same rounding of the exact int32 sum
+    // with the zero points taken out
+    const codesample::quant_axis out_axes[] = {codesample::quant_axis::tensor, codesample::quant_axis::row,
+                                               codesample::quant_axis::column};
+    const codesample::quant_axis axis1 = rng() % 2 ? codesample::quant_axis::row : codesample::quant_axis::tensor;
+    const codesample::quant_axis axis2 = rng() % 2 ? codesample::quant_axis::column : codesample::quant_axis::tensor;
+    const codesample::quant_axis axis_out = out_axes[rng() % 3];
+    const size_t counts1 = axis1 == codesample::quant_axis::row ? m : 1;
+    const size_t counts2 = axis2 == codesample::quant_axis::column ? n : 1;
+    const size_t counts_out =
+        axis_out == codesample::quant_axis::tensor ? 1 : (axis_out == codesample::quant_axis::row ? m : n);
+    std::vector<float> scale1(counts1), scale2(counts2), scale_out(counts_out);
+    std::vector<int32_t> zero1(counts1), zero2(counts2), zero_out(counts_out);
+    for (size_t c = 0; c < counts1; c++)
+    {
+        scale1[c] = static_cast<float>(1 + rng() % 100) / 1000;
+        zero1[c] = static_cast<int32_t>(rng() % 41) - 20;
+    }
+    for (size_t c = 0; c < counts2; c++)
+    {
+        scale2[c] = static_cast<float>(1 + rng() % 100) / 1000;
+        zero2[c] = static_cast<int32_t>(rng() % 41) - 20;
+    }
+    for (size_t c = 0; c < counts_out; c++)
+    {
+        // about the spread of the products, so some saturate and most don't
+        scale_out[c] = static_cast<float>((1 + rng() % 100) * std::sqrt(static_cast<double>(k)) / 5000);
+        zero_out[c] = static_cast<int32_t>(rng() % 41) - 20;
+    }
+    const codesample::quant_params q1(axis1, scale1, zero1), q2(axis2, scale2, zero2);
+    const codesample::quant_params q_out(axis_out, scale_out, zero_out);
+    const codesample::matrix<int8_t> quantized = codesample::multiply_quantized(a_s8, q1, b_s8, q2, q_out);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            const size_t i1 = q1.index(i, 0), i2 = q2.index(0, j), i_out = q_out.index(i, j);
+            int64_t acc = 0;
+            for (size_t p = 0; p < k; p++)
+            {
+                acc += (static_cast<int64_t>(a_s8(i, p)) - q1.zero_point[i1]) *
+                       (static_cast<int64_t>(b_s8(p, j)) - q2.zero_point[i2]);
+            }
+            const double real = static_cast<double>(q1.scale[i1]) * q2.scale[i2] * static_cast<double>(acc);
+            const double q = std::nearbyint(real / q_out.scale[i_out]) + q_out.zero_point[i_out];
+            if (quantized(i, j) != static_cast<int8_t>(std::min(127.0, std::max(-128.0, q))))
+            {
+                std::ostringstream message;
+                message << "multiply_quantized: element (" << i << ", " << j << ")";
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
+
+    if (rng() % 2)
+    {
+        differential_complex<float>(rng, m, n, k);
+    }
+    else
+    {
+        differential_complex<double>(rng, m, n, k);
+    }
+
+    // sparse enough that products are neither all true nor all false
+    codesample::matrix<bool> a_bool(m, k), b_bool(k, n);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            a_bool[i][p] = rng() % (k + 1) < 2;
+        }
+    }
+    for (size_t p = 0; p < k; p++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b_bool[p][j] = rng() % 2 != 0;
+        }
+    }
+    const codesample::bit_matrix a_bits(a_bool), b_bits(b_bool);
+    const codesample::bit_matrix reach = a_bits * b_bits;
+    const codesample::matrix<uint32_t> counts = codesample::bit_matrix::multiply_count(a_bits, b_bits);
+    const codesample::matrix<bool> or_and = codesample::matrix<bool>::multiply<codesample::or_and>(a_bool, b_bool);
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            uint32_t count = 0;
+            for (size_t p = 0; p < k; p++)
+            {
+                count += a_bool(i, p) && b_bool(p, j);
+            }
+            if (counts(i, j) != count || reach.get(i, j) != (count != 0) || or_and(i, j) != (count != 0))
+            {
+                std::ostringstream message;
+                message << "bit_matrix and or_and multiplies: element (" << i << ", " << j << ")";
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
+
+    // residues modulo a random p for each of the three reductions: Barrett
+    // up to 2^32, Montgomery for larger odd p and division for larger even
+    // p. The reference reduces every product, so keep to a few rows.
+    const size_t residue_rows = std::max<size_t>(1, std::min(m, 100000 / (k * n)));
+    const uint64_t high = static_cast<uint64_t>(rng()) << 32 | rng();
+    const uint64_t low = 2 + rng() % 0xfffffffe;
+    const size_t reduction = rng() % 3;
+    const uint64_t p = reduction == 0 ? low : (reduction == 1 ? high | (uint64_t(1) << 63) | 1
+                                                              : (high | (uint64_t(1) << 63)) & ~uint64_t(1));
+    codesample::matrix<uint64_t> a_mod(residue_rows, k), b_mod(k, n);
+    for (size_t i = 0; i < residue_rows; i++)
+    {
+        for (size_t q = 0; q < k; q++)
+        {
+            a_mod[i][q] = static_cast<uint64_t>(rng()) << 32 | rng();
+        }
+    }
+    for (size_t q = 0; q < k; q++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            b_mod[q][j] = static_cast<uint64_t>(rng()) << 32 | rng();
+        }
+    }
+    const codesample::matrix<uint64_t> residues = codesample::modular_multiply(a_mod, b_mod, p);
+    for (size_t i = 0; i < residue_rows; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            unsigned __int128 sum = 0;
+            for (size_t q = 0; q < k; q++)
+            {
+                sum = (sum + static_cast<unsigned __int128>(a_mod(i, q) % p) * (b_mod(q, j) % p)) % p;
+            }
+            if (residues(i, j) != static_cast<uint64_t>(sum))
+            {
+                std::ostringstream message;
+                message << "modular_multiply mod " << p << ": element (" << i << ", " << j << ")";
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
+}
+
+/**
+ * @brief The differential harness: products of random shapes and thread
+ * counts through every kernel, against a naive reference. The plain
+ * kernels and convolution run in a random element type, and the kernels
+ * with element types of their own alongside. Shapes favour primes and
+ * sizes just either side of the kernel's block and tile sizes, where edge
+ * handling goes wrong.
+ *
+ * @param seed Seeds the shapes and data; a failure names the case so it
+ * can be rerun with the same seed
+ */
+void test_differential(unsigned long seed)
+{
+    std::mt19937 rng(static_cast<std::mt19937::result_type>(seed));
+    const size_t edges[] = {1, 2, 3, 4, 5, 7, 8, 9, 13, 16, 17, 31, 63, 64, 65, 127, 129, 255, 256, 257, 511, 513};
+    const size_t edge_count = sizeof(edges) / sizeof(edges[0]);
+    const char *type_names[] = {"int", "long long", "float", "double"};
+    const size_t cases = 40;
+
+    for (size_t c = 0; c < cases; c++)
+    {
+        size_t dims[3];
+        for (size_t &d : dims)
+        {
+            d = rng() % 2 ? edges[rng() % edge_count] : 1 + rng() % 300;
+        }
+        // keep each case to a few million multiply-adds
+        while (dims[0] * dims[1] * dims[2] > 3000000)
+        {
+            size_t &largest = *std::max_element(dims, dims + 3);
+            largest = (largest + 1) / 2;
+        }
+        const size_t type = rng() % 4, threads = 1 + rng() % 8;
+        codesample::set_num_threads(threads);
+        try
+        {
+            switch (type)
+            {
+            case 0:
+                differential_case<int>(rng, dims[0], dims[1], dims[2]);
+                break;
+            case 1:
+                differential_case<long long>(rng, dims[0], dims[1], dims[2]);
+                break;
+            case 2:
+                differential_case<float>(rng, dims[0], dims[1], dims[2]);
+                break;
+            default:
+                differential_case<double>(rng, dims[0], dims[1], dims[2]);
+            }
+            differential_kernels(rng, dims[0], dims[1], dims[2]);
+        }
+        catch (std::exception &e)
+        {
+            codesample::set_num_threads(0);
+            std::ostringstream message;
+            message << "case " << c << " (" << type_names[type] << ", " << dims[0] << " x " << dims[2] << " by "
+                    << dims[2] << " x " << dims[1] << ", " << threads << " threads) " << e.what();
+            throw std::runtime_error(message.str());
+        }
+    }
+    codesample::set_num_threads(0);
+}
+
+void test_checkpoint()
+{
+    const std::string path = "/tmp/matrix_test_" + std::to_string(getpid()) + ".ckpt";
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    codesample::matrix<long long> a(150, 90), b(90, 70);
+    for (size_t i = 0; i < a.rows(); i++)
+    {
+        for (size_t j = 0; j < a.cols(); j++)
+        {
+            a[i][j] = static_cast<long long>((i * 7 + j * 13) % 29) - 14;
+        }
+    }
+    for (size_t i = 0; i < b.rows(); i++)
+    {
+        for (size_t j = 0; j < b.cols(); j++)
+        {
+            b[i][j] = static_cast<long long>((i * 11 + j * 5) % 31) - 15;
+        }
+    }
+    const codesample::matrix<long long> expected = a * b;
+
+    // saved rows are used as they are: zeros stand in for the first 40
+    const uint64_t inputs = codesample::detail::fingerprint(b, codesample::detail::fingerprint(a));
+    {
+        codesample::checkpoint cp(path);
+        cp.save(codesample::detail::checkpoint_multiply, inputs, 40, std::vector<char>(40 * 70 * sizeof(long long)));
+        cp.flush();
+        const codesample::matrix<long long> resumed = codesample::checkpointed_multiply(a, b, cp, 16);
+        typedef codesample::matrix<long long> block;
+        if (cp.restored_step() != 40 || block(resumed.view(40, 0, 110, 70)) != block(expected.view(40, 0, 110, 70)) ||
+            block(resumed.view(0, 0, 40, 70)) != block(40, 70))
+        {
+            throw std::runtime_error("checkpointed multiply resume");
+        }
+        if (std::ifstream(path))
+        {
+            throw std::runtime_error("checkpoint left behind");
+        }
+    }
+
+    // a damaged file, or one for other inputs, is ignored
+    for (size_t damage = 0; damage < 2; damage++)
+    {
+        codesample::checkpoint cp(path);
+        cp.save(codesample::detail::checkpoint_multiply, damage == 0 ? inputs : inputs + 1, 40,
+                std::vector<char>(40 * 70 * sizeof(long long)));
+        cp.flush();
+        if (damage == 0)
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(100);
+            file.put('x');
+        }
+        if (codesample::checkpointed_multiply(a, b, cp, 16) != expected || cp.restored_step() != 0)
+        {
+            throw std::runtime_error("checkpoint damage");
+        }
+    }
+
+    // appended states read back whole, whatever the pieces' sizes, and
+    // bytes an interrupted append left past the state are ignored
+    {
+        std::vector<char> whole(100);
+        for (size_t i = 0; i < whole.size(); i++)
+        {
+            whole[i] = static_cast<char>(i * 37 + 5);
+        }
+        codesample::checkpoint cp(path);
+        cp.save(codesample::detail::checkpoint_multiply, inputs, 1, std::vector<char>(whole.begin(), whole.begin() + 13));
+        cp.append(codesample::detail::checkpoint_multiply, inputs, 2,
+                  std::vector<char>(whole.begin() + 13, whole.begin() + 16));
+        cp.append(codesample::detail::checkpoint_multiply, inputs, 3,
+                  std::vector<char>(whole.begin() + 16, whole.begin() + 61));
+        cp.flush();
+        std::ofstream(path, std::ios::app | std::ios::binary) << "torn";
+
+        codesample::checkpoint again(path);
+        uint64_t step = 0;
+        std::vector<char> state;
+        if (!again.load(codesample::detail::checkpoint_multiply, inputs, step, state) || step != 3 ||
+            state != std::vector<char>(whole.begin(), whole.begin() + 61))
+        {
+            throw std::runtime_error("checkpoint append");
+        }
+        again.append(codesample::detail::checkpoint_multiply, inputs, 4,
+                     std::vector<char>(whole.begin() + 61, whole.end()));
+        again.flush();
+        if (!cp.load(codesample::detail::checkpoint_multiply, inputs, step, state) || step != 4 || state != whole ||
+            cp.saves() != 3 || again.saves() != 1)
+        {
+            throw std::runtime_error("checkpoint append after load");
+        }
+        bool refused = false;
+        try
+        {
+            cp.append(codesample::detail::checkpoint_lu, inputs, 5, std::vector<char>(8));
+        }
+        catch (const std::logic_error &)
+        {
+            refused = true;
+        }
+        cp.remove();
+        if (!refused)
+        {
+            throw std::runtime_error("checkpoint append to another job");
+        }
+    }
+
+    // saving every step appends each panel to the file
+    {
+        codesample::checkpoint cp(path, 0.0);
+        if (codesample::checkpointed_multiply(a, b, cp, 16) != expected || cp.saves() == 0)
+        {
+            throw std::runtime_error("checkpointed multiply saving every step");
+        }
+    }
+
+    // an interrupted factorization carries on where its file left off
+    const size_t n = 600;
+    codesample::matrix<double> m(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            m[i][j] = dist(gen);
+        }
+    }
+    const codesample::lu_decomposition<double> serial(m);
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        codesample::checkpoint cp(path, 0.0);
+        codesample::checkpointed_lu(m, cp);
+        _exit(0);
+    }
+    int status = 0;
+    while (waitpid(child, &status, WNOHANG) == 0)
+    {
+        if (std::ifstream(path))
+        {
+            kill(child, SIGKILL);
+            waitpid(child, &status, 0);
+            break;
+        }
+    }
+    codesample::checkpoint cp(path);
+    const codesample::lu_decomposition<double> lu = codesample::checkpointed_lu(m, cp);
+    if (lu.upper() != serial.upper() || lu.lower() != serial.lower() || lu.permutation() != serial.permutation())
+    {
+        throw std::runtime_error("checkpointed lu resume");
+    }
+}
+
+void test_memo()
+{
+    codesample::product_cache &cache = codesample::product_cache::instance();
+    codesample::matrix<double> a(40, 30), b(30, 20);
+    for (size_t i = 0; i < 40; i++)
+    {
+        for (size_t j = 0; j < 30; j++)
+        {
+            a[i][j] = static_cast<double>((i * 3 + j * 5) % 17);
+        }
+    }
+    for (size_t i = 0; i < 30; i++)
+    {
+        for (size_t j = 0; j < 20; j++)
+        {
+            b[i][j] = static_cast<double>((i * 7 + j) % 13);
+        }
+    }
+
+    // off by default: every call multiplies
+    if (codesample::memo_multiply(a, b) == codesample::memo_multiply(a, b))
+    {
+        throw std::runtime_error("memo cache on by default");
+    }
+
+    cache.enable(1 << 20);
+    cache.reset_stats();
+    const std::shared_ptr<const codesample::matrix<double>> first = codesample::memo_multiply(a, b);
+    const codesample::matrix<double> copy_a = a, copy_b = b;
+    if (*first != a * b || codesample::memo_multiply(copy_a, copy_b) != first)
+    {
+        throw std::runtime_error("memo hit");
+    }
+
+    // a changed element, shape or element type is a different product
+    codesample::matrix<double> changed = a;
+    changed[39][29] += 1;
+    const codesample::matrix<float> a_float(40, 30), b_float(30, 20);
+    const codesample::matrix<double> reshaped(30, 40), b_reshaped(40, 20);
+    if (*codesample::memo_multiply(changed, b) != changed * b)
+    {
+        throw std::runtime_error("memo changed operand");
+    }
+    codesample::memo_multiply(a_float, b_float);
+    codesample::memo_multiply(reshaped, b_reshaped);
+    codesample::product_cache_stats stats = cache.stats();
+    if (stats.hits != 1 || stats.misses != 4 || stats.entries != 4 || stats.evictions != 0)
+    {
+        throw std::runtime_error("memo stats");
+    }
+
+    // a budget of two results keeps the two most recently used
+    const size_t bytes = stats.bytes / 4;
+    cache.enable(2 * bytes + bytes / 2);
+    stats = cache.stats();
+    if (stats.entries != 2 || stats.evictions != 2 || cache.find({codesample::detail::content_hash(a),
+                                                                 codesample::detail::content_hash(b), 40, 30, 20,
+                                                                 std::type_index(typeid(double))}))
+    {
+        throw std::runtime_error("memo eviction");
+    }
+
+    // results already handed out outlive the cache
+    cache.disable();
+    if (*first != a * b || cache.stats().entries != 0)
+    {
+        throw std::runtime_error("memo disable");
+    }
+}
+
+void test_maintained()
+{
+    // what each kind of write stamps
+    codesample::matrix<long long> a(30, 20), b(20, 25);
+    for (size_t i = 0; i < 30; i++)
+    {
+        for (size_t j = 0; j < 20; j++)
+        {
+            a(i, j) = static_cast<long long>((i * 3 + j * 7) % 11) - 5;
+        }
+    }
+    for (size_t i = 0; i < 20; i++)
+    {
+        for (size_t j = 0; j < 25; j++)
+        {
+            b(i, j) = static_cast<long long>((i * 5 + j * 2) % 13) - 6;
+        }
+    }
+    if (a.rows_changed_since(a.version()).size() != 30)
+    {
+        throw std::runtime_error("untracked rows");
+    }
+    a.track_changes();
+    const uint64_t start = a.version();
+    a(4, 9) = 100;
+    a.view(10, 2, 2, 3)(1, 1) = -100;
+    if (a.rows_changed_since(start) != std::vector<size_t>{4, 10, 11} ||
+        a.cols_changed_since(start) != std::vector<size_t>{2, 3, 4, 9} || !a.rows_changed_since(a.version()).empty())
+    {
+        throw std::runtime_error("changed rows and columns");
+    }
+    const uint64_t wide = a.version();
+    a[7][0] = 1;
+    if (a.rows_changed_since(wide) != std::vector<size_t>{7} || a.cols_changed_since(wide).size() != 20)
+    {
+        throw std::runtime_error("row handed out whole");
+    }
+
+    // a cached transpose is patched rather than dropped
+    codesample::matrix<long long> t_cached = a;
+    t_cached.transpose();
+    t_cached(5, 6) = 42;
+    t_cached[29][19] = -42;
+    const codesample::matrix<long long> fresh = t_cached;
+    if (t_cached.transpose() != codesample::matrix<long long>(fresh).transpose() || t_cached.transpose()[6][5] != 42)
+    {
+        throw std::runtime_error("patched transpose");
+    }
+
+    // the product follows changes to either side, recomputing only what they touch
+    codesample::maintained_product<long long> c(a, b);
+    a(3, 1) += 2;
+    a(17, 19) -= 1;
+    if (c.update() != a * b || c.last_update().rows != 2 || c.last_update().cols != 0 || c.last_update().full)
+    {
+        throw std::runtime_error("maintained product rows");
+    }
+    b(0, 24) = 9;
+    b.view(5, 3, 10, 2).assign(codesample::matrix<long long>(10, 2, 1));
+    a(0, 0) = 8;
+    if (c.update() != a * b || c.last_update().rows != 1 || c.last_update().cols != 3)
+    {
+        throw std::runtime_error("maintained product columns");
+    }
+    if (c.update() != a * b || c.last_update().rows != 0 || c.last_update().cols != 0)
+    {
+        throw std::runtime_error("maintained product unchanged");
+    }
+
+    // a row of B handed out whole, or a new B, costs the whole product
+    b[2][2] = 0;
+    if (c.update() != a * b || !c.last_update().full)
+    {
+        throw std::runtime_error("maintained product whole row");
+    }
+    b = codesample::matrix<long long>(20, 25, 3);
+    if (c.update() != a * b || !c.last_update().full)
+    {
+        throw std::runtime_error("maintained product assignment");
+    }
+}
+
+void test_distributed()
+{
+    // a 2 x 2 and a 2 x 3 grid, with blocks that leave the last ones short
+    const size_t n = 75;
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    codesample::matrix<double> a(n, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            a[i][j] = dist(gen);
+        }
+    }
+    const codesample::lu_decomposition<double> serial(a);
+    const codesample::matrix<double> lower = serial.lower(), upper = serial.upper();
+
+    for (size_t processes : {4, 6})
+    {
+        codesample::run_local_processes(processes, [&](codesample::transport &t) {
+            const codesample::process_grid grid(t.size());
+            auto d = codesample::distributed_matrix<double>::scatter(t, grid, a, 8);
+
+            // moving between layouts loses nothing
+            const codesample::process_grid flat(1, t.size());
+            const codesample::matrix<double> moved = d.redistribute(flat, 5).redistribute(grid, 8).gather();
+            const codesample::matrix<double> flipped = d.transpose().gather();
+            if (t.rank() == 0 && (moved != a || flipped != a.transpose()))
+            {
+                throw std::runtime_error("redistribute");
+            }
+
+            const codesample::distributed_lu_result lu = codesample::lu_factor(d);
+            const codesample::matrix<double> factors = d.gather();
+            if (t.rank() != 0)
+            {
+                return;
+            }
+            if (lu.singular || lu.permutation != serial.permutation())
+            {
+                throw std::runtime_error("distributed lu pivots");
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    const double expected = i > j ? lower[i][j] : upper[i][j];
+                    if (std::abs(factors[i][j] - expected) > 1e-10)
+                    {
+                        throw std::runtime_error("distributed lu factors");
+                    }
+                }
+            }
+        });
+    }
+
+    // a zero column is reported, as by lu_decomposition
+    codesample::matrix<double> singular(20, 20);
+    for (size_t i = 0; i < 20; i++)
+    {
+        for (size_t j = 1; j < 20; j++)
+        {
+            singular[i][j] = static_cast<double>((i * 3 + j * 7) % 11);
+        }
+    }
+    codesample::run_local_processes(4, [&](codesample::transport &t) {
+        const codesample::process_grid grid(t.size());
+        auto d = codesample::distributed_matrix<double>::scatter(t, grid, singular, 4);
+        if (!codesample::lu_factor(d).singular)
+        {
+            throw std::runtime_error("distributed lu singular");
+        }
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    const unsigned long seed = argc > 1 ? std::stoul(argv[1]) : 2019;
+
+    std::cout << "Testing transpose... ";
+    try
+    {
+        test_transpose();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+
+    std::cout << "Testing multiply... ";
+    try
+    {
+        test_multiply();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+
+    std::cout << "Testing mixed precision multiply... ";
+    try
+    {
+        test_mixed_precision();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+
+    std::cout << "Testing 16-bit floats... ";
+    try
+    {
+        test_half();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+
+    std::cout << "Testing quantized multiply... ";
+    try
+    {
+        test_quantized();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+
+    std::cout << "Testing complex multiply... ";
+    try
+    {
+        test_complex();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+
+    std::cout << "Testing bit matrix... ";
+    try
+    {
+        test_bit_matrix();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+
+    std::cout << "Testing semiring multiply... ";
+    try
+    {
+        test_semiring();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing modular multiply... ";
+    try
+    {
+        test_modular();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing Kronecker product... ";
+    try
+    {
+        test_kron();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing convolution... ";
+    try
+    {
+        test_conv();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing fused epilogues... ";
+    try
+    {
+        test_epilogue();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing matrix views... ";
+    try
+    {
+        test_view();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing external buffers... ";
+    try
+    {
+        test_matrix_ref();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing column major layout... ";
+    try
+    {
+        test_layout();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing tiled storage... ";
+    try
+    {
+        test_tiled();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing small shape dispatch... ";
+    try
+    {
+        test_small_shapes();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing LU, inverse and determinant... ";
+    try
+    {
+        test_linalg();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing matrix functions... ";
+    try
+    {
+        test_matfun();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing iterative eigensolvers... ";
+    try
+    {
+        test_eigs();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing approximate comparison... ";
+    try
+    {
+        test_compare();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing SUMMA across processes... ";
+    try
+    {
+        test_summa();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing distributed LU... ";
+    try
+    {
+        test_distributed();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing checkpoint and restart... ";
+    try
+    {
+        test_checkpoint();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing the product cache... ";
+    try
+    {
+        test_memo();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing maintained products... ";
+    try
+    {
+        test_maintained();
+        std::cout << "passed" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "failed: " << e.what() << std::endl;
+    }
+    std::cout << "Testing kernels against the reference (seed " << seed << ")... ";
+    try
+    {
+        test_differential(seed);
         std::cout << "passed" << std::endl;
     }
     catch (std::exception &e)
@@ -0,0 +1,197 @@
+/**
+ * @file maintained.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief A product kept up to date as its operands change
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * A maintained_product holds C = A B for two matrices it watches, and
+ * turns on change tracking in both (see matrix::track_changes()). After
+ * the caller changes a few rows of A or a few columns of B, update() asks
+ * each operand which rows and columns changed since the last update (see
+ * matrix::rows_changed_since()) and recomputes just those: k changed rows
+ * of A cost k rows of C, k x n x inner multiply-adds, and k changed
+ * columns of B cost k columns of C. Everything else is left alone.
+ *
+ * An element of A changes one row of C, and an element of B one column.
+ * A row of B handed out whole by operator[] may have changed in every
+ * column, so it costs all of C; write B through operator() or view() to
+ * keep updates to it cheap. Reads through a non-const A or B count as
+ * writes too, and the operands must be written from one thread at a time.
+ *
+ *     maintained_product<double> c(a, b);
+ *     a(3, 7) = 2.0;
+ *     const matrix<double> &now = c.update();    // recomputes row 3 only
+ */
+
+#ifndef _MAINTAINED_H_
+#define _MAINTAINED_H_
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief What the last maintained_product::update() recomputed
+     *
+     */
+    struct product_update
+    {
+        size_t rows;
+        size_t cols;
+
+        /**
+         * Whether the whole product was recomputed
+         */
+        bool full;
+    };
+
+    /**
+     * @brief C = A B, recomputed in part as A and B change
+     *
+     * @tparam T The type of data in the matrices
+     */
+    template <class T>
+    class maintained_product
+    {
+      private:
+        const matrix<T> *_a;
+        const matrix<T> *_b;
+        matrix<T> _c;
+        uint64_t _a_seen;
+        uint64_t _b_seen;
+        product_update _last;
+
+        void recompute_all()
+        {
+            _c = *_a * *_b;
+            _last = product_update{_c.rows(), _c.cols(), true};
+        }
+
+        /**
+         * @brief Recomputes the given rows of C from the same rows of A
+         */
+        void recompute_rows(const std::vector<size_t> &rows)
+        {
+            std::vector<const T *> a_rows(rows.size());
+            std::vector<T *> c_rows(rows.size());
+            for (size_t r = 0; r < rows.size(); r++)
+            {
+                a_rows[r] = (*_a)[rows[r]].data();
+                c_rows[r] = _c[rows[r]].data();
+            }
+            multiply_into(matrix_view<const T>(std::move(a_rows), _a->cols()), *_b,
+                          matrix_view<T>(std::move(c_rows), _c.cols()));
+        }
+
+        /**
+         * @brief Recomputes the given columns of C from the same columns
+         * of B, through a copy of those columns
+         */
+        void recompute_cols(const std::vector<size_t> &cols)
+        {
+            const matrix<T> &b = *_b;
+            matrix<T> b_cols(b.rows(), cols.size());
+            for (size_t i = 0; i < b.rows(); i++)
+            {
+                const std::vector<T> &row = b[i];
+                std::vector<T> &out = b_cols[i];
+                for (size_t c = 0; c < cols.size(); c++)
+                {
+                    out[c] = row[cols[c]];
+                }
+            }
+            const matrix<T> c_cols = *_a * b_cols;
+            for (size_t i = 0; i < _c.rows(); i++)
+            {
+                const std::vector<T> &row = c_cols[i];
+                std::vector<T> &out = _c[i];
+                for (size_t c = 0; c < cols.size(); c++)
+                {
+                    out[cols[c]] = row[c];
+                }
+            }
+        }
+
+      public:
+        /**
+         * @brief Computes a product to maintain, and starts tracking
+         * changes to both matrices. Both must outlive this object.
+         *
+         * @param a The first matrix
+         * @param b The second matrix
+         */
+        maintained_product(matrix<T> &a, matrix<T> &b)
+        : _a(&a), _b(&b), _a_seen(0), _b_seen(0), _last{0, 0, true}
+        {
+            a.track_changes();
+            b.track_changes();
+            _a_seen = a.version();
+            _b_seen = b.version();
+            recompute_all();
+        }
+
+        /**
+         * @brief Brings the product up to date with the operands
+         *
+         * @return const matrix<T>& The product
+         */
+        const matrix<T> &update()
+        {
+            const matrix<T> &a = *_a, &b = *_b;
+            const uint64_t a_now = a.version(), b_now = b.version();
+            if (a_now == _a_seen && b_now == _b_seen)
+            {
+                _last = product_update{0, 0, false};
+                return _c;
+            }
+
+            const std::vector<size_t> rows = a.rows_changed_since(_a_seen);
+            const std::vector<size_t> cols = b.cols_changed_since(_b_seen);
+            _a_seen = a_now;
+            _b_seen = b_now;
+
+            // past half the product, starting over is cheaper
+            if (_c.rows() != a.rows() || _c.cols() != b.cols() || a.cols() != b.rows() ||
+                2 * (rows.size() * b.cols() + cols.size() * a.rows()) >= a.rows() * b.cols())
+            {
+                recompute_all();
+                return _c;
+            }
+            if (!rows.empty())
+            {
+                recompute_rows(rows);
+            }
+            if (!cols.empty())
+            {
+                recompute_cols(cols);
+            }
+            _last = product_update{rows.size(), cols.size(), false};
+            return _c;
+        }
+
+        /**
+         * @brief Gets the product as of the last update
+         */
+        const matrix<T> &product() const
+        {
+            return _c;
+        }
+
+        /**
+         * @brief Gets how much the last update recomputed
+         */
+        const product_update &last_update() const
+        {
+            return _last;
+        }
+    };
+}
+
+#endif
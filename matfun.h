@@ -0,0 +1,368 @@
+/**
+ * @file matfun.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Matrix exponential, integer powers, and square roots and
+ * logarithms of symmetric positive definite matrices
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Everything here is built from products, so its cost is a small number
+ * of calls to the multiply kernel. Intermediate products are written into
+ * matrices allocated once per call with multiply_into(), rather than each
+ * product allocating its own result.
+ */
+
+#ifndef _MATFUN_H_
+#define _MATFUN_H_
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "linalg.h"
+#include "matrix.h"
+
+namespace codesample
+{
+    namespace detail
+    {
+        /**
+         * @brief Writes a * b into out, which must not be a or b
+         */
+        template <class T>
+        void product_into(const matrix<T> &a, const matrix<T> &b, matrix<T> &out)
+        {
+            multiply_into(a, b, out.view(0, 0, out.rows(), out.cols()));
+        }
+
+        /**
+         * @brief The n x n identity
+         */
+        template <class T>
+        matrix<T> identity(size_t n)
+        {
+            matrix<T> m(n, n);
+            for (size_t i = 0; i < n; i++)
+            {
+                m[i][i] = static_cast<T>(1);
+            }
+            return m;
+        }
+
+        /**
+         * @brief Sets out to the sum of scales[t] * terms[t], plus
+         * diagonal * I
+         */
+        template <class T>
+        void linear_combination(matrix<T> &out, const std::vector<const matrix<T> *> &terms,
+                                const std::vector<T> &scales, T diagonal)
+        {
+            for (size_t i = 0; i < out.rows(); i++)
+            {
+                std::vector<T> &row = out[i];
+                std::fill(row.begin(), row.end(), T());
+                for (size_t t = 0; t < terms.size(); t++)
+                {
+                    const std::vector<T> &term = (*terms[t])[i];
+                    for (size_t j = 0; j < row.size(); j++)
+                    {
+                        row[j] += scales[t] * term[j];
+                    }
+                }
+                row[i] += diagonal;
+            }
+        }
+
+        /**
+         * @brief The largest column sum of absolute values
+         */
+        template <class T>
+        T norm1(const matrix<T> &a)
+        {
+            std::vector<T> sums(a.cols());
+            for (size_t i = 0; i < a.rows(); i++)
+            {
+                for (size_t j = 0; j < a.cols(); j++)
+                {
+                    sums[j] += std::abs(a(i, j));
+                }
+            }
+            T result = T();
+            for (size_t j = 0; j < sums.size(); j++)
+            {
+                result = std::max(result, sums[j]);
+            }
+            return result;
+        }
+
+        /**
+         * @brief Computes Q diag(f(values)) Q^T from a symmetric
+         * eigendecomposition. The product is symmetric only up to rounding,
+         * so each pair of mirrored elements is replaced by its mean.
+         */
+        template <class T, class F>
+        matrix<T> apply_to_eigenvalues(const symmetric_eigen<T> &eigen, F f)
+        {
+            const matrix<T> &q = eigen.vectors();
+            const size_t n = q.rows();
+            matrix<T> scaled(n, n);
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    scaled[i][j] = q(i, j) * f(eigen.values()[j]);
+                }
+            }
+            matrix<T> q_T(n, n);
+            transpose_into(q, q_T.view(0, 0, n, n));
+            matrix<T> result(n, n);
+            product_into(scaled, q_T, result);
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < i; j++)
+                {
+                    result[i][j] = result[j][i] = (result(i, j) + result(j, i)) / 2;
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Decomposes a matrix that must be symmetric positive
+         * definite. Products such as b b^T are symmetric only up to
+         * rounding, so mirrored elements may differ by n eps ||a||_1; the
+         * decomposition reads just the lower triangle.
+         */
+        template <class T>
+        symmetric_eigen<T> spd_eigen(const matrix<T> &a)
+        {
+            if (a.rows() != a.cols())
+            {
+                throw invalid_dimension(a.rows(), a.cols());
+            }
+            const T tolerance = static_cast<T>(a.rows()) * std::numeric_limits<T>::epsilon() * norm1(a);
+            for (size_t i = 0; i < a.rows(); i++)
+            {
+                for (size_t j = i + 1; j < a.cols(); j++)
+                {
+                    if (!(std::abs(a(i, j) - a(j, i)) <= tolerance))
+                    {
+                        throw std::domain_error("Matrix is not symmetric");
+                    }
+                }
+            }
+            symmetric_eigen<T> eigen(a);
+            if (eigen.values()[0] <= T())
+            {
+                throw std::domain_error("Matrix is not positive definite");
+            }
+            return eigen;
+        }
+    }
+
+    /**
+     * @brief Computes the matrix exponential e^a by scaling and squaring
+     * with a [m/m] Pade approximant, m in 3, 5, 7, 9 or 13 picked from
+     * ||a||_1 (Higham, "The scaling and squaring method for the matrix
+     * exponential revisited", 2005). a is scaled by 2^-s until degree 13
+     * is accurate to double precision, and the result squared s times.
+     *
+     * @param a A square matrix
+     * @return matrix<T> e^a
+     */
+    template <class T>
+    matrix<T> expm(const matrix<T> &a)
+    {
+        if (a.rows() == 0)
+        {
+            throw std::out_of_range("Can't exponentiate matrix of size 0!");
+        }
+        if (a.rows() != a.cols())
+        {
+            throw invalid_dimension(a.rows(), a.cols());
+        }
+
+        static const double theta[] = {1.495585217958292e-2, 2.539398330063230e-1, 9.504178996162932e-1,
+                                       2.097847961257068e0, 5.371920351148152e0};
+        static const int degree[] = {3, 5, 7, 9, 13};
+        static const double b3[] = {120, 60, 12, 1};
+        static const double b5[] = {30240, 15120, 3360, 420, 30, 1};
+        static const double b7[] = {17297280, 8648640, 1995840, 277200, 25200, 1512, 56, 1};
+        static const double b9[] = {17643225600., 8821612800., 2075673600., 302702400., 30270240.,
+                                    2162160., 110880., 3960., 90., 1.};
+        static const double b13[] = {64764752532480000., 32382376266240000., 7771770303897600.,
+                                     1187353796428800., 129060195264000., 10559470521600.,
+                                     670442572800., 33522128640., 1323241920., 40840800.,
+                                     960960., 16380., 182., 1.};
+        static const double *coefficients[] = {b3, b5, b7, b9, b13};
+
+        const size_t n = a.rows();
+        const double norm = static_cast<double>(detail::norm1(a));
+        size_t choice = 0;
+        while (choice < 4 && norm > theta[choice])
+        {
+            choice++;
+        }
+        int squarings = 0;
+        matrix<T> x = a;
+        if (norm > theta[4])
+        {
+            squarings = static_cast<int>(std::ceil(std::log2(norm / theta[4])));
+            const T scale = static_cast<T>(std::ldexp(1.0, -squarings));
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    x[i][j] *= scale;
+                }
+            }
+        }
+
+        const double *b = coefficients[choice];
+        matrix<T> x2(n, n), x4(n, n), x6(n, n), x8(n, n), work(n, n), u(n, n), v(n, n);
+        detail::product_into(x, x, x2);
+        if (degree[choice] == 13)
+        {
+            detail::product_into(x2, x2, x4);
+            detail::product_into(x2, x4, x6);
+
+            // u = x (x6 (b13 x6 + b11 x4 + b9 x2) + b7 x6 + b5 x4 + b3 x2 + b1 I)
+            // v = x6 (b12 x6 + b10 x4 + b8 x2) + b6 x6 + b4 x4 + b2 x2 + b0 I
+            detail::linear_combination<T>(work, {&x6, &x4, &x2},
+                                          {static_cast<T>(b[13]), static_cast<T>(b[11]), static_cast<T>(b[9])}, T());
+            detail::product_into(x6, work, x8);
+            detail::linear_combination<T>(work, {&x8, &x6, &x4, &x2},
+                                          {1, static_cast<T>(b[7]), static_cast<T>(b[5]), static_cast<T>(b[3])},
+                                          static_cast<T>(b[1]));
+            detail::product_into(x, work, u);
+            detail::linear_combination<T>(work, {&x6, &x4, &x2},
+                                          {static_cast<T>(b[12]), static_cast<T>(b[10]), static_cast<T>(b[8])}, T());
+            detail::product_into(x6, work, x8);
+            detail::linear_combination<T>(v, {&x8, &x6, &x4, &x2},
+                                          {1, static_cast<T>(b[6]), static_cast<T>(b[4]), static_cast<T>(b[2])},
+                                          static_cast<T>(b[0]));
+        }
+        else
+        {
+            // even powers up to x^(m - 1), then u = x sum b(2k+1) x^2k and
+            // v = sum b(2k) x^2k
+            std::vector<const matrix<T> *> powers = {&x2};
+            if (degree[choice] >= 5)
+            {
+                detail::product_into(x2, x2, x4);
+                powers.push_back(&x4);
+            }
+            if (degree[choice] >= 7)
+            {
+                detail::product_into(x2, x4, x6);
+                powers.push_back(&x6);
+            }
+            if (degree[choice] >= 9)
+            {
+                detail::product_into(x4, x4, x8);
+                powers.push_back(&x8);
+            }
+            std::vector<T> odd, even;
+            for (size_t k = 1; k <= powers.size(); k++)
+            {
+                odd.push_back(static_cast<T>(b[2 * k + 1]));
+                even.push_back(static_cast<T>(b[2 * k]));
+            }
+            detail::linear_combination(work, powers, odd, static_cast<T>(b[1]));
+            detail::product_into(x, work, u);
+            detail::linear_combination(v, powers, even, static_cast<T>(b[0]));
+        }
+
+        // r = (v - u)^-1 (v + u)
+        detail::linear_combination<T>(work, {&v, &u}, {1, -1}, T());
+        detail::linear_combination<T>(x2, {&v, &u}, {1, 1}, T());
+        matrix<T> result = lu_decomposition<T>(work).solve(x2);
+        for (int s = 0; s < squarings; s++)
+        {
+            detail::product_into(result, result, work);
+            std::swap(result, work);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Computes a^k by repeated squaring: at most 2 log2(k) products.
+     * Negative powers invert a first.
+     *
+     * @param a A square matrix
+     * @param k The power
+     * @return matrix<T> a^k, the identity for k = 0
+     * @throws singular_matrix if k < 0 and a is singular
+     */
+    template <class T>
+    matrix<T> pow(const matrix<T> &a, long long k)
+    {
+        if (a.rows() != a.cols())
+        {
+            throw invalid_dimension(a.rows(), a.cols());
+        }
+
+        const size_t n = a.rows();
+        matrix<T> base = k < 0 ? inverse(a) : a;
+        unsigned long long e = k < 0 ? 0ULL - static_cast<unsigned long long>(k) : static_cast<unsigned long long>(k);
+        matrix<T> result = detail::identity<T>(n);
+        matrix<T> work(n, n);
+        bool first = true;
+        while (e)
+        {
+            if (e & 1)
+            {
+                if (first)
+                {
+                    result = base;
+                    first = false;
+                }
+                else
+                {
+                    detail::product_into(result, base, work);
+                    std::swap(result, work);
+                }
+            }
+            e >>= 1;
+            if (e)
+            {
+                detail::product_into(base, base, work);
+                std::swap(base, work);
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Computes the symmetric positive definite square root of a
+     * symmetric positive definite matrix, through its eigendecomposition
+     *
+     * @param a The matrix
+     * @return matrix<T> The root r, with r r = a
+     * @throws std::domain_error if a is not symmetric positive definite
+     */
+    template <class T>
+    matrix<T> sqrtm(const matrix<T> &a)
+    {
+        return detail::apply_to_eigenvalues(detail::spd_eigen(a), [](T x) { return std::sqrt(x); });
+    }
+
+    /**
+     * @brief Computes the symmetric logarithm of a symmetric positive
+     * definite matrix, through its eigendecomposition
+     *
+     * @param a The matrix
+     * @return matrix<T> The logarithm l, with expm(l) = a
+     * @throws std::domain_error if a is not symmetric positive definite
+     */
+    template <class T>
+    matrix<T> logm(const matrix<T> &a)
+    {
+        return detail::apply_to_eigenvalues(detail::spd_eigen(a), [](T x) { return std::log(x); });
+    }
+}
+
+#endif
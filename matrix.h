@@ -12,9 +12,18 @@
 #ifndef _MATRIX_H_
 #define _MATRIX_H_
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
 #include <iostream>
 #include <list>
+#include <memory>
 #include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 /**
@@ -88,6 +97,1221 @@ namespace codesample
         return result;
     }
 
+    /**
+     * @brief Computes the dot product of two vectors, accumulating in a wider type.
+     * Each element is converted to Acc before being multiplied, so e.g. float
+     * vectors can be reduced in double without storing them as double.
+     *
+     * @tparam Acc The type to accumulate the products in
+     * @tparam T The type of data in the vectors. Must be convertible to Acc
+     * @param v1 The first vector
+     * @param v2 The second vector
+     * @return Acc The computed dot product
+     */
+    template <class Acc, class T>
+    static Acc dot_accumulate(const std::vector<T> &v1, const std::vector<T> &v2)
+    {
+        if (v1.size() != v2.size())
+        {
+            throw invalid_dimension(v1.size(), v2.size());
+        }
+
+        const T *a = v1.data();
+        const T *b = v2.data();
+        Acc result = Acc();
+        for (size_t i = 0; i < v1.size(); i++)
+        {
+            result += static_cast<Acc>(a[i]) * static_cast<Acc>(b[i]);
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Computes the dot product of two floating point vectors using
+     * compensated arithmetic. Each product and partial sum is split into its
+     * rounded value and exact error (as in the Dot2 algorithm of Ogita, Rump
+     * and Oishi), and the errors are themselves summed with compensation so
+     * that very long vectors stay accurate. The result is close to correctly
+     * rounded without needing a wider type.
+     *
+     * @tparam T The floating point type of data in the vectors
+     * @param v1 The first vector
+     * @param v2 The second vector
+     * @return T The computed dot product
+     */
+    template <class T>
+    static T dot_compensated(const std::vector<T> &v1, const std::vector<T> &v2)
+    {
+        static_assert(std::is_floating_point<T>::value,
+                      "dot_compensated requires a floating point type");
+
+        if (v1.size() != v2.size())
+        {
+            throw invalid_dimension(v1.size(), v2.size());
+        }
+
+        const T *a = v1.data();
+        const T *b = v2.data();
+        T sum = T();
+        T err = T();
+        T err_lost = T();
+        for (size_t i = 0; i < v1.size(); i++)
+        {
+            // error free transformation of the product: a*b == p + e exactly
+            T p = a[i] * b[i];
+            T e = std::fma(a[i], b[i], -p);
+
+            // error free transformation of the sum: sum + p == s + q exactly
+            T s = sum + p;
+            T z = s - sum;
+            T q = (sum - (s - z)) + (p - z);
+            sum = s;
+
+            // and once more for the running error, keeping what it drops
+            T x = q + e;
+            T t = err + x;
+            z = t - err;
+            err_lost += (err - (t - z)) + (x - z);
+            err = t;
+        }
+
+        return sum + (err + err_lost);
+    }
+
+    /**
+     * @brief Sets the number of threads the multiply kernels may use
+     *
+     * @param n The number of threads, or 0 to use one per hardware thread
+     */
+    inline void set_num_threads(size_t n);
+
+    /**
+     * @brief Gets the number of threads the multiply kernels may use
+     *
+     * @return size_t The number of threads
+     */
+    inline size_t num_threads();
+
+    /**
+     * @brief The ordinary (+, *) semiring, accumulating in T.
+     *
+     * A semiring for the multiply kernels is a type with a value_type to
+     * accumulate in, and static zero(), add() and mul(). Operands are
+     * converted to value_type as they are packed and results are converted
+     * back to the element type of the output as they are stored, so
+     * plus_times<double> over matrix<float> accumulates floats in double.
+     * zero() must be the identity of add() and annihilate under mul().
+     * The functions may also be non-static members, for semirings that
+     * carry state such as a modulus; the kernel calls them on an instance.
+     *
+     * @tparam T The type to accumulate in
+     */
+    template <class T>
+    struct plus_times
+    {
+        typedef T value_type;
+
+        static T zero()
+        {
+            return T();
+        }
+
+        static T add(const T &a, const T &b)
+        {
+            return a + b;
+        }
+
+        static T mul(const T &a, const T &b)
+        {
+            return a * b;
+        }
+    };
+
+    /**
+     * @brief A running sum with its rounding error carried alongside, as
+     * dot_compensated() keeps it: the rounded sum, the sum of the exact
+     * errors, and what that sum in turn dropped
+     *
+     * @tparam T The floating point type summed
+     */
+    template <class T>
+    struct compensated_sum
+    {
+        T sum;
+        T err;
+        T err_lost;
+
+        compensated_sum()
+        : sum(), err(), err_lost()
+        {
+        }
+
+        explicit compensated_sum(const T &value)
+        : sum(value), err(), err_lost()
+        {
+        }
+
+        explicit operator T() const
+        {
+            return sum + (err + err_lost);
+        }
+    };
+
+    /**
+     * @brief The (+, *) semiring with compensated accumulation, so that the
+     * multiply kernels compute each element as dot_compensated() would.
+     * mul() splits a product into its rounded value and exact error, and
+     * add() folds both into the running sum with error free transformations.
+     *
+     * @tparam T The floating point type of the operands
+     */
+    template <class T>
+    struct plus_times_compensated
+    {
+        static_assert(std::is_floating_point<T>::value, "Compensated accumulation requires a floating point type");
+
+        typedef compensated_sum<T> value_type;
+
+        static value_type zero()
+        {
+            return value_type();
+        }
+
+        static value_type add(const value_type &a, const value_type &b)
+        {
+            // error free transformation of the sum: a.sum + b.sum == s + q exactly
+            value_type r;
+            r.sum = a.sum + b.sum;
+            T z = r.sum - a.sum;
+            const T q = (a.sum - (r.sum - z)) + (b.sum - z);
+
+            // and once more for the running error, keeping what it drops
+            const T x = q + b.err;
+            r.err = a.err + x;
+            z = r.err - a.err;
+            r.err_lost = (a.err_lost + b.err_lost) + ((a.err - (r.err - z)) + (x - z));
+            return r;
+        }
+
+        static value_type mul(const value_type &a, const value_type &b)
+        {
+            // error free transformation of the product: a*b == p + e exactly
+            value_type r;
+            r.sum = a.sum * b.sum;
+            r.err = std::fma(a.sum, b.sum, -r.sum);
+            return r;
+        }
+    };
+
+    template <class T>
+    class matrix;
+
+    /**
+     * @brief Implementation details of the multiply kernels
+     *
+     */
+    namespace detail
+    {
+        inline std::atomic<size_t> &thread_setting()
+        {
+            static std::atomic<size_t> setting(0);
+            return setting;
+        }
+
+        /**
+         * @brief Runs f(begin, end) over [0, n) split into one contiguous
+         * range per thread. Range boundaries are multiples of grain. The
+         * calling thread takes the first range, and the first exception
+         * thrown by any range is rethrown once all have finished.
+         *
+         * @param n The size of the range
+         * @param grain The granularity of the split
+         * @param threads The most threads to use
+         * @param f The function to run on each range
+         */
+        template <class F>
+        void parallel_for(size_t n, size_t grain, size_t threads, const F &f)
+        {
+            size_t chunks = (n + grain - 1) / grain;
+            threads = std::max<size_t>(1, std::min(threads, chunks));
+            if (threads == 1)
+            {
+                f(0, n);
+                return;
+            }
+
+            size_t per_thread = (chunks + threads - 1) / threads * grain;
+            std::vector<std::thread> workers;
+            std::vector<std::exception_ptr> errors(threads);
+            for (size_t t = 1; t < threads; t++)
+            {
+                size_t begin = std::min(n, t * per_thread);
+                size_t end = std::min(n, begin + per_thread);
+                workers.push_back(std::thread([&f, &errors, t, begin, end]() {
+                    try
+                    {
+                        f(begin, end);
+                    }
+                    catch (...)
+                    {
+                        errors[t] = std::current_exception();
+                    }
+                }));
+            }
+
+            try
+            {
+                f(0, std::min(n, per_thread));
+            }
+            catch (...)
+            {
+                errors[0] = std::current_exception();
+            }
+
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+            for (auto &error : errors)
+            {
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+        }
+
+        /**
+         * @brief Below this many elements a comparison runs on one thread
+         */
+        const size_t compare_parallel_threshold = 1 << 18;
+
+        /**
+         * @brief Comparisons test this many elements with no branch, so the
+         * loop vectorizes, before checking whether any differed
+         */
+        const size_t compare_chunk = 64;
+
+        /**
+         * @brief Whether row_fails(i) is true for any of rows rows, split
+         * across threads for large matrices. Every thread stops once one
+         * finds a failing row.
+         *
+         * @param rows The number of rows
+         * @param cols The number of columns, to decide on threads
+         * @param row_fails The test of one row
+         */
+        template <class F>
+        bool any_row(size_t rows, size_t cols, const F &row_fails)
+        {
+            std::atomic<bool> found(false);
+            const size_t threads = rows * cols < compare_parallel_threshold ? 1 : num_threads();
+            parallel_for(rows, 1, threads, [&](size_t r0, size_t r1) {
+                for (size_t i = r0; i < r1 && !found.load(std::memory_order_relaxed); i++)
+                {
+                    if (row_fails(i))
+                    {
+                        found = true;
+                    }
+                }
+            });
+            return found;
+        }
+
+        /**
+         * @brief Whether pass(a[j], b[j]) is false for any j, for rows of
+         * the same length
+         */
+        template <class T, class F>
+        bool row_fails(const std::vector<T> &a, const std::vector<T> &b, const F &pass)
+        {
+            const size_t n = a.size();
+            for (size_t j0 = 0; j0 < n; j0 += compare_chunk)
+            {
+                const size_t j1 = std::min(n, j0 + compare_chunk);
+                bool failed = false;
+                for (size_t j = j0; j < j1; j++)
+                {
+                    failed |= !pass(a[j], b[j]);
+                }
+                if (failed)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief Block sizes for the multiply kernel, in elements of the
+         * accumulation type V. A register tile of mr x nr results is
+         * updated from a packed sliver of a (mr x kc) and of b (kc x nr);
+         * mc x kc of a is packed per block and kc x nc of b per panel.
+         */
+        template <class V>
+        struct gemm_blocking
+        {
+            static const size_t mr = 4;
+            static const size_t nr = sizeof(V) >= 16 ? 4 : (sizeof(V) >= 8 ? 8 : 16);
+            static const size_t mc = 64;
+            static const size_t kc = 256;
+            static const size_t nc = 512;
+        };
+
+        template <class V> const size_t gemm_blocking<V>::mr;
+        template <class V> const size_t gemm_blocking<V>::nr;
+        template <class V> const size_t gemm_blocking<V>::mc;
+        template <class V> const size_t gemm_blocking<V>::kc;
+        template <class V> const size_t gemm_blocking<V>::nc;
+
+        /**
+         * @brief Below this many multiply-adds a product runs on one thread
+         */
+        const size_t gemm_parallel_threshold = 64 * 64 * 64;
+
+        /**
+         * @brief Converts n elements of row i of a source, from column j on,
+         * to the type the kernel accumulates in, as it packs them.
+         * Specialized where whole runs convert faster than one element at a
+         * time, as 16-bit floats widen (see half.h); fast then says that the
+         * kernel should go through row() even where it packs by columns.
+         */
+        template <class Src, class V>
+        struct pack_convert
+        {
+            static const bool fast = false;
+
+            static void row(const Src &src, size_t i, size_t j, size_t n, V *out)
+            {
+                for (size_t c = 0; c < n; c++)
+                {
+                    out[c] = static_cast<V>(src(i, j + c));
+                }
+            }
+        };
+
+        template <class Src, class V> const bool pack_convert<Src, V>::fast;
+
+        /**
+         * @brief Packs rows [i0, i0 + mc) and columns [p0, p0 + kc) of a into
+         * slivers of mr rows, each stored column by column. Rows past the end
+         * are filled with the semiring's zero.
+         */
+        template <class S, size_t MR, class A>
+        void gemm_pack_a(const S &s_ring, const A &a, size_t i0, size_t mc, size_t p0, size_t kc,
+                         typename S::value_type *packed)
+        {
+            typedef typename S::value_type V;
+            typedef pack_convert<A, V> convert;
+            std::unique_ptr<V[]> converted(convert::fast ? new V[kc] : nullptr);
+            for (size_t s = 0; s < mc; s += MR)
+            {
+                V *sliver = packed + s * kc;
+                for (size_t r = 0; r < MR; r++)
+                {
+                    if (s + r < mc && convert::fast)
+                    {
+                        // convert the row in one run, then spread it down the sliver
+                        convert::row(a, i0 + s + r, p0, kc, converted.get());
+                        for (size_t p = 0; p < kc; p++)
+                        {
+                            sliver[p * MR + r] = converted[p];
+                        }
+                    }
+                    else if (s + r < mc)
+                    {
+                        for (size_t p = 0; p < kc; p++)
+                        {
+                            sliver[p * MR + r] = static_cast<V>(a(i0 + s + r, p0 + p));
+                        }
+                    }
+                    else
+                    {
+                        for (size_t p = 0; p < kc; p++)
+                        {
+                            sliver[p * MR + r] = s_ring.zero();
+                        }
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Packs rows [p0, p0 + kc) and columns [j0, j0 + nc) of b into
+         * slivers of nr columns, each stored row by row. Columns past the end
+         * are filled with the semiring's zero.
+         */
+        template <class S, size_t NR, class B>
+        void gemm_pack_b(const S &s_ring, const B &b, size_t p0, size_t kc, size_t j0, size_t nc,
+                         typename S::value_type *packed)
+        {
+            typedef typename S::value_type V;
+            for (size_t s = 0; s < nc; s += NR)
+            {
+                V *sliver = packed + s * kc;
+                const size_t width = std::min(NR, nc - s);
+                for (size_t p = 0; p < kc; p++)
+                {
+                    pack_convert<B, V>::row(b, p0 + p, j0 + s, width, sliver + p * NR);
+                    for (size_t c = width; c < NR; c++)
+                    {
+                        sliver[p * NR + c] = s_ring.zero();
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Updates an mr x nr tile from packed slivers of a and b.
+         * The tile starts from zero on the first panel of k and otherwise
+         * from the partial sums in c. On the last panel the finished values
+         * go to out(i, j, value) while still in registers, otherwise back to c.
+         */
+        template <class S, size_t MR, size_t NR, class Out>
+        void gemm_micro(const S &s_ring, size_t kc, const typename S::value_type *a, const typename S::value_type *b,
+                        typename S::value_type *c, size_t ldc, bool first, bool last,
+                        Out &out, size_t i0, size_t j0, size_t rows, size_t cols)
+        {
+            typedef typename S::value_type V;
+            V acc[MR][NR];
+            for (size_t i = 0; i < MR; i++)
+            {
+                for (size_t j = 0; j < NR; j++)
+                {
+                    acc[i][j] = first ? s_ring.zero() : c[i * ldc + j];
+                }
+            }
+
+            for (size_t p = 0; p < kc; p++)
+            {
+                const V *ap = a + p * MR;
+                const V *bp = b + p * NR;
+                for (size_t i = 0; i < MR; i++)
+                {
+                    const V ai = ap[i];
+                    for (size_t j = 0; j < NR; j++)
+                    {
+                        acc[i][j] = s_ring.add(acc[i][j], s_ring.mul(ai, bp[j]));
+                    }
+                }
+            }
+
+            if (last)
+            {
+                for (size_t i = 0; i < rows; i++)
+                {
+                    for (size_t j = 0; j < cols; j++)
+                    {
+                        out(i0 + i, j0 + j, acc[i][j]);
+                    }
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < MR; i++)
+                {
+                    for (size_t j = 0; j < NR; j++)
+                    {
+                        c[i * ldc + j] = acc[i][j];
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Computes rows [r0, r1) of a * b over the semiring S
+         */
+        template <class S, class A, class B, class Out>
+        void gemm_rows(const S &s_ring, const A &a, const B &b, Out &out, size_t r0, size_t r1)
+        {
+            typedef typename S::value_type V;
+            typedef gemm_blocking<V> blocking;
+            const size_t MR = blocking::mr, NR = blocking::nr;
+            const size_t k = a.cols();
+            const size_t n = b.cols();
+
+            const size_t kc_max = std::min<size_t>(blocking::kc, k);
+            const size_t nc_max = std::min<size_t>(blocking::nc, (n + NR - 1) / NR * NR);
+            const size_t mc_max = std::min<size_t>(blocking::mc, (r1 - r0 + MR - 1) / MR * MR);
+            std::unique_ptr<V[]> a_packed(new V[mc_max * kc_max]);
+            std::unique_ptr<V[]> b_packed(new V[kc_max * nc_max]);
+
+            // partial sums only need keeping when k spans several panels
+            const size_t ldc = nc_max;
+            const size_t c_rows = (r1 - r0 + MR - 1) / MR * MR;
+            std::unique_ptr<V[]> c_partial(k > kc_max ? new V[c_rows * ldc] : nullptr);
+
+            for (size_t j0 = 0; j0 < n; j0 += blocking::nc)
+            {
+                const size_t nc = std::min<size_t>(blocking::nc, n - j0);
+                for (size_t p0 = 0; p0 < k; p0 += blocking::kc)
+                {
+                    const size_t kc = std::min<size_t>(blocking::kc, k - p0);
+                    const bool first = p0 == 0;
+                    const bool last = p0 + kc == k;
+                    gemm_pack_b<S, NR>(s_ring, b, p0, kc, j0, nc, b_packed.get());
+
+                    for (size_t i0 = r0; i0 < r1; i0 += blocking::mc)
+                    {
+                        const size_t mc = std::min<size_t>(blocking::mc, r1 - i0);
+                        gemm_pack_a<S, MR>(s_ring, a, i0, mc, p0, kc, a_packed.get());
+
+                        for (size_t jr = 0; jr < nc; jr += NR)
+                        {
+                            for (size_t ir = 0; ir < mc; ir += MR)
+                            {
+                                V *c = c_partial ? &c_partial[(i0 - r0 + ir) * ldc + jr] : nullptr;
+                                gemm_micro<S, MR, NR>(s_ring, kc, &a_packed[ir * kc], &b_packed[jr * kc], c, ldc,
+                                                      first, last, out, i0 + ir, j0 + jr,
+                                                      std::min(MR, mc - ir), std::min(NR, nc - jr));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief A row major array seen as a matrix by the multiply kernel
+         */
+        template <class T>
+        struct array_source
+        {
+            const T *data;
+            size_t row_count;
+            size_t col_count;
+
+            size_t rows() const
+            {
+                return row_count;
+            }
+
+            size_t cols() const
+            {
+                return col_count;
+            }
+
+            const T &operator()(size_t i, size_t j) const
+            {
+                return data[i * col_count + j];
+            }
+        };
+
+        /**
+         * @brief Stores kernel output into a row major array
+         */
+        template <class T>
+        struct array_writer
+        {
+            T *data;
+            size_t col_count;
+
+            template <class V>
+            void operator()(size_t i, size_t j, const V &value)
+            {
+                data[i * col_count + j] = static_cast<T>(value);
+            }
+        };
+
+        /**
+         * @brief Shapes below these sizes skip the packing in gemm_rows(),
+         * which costs more than it saves on them. Chosen from the timings
+         * in bench_small_shapes() (bench.cpp).
+         */
+        const size_t gemm_tiny_size = 4;
+        const size_t gemm_skinny_k = 16;
+
+        /**
+         * @brief Computes a * b for k == K, with the inner loop fully
+         * unrolled and each row of a held in registers
+         */
+        template <class S, size_t K, class A, class B, class Out>
+        void gemm_tiny(const S &s_ring, const A &a, const B &b, Out &out)
+        {
+            typedef typename S::value_type V;
+            for (size_t i = 0; i < a.rows(); i++)
+            {
+                V a_row[K];
+                for (size_t p = 0; p < K; p++)
+                {
+                    a_row[p] = static_cast<V>(a(i, p));
+                }
+                for (size_t j = 0; j < b.cols(); j++)
+                {
+                    V acc = s_ring.zero();
+                    for (size_t p = 0; p < K; p++)
+                    {
+                        acc = s_ring.add(acc, s_ring.mul(a_row[p], static_cast<V>(b(p, j))));
+                    }
+                    out(i, j, acc);
+                }
+            }
+        }
+
+        /**
+         * @brief Computes the matrix-vector product a * b for b with one
+         * column, four rows of a at a time
+         */
+        template <class S, class A, class B, class Out>
+        void gemv(const S &s_ring, const A &a, const B &b, Out &out)
+        {
+            typedef typename S::value_type V;
+            const size_t m = a.rows();
+            const size_t k = a.cols();
+            std::unique_ptr<V[]> x(new V[k]);
+            for (size_t p = 0; p < k; p++)
+            {
+                x[p] = static_cast<V>(b(p, 0));
+            }
+
+            const size_t threads = m * k < gemm_parallel_threshold ? 1 : num_threads();
+            parallel_for(m, 4, threads, [&](size_t r0, size_t r1) {
+                size_t i = r0;
+                for (; i + 4 <= r1; i += 4)
+                {
+                    V c0 = s_ring.zero(), c1 = c0, c2 = c0, c3 = c0;
+                    for (size_t p = 0; p < k; p++)
+                    {
+                        c0 = s_ring.add(c0, s_ring.mul(static_cast<V>(a(i, p)), x[p]));
+                        c1 = s_ring.add(c1, s_ring.mul(static_cast<V>(a(i + 1, p)), x[p]));
+                        c2 = s_ring.add(c2, s_ring.mul(static_cast<V>(a(i + 2, p)), x[p]));
+                        c3 = s_ring.add(c3, s_ring.mul(static_cast<V>(a(i + 3, p)), x[p]));
+                    }
+                    out(i, 0, c0);
+                    out(i + 1, 0, c1);
+                    out(i + 2, 0, c2);
+                    out(i + 3, 0, c3);
+                }
+                for (; i < r1; i++)
+                {
+                    V c = s_ring.zero();
+                    for (size_t p = 0; p < k; p++)
+                    {
+                        c = s_ring.add(c, s_ring.mul(static_cast<V>(a(i, p)), x[p]));
+                    }
+                    out(i, 0, c);
+                }
+            });
+        }
+
+        /**
+         * @brief Computes columns [j0, j0 + nr) of one row of a * b from that
+         * row of a, as a sum of k scaled rows of b
+         */
+        template <class S, size_t NR, class B, class Out>
+        void gemm_row_block(const S &s_ring, const typename S::value_type *a_row, size_t k, const B &b,
+                            Out &out, size_t i, size_t j0, size_t cols)
+        {
+            typedef typename S::value_type V;
+            V acc[NR];
+            for (size_t c = 0; c < NR; c++)
+            {
+                acc[c] = s_ring.zero();
+            }
+            for (size_t p = 0; p < k; p++)
+            {
+                const V ap = a_row[p];
+                if (cols == NR)
+                {
+                    for (size_t c = 0; c < NR; c++)
+                    {
+                        acc[c] = s_ring.add(acc[c], s_ring.mul(ap, static_cast<V>(b(p, j0 + c))));
+                    }
+                }
+                else
+                {
+                    for (size_t c = 0; c < cols; c++)
+                    {
+                        acc[c] = s_ring.add(acc[c], s_ring.mul(ap, static_cast<V>(b(p, j0 + c))));
+                    }
+                }
+            }
+            for (size_t c = 0; c < cols; c++)
+            {
+                out(i, j0 + c, acc[c]);
+            }
+        }
+
+        /**
+         * @brief Computes a * b for short inner dimensions or a single row
+         * of a. Each row of the result is built nr columns at a time from
+         * scaled rows of b, which is packed once when more than one row
+         * reuses it.
+         */
+        template <class S, class A, class B, class Out>
+        void gemm_skinny(const S &s_ring, const A &a, const B &b, Out &out)
+        {
+            typedef typename S::value_type V;
+            const size_t NR = gemm_blocking<V>::nr;
+            const size_t m = a.rows();
+            const size_t n = b.cols();
+            const size_t k = a.cols();
+            const size_t threads = m * n * k < gemm_parallel_threshold ? 1 : num_threads();
+
+            if (m == 1)
+            {
+                std::unique_ptr<V[]> a_row(new V[k]);
+                pack_convert<A, V>::row(a, 0, 0, k, a_row.get());
+                // the one row is split by columns, on multiples of 64 so that
+                // packed rows (std::vector<bool>) never share a word between threads
+                parallel_for(n, NR * 64, threads, [&](size_t c0, size_t c1) {
+                    for (size_t j0 = c0; j0 < c1; j0 += NR)
+                    {
+                        gemm_row_block<S, NR>(s_ring, a_row.get(), k, b, out, 0, j0, std::min(NR, c1 - j0));
+                    }
+                });
+                return;
+            }
+
+            std::unique_ptr<V[]> packed(new V[k * n]);
+            for (size_t p = 0; p < k; p++)
+            {
+                pack_convert<B, V>::row(b, p, 0, n, &packed[p * n]);
+            }
+            const array_source<V> b_packed = {packed.get(), k, n};
+            parallel_for(m, 1, threads, [&](size_t r0, size_t r1) {
+                std::unique_ptr<V[]> a_row(new V[k]);
+                for (size_t i = r0; i < r1; i++)
+                {
+                    pack_convert<A, V>::row(a, i, 0, k, a_row.get());
+                    for (size_t j0 = 0; j0 < n; j0 += NR)
+                    {
+                        gemm_row_block<S, NR>(s_ring, a_row.get(), k, b_packed, out, i, j0, std::min(NR, n - j0));
+                    }
+                }
+            });
+        }
+
+        /**
+         * @brief Computes the product a * b over the semiring S with the
+         * packed, blocked kernel, whatever its shape
+         */
+        template <class S, class A, class B, class Out>
+        void gemm_blocked(const A &a, const B &b, Out &out, const S &s_ring = S())
+        {
+            const size_t m = a.rows();
+            const size_t n = b.cols();
+            const size_t k = a.cols();
+            if (m == 0 || n == 0 || k == 0)
+            {
+                return;
+            }
+
+            const size_t threads = m * n * k < gemm_parallel_threshold ? 1 : num_threads();
+            parallel_for(m, gemm_blocking<typename S::value_type>::mr, threads,
+                         [&](size_t r0, size_t r1) { gemm_rows(s_ring, a, b, out, r0, r1); });
+        }
+
+        /**
+         * @brief Computes the product a * b over the semiring S, passing
+         * each finished element to out(i, j, value). Rows of the result are
+         * split across threads, so out is called concurrently but never for
+         * the same row from two threads, except that a single row is split
+         * by columns in ranges that start on multiples of 64.
+         *
+         * Tiny products go to an unrolled kernel, matrix-vector products and
+         * short inner dimensions to kernels that skip packing, and the rest
+         * to gemm_blocked(). Every path accumulates over k in increasing
+         * order.
+         *
+         * @tparam S The semiring
+         * @tparam A Any matrix-like type with rows(), cols() and a(i, j)
+         * @tparam B Any matrix-like type with rows(), cols() and b(i, j)
+         * @tparam Out Callable as out(i, j, typename S::value_type)
+         * @param s_ring The semiring instance, for semirings with state
+         */
+        template <class S, class A, class B, class Out>
+        void gemm(const A &a, const B &b, Out &out, const S &s_ring = S())
+        {
+            const size_t m = a.rows();
+            const size_t n = b.cols();
+            const size_t k = a.cols();
+            if (m == 0 || n == 0 || k == 0)
+            {
+                return;
+            }
+
+            if (m <= gemm_tiny_size && n <= gemm_tiny_size && k <= gemm_tiny_size)
+            {
+                switch (k)
+                {
+                case 1:
+                    return gemm_tiny<S, 1>(s_ring, a, b, out);
+                case 2:
+                    return gemm_tiny<S, 2>(s_ring, a, b, out);
+                case 3:
+                    return gemm_tiny<S, 3>(s_ring, a, b, out);
+                default:
+                    return gemm_tiny<S, 4>(s_ring, a, b, out);
+                }
+            }
+            if (n == 1)
+            {
+                return gemv(s_ring, a, b, out);
+            }
+            if (m == 1 || k <= gemm_skinny_k)
+            {
+                return gemm_skinny(s_ring, a, b, out);
+            }
+            gemm_blocked(a, b, out, s_ring);
+        }
+
+        /**
+         * @brief Stores results into a matrix, converting from the
+         * accumulation type. Rows are looked up once, up front, so that
+         * threads writing to different rows never touch shared state.
+         */
+        template <class T>
+        class row_writer
+        {
+          private:
+            std::vector<std::vector<T> *> _rows;
+
+          public:
+            explicit row_writer(matrix<T> &m);
+
+            template <class V>
+            void operator()(size_t i, size_t j, const V &value)
+            {
+                (*_rows[i])[j] = static_cast<T>(value);
+            }
+        };
+
+        /**
+         * @brief Calls epilogue.check(rows, cols) for an epilogue that has
+         * one, such as one holding a value per column, so that it can throw
+         * before the multiply starts
+         */
+        template <class Epilogue>
+        auto check_epilogue(const Epilogue &epilogue, size_t rows, size_t cols, int)
+            -> decltype(epilogue.check(rows, cols), void())
+        {
+            epilogue.check(rows, cols);
+        }
+
+        template <class Epilogue>
+        void check_epilogue(const Epilogue &, size_t, size_t, long)
+        {
+        }
+
+        /**
+         * @brief Stores results into a matrix after passing each through an
+         * epilogue, so that the epilogue runs on values the kernel still
+         * has in registers rather than in a second pass over the output
+         */
+        template <class T, class Epilogue>
+        class epilogue_writer
+        {
+          private:
+            row_writer<T> _out;
+            const Epilogue &_epilogue;
+
+          public:
+            epilogue_writer(matrix<T> &m, const Epilogue &epilogue)
+            : _out(m), _epilogue(epilogue)
+            {
+                check_epilogue(epilogue, m.rows(), m.cols(), 0);
+            }
+
+            template <class V>
+            void operator()(size_t i, size_t j, const V &value)
+            {
+                _out(i, j, _epilogue(i, j, value));
+            }
+        };
+    }
+
+    /**
+     * @brief A non-owning view of a rectangular block of a matrix. Copying
+     * a view copies one pointer per row, never the elements. The multiply
+     * kernel reads views like matrices, and multiply_into() writes into
+     * them.
+     *
+     * Like references returned by operator[], a view stays valid until the
+     * matrix it came from is resized or destroyed.
+     *
+     * @tparam T The type of data in the matrix, const for a read-only view
+     */
+    template <class T>
+    class matrix_view
+    {
+      private:
+        std::vector<T *> _rows;
+        size_t _cols;
+
+      public:
+        /**
+         * @brief Construct a new matrix view
+         *
+         * @param rows A pointer to the first element of each row
+         * @param cols The number of columns
+         */
+        matrix_view(std::vector<T *> rows, size_t cols)
+        : _rows(std::move(rows)), _cols(cols)
+        {
+        }
+
+        /**
+         * @brief Construct a read-only view from a writable one
+         *
+         */
+        template <class U, class = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+        matrix_view(const matrix_view<U> &other)
+        : _cols(other.cols())
+        {
+            for (size_t i = 0; i < other.rows(); i++)
+            {
+                _rows.push_back(other.row(i));
+            }
+        }
+
+        size_t rows() const
+        {
+            return _rows.size();
+        }
+
+        size_t cols() const
+        {
+            return _rows.empty() ? 0 : _cols;
+        }
+
+        /**
+         * @brief Gets a pointer to the first element of a row. The row's
+         * elements are contiguous.
+         */
+        T *row(size_t i) const
+        {
+            return _rows[i];
+        }
+
+        /**
+         * @brief Gets an element of the view without bounds checking
+         */
+        T &operator()(size_t i, size_t j) const
+        {
+            return _rows[i][j];
+        }
+
+        /**
+         * @brief A view of a block of this view
+         *
+         * @param r0 The first row of the block
+         * @param c0 The first column of the block
+         * @param rows The number of rows in the block
+         * @param cols The number of columns in the block
+         * @return matrix_view<T> The block
+         */
+        matrix_view<T> view(size_t r0, size_t c0, size_t rows, size_t cols) const
+        {
+            if (r0 + rows > this->rows() || c0 + cols > this->cols())
+            {
+                throw std::out_of_range("View extends past the end of the matrix");
+            }
+            std::vector<T *> block(rows);
+            for (size_t i = 0; i < rows; i++)
+            {
+                block[i] = _rows[r0 + i] + c0;
+            }
+            return matrix_view<T>(std::move(block), cols);
+        }
+
+        /**
+         * @brief Copies the elements of another matrix or view into this one
+         *
+         * @param source Anything with rows(), cols() and operator()(i, j), the same size as this view
+         */
+        template <class Source>
+        void assign(const Source &source) const
+        {
+            if (source.rows() != rows() || source.cols() != cols())
+            {
+                throw invalid_dimension("Views differ in size");
+            }
+            for (size_t i = 0; i < rows(); i++)
+            {
+                for (size_t j = 0; j < cols(); j++)
+                {
+                    _rows[i][j] = source(i, j);
+                }
+            }
+        }
+    };
+
+    struct column_major;
+
+    /**
+     * @brief Row major storage: element (i, j) is at i * ld + j, where the
+     * leading dimension ld is at least the number of columns. matrix<T>
+     * rows are laid out this way.
+     *
+     */
+    struct row_major
+    {
+        typedef column_major transposed;
+
+        static size_t offset(size_t i, size_t j, size_t ld)
+        {
+            return i * ld + j;
+        }
+
+        static size_t min_ld(size_t, size_t cols)
+        {
+            return cols;
+        }
+    };
+
+    /**
+     * @brief Column major (Fortran) storage: element (i, j) is at
+     * i + j * ld, where the leading dimension ld is at least the number of
+     * rows
+     *
+     */
+    struct column_major
+    {
+        typedef row_major transposed;
+
+        static size_t offset(size_t i, size_t j, size_t ld)
+        {
+            return i + j * ld;
+        }
+
+        static size_t min_ld(size_t rows, size_t)
+        {
+            return rows;
+        }
+    };
+
+    /**
+     * @brief A non-owning matrix over memory that belongs to someone else:
+     * a pointer to the first element, a shape, a layout and a leading
+     * dimension (the distance between the starts of consecutive rows, or
+     * of consecutive columns when column major). The kernels read and
+     * write it like a matrix, so buffers from elsewhere need not be copied
+     * in. The multiply kernel copies operands into its own panels anyway,
+     * so products of any mix of layouts run without conversion.
+     *
+     * @tparam T The type of data in the buffer, const for a read-only ref
+     * @tparam Layout row_major or column_major
+     */
+    template <class T, class Layout = row_major>
+    class matrix_ref
+    {
+      private:
+        T *_data;
+        size_t _rows;
+        size_t _cols;
+        size_t _ld;
+
+      public:
+        typedef Layout layout;
+
+        /**
+         * @brief Construct a new matrix ref
+         *
+         * @param data The first element
+         * @param rows The number of rows
+         * @param cols The number of columns
+         * @param ld The leading dimension; 0 means the rows (or columns) are packed together
+         */
+        matrix_ref(T *data, size_t rows, size_t cols, size_t ld = 0)
+        : _data(data), _rows(rows), _cols(cols), _ld(ld == 0 ? Layout::min_ld(rows, cols) : ld)
+        {
+            if (_ld < Layout::min_ld(rows, cols))
+            {
+                throw std::invalid_argument("Leading dimension is smaller than the row length");
+            }
+        }
+
+        /**
+         * @brief Construct a read-only ref from a writable one
+         *
+         */
+        template <class U, class = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+        matrix_ref(const matrix_ref<U, Layout> &other)
+        : _data(other.data()), _rows(other.rows()), _cols(other.cols()), _ld(other.ld())
+        {
+        }
+
+        size_t rows() const
+        {
+            return _rows;
+        }
+
+        size_t cols() const
+        {
+            return _cols;
+        }
+
+        size_t ld() const
+        {
+            return _ld;
+        }
+
+        T *data() const
+        {
+            return _data;
+        }
+
+        /**
+         * @brief Gets an element without bounds checking
+         */
+        T &operator()(size_t i, size_t j) const
+        {
+            return _data[Layout::offset(i, j, _ld)];
+        }
+
+        /**
+         * @brief A ref to a block of this one, sharing its leading dimension
+         *
+         * @param r0 The first row of the block
+         * @param c0 The first column of the block
+         * @param rows The number of rows in the block
+         * @param cols The number of columns in the block
+         * @return matrix_ref<T, Layout> The block
+         */
+        matrix_ref<T, Layout> view(size_t r0, size_t c0, size_t rows, size_t cols) const
+        {
+            if (r0 + rows > _rows || c0 + cols > _cols)
+            {
+                throw std::out_of_range("View extends past the end of the matrix");
+            }
+            return matrix_ref<T, Layout>(_data + Layout::offset(r0, c0, _ld), rows, cols, _ld);
+        }
+
+        /**
+         * @brief The transpose, without copying: the same memory read in
+         * the other layout
+         *
+         * @return matrix_ref<T, typename Layout::transposed> The transpose
+         */
+        matrix_ref<T, typename Layout::transposed> transposed() const
+        {
+            return matrix_ref<T, typename Layout::transposed>(_data, _cols, _rows, _ld);
+        }
+
+        /**
+         * @brief Copies the elements of another matrix, view or ref into this one
+         *
+         * @param source Anything with rows(), cols() and operator()(i, j), the same size as this ref
+         */
+        template <class Source>
+        void assign(const Source &source) const
+        {
+            if (source.rows() != _rows || source.cols() != _cols)
+            {
+                throw invalid_dimension("Views differ in size");
+            }
+            for (size_t i = 0; i < _rows; i++)
+            {
+                for (size_t j = 0; j < _cols; j++)
+                {
+                    (*this)(i, j) = source(i, j);
+                }
+            }
+        }
+    };
+
     /**
      * @brief A class representing a 2-dimensional matrix of objects
      * 
@@ -101,6 +1325,136 @@ namespace codesample
         std::vector<std::vector<T>> _data;
         std::list<matrix<T>> _cache;
 
+        // Change tracking, off until track_changes(): _version counts the
+        // times the matrix has been handed out for writing, and each stamp
+        // is the version a row or column was last handed out at. A whole
+        // row handed out may be written anywhere, so it stamps every column
+        // through _wide_stamp; assignment stamps everything through
+        // _all_stamp. The stamp vectors are sized when tracking starts and
+        // on assignment, so the accessors only store.
+        bool _tracking = false;
+        uint64_t _version = 0;
+        uint64_t _all_stamp = 0;
+        uint64_t _wide_stamp = 0;
+        std::vector<uint64_t> _row_stamps;
+        std::vector<uint64_t> _col_stamps;
+
+        // the version the cached transpose is current as of
+        uint64_t _cache_version = 0;
+
+        /**
+         * @brief Notes that rows [r0, r1) and columns [c0, c1) are being
+         * handed out for writing: stamps them if tracking, and otherwise
+         * drops the cached transpose
+         */
+        void written(size_t r0, size_t r1, size_t c0, size_t c1)
+        {
+            if (!_tracking)
+            {
+                _cache.clear();      // matix has changed so cached transpose is invalid
+                return;
+            }
+            _version++;
+            for (size_t i = r0; i < r1; i++)
+            {
+                _row_stamps[i] = _version;
+            }
+            if (c1 > _col_stamps.size())
+            {
+                // a row lengthened through operator[]
+                _wide_stamp = _version;
+                return;
+            }
+            for (size_t j = c0; j < c1; j++)
+            {
+                _col_stamps[j] = _version;
+            }
+        }
+
+        /**
+         * @brief Takes on another matrix's contents, as a change to every
+         * element. The other's transpose comes along if it was current.
+         */
+        template <class Other>
+        void replace_with(Other &&other)
+        {
+            const bool cache_current =
+                !other._cache.empty() && (!other._tracking || other._cache_version == other._version);
+            const uint64_t version = std::max(_version, other._version) + 1;
+            _data = std::forward<Other>(other)._data;
+            _cache = std::forward<Other>(other)._cache;
+            if (!cache_current)
+            {
+                _cache.clear();
+            }
+            if (_tracking)
+            {
+                _row_stamps.assign(rows(), 0);
+                _col_stamps.assign(cols(), 0);
+                _version = _all_stamp = version;
+                _cache_version = version;
+            }
+        }
+
+        /**
+         * @brief Brings the cached transpose up to date by rewriting the
+         * columns of the rows changed since it was made
+         *
+         * @return true If it could be patched; false if it should be rebuilt
+         */
+        bool patch_transpose()
+        {
+            if (!_tracking)
+            {
+                // untracked writes drop the cache, so it is current
+                return true;
+            }
+            matrix<T> &t = _cache.front();
+            if (_all_stamp > _cache_version || t.rows() != cols() || t.cols() != rows())
+            {
+                return false;
+            }
+            const std::vector<size_t> changed = rows_changed_since(_cache_version);
+            if (changed.size() > rows() / 4)
+            {
+                // rebuilding with the tiled transpose beats writing this
+                // many scattered columns
+                return false;
+            }
+            for (size_t i : changed)
+            {
+                if (_data[i].size() != t.rows())
+                {
+                    return false;
+                }
+                for (size_t j = 0; j < t.rows(); j++)
+                {
+                    t._data[j][i] = _data[i][j];
+                }
+            }
+            _cache_version = _version;
+            return true;
+        }
+
+        /**
+         * @brief A view of a block of the given rows, pointing at just the
+         * rows it covers
+         */
+        template <class U, class Data>
+        static matrix_view<U> block_view(Data &data, size_t r0, size_t c0, size_t rows, size_t cols)
+        {
+            if (r0 + rows > data.size() || c0 + cols > (data.empty() ? 0 : data[0].size()))
+            {
+                throw std::out_of_range("View extends past the end of the matrix");
+            }
+            std::vector<U *> block(rows);
+            for (size_t i = 0; i < rows; i++)
+            {
+                block[i] = data[r0 + i].data() + c0;
+            }
+            return matrix_view<U>(std::move(block), cols);
+        }
+
       public:
        /**
         * @brief Construct a new matrix object
@@ -155,6 +1509,64 @@ namespace codesample
         {
         }
 
+        matrix(const matrix<T> &other) = default;
+        matrix(matrix<T> &&other) = default;
+
+        /**
+         * @brief Replaces the contents of this matrix, which counts as a
+         * change to every row and column
+         */
+        matrix<T> &operator=(const matrix<T> &other)
+        {
+            if (this != &other)
+            {
+                replace_with(other);
+            }
+            return *this;
+        }
+
+        matrix<T> &operator=(matrix<T> &&other)
+        {
+            if (this != &other)
+            {
+                replace_with(std::move(other));
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Construct a new matrix object by copying the elements of a view
+         *
+         * @param v The view to copy
+         */
+        template <class U>
+        explicit matrix(const matrix_view<U> &v)
+        : _data(v.rows())
+        {
+            for (size_t i = 0; i < v.rows(); i++)
+            {
+                _data[i].assign(v.row(i), v.row(i) + v.cols());
+            }
+        }
+
+        /**
+         * @brief Construct a new matrix object by copying the elements of an external buffer
+         *
+         * @param r The buffer to copy
+         */
+        template <class U, class Layout>
+        explicit matrix(const matrix_ref<U, Layout> &r)
+        : _data(r.rows(), std::vector<T>(r.cols()))
+        {
+            for (size_t i = 0; i < r.rows(); i++)
+            {
+                for (size_t j = 0; j < r.cols(); j++)
+                {
+                    _data[i][j] = r(i, j);
+                }
+            }
+        }
+
         /**
          * @brief Gets the number of rows in this matrix
          * 
@@ -175,6 +1587,62 @@ namespace codesample
             return _data.size() > 0 ? _data.at(0).size() : 0;
         }
 
+        /**
+         * @brief Gets an element of this matrix without bounds checking
+         *
+         * @param i The row of the element
+         * @param j The column of the element
+         * @return The element at row i, column j
+         */
+        typename std::vector<T>::const_reference operator()(size_t i, size_t j) const
+        {
+            return _data[i][j];
+        }
+
+        /**
+         * @brief Modifies an element of this matrix without bounds checking
+         *
+         * @param i The row of the element
+         * @param j The column of the element
+         * @return The element at row i, column j
+         */
+        typename std::vector<T>::reference operator()(size_t i, size_t j)
+        {
+            written(i, i + 1, j, j + 1);
+            return _data[i][j];
+        }
+
+        /**
+         * @brief Gets a view of a block of this matrix, without copying.
+         * Writes through the view change this matrix.
+         *
+         * @param r0 The first row of the block
+         * @param c0 The first column of the block
+         * @param rows The number of rows in the block
+         * @param cols The number of columns in the block
+         * @return matrix_view<T> The block
+         */
+        matrix_view<T> view(size_t r0, size_t c0, size_t rows, size_t cols)
+        {
+            matrix_view<T> block = block_view<T>(_data, r0, c0, rows, cols);
+            written(r0, r0 + rows, c0, c0 + cols);      // the view may be written through
+            return block;
+        }
+
+        /**
+         * @brief Gets a read-only view of a block of this matrix, without copying
+         *
+         * @param r0 The first row of the block
+         * @param c0 The first column of the block
+         * @param rows The number of rows in the block
+         * @param cols The number of columns in the block
+         * @return matrix_view<const T> The block
+         */
+        matrix_view<const T> view(size_t r0, size_t c0, size_t rows, size_t cols) const
+        {
+            return block_view<const T>(_data, r0, c0, rows, cols);
+        }
+
         /**
          * @brief Computes the transpose of this matrix and caches it
          * 
@@ -182,25 +1650,37 @@ namespace codesample
          */
         matrix<T> transpose()
         {
-            if (_cache.size() > 0)
+            if (_cache.size() > 0 && patch_transpose())
             {
                 // transpose already computed so return
-                // previous result
+                // previous result, with any changed rows rewritten
                 return _cache.front();
             }
+            _cache.clear();
 
             if (_data.size() > 0)
             {
-                // compute the transpose
+                // compute the transpose, in square tiles as transpose_into()
+                // does so both sides are read and written a cache line at a time
                 matrix<T> m_T(cols(), rows());
-                for (size_t i = 0; i < _data.at(0).size(); i++)
+                const size_t tile = 32;
+                for (size_t i0 = 0; i0 < m_T.rows(); i0 += tile)
                 {
-                    for (size_t j = 0; j < _data.size(); j++)
+                    const size_t i1 = std::min(m_T.rows(), i0 + tile);
+                    for (size_t j0 = 0; j0 < m_T.cols(); j0 += tile)
                     {
-                        m_T[i][j] = _data[j][i];
+                        const size_t j1 = std::min(m_T.cols(), j0 + tile);
+                        for (size_t i = i0; i < i1; i++)
+                        {
+                            for (size_t j = j0; j < j1; j++)
+                            {
+                                m_T._data[i][j] = _data[j][i];
+                            }
+                        }
                     }
                 }
                 _cache.push_front(m_T);
+                _cache_version = _version;
                 return _cache.front();
             }
 
@@ -215,35 +1695,116 @@ namespace codesample
          * @param m2 The second matrix
          * @return matrix<T> The computed matrix product
          */
-        static matrix<T> multiply(matrix<T> &m1, matrix<T> &m2)
+        static matrix<T> multiply(const matrix<T> &m1, const matrix<T> &m2)
+        {
+            return multiply<plus_times<T>>(m1, m2);
+        }
+
+        /**
+         * @brief Computes the product of two matrices over a semiring, using
+         * the blocked, multithreaded multiply kernel. e.g.
+         * matrix<double>::multiply<min_plus<double>>(a, b) computes
+         * min_k(a(i, k) + b(k, j)) for shortest paths (see semiring.h).
+         *
+         * @tparam S The semiring (see plus_times)
+         * @param m1 The first matrix
+         * @param m2 The second matrix
+         * @return matrix<T> The computed matrix product
+         */
+        template <class S>
+        static matrix<T> multiply(const matrix<T> &m1, const matrix<T> &m2)
         {
             if (m1.rows() == 0 || m2.rows() == 0)
             {
                 throw std::out_of_range("Can't multiply matrix of size 0!");
             }
+            if (m1.cols() != m2.rows())
+            {
+                throw invalid_dimension(m1.cols(), m2.rows());
+            }
 
             matrix<T> result(m1.rows(), m2.cols());
-            for (size_t i = 0; i < m1.rows(); i++)
+            detail::row_writer<T> out(result);
+            detail::gemm<S>(m1, m2, out);
+            return result;
+        }
+
+        /**
+         * @brief Compute the product of two matrices, passing each element
+         * through an epilogue as it is produced, e.g. to add a bias and
+         * apply an activation without another pass over the result (see
+         * epilogue.h for the built in ones)
+         *
+         * @tparam Epilogue Callable as epilogue(i, j, value), returning the
+         * value to store, and optionally with check(rows, cols) to check
+         * itself against the shape of the product
+         * @param m1 The first matrix
+         * @param m2 The second matrix
+         * @param epilogue Applied to element (i, j) of the product
+         * @return matrix<T> The transformed product
+         */
+        template <class Epilogue>
+        static matrix<T> multiply(const matrix<T> &m1, const matrix<T> &m2, const Epilogue &epilogue)
+        {
+            if (m1.rows() == 0 || m2.rows() == 0)
             {
-                for (size_t j = 0; j < m2.cols(); j++)
-                {
-                    result[i][j] = dot(m1[i], m2.transpose()[j]);
-                }
+                throw std::out_of_range("Can't multiply matrix of size 0!");
             }
+            if (m1.cols() != m2.rows())
+            {
+                throw invalid_dimension(m1.cols(), m2.rows());
+            }
+
+            matrix<T> result(m1.rows(), m2.cols());
+            detail::epilogue_writer<T, Epilogue> out(result, epilogue);
+            detail::gemm<plus_times<T>>(m1, m2, out);
             return result;
         }
 
         /**
          * @brief Compute the product of this matrix with another
-         * 
+         *
          * @param other The other matrix to multiply agains
          * @return matrix<T> The computed matrix product
          */
-        matrix<T> multiply(matrix<T> &other)
+        matrix<T> multiply(const matrix<T> &other) const
         {
             return multiply(*this, other);
         }
 
+        /**
+         * @brief Computes the product of two matrices, accumulating each
+         * element of the result in a wider type before storing it back as T.
+         * e.g. matrix<float>::multiply_mixed<double>(a, b) keeps float storage
+         * but does not lose accuracy on long inner dimensions.
+         *
+         * @tparam Acc The type to accumulate the products in
+         * @param m1 The first matrix
+         * @param m2 The second matrix
+         * @return matrix<T> The computed matrix product
+         */
+        template <class Acc>
+        static matrix<T> multiply_mixed(const matrix<T> &m1, const matrix<T> &m2)
+        {
+            return multiply<plus_times<Acc>>(m1, m2);
+        }
+
+        /**
+         * @brief Computes the product of two floating point matrices using
+         * compensated dot products (see dot_compensated()), through the
+         * multiply kernel with plus_times_compensated. Gives roughly the
+         * accuracy of multiply_mixed() with a type twice as wide, for when no
+         * such type is available or its SIMD width is too costly.
+         *
+         * @param m1 The first matrix
+         * @param m2 The second matrix
+         * @return matrix<T> The computed matrix product
+         */
+        static matrix<T> multiply_compensated(const matrix<T> &m1, const matrix<T> &m2)
+        {
+            return multiply<plus_times_compensated<T>>(m1, m2);
+        }
+
         /**
          * @brief Print the contents of this matrix to the specified ostream.
          * The items in this matrix must support the stream extraction operation (operator<<).
@@ -267,7 +1828,7 @@ namespace codesample
          * @param other The other matrix to multiply agains
          * @return matrix<T> The computed matrix product
          */
-        matrix<T> operator* (matrix<T> &other)
+        matrix<T> operator* (const matrix<T> &other) const
         {
             return multiply(*this, other);
         }
@@ -291,10 +1852,104 @@ namespace codesample
          */
         std::vector<T> &operator[](size_t i)
         {
-            _cache.clear();      // matix has changed so cached transpose is invalid
+            written(i, i + 1, 0, 0);
+            if (_tracking)
+            {
+                // any column of the row may be written
+                _wide_stamp = _version;
+            }
             return _data[i];
         }
 
+        /**
+         * @brief Starts tracking which rows and columns are handed out for
+         * writing, so that rows_changed_since() and cols_changed_since()
+         * can name them and the cached transpose can be patched instead of
+         * dropped. Everything counts as changed before tracking starts.
+         *
+         * Tracking makes each non-const operator[], operator() and view()
+         * a few stores more expensive, including those used only to read,
+         * and they must not then be called from several threads at once.
+         * Take a const reference to read, and write from one thread.
+         */
+        void track_changes()
+        {
+            if (_tracking)
+            {
+                return;
+            }
+            _tracking = true;
+            _row_stamps.assign(rows(), 0);
+            _col_stamps.assign(cols(), 0);
+            _version = _all_stamp = _version + 1;
+            _cache_version = _version;
+        }
+
+        /**
+         * @brief Whether track_changes() has been called
+         */
+        bool tracking_changes() const
+        {
+            return _tracking;
+        }
+
+        /**
+         * @brief Gets the version of this matrix: a count that goes up
+         * each time it is handed out for writing, by the non-const
+         * operator[], operator() or view(), or assigned to, while changes
+         * are tracked. Pass it to rows_changed_since() and
+         * cols_changed_since() later.
+         *
+         * @return uint64_t The current version
+         */
+        uint64_t version() const
+        {
+            return _version;
+        }
+
+        /**
+         * @brief Finds the rows that may have changed since a version:
+         * those handed out for writing since, whether or not they were
+         * written. Every row if changes aren't tracked.
+         *
+         * @param version A value version() returned
+         * @return std::vector<size_t> The rows, in order
+         */
+        std::vector<size_t> rows_changed_since(uint64_t version) const
+        {
+            std::vector<size_t> changed;
+            for (size_t i = 0; i < rows(); i++)
+            {
+                if (!_tracking || _all_stamp > version || _row_stamps[i] > version)
+                {
+                    changed.push_back(i);
+                }
+            }
+            return changed;
+        }
+
+        /**
+         * @brief Finds the columns that may have changed since a version.
+         * A row handed out by operator[] may change in any column. Every
+         * column if changes aren't tracked.
+         *
+         * @param version A value version() returned
+         * @return std::vector<size_t> The columns, in order
+         */
+        std::vector<size_t> cols_changed_since(uint64_t version) const
+        {
+            std::vector<size_t> changed;
+            const bool all = !_tracking || _all_stamp > version || _wide_stamp > version;
+            for (size_t j = 0; j < cols(); j++)
+            {
+                if (all || (j < _col_stamps.size() && _col_stamps[j] > version))
+                {
+                    changed.push_back(j);
+                }
+            }
+            return changed;
+        }
+
         /**
          * @brief Calculates whether this matrix is not equal to another
          * 
@@ -302,25 +1957,16 @@ namespace codesample
          * @return true If the other matrix is not equal to this one
          * @return false If the other matrix is equal to this one
          */
-        bool operator!= (const matrix<T> &rhs)
+        bool operator!= (const matrix<T> &rhs) const
         {
             if (rows() != rhs.rows() || cols() != rhs.cols())
             {
                 return true;
             }
 
-            for (size_t i = 0; i < rows(); i++)
-            {
-                for (size_t j = 0; j < cols(); j++)
-                {
-                    if (_data [i][j] != rhs[i][j])
-                    {
-                        return true;
-                    }
-                }
-            }
-
-            return false;
+            return detail::any_row(rows(), cols(), [&](size_t i) {
+                return detail::row_fails(_data[i], rhs._data[i], [](const T &x, const T &y) { return x == y; });
+            });
         }
 
         /**
@@ -330,12 +1976,138 @@ namespace codesample
          * @return true If the other matrix is equal to this one
          * @return false If the other matrix is not equal to this one
          */
-        bool operator== (const matrix<T> &rhs)
+        bool operator== (const matrix<T> &rhs) const
         {
             return !(*this != rhs);
         }
     };
 
+    inline void set_num_threads(size_t n)
+    {
+        detail::thread_setting() = n;
+    }
+
+    inline size_t num_threads()
+    {
+        size_t n = detail::thread_setting();
+        if (n == 0)
+        {
+            n = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        return n;
+    }
+
+    template <class T>
+    detail::row_writer<T>::row_writer(matrix<T> &m)
+    {
+        _rows.reserve(m.rows());
+        for (size_t i = 0; i < m.rows(); i++)
+        {
+            _rows.push_back(&m[i]);
+        }
+    }
+
+    namespace detail
+    {
+        /**
+         * @brief Stores results into a view, or adds them to what is there
+         */
+        template <class View>
+        struct view_writer
+        {
+            const View &out;
+            bool accumulate;
+
+            template <class V>
+            void operator()(size_t i, size_t j, const V &value) const
+            {
+                typedef typename std::remove_reference<decltype(out(i, j))>::type element;
+                if (accumulate)
+                {
+                    out(i, j) = static_cast<element>(out(i, j) + value);
+                }
+                else
+                {
+                    out(i, j) = static_cast<element>(value);
+                }
+            }
+        };
+    }
+
+    /**
+     * @brief Computes out = m1 * m2, or out += m1 * m2, writing straight
+     * into a view of a larger matrix or into an external buffer. The
+     * operands may be matrices, views or refs but must not overlap the
+     * output.
+     *
+     * @tparam A The type of the first operand
+     * @tparam B The type of the second operand
+     * @tparam Out A matrix_view or matrix_ref
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @param out Where to store the product, m1.rows() x m2.cols()
+     * @param accumulate Whether to add to the output rather than overwrite it
+     */
+    template <class A, class B, class Out>
+    void multiply_into(const A &m1, const B &m2, const Out &out, bool accumulate = false)
+    {
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+        if (out.rows() != m1.rows() || out.cols() != m2.cols())
+        {
+            throw invalid_dimension("Output view is the wrong size for the product");
+        }
+        typedef typename std::remove_reference<decltype(out(0, 0))>::type element;
+        if (!accumulate && m1.cols() == 0)
+        {
+            out.assign(matrix<element>(out.rows(), out.cols()));
+            return;
+        }
+        detail::view_writer<Out> writer = {out, accumulate};
+        detail::gemm<plus_times<element>>(m1, m2, writer);
+    }
+
+    /**
+     * @brief Writes the transpose of a matrix, view or ref into a view or
+     * ref, in square tiles so that both sides are accessed a cache line at
+     * a time. The two must not overlap.
+     *
+     * @tparam Source The type of the input
+     * @tparam Out A matrix_view or matrix_ref
+     * @param in The matrix to transpose
+     * @param out Where to store the transpose, in.cols() x in.rows()
+     */
+    template <class Source, class Out>
+    void transpose_into(const Source &in, const Out &out)
+    {
+        if (out.rows() != in.cols() || out.cols() != in.rows())
+        {
+            throw invalid_dimension("Output view is the wrong size for the transpose");
+        }
+        const size_t tile = 32;
+        const size_t work = in.rows() * in.cols();
+        detail::parallel_for(out.rows(), tile, work < detail::gemm_parallel_threshold ? 1 : num_threads(),
+                             [&](size_t r0, size_t r1) {
+            for (size_t i0 = r0; i0 < r1; i0 += tile)
+            {
+                const size_t i1 = std::min(r1, i0 + tile);
+                for (size_t j0 = 0; j0 < out.cols(); j0 += tile)
+                {
+                    const size_t j1 = std::min(out.cols(), j0 + tile);
+                    for (size_t i = i0; i < i1; i++)
+                    {
+                        for (size_t j = j0; j < j1; j++)
+                        {
+                            out(i, j) = in(j, i);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
     /**
      * @brief Matrix stream extraction operator
      * 
@@ -0,0 +1,341 @@
+/**
+ * @file memo.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief A process-wide cache of matrix products, keyed by content
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * memo_multiply(a, b) hashes both operands and looks the pair up in one
+ * least recently used cache shared by the whole process. A repeated
+ * product is handed back as a shared reference to the stored result
+ * instead of being multiplied again; a new one is multiplied and stored,
+ * evicting the least recently used results until the cache fits its
+ * memory budget. The cache is off until product_cache::instance().enable()
+ * is called, and memo_multiply() then just multiplies.
+ *
+ * Hashing reads each operand once, n^2 work against the multiply's n^3.
+ * The hash runs eight independent lanes over the raw bytes so the
+ * compiler can vectorize it. Keys are the two 64 bit hashes plus the
+ * shapes and element type; operands are not kept to check against, so two
+ * different operands that happen to hash alike (about one chance in 2^64
+ * for any pair, for data not built to collide) would share a result.
+ */
+
+#ifndef _MEMO_H_
+#define _MEMO_H_
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    namespace detail
+    {
+        inline uint64_t mix64(uint64_t x)
+        {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccd;
+            x ^= x >> 33;
+            x *= 0xc4ceb9fe1a85ec53;
+            x ^= x >> 33;
+            return x;
+        }
+
+        /**
+         * @brief Hashes a byte range in eight lanes of 64 bit words, enough
+         * independent multiplies in flight to keep up with memory, which
+         * the compiler turns into vector code; the lanes and the tail are
+         * mixed together at the end
+         */
+        inline uint64_t content_hash(const void *data, size_t bytes, uint64_t seed)
+        {
+            const unsigned char *p = static_cast<const unsigned char *>(data);
+            uint64_t lanes[8];
+            for (int l = 0; l < 8; l++)
+            {
+                lanes[l] = seed ^ (0x9e3779b97f4a7c15 * static_cast<uint64_t>(l + 1));
+            }
+            size_t i = 0;
+            for (; i + 64 <= bytes; i += 64)
+            {
+                uint64_t words[8];
+                std::memcpy(words, p + i, 64);
+                for (int l = 0; l < 8; l++)
+                {
+                    lanes[l] = (lanes[l] ^ words[l]) * 0x9fb21c651e98df25;
+                    lanes[l] ^= lanes[l] >> 29;
+                }
+            }
+            uint64_t tail = bytes;
+            for (; i < bytes; i++)
+            {
+                tail = (tail ^ p[i]) * 0x100000001b3;
+            }
+            uint64_t hash = mix64(tail);
+            for (int l = 0; l < 8; l++)
+            {
+                hash = mix64(hash ^ lanes[l]);
+            }
+            return hash;
+        }
+
+        /**
+         * @brief Hashes a matrix's shape and contents, a row at a time
+         */
+        template <class T>
+        uint64_t content_hash(const matrix<T> &m)
+        {
+            uint64_t hash = mix64(m.rows() * 0x9e3779b97f4a7c15 + m.cols());
+            for (size_t i = 0; i < m.rows(); i++)
+            {
+                hash = content_hash(m[i].data(), m.cols() * sizeof(T), hash);
+            }
+            return hash;
+        }
+
+        struct product_key
+        {
+            uint64_t left;
+            uint64_t right;
+            size_t rows;
+            size_t inner;
+            size_t cols;
+            std::type_index type;
+
+            bool operator==(const product_key &other) const
+            {
+                return left == other.left && right == other.right && rows == other.rows && inner == other.inner &&
+                       cols == other.cols && type == other.type;
+            }
+        };
+
+        struct product_key_hash
+        {
+            size_t operator()(const product_key &key) const
+            {
+                return static_cast<size_t>(mix64(key.left ^ mix64(key.right)));
+            }
+        };
+    }
+
+    /**
+     * @brief Counts kept by the product cache
+     *
+     */
+    struct product_cache_stats
+    {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+
+        /**
+         * Results held now, and their total size in bytes
+         */
+        size_t entries;
+        size_t bytes;
+    };
+
+    /**
+     * @brief The process-wide cache behind memo_multiply(). Thread safe.
+     *
+     */
+    class product_cache
+    {
+      private:
+        struct entry
+        {
+            detail::product_key key;
+            std::shared_ptr<const void> result;
+            size_t bytes;
+        };
+
+        typedef std::list<entry> entry_list;
+
+        mutable std::mutex _lock;
+        bool _enabled;
+        size_t _budget;
+        product_cache_stats _stats;
+
+        // most recently used first
+        entry_list _entries;
+        std::unordered_map<detail::product_key, entry_list::iterator, detail::product_key_hash> _index;
+
+        product_cache()
+        : _enabled(false), _budget(0), _stats{0, 0, 0, 0, 0}
+        {
+        }
+
+        void evict_to(size_t budget)
+        {
+            while (_stats.bytes > budget)
+            {
+                const entry &last = _entries.back();
+                _stats.bytes -= last.bytes;
+                _stats.entries--;
+                _stats.evictions++;
+                _index.erase(last.key);
+                _entries.pop_back();
+            }
+        }
+
+      public:
+        product_cache(const product_cache &) = delete;
+        product_cache &operator=(const product_cache &) = delete;
+
+        static product_cache &instance()
+        {
+            static product_cache cache;
+            return cache;
+        }
+
+        /**
+         * @brief Turns the cache on, or changes its budget
+         *
+         * @param budget The most bytes of results to hold
+         */
+        void enable(size_t budget)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _enabled = true;
+            _budget = budget;
+            evict_to(budget);
+        }
+
+        /**
+         * @brief Turns the cache off and drops what it holds. Results
+         * already handed out stay valid.
+         */
+        void disable()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _enabled = false;
+            _entries.clear();
+            _index.clear();
+            _stats.entries = _stats.bytes = 0;
+        }
+
+        bool enabled() const
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            return _enabled;
+        }
+
+        size_t budget() const
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            return _budget;
+        }
+
+        /**
+         * @brief Drops every result, keeping the budget and counts
+         */
+        void clear()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _entries.clear();
+            _index.clear();
+            _stats.entries = _stats.bytes = 0;
+        }
+
+        product_cache_stats stats() const
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            return _stats;
+        }
+
+        void reset_stats()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stats.hits = _stats.misses = _stats.evictions = 0;
+        }
+
+        /**
+         * @brief Looks a product up, making it the most recently used
+         *
+         * @return std::shared_ptr<const void> The result, null if it isn't
+         * held or the cache is off
+         */
+        std::shared_ptr<const void> find(const detail::product_key &key)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (!_enabled)
+            {
+                return nullptr;
+            }
+            const auto found = _index.find(key);
+            if (found == _index.end())
+            {
+                _stats.misses++;
+                return nullptr;
+            }
+            _stats.hits++;
+            _entries.splice(_entries.begin(), _entries, found->second);
+            return found->second->result;
+        }
+
+        /**
+         * @brief Stores a product, evicting others to stay within budget.
+         * A result bigger than the whole budget is not stored.
+         */
+        void insert(const detail::product_key &key, std::shared_ptr<const void> result, size_t bytes)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (!_enabled || bytes > _budget || _index.count(key) != 0)
+            {
+                // another thread may have stored the same product meanwhile
+                return;
+            }
+            evict_to(_budget - bytes);
+            _entries.push_front(entry{key, std::move(result), bytes});
+            _index.emplace(key, _entries.begin());
+            _stats.entries++;
+            _stats.bytes += bytes;
+        }
+    };
+
+    /**
+     * @brief Multiplies two matrices through the product cache: a product
+     * already in the cache is returned as is, without multiplying, and a
+     * new one is stored. With the cache off, just multiplies.
+     *
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @return std::shared_ptr<const matrix<T>> The product, shared with the cache
+     */
+    template <class T>
+    std::shared_ptr<const matrix<T>> memo_multiply(const matrix<T> &m1, const matrix<T> &m2)
+    {
+        product_cache &cache = product_cache::instance();
+        if (!cache.enabled())
+        {
+            return std::make_shared<const matrix<T>>(m1 * m2);
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+
+        const detail::product_key key = {detail::content_hash(m1), detail::content_hash(m2), m1.rows(), m1.cols(),
+                                         m2.cols(), std::type_index(typeid(T))};
+        std::shared_ptr<const void> found = cache.find(key);
+        if (found)
+        {
+            return std::static_pointer_cast<const matrix<T>>(found);
+        }
+        const std::shared_ptr<const matrix<T>> result = std::make_shared<const matrix<T>>(m1 * m2);
+        cache.insert(key, result, sizeof(matrix<T>) + m1.rows() * (sizeof(std::vector<T>) + m2.cols() * sizeof(T)));
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,918 @@
+/**
+ * @file modular.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Matrix multiply modulo an integer, and exact integer multiply
+ * through the Chinese remainder theorem
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * modular_multiply runs the blocked kernel from matrix.h over one of
+ * three semirings, chosen by the size of the modulus:
+ *
+ * - p <= 2^32: residues are multiplied in 64 bits and summed in a 128 bit
+ *   accumulator with no reduction at all; each output is reduced once at
+ *   the end with a Barrett reduction.
+ * - odd p: operands are moved into Montgomery form, so each product is
+ *   reduced with two multiplies and no division.
+ * - anything else: each product is reduced with a 128 bit division.
+ *
+ * exact_multiply multiplies 64 bit integer matrices modulo a few 62 bit
+ * primes and reconstructs the exact 128 bit result with Garner's algorithm.
+ */
+
+#ifndef _MODULAR_H_
+#define _MODULAR_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    namespace detail
+    {
+        /**
+         * @brief An unsigned 128 bit integer as two 64 bit words
+         */
+        struct u128
+        {
+            uint64_t lo;
+            uint64_t hi;
+        };
+
+        inline u128 make_u128(uint64_t hi, uint64_t lo)
+        {
+            u128 r;
+            r.lo = lo;
+            r.hi = hi;
+            return r;
+        }
+
+        inline u128 add(u128 a, u128 b)
+        {
+            u128 r;
+            r.lo = a.lo + b.lo;
+            r.hi = a.hi + b.hi + (r.lo < a.lo);
+            return r;
+        }
+
+        inline u128 sub(u128 a, u128 b)
+        {
+            u128 r;
+            r.lo = a.lo - b.lo;
+            r.hi = a.hi - b.hi - (a.lo < b.lo);
+            return r;
+        }
+
+        /**
+         * @brief The full 128 bit product of two 64 bit integers
+         */
+        inline u128 mul_wide(uint64_t a, uint64_t b)
+        {
+#ifdef __SIZEOF_INT128__
+            unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+            return make_u128(static_cast<uint64_t>(p >> 64), static_cast<uint64_t>(p));
+#else
+            uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+            uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+            uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi, hl = a_hi * b_lo, hh = a_hi * b_hi;
+            uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFFu) + (hl & 0xFFFFFFFFu);
+            return make_u128(hh + (lh >> 32) + (hl >> 32) + (mid >> 32), (mid << 32) | (ll & 0xFFFFFFFFu));
+#endif
+        }
+
+        inline uint64_t mul_hi(uint64_t a, uint64_t b)
+        {
+            return mul_wide(a, b).hi;
+        }
+
+        /**
+         * @brief The low 128 bits of a 128 bit by 64 bit product
+         */
+        inline u128 mul_low(u128 a, uint64_t b)
+        {
+            u128 r = mul_wide(a.lo, b);
+            r.hi += a.hi * b;
+            return r;
+        }
+
+        /**
+         * @brief Divides a 128 bit integer by a nonzero 64 bit one
+         *
+         * @param rem Set to the remainder
+         * @return u128 The quotient
+         */
+        inline u128 divmod(u128 a, uint64_t d, uint64_t &rem)
+        {
+#ifdef __SIZEOF_INT128__
+            unsigned __int128 n = (static_cast<unsigned __int128>(a.hi) << 64) | a.lo;
+            rem = static_cast<uint64_t>(n % d);
+            n /= d;
+            return make_u128(static_cast<uint64_t>(n >> 64), static_cast<uint64_t>(n));
+#else
+            u128 q = make_u128(a.hi / d, 0);
+            uint64_t r = a.hi % d;
+            for (int bit = 63; bit >= 0; bit--)
+            {
+                bool carry = (r >> 63) != 0;
+                r = (r << 1) | ((a.lo >> bit) & 1);
+                if (carry || r >= d)
+                {
+                    r -= d;
+                    q.lo |= uint64_t(1) << bit;
+                }
+            }
+            rem = r;
+            return q;
+#endif
+        }
+
+        inline uint64_t mod(u128 a, uint64_t d)
+        {
+            uint64_t rem;
+            divmod(a, d, rem);
+            return rem;
+        }
+
+        inline uint64_t mulmod(uint64_t a, uint64_t b, uint64_t p)
+        {
+            return mod(mul_wide(a, b), p);
+        }
+
+        inline uint64_t addmod(uint64_t a, uint64_t b, uint64_t p)
+        {
+            // Masked rather than a conditional, which compilers turn into a
+            // branch that is mispredicted half the time on residues
+            uint64_t s = a + b;
+            uint64_t wrap = static_cast<uint64_t>((s < a) | (s >= p));
+            return s - (p & (0 - wrap));
+        }
+    }
+
+    /**
+     * @brief Barrett reduction modulo p <= 2^32: the quotient is estimated
+     * with a multiply by a precomputed reciprocal instead of a division
+     *
+     */
+    class barrett_reducer
+    {
+      private:
+        uint64_t _p;
+        uint64_t _m;
+        uint64_t _r64;
+
+      public:
+        /**
+         * @brief Construct a new barrett reducer
+         *
+         * @param p The modulus, between 1 and 2^32
+         */
+        explicit barrett_reducer(uint64_t p)
+        : _p(p), _m(p ? UINT64_MAX / p : 0), _r64(p ? (0 - p) % p : 0)
+        {
+            if (p == 0 || p > (uint64_t(1) << 32))
+            {
+                throw std::invalid_argument("Barrett modulus must be between 1 and 2^32");
+            }
+        }
+
+        uint64_t modulus() const
+        {
+            return _p;
+        }
+
+        /**
+         * @brief Reduces a 64 bit value modulo p
+         */
+        uint64_t reduce(uint64_t x) const
+        {
+            // The estimate is at most one short, since m >= 2^64 / p - 1
+            uint64_t r = x - detail::mul_hi(x, _m) * _p;
+            return r >= _p ? r - _p : r;
+        }
+
+        /**
+         * @brief Reduces a 128 bit value modulo p as hi * (2^64 mod p) + lo
+         */
+        uint64_t reduce(detail::u128 x) const
+        {
+            return reduce(reduce(x.hi) * _r64 + reduce(x.lo));
+        }
+    };
+
+    /**
+     * @brief Montgomery arithmetic modulo an odd p < 2^64. A value x is
+     * held as x * 2^64 mod p, which lets products be reduced with two
+     * multiplies and no division.
+     *
+     */
+    class montgomery_reducer
+    {
+      private:
+        uint64_t _p;
+        uint64_t _p_inv;
+        uint64_t _r2;
+
+      public:
+        /**
+         * @brief Construct a new montgomery reducer
+         *
+         * @param p The modulus, which must be odd and greater than 1
+         */
+        explicit montgomery_reducer(uint64_t p)
+        : _p(p), _p_inv(p), _r2(0)
+        {
+            if (p < 3 || p % 2 == 0)
+            {
+                throw std::invalid_argument("Montgomery modulus must be odd and greater than 1");
+            }
+            // Newton's iteration doubles the correct low bits of p^-1 mod 2^64,
+            // starting from the 3 that p * p = 1 mod 8 gives for free
+            for (int i = 0; i < 5; i++)
+            {
+                _p_inv *= 2 - p * _p_inv;
+            }
+            uint64_t r = (0 - p) % p;
+            _r2 = detail::mulmod(r, r, p);
+        }
+
+        uint64_t modulus() const
+        {
+            return _p;
+        }
+
+        /**
+         * @brief Computes x / 2^64 mod p for x < p * 2^64
+         */
+        uint64_t reduce(detail::u128 x) const
+        {
+            // m * p agrees with x in the low word, so only the high words differ
+            uint64_t m = x.lo * _p_inv;
+            uint64_t mp = detail::mul_hi(m, _p);
+            return x.hi < mp ? x.hi - mp + _p : x.hi - mp;
+        }
+
+        uint64_t to_montgomery(uint64_t x) const
+        {
+            return reduce(detail::mul_wide(x % _p, _r2));
+        }
+
+        uint64_t from_montgomery(uint64_t x) const
+        {
+            return reduce(detail::make_u128(0, x));
+        }
+
+        /**
+         * @brief Multiplies two values in Montgomery form
+         */
+        uint64_t multiply(uint64_t a, uint64_t b) const
+        {
+            return reduce(detail::mul_wide(a, b));
+        }
+
+        uint64_t add(uint64_t a, uint64_t b) const
+        {
+            return detail::addmod(a, b, _p);
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Residues below 2^32 summed lazily: products fit in 64 bits
+         * and the 128 bit sum cannot overflow for any realistic k, so
+         * nothing is reduced until the output
+         */
+        struct lazy_mod_ring
+        {
+            typedef u128 value_type;
+
+            static u128 zero()
+            {
+                return make_u128(0, 0);
+            }
+
+            static u128 add(const u128 &a, const u128 &b)
+            {
+                return detail::add(a, b);
+            }
+
+            static u128 mul(const u128 &a, const u128 &b)
+            {
+                return make_u128(0, a.lo * b.lo);
+            }
+        };
+
+        /**
+         * @brief Residues in Montgomery form
+         */
+        struct montgomery_ring
+        {
+            typedef uint64_t value_type;
+
+            montgomery_reducer reducer;
+
+            explicit montgomery_ring(uint64_t p)
+            : reducer(p)
+            {
+            }
+
+            static uint64_t zero()
+            {
+                return 0;
+            }
+
+            uint64_t add(uint64_t a, uint64_t b) const
+            {
+                return reducer.add(a, b);
+            }
+
+            uint64_t mul(uint64_t a, uint64_t b) const
+            {
+                return reducer.multiply(a, b);
+            }
+        };
+
+        /**
+         * @brief Residues reduced by division after every product, for
+         * large even moduli
+         */
+        struct divide_mod_ring
+        {
+            typedef uint64_t value_type;
+
+            uint64_t p;
+
+            static uint64_t zero()
+            {
+                return 0;
+            }
+
+            uint64_t add(uint64_t a, uint64_t b) const
+            {
+                return addmod(a, b, p);
+            }
+
+            uint64_t mul(uint64_t a, uint64_t b) const
+            {
+                return mulmod(a, b, p);
+            }
+        };
+
+        /**
+         * @brief Presents a matrix to the kernel as residues in the form a
+         * ring expects, converting as elements are packed
+         */
+        template <class T, class Convert>
+        class residue_source
+        {
+          private:
+            const matrix<T> &_m;
+            Convert _convert;
+
+          public:
+            residue_source(const matrix<T> &m, Convert convert)
+            : _m(m), _convert(convert)
+            {
+            }
+
+            size_t rows() const
+            {
+                return _m.rows();
+            }
+
+            size_t cols() const
+            {
+                return _m.cols();
+            }
+
+            typename Convert::result_type operator()(size_t i, size_t j) const
+            {
+                return _convert(_m(i, j));
+            }
+        };
+
+        template <class T, class Convert>
+        residue_source<T, Convert> residues(const matrix<T> &m, Convert convert)
+        {
+            return residue_source<T, Convert>(m, convert);
+        }
+
+        /**
+         * @brief Conversions into and out of the ring representations
+         */
+        struct to_barrett
+        {
+            typedef u128 result_type;
+            const barrett_reducer *r;
+            u128 operator()(uint64_t x) const
+            {
+                return make_u128(0, r->reduce(x));
+            }
+        };
+
+        struct to_montgomery
+        {
+            typedef uint64_t result_type;
+            const montgomery_reducer *r;
+            uint64_t operator()(uint64_t x) const
+            {
+                return r->to_montgomery(x);
+            }
+        };
+
+        struct to_residue
+        {
+            typedef uint64_t result_type;
+            uint64_t p;
+            uint64_t operator()(uint64_t x) const
+            {
+                return x % p;
+            }
+        };
+
+        /**
+         * @brief Writes ring values to a matrix, mapping each back to an
+         * ordinary residue with the given conversion
+         */
+        template <class Convert>
+        class residue_writer
+        {
+          private:
+            row_writer<uint64_t> _out;
+            Convert _convert;
+
+          public:
+            residue_writer(matrix<uint64_t> &m, Convert convert)
+            : _out(m), _convert(convert)
+            {
+            }
+
+            template <class V>
+            void operator()(size_t i, size_t j, const V &value)
+            {
+                _out(i, j, _convert(value));
+            }
+        };
+
+        struct from_barrett
+        {
+            const barrett_reducer *r;
+            uint64_t operator()(const u128 &x) const
+            {
+                return r->reduce(x);
+            }
+        };
+
+        struct from_montgomery
+        {
+            const montgomery_reducer *r;
+            uint64_t operator()(uint64_t x) const
+            {
+                return r->from_montgomery(x);
+            }
+        };
+
+        struct from_residue
+        {
+            uint64_t operator()(uint64_t x) const
+            {
+                return x;
+            }
+        };
+
+        template <class Convert>
+        residue_writer<Convert> residue_output(matrix<uint64_t> &m, Convert convert)
+        {
+            return residue_writer<Convert>(m, convert);
+        }
+    }
+
+    /**
+     * @brief Computes the product of two matrices modulo p. Elements need
+     * not already be reduced.
+     *
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @param p The modulus, which must be nonzero
+     * @return matrix<uint64_t> The product with every element in [0, p)
+     */
+    inline matrix<uint64_t> modular_multiply(const matrix<uint64_t> &m1, const matrix<uint64_t> &m2, uint64_t p)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+        if (p == 0)
+        {
+            throw std::invalid_argument("Modulus must be nonzero");
+        }
+
+        matrix<uint64_t> result(m1.rows(), m2.cols());
+        if (p <= (uint64_t(1) << 32))
+        {
+            barrett_reducer r(p);
+            detail::to_barrett in = {&r};
+            detail::from_barrett back = {&r};
+            auto out = detail::residue_output(result, back);
+            detail::gemm<detail::lazy_mod_ring>(detail::residues(m1, in), detail::residues(m2, in), out);
+        }
+        else if (p % 2 == 1)
+        {
+            detail::montgomery_ring ring(p);
+            detail::to_montgomery in = {&ring.reducer};
+            detail::from_montgomery back = {&ring.reducer};
+            auto out = detail::residue_output(result, back);
+            detail::gemm(detail::residues(m1, in), detail::residues(m2, in), out, ring);
+        }
+        else
+        {
+            detail::divide_mod_ring ring = {p};
+            detail::to_residue in = {p};
+            auto out = detail::residue_output(result, detail::from_residue());
+            detail::gemm(detail::residues(m1, in), detail::residues(m2, in), out, ring);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Deterministic primality test for 64 bit integers (Miller-Rabin
+     * with the first twelve primes as bases, which has no pseudoprimes
+     * below 2^64)
+     *
+     * @param n The number to test
+     * @return true if n is prime
+     */
+    inline bool is_prime(uint64_t n)
+    {
+        const uint64_t bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+        if (n < 2)
+        {
+            return false;
+        }
+        for (uint64_t b : bases)
+        {
+            if (n % b == 0)
+            {
+                return n == b;
+            }
+        }
+
+        uint64_t d = n - 1;
+        int s = 0;
+        while (d % 2 == 0)
+        {
+            d /= 2;
+            s++;
+        }
+
+        montgomery_reducer r(n);
+        const uint64_t one = r.to_montgomery(1), minus_one = r.to_montgomery(n - 1);
+        for (uint64_t b : bases)
+        {
+            uint64_t x = one, base = r.to_montgomery(b);
+            for (uint64_t e = d; e; e >>= 1)
+            {
+                if (e & 1)
+                {
+                    x = r.multiply(x, base);
+                }
+                base = r.multiply(base, base);
+            }
+            if (x == one || x == minus_one)
+            {
+                continue;
+            }
+            bool composite = true;
+            for (int i = 1; i < s && composite; i++)
+            {
+                x = r.multiply(x, x);
+                composite = x != minus_one;
+            }
+            if (composite)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief A signed 128 bit integer, the element type of exact_multiply.
+     * Arithmetic wraps like unsigned integers.
+     *
+     */
+    class int128
+    {
+      private:
+        detail::u128 _v;
+
+        static int128 from_u128(detail::u128 v)
+        {
+            int128 r;
+            r._v = v;
+            return r;
+        }
+
+      public:
+        int128()
+        : _v(detail::make_u128(0, 0))
+        {
+        }
+
+        int128(int64_t v)
+        : _v(detail::make_u128(v < 0 ? UINT64_MAX : 0, static_cast<uint64_t>(v)))
+        {
+        }
+
+        /**
+         * @brief Construct from the two's complement words
+         */
+        static int128 from_words(uint64_t hi, uint64_t lo)
+        {
+            return from_u128(detail::make_u128(hi, lo));
+        }
+
+        uint64_t high() const
+        {
+            return _v.hi;
+        }
+
+        uint64_t low() const
+        {
+            return _v.lo;
+        }
+
+        bool negative() const
+        {
+            return (_v.hi >> 63) != 0;
+        }
+
+        explicit operator long double() const
+        {
+            int128 m = negative() ? -*this : *this;
+            long double v = static_cast<long double>(m._v.hi) * 18446744073709551616.0L + m._v.lo;
+            return negative() ? -v : v;
+        }
+
+        int128 operator-() const
+        {
+            return from_u128(detail::sub(detail::make_u128(0, 0), _v));
+        }
+
+        int128 operator+(const int128 &other) const
+        {
+            return from_u128(detail::add(_v, other._v));
+        }
+
+        int128 operator-(const int128 &other) const
+        {
+            return from_u128(detail::sub(_v, other._v));
+        }
+
+        int128 operator*(const int128 &other) const
+        {
+            detail::u128 r = detail::mul_wide(_v.lo, other._v.lo);
+            r.hi += _v.hi * other._v.lo + _v.lo * other._v.hi;
+            return from_u128(r);
+        }
+
+        int128 &operator+=(const int128 &other)
+        {
+            return *this = *this + other;
+        }
+
+        bool operator==(const int128 &other) const
+        {
+            return _v.lo == other._v.lo && _v.hi == other._v.hi;
+        }
+
+        bool operator!=(const int128 &other) const
+        {
+            return !(*this == other);
+        }
+
+        bool operator<(const int128 &other) const
+        {
+            if (_v.hi != other._v.hi)
+            {
+                return static_cast<int64_t>(_v.hi) < static_cast<int64_t>(other._v.hi);
+            }
+            return _v.lo < other._v.lo;
+        }
+
+        /**
+         * @brief The decimal representation
+         */
+        std::string str() const
+        {
+            detail::u128 m = negative() ? (-*this)._v : _v;
+            std::string digits;
+            do
+            {
+                uint64_t rem;
+                m = detail::divmod(m, 10, rem);
+                digits.push_back(static_cast<char>('0' + rem));
+            } while (m.lo != 0 || m.hi != 0);
+            if (negative())
+            {
+                digits.push_back('-');
+            }
+            return std::string(digits.rbegin(), digits.rend());
+        }
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, const int128 &v)
+    {
+        return os << v.str();
+    }
+
+    namespace detail
+    {
+        /**
+         * @brief The largest primes below 2^62, found once on first use.
+         * Three are enough for any result that fits in 128 bits.
+         */
+        inline const std::vector<uint64_t> &crt_primes()
+        {
+            static const std::vector<uint64_t> primes = [] {
+                std::vector<uint64_t> found;
+                for (uint64_t n = (uint64_t(1) << 62) - 1; found.size() < 3; n -= 2)
+                {
+                    if (is_prime(n))
+                    {
+                        found.push_back(n);
+                    }
+                }
+                return found;
+            }();
+            return primes;
+        }
+
+        inline int bit_length(uint64_t x)
+        {
+            int bits = 0;
+            for (; x; x >>= 1)
+            {
+                bits++;
+            }
+            return bits;
+        }
+
+        inline uint64_t max_magnitude(const matrix<int64_t> &m)
+        {
+            uint64_t largest = 0;
+            for (size_t i = 0; i < m.rows(); i++)
+            {
+                for (size_t j = 0; j < m.cols(); j++)
+                {
+                    int64_t v = m(i, j);
+                    largest = std::max(largest, v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v));
+                }
+            }
+            return largest;
+        }
+
+        /**
+         * @brief Residues of a signed matrix modulo p
+         */
+        inline matrix<uint64_t> signed_residues(const matrix<int64_t> &m, uint64_t p)
+        {
+            matrix<uint64_t> result(m.rows(), m.cols());
+            for (size_t i = 0; i < m.rows(); i++)
+            {
+                for (size_t j = 0; j < m.cols(); j++)
+                {
+                    int64_t v = m(i, j);
+                    uint64_t r = (v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v)) % p;
+                    result[i][j] = (v < 0 && r) ? p - r : r;
+                }
+            }
+            return result;
+        }
+    }
+
+    /**
+     * @brief Computes the exact product of two integer matrices, however
+     * large the intermediate sums get, by multiplying modulo as many 62 bit
+     * primes as the worst case needs and combining the results
+     *
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @return matrix<int128> The exact product
+     * @throws std::overflow_error if the worst case result does not fit in 128 bits
+     */
+    inline matrix<int128> exact_multiply(const matrix<int64_t> &m1, const matrix<int64_t> &m2)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+
+        // |c| <= k * max|a| * max|b| < 2^bits, and the primes must cover
+        // twice that to recover the sign
+        const detail::u128 magnitudes = detail::mul_wide(detail::max_magnitude(m1), detail::max_magnitude(m2));
+        const detail::u128 low = detail::mul_wide(magnitudes.lo, m1.cols());
+        const detail::u128 high = detail::mul_wide(magnitudes.hi, m1.cols());
+        const uint64_t bound_hi = low.hi + high.lo;
+        if (high.hi != 0 || bound_hi < low.hi || (bound_hi >> 63) != 0)
+        {
+            throw std::overflow_error("Product may not fit in 128 bits");
+        }
+        const int bits = bound_hi ? 64 + detail::bit_length(bound_hi) : detail::bit_length(low.lo);
+        const std::vector<uint64_t> &all_primes = detail::crt_primes();
+        const size_t count = static_cast<size_t>(bits + 1) / 61 + 1;
+        const std::vector<uint64_t> primes(all_primes.begin(), all_primes.begin() + count);
+
+        std::vector<matrix<uint64_t>> residues;
+        for (uint64_t p : primes)
+        {
+            residues.push_back(modular_multiply(detail::signed_residues(m1, p), detail::signed_residues(m2, p), p));
+        }
+
+        // Garner's algorithm: x = d0 + p0 (d1 + p1 (d2 + ...)) with each
+        // digit di in [0, pi). inverses[j][i] is pj^-1 mod pi.
+        std::vector<std::vector<uint64_t>> inverses(count, std::vector<uint64_t>(count));
+        for (size_t i = 0; i < count; i++)
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                // pi is prime, so pj^-1 = pj^(pi - 2)
+                uint64_t inv = 1, base = primes[j] % primes[i];
+                for (uint64_t e = primes[i] - 2; e; e >>= 1)
+                {
+                    if (e & 1)
+                    {
+                        inv = detail::mulmod(inv, base, primes[i]);
+                    }
+                    base = detail::mulmod(base, base, primes[i]);
+                }
+                inverses[j][i] = inv;
+            }
+        }
+
+        // x > (P - 1) / 2 means the result is x - P. (P - 1) / 2 has the
+        // mixed radix digits (pi - 1) / 2 since every pi is odd.
+        detail::u128 modulus = detail::make_u128(0, 1);
+        for (uint64_t p : primes)
+        {
+            modulus = detail::mul_low(modulus, p);
+        }
+
+        matrix<int128> result(m1.rows(), m2.cols());
+        std::vector<uint64_t> digits(count);
+        for (size_t r = 0; r < result.rows(); r++)
+        {
+            for (size_t c = 0; c < result.cols(); c++)
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    uint64_t t = residues[i](r, c);
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        uint64_t d = digits[j] % primes[i];
+                        t = detail::mulmod(t >= d ? t - d : t + primes[i] - d, inverses[j][i], primes[i]);
+                    }
+                    digits[i] = t;
+                }
+
+                detail::u128 x = detail::make_u128(0, digits[count - 1]);
+                int sign = 0;
+                for (size_t i = count; i-- > 0;)
+                {
+                    if (i + 1 < count)
+                    {
+                        x = detail::add(detail::mul_low(x, primes[i]), detail::make_u128(0, digits[i]));
+                    }
+                    if (sign == 0 && digits[i] != (primes[i] - 1) / 2)
+                    {
+                        sign = digits[i] > (primes[i] - 1) / 2 ? -1 : 1;
+                    }
+                }
+                if (sign < 0)
+                {
+                    x = detail::sub(x, modulus);
+                }
+                result[r][c] = int128::from_words(x.hi, x.lo);
+            }
+        }
+        return result;
+    }
+}
+
+#endif
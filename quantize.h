@@ -0,0 +1,549 @@
+/**
+ * @file quantize.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Quantized int8 matrix multiply with int32 accumulation
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * A quantized value q represents the real value scale * (q - zero_point).
+ * Products are accumulated exactly in int32 and the zero points are
+ * corrected for afterwards using row sums of the left operand and column
+ * sums of the right one, so the inner loop is a plain int8 dot product.
+ *
+ * The inner loop uses AVX512-VNNI or AVX-VNNI (vpdpbusd) when compiled
+ * for it, otherwise AVX2 (sign extension and vpmaddwd), otherwise portable
+ * code. All paths are exact for the full int8 range, as long as the
+ * inner dimension is at most s8_max_depth: each product is at most 2^14
+ * in magnitude, so longer sums could leave int32. Longer products are
+ * refused. Rows of the result are split across threads for large
+ * products, as in the float kernels.
+ */
+
+#ifndef _QUANTIZE_H_
+#define _QUANTIZE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__AVX512VNNI__) || defined(__AVXVNNI__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief Which elements of a matrix share a scale and zero point
+     *
+     */
+    enum class quant_axis
+    {
+        tensor,     ///< one scale and zero point for the whole matrix
+        row,        ///< one per row
+        column      ///< one per column
+    };
+
+    /**
+     * @brief Scales and zero points of a quantized matrix.
+     * Element (i, j) represents scale * (q - zero_point) where the scale and
+     * zero point are picked by row i, column j, or shared, depending on axis.
+     *
+     */
+    struct quant_params
+    {
+        quant_axis axis;
+        std::vector<float> scale;
+        std::vector<int32_t> zero_point;
+
+        /**
+         * @brief Construct per-tensor parameters
+         *
+         * @param s The scale
+         * @param z The zero point
+         */
+        quant_params(float s = 1.0f, int32_t z = 0)
+        : axis(quant_axis::tensor), scale(1, s), zero_point(1, z)
+        {
+        }
+
+        /**
+         * @brief Construct per-row or per-column parameters
+         *
+         * @param a The axis the parameters vary along
+         * @param s The scales, one per row or column
+         * @param z The zero points, one per row or column
+         */
+        quant_params(quant_axis a, const std::vector<float> &s, const std::vector<int32_t> &z)
+        : axis(a), scale(s), zero_point(z)
+        {
+            if (scale.size() != zero_point.size())
+            {
+                throw invalid_dimension(scale.size(), zero_point.size());
+            }
+        }
+
+        /**
+         * @brief Index into scale and zero_point for element (i, j)
+         */
+        size_t index(size_t i, size_t j) const
+        {
+            return axis == quant_axis::tensor ? 0 : (axis == quant_axis::row ? i : j);
+        }
+
+        /**
+         * @brief Checks that there is one scale per row or column of a matrix
+         *
+         * @param rows The number of rows in the matrix
+         * @param cols The number of columns in the matrix
+         */
+        void check(size_t rows, size_t cols) const
+        {
+            size_t expected = axis == quant_axis::tensor ? 1 : (axis == quant_axis::row ? rows : cols);
+            if (scale.size() != expected)
+            {
+                throw invalid_dimension(scale.size(), expected);
+            }
+        }
+    };
+
+    /**
+     * @brief The longest inner dimension the int8 multiplies accept: the
+     * most products of 128 * 128 = 2^14 whose sum still fits in int32.
+     * The VNNI kernels' offset sums can wrap past about half this, but
+     * wrap back, since the final dot product fits.
+     */
+    const size_t s8_max_depth = static_cast<size_t>(std::numeric_limits<int32_t>::max()) / (128 * 128);
+
+    namespace detail
+    {
+        /**
+         * @brief Refuses inner dimensions whose int8 dot products could
+         * overflow int32
+         */
+        inline void check_s8_depth(size_t k)
+        {
+            if (k > s8_max_depth)
+            {
+                throw std::invalid_argument("int8 products overflow int32 past an inner dimension of " +
+                                            std::to_string(s8_max_depth));
+            }
+        }
+
+        /**
+         * @brief int8 operands repacked for the dot product kernels: rows
+         * zero padded to a multiple of the SIMD width, and the sum of each
+         * row for the zero point correction.
+         */
+        struct s8_panel
+        {
+            static const size_t align = 64;
+
+            size_t count;
+            size_t length;
+            size_t padded;
+            std::vector<int8_t> data;
+            std::vector<int32_t> sums;
+
+            s8_panel(size_t n, size_t k)
+            : count(n), length(k), padded((k + align - 1) / align * align),
+              data(n * padded, 0), sums(n, 0)
+            {
+            }
+
+            int8_t *row(size_t i)
+            {
+                return &data[i * padded];
+            }
+
+            const int8_t *row(size_t i) const
+            {
+                return &data[i * padded];
+            }
+        };
+
+        /**
+         * @brief Packs the rows of a (the left operand)
+         */
+        inline s8_panel pack_s8_rows(const matrix<int8_t> &a)
+        {
+            s8_panel panel(a.rows(), a.cols());
+            for (size_t i = 0; i < a.rows(); i++)
+            {
+                const int8_t *src = a[i].data();
+                int32_t sum = 0;
+                for (size_t p = 0; p < a.cols(); p++)
+                {
+                    sum += src[p];
+                }
+                std::copy(src, src + a.cols(), panel.row(i));
+                panel.sums[i] = sum;
+            }
+            return panel;
+        }
+
+        /**
+         * @brief Packs the columns of b (the right operand) as rows
+         */
+        inline s8_panel pack_s8_cols(const matrix<int8_t> &b)
+        {
+            s8_panel panel(b.cols(), b.rows());
+            for (size_t p = 0; p < b.rows(); p++)
+            {
+                const int8_t *src = b[p].data();
+                for (size_t j = 0; j < b.cols(); j++)
+                {
+                    panel.row(j)[p] = src[j];
+                    panel.sums[j] += src[j];
+                }
+            }
+            return panel;
+        }
+
+#if defined(__AVX2__) || defined(__AVX512VNNI__) || defined(__AVXVNNI__)
+        inline int32_t hsum_epi32(__m256i v)
+        {
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(s);
+        }
+#endif
+
+#if (defined(__AVX512VNNI__) && defined(__AVX512BW__)) || defined(__AVXVNNI__)
+        // vpdpbusd multiplies unsigned by signed bytes, so the kernel flips a
+        // into unsigned (a + 128) and 128 * sum(b) is taken back off after
+        const int32_t s8_flip_bias = 128;
+#else
+        const int32_t s8_flip_bias = 0;
+#endif
+
+        /**
+         * @brief Dot products of one packed row of a with four packed rows
+         * of b^T. Lengths are multiples of s8_panel::align and padding is zero.
+         * The result is offset by s8_flip_bias * sum(b).
+         *
+         * @param a The row of a
+         * @param b Four rows of b^T
+         * @param k The padded length
+         * @param out The four dot products
+         */
+        inline void dot_s8_x4(const int8_t *a, const int8_t *const b[4], size_t k, int32_t out[4])
+        {
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+            const __m512i flip = _mm512_set1_epi8(static_cast<char>(0x80));
+            __m512i acc[4] = {_mm512_setzero_si512(), _mm512_setzero_si512(),
+                              _mm512_setzero_si512(), _mm512_setzero_si512()};
+            for (size_t p = 0; p < k; p += 64)
+            {
+                __m512i va = _mm512_xor_si512(_mm512_loadu_si512(a + p), flip);
+                for (int c = 0; c < 4; c++)
+                {
+                    acc[c] = _mm512_dpbusd_epi32(acc[c], va, _mm512_loadu_si512(b[c] + p));
+                }
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                out[c] = _mm512_reduce_add_epi32(acc[c]);
+            }
+#elif defined(__AVXVNNI__)
+            const __m256i flip = _mm256_set1_epi8(static_cast<char>(0x80));
+            __m256i acc[4];
+            for (int c = 0; c < 4; c++)
+            {
+                acc[c] = _mm256_setzero_si256();
+            }
+            for (size_t p = 0; p < k; p += 32)
+            {
+                __m256i va = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + p)), flip);
+                for (int c = 0; c < 4; c++)
+                {
+                    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b[c] + p));
+                    acc[c] = _mm256_dpbusd_avx_epi32(acc[c], va, vb);
+                }
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                out[c] = hsum_epi32(acc[c]);
+            }
+#elif defined(__AVX2__)
+            // sign extend to 16 bits and multiply-add adjacent pairs into
+            // 32 bits, which cannot saturate for int8 inputs
+            __m256i acc[4];
+            for (int c = 0; c < 4; c++)
+            {
+                acc[c] = _mm256_setzero_si256();
+            }
+            for (size_t p = 0; p < k; p += 16)
+            {
+                __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + p)));
+                for (int c = 0; c < 4; c++)
+                {
+                    __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b[c] + p)));
+                    acc[c] = _mm256_add_epi32(acc[c], _mm256_madd_epi16(va, vb));
+                }
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                out[c] = hsum_epi32(acc[c]);
+            }
+#else
+            for (int c = 0; c < 4; c++)
+            {
+                int32_t sum = 0;
+                for (size_t p = 0; p < k; p++)
+                {
+                    sum += static_cast<int32_t>(a[p]) * static_cast<int32_t>(b[c][p]);
+                }
+                out[c] = sum;
+            }
+#endif
+        }
+
+        /**
+         * @brief Runs the int8 kernel over every element of the product,
+         * handing each raw int32 dot product to an epilogue. Rows are split
+         * across threads above gemm_parallel_threshold multiply-adds, so the
+         * epilogue is called concurrently, but never for the same row from
+         * two threads.
+         *
+         * @tparam Epilogue Callable as epilogue(i, j, int32_t dot)
+         */
+        template <class Epilogue>
+        void gemm_s8(const s8_panel &a, const s8_panel &b_T, Epilogue &epilogue)
+        {
+            const size_t n = b_T.count;
+            const std::vector<int8_t> zeros(b_T.padded, 0);
+            const size_t threads = a.count * n * a.length < gemm_parallel_threshold ? 1 : num_threads();
+            parallel_for(a.count, 1, threads, [&](size_t r0, size_t r1) {
+                for (size_t i = r0; i < r1; i++)
+                {
+                    for (size_t j = 0; j < n; j += 4)
+                    {
+                        // pad the last group of columns with a zero row
+                        const int8_t *cols[4];
+                        for (size_t c = 0; c < 4; c++)
+                        {
+                            cols[c] = j + c < n ? b_T.row(j + c) : zeros.data();
+                        }
+
+                        int32_t dots[4];
+                        dot_s8_x4(a.row(i), cols, a.padded, dots);
+                        for (size_t c = 0; c < 4 && j + c < n; c++)
+                        {
+                            // in unsigned arithmetic, as the offset dot product may have wrapped
+                            const uint32_t offset = static_cast<uint32_t>(s8_flip_bias * b_T.sums[j + c]);
+                            epilogue(i, j + c, static_cast<int32_t>(static_cast<uint32_t>(dots[c]) - offset));
+                        }
+                    }
+                }
+            });
+        }
+
+        /**
+         * @brief Stores the raw int32 products
+         */
+        struct store_s32
+        {
+            row_writer<int32_t> result;
+
+            void operator()(size_t i, size_t j, int32_t dot)
+            {
+                result(i, j, dot);
+            }
+        };
+
+        /**
+         * @brief Corrects for the zero points, rescales and rounds back to
+         * int8 in the output's quantization
+         */
+        struct requantize_s8
+        {
+            const s8_panel &a;
+            const s8_panel &b_T;
+            const quant_params &qa;
+            const quant_params &qb;
+            const quant_params &qc;
+            row_writer<int8_t> result;
+
+            void operator()(size_t i, size_t j, int32_t dot)
+            {
+                const size_t ia = qa.index(i, 0);
+                const size_t ib = qb.index(0, j);
+                const size_t ic = qc.index(i, j);
+                const int64_t za = qa.zero_point[ia];
+                const int64_t zb = qb.zero_point[ib];
+
+                // sum (a - za)(b - zb) = sum ab - zb sum a - za sum b + k za zb
+                int64_t acc = static_cast<int64_t>(dot) - zb * a.sums[i] - za * b_T.sums[j]
+                              + static_cast<int64_t>(a.length) * za * zb;
+
+                double real = static_cast<double>(qa.scale[ia]) * qb.scale[ib] * static_cast<double>(acc);
+                double q = std::nearbyint(real / qc.scale[ic]) + qc.zero_point[ic];
+                result(i, j, static_cast<int8_t>(std::min(127.0, std::max(-128.0, q))));
+            }
+        };
+    }
+
+    /**
+     * @brief Computes the exact product of two int8 matrices in int32.
+     * The inner dimension may be at most s8_max_depth.
+     *
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @return matrix<int32_t> The computed matrix product
+     */
+    inline matrix<int32_t> multiply_s8(const matrix<int8_t> &m1, const matrix<int8_t> &m2)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+
+        detail::check_s8_depth(m1.cols());
+
+        detail::s8_panel a = detail::pack_s8_rows(m1);
+        detail::s8_panel b_T = detail::pack_s8_cols(m2);
+        matrix<int32_t> result(m1.rows(), m2.cols());
+        detail::store_s32 store = {detail::row_writer<int32_t>(result)};
+        detail::gemm_s8(a, b_T, store);
+        return result;
+    }
+
+    /**
+     * @brief Computes the product of two quantized matrices and quantizes
+     * the result, with the requantization fused into the kernel so the
+     * int32 products are never stored.
+     *
+     * @param m1 The first matrix
+     * @param q1 Its quantization, per tensor or per row
+     * @param m2 The second matrix
+     * @param q2 Its quantization, per tensor or per column
+     * @param q_out The quantization of the result, along any axis
+     * @return matrix<int8_t> The computed matrix product
+     */
+    inline matrix<int8_t> multiply_quantized(const matrix<int8_t> &m1, const quant_params &q1,
+                                             const matrix<int8_t> &m2, const quant_params &q2,
+                                             const quant_params &q_out)
+    {
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+        if (q1.axis == quant_axis::column || q2.axis == quant_axis::row)
+        {
+            // the zero point correction needs a's parameters to be constant
+            // along each row and b's along each column
+            throw std::invalid_argument("multiply_quantized needs per-row m1 and per-column m2 parameters");
+        }
+        q1.check(m1.rows(), m1.cols());
+        q2.check(m2.rows(), m2.cols());
+        q_out.check(m1.rows(), m2.cols());
+        detail::check_s8_depth(m1.cols());
+
+        detail::s8_panel a = detail::pack_s8_rows(m1);
+        detail::s8_panel b_T = detail::pack_s8_cols(m2);
+        matrix<int8_t> result(m1.rows(), m2.cols());
+        detail::requantize_s8 requantize = {a, b_T, q1, q2, q_out, detail::row_writer<int8_t>(result)};
+        detail::gemm_s8(a, b_T, requantize);
+        return result;
+    }
+
+    /**
+     * @brief Chooses asymmetric quantization parameters covering the range
+     * of values in a matrix (always including zero)
+     *
+     * @param m The matrix to quantize
+     * @param axis Whether to choose one scale for the matrix, or per row or column
+     * @return quant_params The chosen parameters
+     */
+    inline quant_params choose_quant_params(const matrix<float> &m, quant_axis axis = quant_axis::tensor)
+    {
+        size_t count = axis == quant_axis::tensor ? 1 : (axis == quant_axis::row ? m.rows() : m.cols());
+        std::vector<float> lo(count, 0.0f);
+        std::vector<float> hi(count, 0.0f);
+        quant_params shape(axis, lo, std::vector<int32_t>(count));
+
+        for (size_t i = 0; i < m.rows(); i++)
+        {
+            for (size_t j = 0; j < m.cols(); j++)
+            {
+                size_t idx = shape.index(i, j);
+                lo[idx] = std::min(lo[idx], m[i][j]);
+                hi[idx] = std::max(hi[idx], m[i][j]);
+            }
+        }
+
+        std::vector<float> scale(count);
+        std::vector<int32_t> zero_point(count);
+        for (size_t c = 0; c < count; c++)
+        {
+            scale[c] = hi[c] > lo[c] ? (hi[c] - lo[c]) / 255.0f : 1.0f;
+            zero_point[c] = static_cast<int32_t>(std::nearbyint(-128.0f - lo[c] / scale[c]));
+            zero_point[c] = std::min(127, std::max(-128, zero_point[c]));
+        }
+        return quant_params(axis, scale, zero_point);
+    }
+
+    /**
+     * @brief Quantizes a float matrix, rounding to nearest and saturating
+     *
+     * @param m The matrix to quantize
+     * @param q The quantization parameters
+     * @return matrix<int8_t> The quantized matrix
+     */
+    inline matrix<int8_t> quantize(const matrix<float> &m, const quant_params &q)
+    {
+        q.check(m.rows(), m.cols());
+        matrix<int8_t> result(m.rows(), m.cols());
+        for (size_t i = 0; i < m.rows(); i++)
+        {
+            for (size_t j = 0; j < m.cols(); j++)
+            {
+                size_t idx = q.index(i, j);
+                float v = std::nearbyint(m[i][j] / q.scale[idx]) + q.zero_point[idx];
+                result[i][j] = static_cast<int8_t>(std::min(127.0f, std::max(-128.0f, v)));
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Converts a quantized matrix back to float
+     *
+     * @param m The quantized matrix
+     * @param q The quantization parameters
+     * @return matrix<float> The real values represented by m
+     */
+    inline matrix<float> dequantize(const matrix<int8_t> &m, const quant_params &q)
+    {
+        q.check(m.rows(), m.cols());
+        matrix<float> result(m.rows(), m.cols());
+        for (size_t i = 0; i < m.rows(); i++)
+        {
+            for (size_t j = 0; j < m.cols(); j++)
+            {
+                size_t idx = q.index(i, j);
+                result[i][j] = q.scale[idx] * (m[i][j] - q.zero_point[idx]);
+            }
+        }
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * @file semiring.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Semirings for the generic matrix multiply, and graph algorithms
+ * built on them
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Any of these can be passed to matrix<T>::multiply<S>() to run the same
+ * blocked, multithreaded kernel as the ordinary product with a different
+ * pair of operations. See plus_times in matrix.h for the requirements.
+ */
+
+#ifndef _SEMIRING_H_
+#define _SEMIRING_H_
+
+#include <algorithm>
+#include <limits>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    namespace detail
+    {
+        /**
+         * @brief Adds two values where an extreme value (the semiring's
+         * zero) absorbs everything. Types with an infinity get this for
+         * free; integers need the explicit check to avoid overflowing.
+         */
+        template <class T>
+        T absorbing_add(const T &a, const T &b, const T &extreme)
+        {
+            if (!std::numeric_limits<T>::has_infinity && (a == extreme || b == extreme))
+            {
+                return extreme;
+            }
+            return a + b;
+        }
+    }
+
+    /**
+     * @brief The tropical (min, +) semiring. The product of edge weight
+     * matrices gives the lengths of the shortest two-step paths.
+     * zero() (infinity, or the largest value for integers) means no path.
+     *
+     * @tparam T The type of the weights
+     */
+    template <class T>
+    struct min_plus
+    {
+        typedef T value_type;
+
+        static T zero()
+        {
+            return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+                                                        : std::numeric_limits<T>::max();
+        }
+
+        static T add(const T &a, const T &b)
+        {
+            return std::min(a, b);
+        }
+
+        static T mul(const T &a, const T &b)
+        {
+            return detail::absorbing_add(a, b, zero());
+        }
+    };
+
+    /**
+     * @brief The (max, +) semiring, e.g. for Viterbi style best path scores
+     * over log probabilities. zero() (minus infinity, or the lowest value for
+     * integers) means no path.
+     *
+     * @tparam T The type of the scores
+     */
+    template <class T>
+    struct max_plus
+    {
+        typedef T value_type;
+
+        static T zero()
+        {
+            return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                                        : std::numeric_limits<T>::lowest();
+        }
+
+        static T add(const T &a, const T &b)
+        {
+            return std::max(a, b);
+        }
+
+        static T mul(const T &a, const T &b)
+        {
+            return detail::absorbing_add(a, b, zero());
+        }
+    };
+
+    /**
+     * @brief The boolean (or, and) semiring, for reachability. Nonzero
+     * elements are true. For large graphs bit_matrix is much faster.
+     *
+     */
+    struct or_and
+    {
+        typedef bool value_type;
+
+        static bool zero()
+        {
+            return false;
+        }
+
+        static bool add(bool a, bool b)
+        {
+            return a || b;
+        }
+
+        static bool mul(bool a, bool b)
+        {
+            return a && b;
+        }
+    };
+
+    /**
+     * @brief Computes the length of the shortest path between every pair
+     * of vertices, by squaring the weight matrix over (min, +) until every
+     * path length up to n - 1 edges is covered: O(log n) products.
+     * Negative edges are allowed but negative cycles are not detected.
+     *
+     * @tparam T The type of the weights
+     * @param weights Square matrix of edge weights, with min_plus<T>::zero()
+     * where there is no edge. The diagonal is treated as 0.
+     * @return matrix<T> The shortest path lengths, min_plus<T>::zero() where unreachable
+     */
+    template <class T>
+    matrix<T> shortest_paths(const matrix<T> &weights)
+    {
+        if (weights.rows() != weights.cols())
+        {
+            throw invalid_dimension(weights.rows(), weights.cols());
+        }
+
+        matrix<T> dist = weights;
+        for (size_t i = 0; i < dist.rows(); i++)
+        {
+            dist(i, i) = std::min(dist(i, i), T());
+        }
+
+        for (size_t span = 1; span + 1 < dist.rows(); span *= 2)
+        {
+            matrix<T> next = matrix<T>::template multiply<min_plus<T>>(dist, dist);
+            if (next == dist)
+            {
+                break;
+            }
+            dist = next;
+        }
+        return dist;
+    }
+}
+
+#endif
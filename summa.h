@@ -0,0 +1,718 @@
+/**
+ * @file summa.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Matrix multiply across worker processes by SUMMA, over POSIX
+ * shared memory and local sockets
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * run_local_processes() forks workers and runs the same function in each,
+ * the calling process being rank 0, with a transport between them: the
+ * only way the ranks talk. local_transport moves data through one POSIX
+ * shared memory slot per rank and signals over a mesh of Unix domain
+ * sockets, so a message is copied in and out of shared memory once and a
+ * broadcast is copied in once. Nothing else knows that, so an MPI or RDMA
+ * transport can be dropped in by implementing the same interface.
+ *
+ * summa_multiply() computes a product this way with the SUMMA algorithm
+ * (van de Geijn and Watts, 1997): the ranks form a 2D grid, each owning a
+ * block of a, b and the product, and for each panel of the inner dimension
+ * the owners broadcast their piece of a along grid rows and of b along
+ * grid columns, after which every rank adds the panel product to its block
+ * with the multiply kernel.
+ *
+ * A worker that dies closes its sockets, so whoever waits on it gets an
+ * error rather than hanging, and the caller gets an exception naming the
+ * worker. Linux (or any POSIX system) only.
+ */
+
+#ifndef _SUMMA_H_
+#define _SUMMA_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief How ranks exchange data. Sends are synchronous: they return
+     * once the receiver has the data, so a buffer can be reused straight
+     * away.
+     *
+     */
+    class transport
+    {
+      public:
+        virtual ~transport()
+        {
+        }
+
+        /**
+         * @brief This process's rank, from 0 to size() - 1
+         */
+        virtual size_t rank() const = 0;
+
+        /**
+         * @brief The number of ranks
+         */
+        virtual size_t size() const = 0;
+
+        /**
+         * @brief Sends bytes bytes to rank to, which must receive them
+         */
+        virtual void send(size_t to, const void *data, size_t bytes) = 0;
+
+        /**
+         * @brief Receives bytes bytes sent by rank from
+         */
+        virtual void receive(size_t from, void *data, size_t bytes) = 0;
+
+        /**
+         * @brief Copies bytes bytes from root's data to everyone else's in
+         * group. Every rank in group, root included, must call it.
+         *
+         * @param group The ranks taking part, in the same order on all of them
+         * @param root The rank sending
+         * @param data The buffer to send from or receive into
+         * @param bytes The size of the message
+         */
+        virtual void broadcast(const std::vector<size_t> &group, size_t root, void *data, size_t bytes)
+        {
+            if (rank() != root)
+            {
+                receive(root, data, bytes);
+                return;
+            }
+            for (size_t member : group)
+            {
+                if (member != root)
+                {
+                    send(member, data, bytes);
+                }
+            }
+        }
+
+        /**
+         * @brief Returns once every rank has called it
+         */
+        virtual void barrier()
+        {
+            char token = 0;
+            if (rank() == 0)
+            {
+                for (size_t r = 1; r < size(); r++)
+                {
+                    receive(r, &token, 1);
+                }
+                for (size_t r = 1; r < size(); r++)
+                {
+                    send(r, &token, 1);
+                }
+            }
+            else
+            {
+                send(0, &token, 1);
+                receive(0, &token, 1);
+            }
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief The default size of each rank's shared memory slot;
+         * longer messages go through in pieces this long
+         */
+        const size_t local_slot_bytes = 1 << 20;
+
+        inline void write_all(int fd, const void *data, size_t bytes)
+        {
+            const char *p = static_cast<const char *>(data);
+            while (bytes > 0)
+            {
+                // MSG_NOSIGNAL: a dead peer is an error here, not SIGPIPE
+                const ssize_t done = ::send(fd, p, bytes, MSG_NOSIGNAL);
+                if (done < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (done <= 0)
+                {
+                    throw std::runtime_error("Lost connection to a worker process");
+                }
+                p += done;
+                bytes -= static_cast<size_t>(done);
+            }
+        }
+
+        inline void read_all(int fd, void *data, size_t bytes)
+        {
+            char *p = static_cast<char *>(data);
+            while (bytes > 0)
+            {
+                const ssize_t done = ::read(fd, p, bytes);
+                if (done < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (done <= 0)
+                {
+                    throw std::runtime_error("Lost connection to a worker process");
+                }
+                p += done;
+                bytes -= static_cast<size_t>(done);
+            }
+        }
+
+        inline std::atomic<unsigned> &local_segment_counter()
+        {
+            static std::atomic<unsigned> counter(0);
+            return counter;
+        }
+    }
+
+    /**
+     * @brief Ranks on one machine: each has a slot in a POSIX shared
+     * memory segment and a Unix domain socket to every other rank. To send,
+     * a rank copies a piece into its slot and announces its length on the
+     * socket; the receiver copies it out and acknowledges.
+     *
+     */
+    class local_transport : public transport
+    {
+      private:
+        size_t _rank;
+        size_t _size;
+        unsigned char *_slots;
+        size_t _slot_bytes;
+        std::vector<int> _sockets;
+
+        unsigned char *slot(size_t r) const
+        {
+            return _slots + r * _slot_bytes;
+        }
+
+      public:
+        /**
+         * @brief Construct a new local transport. run_local_processes()
+         * makes these; the segment and sockets belong to it.
+         *
+         * @param rank This process's rank
+         * @param size The number of ranks
+         * @param slots The shared segment, size * slot_bytes long
+         * @param slot_bytes The size of each rank's slot
+         * @param sockets The socket to each rank, by rank
+         */
+        local_transport(size_t rank, size_t size, unsigned char *slots, size_t slot_bytes,
+                        const std::vector<int> &sockets)
+        : _rank(rank), _size(size), _slots(slots), _slot_bytes(slot_bytes), _sockets(sockets)
+        {
+        }
+
+        size_t rank() const override
+        {
+            return _rank;
+        }
+
+        size_t size() const override
+        {
+            return _size;
+        }
+
+        void send(size_t to, const void *data, size_t bytes) override
+        {
+            const std::vector<size_t> pair = {_rank, to};
+            broadcast(pair, _rank, const_cast<void *>(data), bytes);
+        }
+
+        void receive(size_t from, void *data, size_t bytes) override
+        {
+            const std::vector<size_t> pair = {from, _rank};
+            broadcast(pair, from, data, bytes);
+        }
+
+        /**
+         * @brief Copies each piece into the root's slot once, then lets
+         * every member copy it out
+         */
+        void broadcast(const std::vector<size_t> &group, size_t root, void *data, size_t bytes) override
+        {
+            unsigned char *p = static_cast<unsigned char *>(data);
+            size_t offset = 0;
+            do
+            {
+                uint64_t piece = std::min(_slot_bytes, bytes - offset);
+                char ack = 0;
+                if (_rank == root)
+                {
+                    std::memcpy(slot(root), p + offset, piece);
+                    for (size_t member : group)
+                    {
+                        if (member != root)
+                        {
+                            detail::write_all(_sockets[member], &piece, sizeof(piece));
+                        }
+                    }
+                    for (size_t member : group)
+                    {
+                        if (member != root)
+                        {
+                            detail::read_all(_sockets[member], &ack, 1);
+                        }
+                    }
+                }
+                else
+                {
+                    detail::read_all(_sockets[root], &piece, sizeof(piece));
+                    std::memcpy(p + offset, slot(root), piece);
+                    detail::write_all(_sockets[root], &ack, 1);
+                }
+                offset += piece;
+            } while (offset < bytes);
+        }
+    };
+
+    /**
+     * @brief Runs f(transport &) on processes ranks: the caller as rank 0
+     * and forked workers as the rest, connected by a local_transport.
+     * Workers start as copies of the caller, and exit when f returns.
+     * Output buffered in std::cout is flushed first so workers do not
+     * repeat it.
+     *
+     * @param processes The number of ranks
+     * @param f The function each rank runs
+     * @param slot_bytes The size of each rank's shared memory slot
+     * @throws std::runtime_error if a worker throws, crashes or exits early;
+     * the other workers are killed. What rank 0's f throws is rethrown.
+     */
+    template <class F>
+    void run_local_processes(size_t processes, const F &f, size_t slot_bytes = detail::local_slot_bytes)
+    {
+        if (processes == 0 || slot_bytes == 0)
+        {
+            throw std::invalid_argument("Need at least one process and a nonempty slot");
+        }
+
+        // the name only lives long enough to map the segment
+        const std::string name = "/codesample." + std::to_string(::getpid()) + "." +
+                                 std::to_string(detail::local_segment_counter()++);
+        const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Can't create shared memory segment");
+        }
+        ::shm_unlink(name.c_str());
+        const size_t segment_bytes = processes * slot_bytes;
+        void *segment = MAP_FAILED;
+        if (::ftruncate(fd, static_cast<off_t>(segment_bytes)) == 0)
+        {
+            segment = ::mmap(nullptr, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (segment == MAP_FAILED)
+        {
+            throw std::runtime_error("Can't map shared memory segment");
+        }
+
+        // sockets[i * processes + j] is rank i's end of the pair to rank j
+        std::vector<int> sockets(processes * processes, -1);
+        const auto close_all = [&]() {
+            for (int &s : sockets)
+            {
+                if (s >= 0)
+                {
+                    ::close(s);
+                    s = -1;
+                }
+            }
+            ::munmap(segment, segment_bytes);
+        };
+        for (size_t i = 0; i < processes; i++)
+        {
+            for (size_t j = i + 1; j < processes; j++)
+            {
+                int pair[2];
+                if (::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+                {
+                    close_all();
+                    throw std::runtime_error("Can't create sockets");
+                }
+                sockets[i * processes + j] = pair[0];
+                sockets[j * processes + i] = pair[1];
+            }
+        }
+        // keep only rank r's ends, so that a dead rank's sockets really close
+        const auto ends_of = [&](size_t r) {
+            for (size_t s = 0; s < sockets.size(); s++)
+            {
+                if (s / processes != r && sockets[s] >= 0)
+                {
+                    ::close(sockets[s]);
+                    sockets[s] = -1;
+                }
+            }
+            return std::vector<int>(sockets.begin() + r * processes, sockets.begin() + (r + 1) * processes);
+        };
+
+        std::cout.flush();
+        std::fflush(nullptr);
+        std::vector<pid_t> workers;
+        for (size_t r = 1; r < processes; r++)
+        {
+            const pid_t pid = ::fork();
+            if (pid == 0)
+            {
+                int status = 0;
+                try
+                {
+                    local_transport t(r, processes, static_cast<unsigned char *>(segment), slot_bytes, ends_of(r));
+                    f(static_cast<transport &>(t));
+                }
+                catch (...)
+                {
+                    status = 1;
+                }
+                std::cout.flush();
+                std::fflush(nullptr);
+                ::_exit(status);
+            }
+            if (pid < 0)
+            {
+                for (pid_t worker : workers)
+                {
+                    ::kill(worker, SIGKILL);
+                    ::waitpid(worker, nullptr, 0);
+                }
+                close_all();
+                throw std::runtime_error("Can't start worker process");
+            }
+            workers.push_back(pid);
+        }
+
+        std::string failure;
+        try
+        {
+            local_transport t(0, processes, static_cast<unsigned char *>(segment), slot_bytes, ends_of(0));
+            f(static_cast<transport &>(t));
+        }
+        catch (...)
+        {
+            // the workers may be waiting on rank 0, or be what failed
+            for (pid_t worker : workers)
+            {
+                ::kill(worker, SIGKILL);
+                ::waitpid(worker, nullptr, 0);
+            }
+            close_all();
+            throw;
+        }
+        for (size_t w = 0; w < workers.size(); w++)
+        {
+            int status = 0;
+            while (::waitpid(workers[w], &status, 0) < 0 && errno == EINTR)
+            {
+            }
+            if (failure.empty() && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+            {
+                failure = "Worker process " + std::to_string(w + 1) + " failed";
+            }
+        }
+        close_all();
+        if (!failure.empty())
+        {
+            throw std::runtime_error(failure);
+        }
+    }
+
+    /**
+     * @brief The shape of a grid of ranks: the factorization of processes
+     * into rows x cols closest to square, rows <= cols
+     */
+    struct process_grid
+    {
+        size_t rows;
+        size_t cols;
+
+        explicit process_grid(size_t processes)
+        : rows(1), cols(processes)
+        {
+            for (size_t r = 1; r * r <= processes; r++)
+            {
+                if (processes % r == 0)
+                {
+                    rows = r;
+                    cols = processes / r;
+                }
+            }
+        }
+
+        /**
+         * @brief A grid of a given shape
+         */
+        process_grid(size_t rows, size_t cols)
+        : rows(rows), cols(cols)
+        {
+        }
+
+        size_t rank(size_t row, size_t col) const
+        {
+            return row * cols + col;
+        }
+
+        /**
+         * @brief The ranks in one grid row, or one grid column
+         */
+        std::vector<size_t> row_group(size_t row) const
+        {
+            std::vector<size_t> group;
+            for (size_t c = 0; c < cols; c++)
+            {
+                group.push_back(rank(row, c));
+            }
+            return group;
+        }
+
+        std::vector<size_t> col_group(size_t col) const
+        {
+            std::vector<size_t> group;
+            for (size_t r = 0; r < rows; r++)
+            {
+                group.push_back(rank(r, col));
+            }
+            return group;
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief The start of part i of n split into parts nearly equal parts
+         */
+        inline size_t part_start(size_t n, size_t parts, size_t i)
+        {
+            return n * i / parts;
+        }
+
+        /**
+         * @brief The part of n split into parts that index x falls in
+         */
+        inline size_t part_of(size_t n, size_t parts, size_t x)
+        {
+            size_t i = x * parts / n;
+            while (part_start(n, parts, i + 1) <= x)
+            {
+                i++;
+            }
+            while (part_start(n, parts, i) > x)
+            {
+                i--;
+            }
+            return i;
+        }
+
+        /**
+         * @brief Copies rows [r0, r1) x columns [c0, c1) of a matrix into
+         * a row major buffer
+         */
+        template <class T>
+        std::vector<T> pack_block(const matrix<T> &m, size_t r0, size_t r1, size_t c0, size_t c1)
+        {
+            std::vector<T> block((r1 - r0) * (c1 - c0));
+            for (size_t i = r0; i < r1; i++)
+            {
+                std::copy(&m(i, 0) + c0, &m(i, 0) + c1, block.begin() + (i - r0) * (c1 - c0));
+            }
+            return block;
+        }
+
+        /**
+         * @brief The SUMMA algorithm as run by one rank. Rank 0 holds a and
+         * b, scatters their blocks, and gathers the product into result;
+         * the other ranks ignore those arguments.
+         */
+        template <class T>
+        void summa(transport &t, const process_grid &grid, size_t m, size_t n, size_t k, const matrix<T> &a,
+                   const matrix<T> &b, matrix<T> &result, size_t panel)
+        {
+            const size_t row = t.rank() / grid.cols, col = t.rank() % grid.cols;
+
+            // a is split rows by grid rows and k by grid columns; b k by
+            // grid rows and columns by grid columns; the product like neither
+            const auto a_rows = [&](size_t r) { return part_start(m, grid.rows, r); };
+            const auto a_ks = [&](size_t c) { return part_start(k, grid.cols, c); };
+            const auto b_ks = [&](size_t r) { return part_start(k, grid.rows, r); };
+            const auto b_cols = [&](size_t c) { return part_start(n, grid.cols, c); };
+
+            std::vector<T> a_block, b_block;
+            if (t.rank() == 0)
+            {
+                for (size_t q = t.size(); q-- > 0;)
+                {
+                    const size_t r = q / grid.cols, c = q % grid.cols;
+                    std::vector<T> a_part = pack_block(a, a_rows(r), a_rows(r + 1), a_ks(c), a_ks(c + 1));
+                    std::vector<T> b_part = pack_block(b, b_ks(r), b_ks(r + 1), b_cols(c), b_cols(c + 1));
+                    if (q == 0)
+                    {
+                        a_block.swap(a_part);
+                        b_block.swap(b_part);
+                        break;
+                    }
+                    t.send(q, a_part.data(), a_part.size() * sizeof(T));
+                    t.send(q, b_part.data(), b_part.size() * sizeof(T));
+                }
+            }
+            else
+            {
+                a_block.resize((a_rows(row + 1) - a_rows(row)) * (a_ks(col + 1) - a_ks(col)));
+                b_block.resize((b_ks(row + 1) - b_ks(row)) * (b_cols(col + 1) - b_cols(col)));
+                t.receive(0, a_block.data(), a_block.size() * sizeof(T));
+                t.receive(0, b_block.data(), b_block.size() * sizeof(T));
+            }
+
+            const size_t my_rows = a_rows(row + 1) - a_rows(row), my_cols = b_cols(col + 1) - b_cols(col);
+            const size_t my_a_k = a_ks(col + 1) - a_ks(col);
+            std::vector<T> c_block(my_rows * my_cols);
+            std::vector<T> a_panel(my_rows * std::min(panel, k)), b_panel(std::min(panel, k) * my_cols);
+            const std::vector<size_t> my_row = grid.row_group(row), my_col = grid.col_group(col);
+
+            // panels never straddle a block boundary in either operand
+            for (size_t p0 = 0; p0 < k;)
+            {
+                const size_t a_owner = part_of(k, grid.cols, p0), b_owner = part_of(k, grid.rows, p0);
+                const size_t p1 = std::min(std::min(p0 + panel, a_ks(a_owner + 1)), b_ks(b_owner + 1));
+                const size_t width = p1 - p0;
+
+                if (col == a_owner)
+                {
+                    for (size_t i = 0; i < my_rows; i++)
+                    {
+                        const T *src = &a_block[i * my_a_k + (p0 - a_ks(col))];
+                        std::copy(src, src + width, &a_panel[i * width]);
+                    }
+                }
+                if (my_rows > 0)
+                {
+                    t.broadcast(my_row, grid.rank(row, a_owner), a_panel.data(), my_rows * width * sizeof(T));
+                }
+                if (row == b_owner)
+                {
+                    const T *src = &b_block[(p0 - b_ks(row)) * my_cols];
+                    std::copy(src, src + width * my_cols, b_panel.begin());
+                }
+                if (my_cols > 0)
+                {
+                    t.broadcast(my_col, grid.rank(b_owner, col), b_panel.data(), width * my_cols * sizeof(T));
+                }
+
+                if (my_rows > 0 && my_cols > 0)
+                {
+                    multiply_into(matrix_ref<const T>(a_panel.data(), my_rows, width),
+                                  matrix_ref<const T>(b_panel.data(), width, my_cols),
+                                  matrix_ref<T>(c_block.data(), my_rows, my_cols), true);
+                }
+                p0 = p1;
+            }
+
+            if (t.rank() != 0)
+            {
+                t.send(0, c_block.data(), c_block.size() * sizeof(T));
+                return;
+            }
+            for (size_t q = 0; q < t.size(); q++)
+            {
+                const size_t r = q / grid.cols, c = q % grid.cols;
+                const size_t rows = a_rows(r + 1) - a_rows(r), cols = b_cols(c + 1) - b_cols(c);
+                std::vector<T> block(rows * cols);
+                if (q == 0)
+                {
+                    block.swap(c_block);
+                }
+                else
+                {
+                    t.receive(q, block.data(), block.size() * sizeof(T));
+                }
+                for (size_t i = 0; i < rows && cols > 0; i++)
+                {
+                    std::copy(&block[i * cols], &block[i * cols] + cols, &result[a_rows(r) + i][b_cols(c)]);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Computes the product of two matrices with SUMMA across
+     * processes ranks on a 2D grid (see run_local_processes()). The ranks
+     * share the machine's threads between them.
+     *
+     * @param m1 The first matrix
+     * @param m2 The second matrix
+     * @param processes The number of ranks, 0 for one per thread (see num_threads())
+     * @param panel The widest panel of the inner dimension broadcast at once
+     * @return matrix<T> The product
+     * @throws std::runtime_error if a worker process fails
+     */
+    template <class T>
+    matrix<T> summa_multiply(const matrix<T> &m1, const matrix<T> &m2, size_t processes = 0, size_t panel = 256)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "SUMMA sends elements as bytes");
+        if (m1.rows() == 0 || m2.rows() == 0)
+        {
+            throw std::out_of_range("Can't multiply matrix of size 0!");
+        }
+        if (m1.cols() != m2.rows())
+        {
+            throw invalid_dimension(m1.cols(), m2.rows());
+        }
+        if (panel == 0)
+        {
+            throw std::invalid_argument("Panel width must be nonzero");
+        }
+
+        if (processes == 0)
+        {
+            processes = num_threads();
+        }
+        const process_grid grid(processes);
+        matrix<T> result(m1.rows(), m2.cols());
+
+        // each rank gets its share of the threads; rank 0 is this process
+        const size_t previous = detail::thread_setting();
+        const size_t threads = std::max<size_t>(1, num_threads() / processes);
+        try
+        {
+            run_local_processes(processes, [&](transport &t) {
+                set_num_threads(threads);
+                detail::summa(t, grid, m1.rows(), m2.cols(), m1.cols(), m1, m2, result, panel);
+            });
+        }
+        catch (...)
+        {
+            set_num_threads(previous);
+            throw;
+        }
+        set_num_threads(previous);
+        return result;
+    }
+}
+
+#endif
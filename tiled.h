@@ -0,0 +1,362 @@
+/**
+ * @file tiled.h
+ * @author henry gaudet (henrygaudet88@gmail.com)
+ * @brief Matrices stored as square tiles, optionally in Morton order
+ * @version 0.1
+ * @date 2019-06-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * A tiled_matrix keeps each tile x tile block contiguous, so a block is a
+ * few pages rather than one cache line from each of tile rows. Tiles are
+ * stored either by rows of tiles or in Morton (Z) order, which interleaves
+ * the bits of the tile row and column so that every aligned power-of-two
+ * square of tiles is contiguous too; recursive and blocked algorithms then
+ * stay local at every level. Edge tiles are padded with zeros so that the
+ * kernels never need to check bounds.
+ */
+
+#ifndef _TILED_H_
+#define _TILED_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.h"
+
+namespace codesample
+{
+    /**
+     * @brief The order tiles are stored in
+     *
+     */
+    enum class tile_order
+    {
+        /**
+         * Row by row of tiles
+         */
+        row_major,
+
+        /**
+         * Morton (Z) order
+         */
+        morton
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Interleaves the bits of row and col, row taking the odd bits
+         */
+        inline uint64_t morton_code(uint32_t row, uint32_t col)
+        {
+            uint64_t code = 0;
+            for (int bit = 0; bit < 32; bit++)
+            {
+                code |= static_cast<uint64_t>((col >> bit) & 1) << (2 * bit);
+                code |= static_cast<uint64_t>((row >> bit) & 1) << (2 * bit + 1);
+            }
+            return code;
+        }
+    }
+
+    template <class T>
+    class tiled_matrix;
+
+    namespace detail
+    {
+        template <class T>
+        struct tiled_writer;
+    }
+
+    /**
+     * @brief A matrix stored as contiguous square tiles
+     *
+     * @tparam T The type of data in the matrix
+     */
+    template <class T>
+    class tiled_matrix
+    {
+      private:
+        size_t _rows;
+        size_t _cols;
+        size_t _tile;
+        size_t _tile_rows;
+        size_t _tile_cols;
+        tile_order _order;
+        std::vector<size_t> _slot;
+        std::vector<T> _data;
+
+        void layout_tiles()
+        {
+            _tile_rows = (_rows + _tile - 1) / _tile;
+            _tile_cols = (_cols + _tile - 1) / _tile;
+            _slot.resize(_tile_rows * _tile_cols);
+            for (size_t t = 0; t < _slot.size(); t++)
+            {
+                _slot[t] = t;
+            }
+            if (_order == tile_order::morton)
+            {
+                // rank the tiles by Morton code, so that a grid that is not
+                // a power-of-two square wastes no storage
+                std::vector<std::pair<uint64_t, size_t>> codes(_slot.size());
+                for (size_t t = 0; t < codes.size(); t++)
+                {
+                    codes[t] = std::make_pair(detail::morton_code(static_cast<uint32_t>(t / _tile_cols),
+                                                                  static_cast<uint32_t>(t % _tile_cols)), t);
+                }
+                std::sort(codes.begin(), codes.end());
+                for (size_t rank = 0; rank < codes.size(); rank++)
+                {
+                    _slot[codes[rank].second] = rank;
+                }
+            }
+            _data.assign(_slot.size() * _tile * _tile, T());
+        }
+
+      public:
+        /**
+         * @brief Construct a new tiled matrix of zeros
+         *
+         * @param rows The number of rows
+         * @param cols The number of columns
+         * @param order The order to store tiles in
+         * @param tile The side of each tile
+         */
+        tiled_matrix(size_t rows = 0, size_t cols = 0, tile_order order = tile_order::morton, size_t tile = 64)
+        : _rows(rows), _cols(cols), _tile(tile), _order(order)
+        {
+            if (tile == 0)
+            {
+                throw std::invalid_argument("Tile size must be nonzero");
+            }
+            layout_tiles();
+        }
+
+        /**
+         * @brief Construct a new tiled matrix from a row major one
+         *
+         * @param m The matrix to copy
+         * @param order The order to store tiles in
+         * @param tile The side of each tile
+         */
+        explicit tiled_matrix(const matrix<T> &m, tile_order order = tile_order::morton, size_t tile = 64)
+        : tiled_matrix(m.rows(), m.cols(), order, tile)
+        {
+            for (size_t ti = 0; ti < _tile_rows; ti++)
+            {
+                for (size_t tj = 0; tj < _tile_cols; tj++)
+                {
+                    T *dst = this->tile(ti, tj);
+                    const size_t i_end = std::min(_tile, _rows - ti * _tile);
+                    const size_t j_end = std::min(_tile, _cols - tj * _tile);
+                    for (size_t i = 0; i < i_end; i++)
+                    {
+                        const T *src = &m(ti * _tile + i, tj * _tile);
+                        std::copy(src, src + j_end, dst + i * _tile);
+                    }
+                }
+            }
+        }
+
+        size_t rows() const
+        {
+            return _rows;
+        }
+
+        size_t cols() const
+        {
+            return _cols;
+        }
+
+        size_t tile_size() const
+        {
+            return _tile;
+        }
+
+        tile_order order() const
+        {
+            return _order;
+        }
+
+        /**
+         * @brief Gets a tile: tile_size() x tile_size() elements, row major
+         *
+         * @param ti The tile row
+         * @param tj The tile column
+         * @return T* The first element of the tile
+         */
+        T *tile(size_t ti, size_t tj)
+        {
+            return &_data[_slot[ti * _tile_cols + tj] * _tile * _tile];
+        }
+
+        const T *tile(size_t ti, size_t tj) const
+        {
+            return &_data[_slot[ti * _tile_cols + tj] * _tile * _tile];
+        }
+
+        /**
+         * @brief Gets an element without bounds checking
+         */
+        T &operator()(size_t i, size_t j)
+        {
+            return tile(i / _tile, j / _tile)[(i % _tile) * _tile + j % _tile];
+        }
+
+        const T &operator()(size_t i, size_t j) const
+        {
+            return tile(i / _tile, j / _tile)[(i % _tile) * _tile + j % _tile];
+        }
+
+        /**
+         * @brief Copies this matrix into an ordinary row major one
+         *
+         * @return matrix<T> The copy
+         */
+        matrix<T> to_matrix() const
+        {
+            matrix<T> m(_rows, _cols);
+            for (size_t ti = 0; ti < _tile_rows; ti++)
+            {
+                for (size_t tj = 0; tj < _tile_cols; tj++)
+                {
+                    const T *src = tile(ti, tj);
+                    const size_t i_end = std::min(_tile, _rows - ti * _tile);
+                    const size_t j_end = std::min(_tile, _cols - tj * _tile);
+                    for (size_t i = 0; i < i_end; i++)
+                    {
+                        std::copy(src + i * _tile, src + i * _tile + j_end, &m[ti * _tile + i][tj * _tile]);
+                    }
+                }
+            }
+            return m;
+        }
+
+        /**
+         * @brief Computes the transpose, tile by tile
+         *
+         * @return tiled_matrix<T> The transpose, with the same tile size and order
+         */
+        tiled_matrix<T> transpose() const
+        {
+            tiled_matrix<T> result(_cols, _rows, _order, _tile);
+            for (size_t ti = 0; ti < _tile_rows; ti++)
+            {
+                for (size_t tj = 0; tj < _tile_cols; tj++)
+                {
+                    const T *src = tile(ti, tj);
+                    T *dst = result.tile(tj, ti);
+                    for (size_t i = 0; i < _tile; i++)
+                    {
+                        for (size_t j = 0; j < _tile; j++)
+                        {
+                            dst[j * _tile + i] = src[i * _tile + j];
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Computes the product of two tiled matrices with the same
+         * tile size. The blocked kernel packs its panels straight from the
+         * tiles, so the operands are never converted.
+         *
+         * @param m1 The first matrix
+         * @param m2 The second matrix
+         * @return tiled_matrix<T> The product, in the tile order of m1
+         */
+        static tiled_matrix<T> multiply(const tiled_matrix<T> &m1, const tiled_matrix<T> &m2)
+        {
+            if (m1.rows() == 0 || m2.rows() == 0)
+            {
+                throw std::out_of_range("Can't multiply matrix of size 0!");
+            }
+            if (m1.cols() != m2.rows())
+            {
+                throw invalid_dimension(m1.cols(), m2.rows());
+            }
+            if (m1._tile != m2._tile)
+            {
+                throw invalid_dimension("Tile sizes differ");
+            }
+
+            tiled_matrix<T> result(m1._rows, m2._cols, m1._order, m1._tile);
+            detail::tiled_writer<T> out = {result};
+            detail::gemm<plus_times<T>>(m1, m2, out);
+            return result;
+        }
+
+        tiled_matrix<T> operator*(const tiled_matrix<T> &other) const
+        {
+            return multiply(*this, other);
+        }
+
+        /**
+         * @brief Equal if the shapes and elements match, whatever the tiling
+         */
+        bool operator==(const tiled_matrix<T> &other) const
+        {
+            if (_rows != other._rows || _cols != other._cols)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < _rows; i++)
+            {
+                for (size_t j = 0; j < _cols; j++)
+                {
+                    if ((*this)(i, j) != other(i, j))
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        bool operator!=(const tiled_matrix<T> &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Stores kernel output into a tiled matrix
+         */
+        template <class T>
+        struct tiled_writer
+        {
+            tiled_matrix<T> &m;
+
+            template <class V>
+            void operator()(size_t i, size_t j, const V &value)
+            {
+                m(i, j) = static_cast<T>(value);
+            }
+        };
+    }
+
+    /**
+     * @brief Tiled matrix stream extraction operator
+     *
+     * @tparam T The type of data in the matrix
+     * @param os The ostream to print the matrix onto
+     * @param m The matrix to print
+     * @return std::ostream& The modified ostream
+     */
+    template <class T>
+    std::ostream &operator<<(std::ostream &os, const tiled_matrix<T> &m)
+    {
+        return os << m.to_matrix();
+    }
+}
+
+#endif